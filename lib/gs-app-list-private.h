@@ -38,6 +38,12 @@ void		 gs_app_list_set_size_peak	(GsAppList	*list,
 void		 gs_app_list_filter_duplicates	(GsAppList	*list,
 						 GsAppListFilterFlags flags);
 void		 gs_app_list_randomize		(GsAppList	*list);
+void		 gs_app_list_randomize_truncate	(GsAppList	*list,
+						 guint		 length);
+void		 gs_app_list_sort_truncate	(GsAppList	*list,
+						 GsAppListSortFunc func,
+						 gpointer	 user_data,
+						 guint		 length);
 void		 gs_app_list_remove_all		(GsAppList	*list);
 void		 gs_app_list_truncate		(GsAppList	*list,
 						 guint		 length);
@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include <glib.h>
+#include <string.h>
 
 #include "gs-app-private.h"
 #include "gs-app-list-private.h"
@@ -739,6 +740,205 @@ gs_app_list_randomize (GsAppList *list)
 	g_rand_free (rand);
 }
 
+typedef struct {
+	GsApp	*app;  /* (unowned) */
+	guint	 idx;  /* original position, to break ties like a stable sort */
+} GsAppListTopKItem;
+
+static gint
+gs_app_list_top_k_cmp (const GsAppListTopKItem  *a,
+		       const GsAppListTopKItem  *b,
+		       const GsAppListSortHelper *helper)
+{
+	gint rc = helper->func (a->app, b->app, helper->user_data);
+	if (rc != 0)
+		return rc;
+	return (a->idx < b->idx) ? -1 : (a->idx > b->idx) ? 1 : 0;
+}
+
+static gint
+gs_app_list_top_k_sort_cb (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	return gs_app_list_top_k_cmp (a, b, user_data);
+}
+
+/* restore the max-heap property below @root, where the ‘largest’ item is the
+ * one which sorts last */
+static void
+gs_app_list_top_k_sift_down (GsAppListTopKItem         *heap,
+			     guint                      n_items,
+			     guint                      root,
+			     const GsAppListSortHelper *helper)
+{
+	for (;;) {
+		guint child = 2 * root + 1;
+		GsAppListTopKItem tmp;
+
+		if (child >= n_items)
+			return;
+		if (child + 1 < n_items &&
+		    gs_app_list_top_k_cmp (&heap[child + 1], &heap[child], helper) > 0)
+			child++;
+		if (gs_app_list_top_k_cmp (&heap[child], &heap[root], helper) <= 0)
+			return;
+
+		tmp = heap[root];
+		heap[root] = heap[child];
+		heap[child] = tmp;
+		root = child;
+	}
+}
+
+/* reorder the array so that @kept come first, in order, followed by all the
+ * other apps, and then drop everything after the kept apps */
+static void
+gs_app_list_keep_only (GsAppList               *list,
+		       const GsAppListTopKItem *kept,
+		       guint                    n_kept)
+{
+	g_autofree gpointer *pdata = g_new (gpointer, list->array->len);
+	g_autofree gboolean *is_kept = g_new0 (gboolean, list->array->len);
+	guint n = 0;
+
+	for (guint i = 0; i < n_kept; i++) {
+		pdata[n++] = kept[i].app;
+		is_kept[kept[i].idx] = TRUE;
+	}
+	for (guint i = 0; i < list->array->len; i++) {
+		if (!is_kept[i])
+			pdata[n++] = list->array->pdata[i];
+	}
+
+	memcpy (list->array->pdata, pdata, sizeof (gpointer) * list->array->len);
+	list->flags |= GS_APP_LIST_FLAG_IS_TRUNCATED;
+	g_ptr_array_set_size (list->array, n_kept);
+}
+
+/**
+ * gs_app_list_sort_truncate:
+ * @list: A #GsAppList
+ * @func: A #GsAppListSortFunc
+ * @user_data: user data to pass to @func
+ * @length: the maximum number of apps to keep
+ *
+ * Sorts the application list and truncates it to at most @length apps. The
+ * result is the same as calling gs_app_list_sort() followed by
+ * gs_app_list_truncate(), but only the apps which are kept are fully sorted,
+ * using a bounded heap to select them. This is much cheaper when @length is
+ * small compared to the size of the list.
+ *
+ * Since: 44
+ **/
+void
+gs_app_list_sort_truncate (GsAppList         *list,
+			   GsAppListSortFunc  func,
+			   gpointer           user_data,
+			   guint              length)
+{
+	g_autofree GsAppListTopKItem *heap = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+	GsAppListSortHelper helper;
+
+	g_return_if_fail (GS_IS_APP_LIST (list));
+	g_return_if_fail (func != NULL);
+
+	if (length == 0) {
+		gs_app_list_truncate (list, 0);
+		return;
+	}
+
+	locker = g_mutex_locker_new (&list->mutex);
+	helper.func = func;
+	helper.user_data = user_data;
+
+	/* nothing to drop */
+	if (length >= list->array->len) {
+		g_ptr_array_sort_with_data (list->array, gs_app_list_sort_cb, &helper);
+		return;
+	}
+
+	/* keep the @length apps which sort first in a max-heap, so the root is
+	 * the one to evict when a better app is found */
+	heap = g_new (GsAppListTopKItem, length);
+	for (guint i = 0; i < length; i++) {
+		heap[i].app = g_ptr_array_index (list->array, i);
+		heap[i].idx = i;
+	}
+	for (guint i = length / 2; i > 0; i--)
+		gs_app_list_top_k_sift_down (heap, length, i - 1, &helper);
+
+	for (guint i = length; i < list->array->len; i++) {
+		GsAppListTopKItem item = { g_ptr_array_index (list->array, i), i };
+
+		if (gs_app_list_top_k_cmp (&item, &heap[0], &helper) >= 0)
+			continue;
+		heap[0] = item;
+		gs_app_list_top_k_sift_down (heap, length, 0, &helper);
+	}
+
+	g_qsort_with_data (heap, length, sizeof (GsAppListTopKItem),
+			   gs_app_list_top_k_sort_cb, &helper);
+	gs_app_list_keep_only (list, heap, length);
+}
+
+/**
+ * gs_app_list_randomize_truncate:
+ * @list: A #GsAppList
+ * @length: the maximum number of apps to keep
+ *
+ * Picks at most @length apps from the list at random, in a random order, and
+ * drops the rest. Like gs_app_list_randomize(), the choice does not change
+ * until the next day.
+ *
+ * Only the kept positions are shuffled (a partial Fisher–Yates shuffle), so
+ * this is much cheaper than gs_app_list_randomize() followed by
+ * gs_app_list_truncate() when @length is small.
+ *
+ * Since: 44
+ **/
+void
+gs_app_list_randomize_truncate (GsAppList *list,
+				guint      length)
+{
+	GRand *rand;
+	g_autoptr(GDateTime) date = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_APP_LIST (list));
+
+	if (length == 0) {
+		gs_app_list_truncate (list, 0);
+		return;
+	}
+
+	locker = g_mutex_locker_new (&list->mutex);
+
+	if (!gs_app_list_length (list))
+		return;
+
+	rand = g_rand_new ();
+	date = g_date_time_new_now_utc ();
+	g_rand_set_seed (rand, (guint32) g_date_time_get_day_of_year (date));
+
+	/* each kept position gets a uniformly chosen app from those which
+	 * have not been picked yet */
+	for (guint i = 0; i < length && i + 1 < list->array->len; i++) {
+		gpointer tmp;
+		guint j = g_rand_int_range (rand, i, list->array->len);
+
+		tmp = list->array->pdata[i];
+		list->array->pdata[i] = list->array->pdata[j];
+		list->array->pdata[j] = tmp;
+	}
+
+	g_rand_free (rand);
+
+	if (length < list->array->len) {
+		list->flags |= GS_APP_LIST_FLAG_IS_TRUNCATED;
+		g_ptr_array_set_size (list->array, length);
+	}
+}
+
 static gboolean
 gs_app_list_filter_app_is_better (GsApp *app, GsApp *found, GsAppListFilterFlags flags)
 {
@@ -758,56 +958,186 @@ gs_app_list_filter_app_is_better (GsApp *app, GsApp *found, GsAppListFilterFlags
 	return FALSE;
 }
 
-static GPtrArray *
-gs_app_list_filter_app_get_keys (GsApp *app, GsAppListFilterFlags flags)
+/* A key identifying an app for gs_app_list_filter_duplicates(). The parts
+ * are borrowed from the #GsApp, so building a key never allocates; the hash is
+ * computed once per key and compared before the strings are. */
+typedef struct {
+	const gchar	*parts[3];  /* (unowned) (nullable) ID, source, version */
+	guint64		 hash;
+} GsAppListFilterKey;
+
+typedef struct {
+	GsApp			*app;  /* (unowned) */
+	GsAppListFilterFlags	 flags;
+	gboolean		 started;
+	guint			 provided_idx;
+	guint			 item_idx;
+} GsAppListFilterKeyIter;
+
+typedef struct {
+	GsAppListFilterKey	 key;
+	guint			 idx;  /* index into the list, or G_MAXUINT if empty */
+} GsAppListFilterSlot;
+
+/* how many keys of each app are remembered between the lookup and insert
+ * passes; apps with more keys than this are re-iterated */
+#define GS_APP_LIST_FILTER_KEYS_MAX	8
+
+static guint64
+gs_app_list_filter_key_hash (const GsAppListFilterKey *key)
 {
-	GPtrArray *keys = g_ptr_array_new_with_free_func (g_free);
-	g_autoptr(GString) key = NULL;
+	/* 64-bit FNV-1a, with the part index mixed in so that the same string
+	 * as an ID or as a version does not hash the same */
+	guint64 hash = G_GUINT64_CONSTANT (0xcbf29ce484222325);
 
-	/* just use the unique ID */
-	if (flags == GS_APP_LIST_FILTER_FLAG_NONE) {
-		if (gs_app_get_unique_id (app) != NULL)
-			g_ptr_array_add (keys, g_strdup (gs_app_get_unique_id (app)));
-		return keys;
+	for (guint i = 0; i < G_N_ELEMENTS (key->parts); i++) {
+		if (key->parts[i] == NULL)
+			continue;
+		hash = (hash ^ (i + 1)) * G_GUINT64_CONSTANT (0x100000001b3);
+		for (const guchar *p = (const guchar *) key->parts[i]; *p != '\0'; p++)
+			hash = (hash ^ *p) * G_GUINT64_CONSTANT (0x100000001b3);
+	}
+
+	return hash;
+}
+
+static gboolean
+gs_app_list_filter_key_equal (const GsAppListFilterKey *a,
+			      const GsAppListFilterKey *b)
+{
+	if (a->hash != b->hash)
+		return FALSE;
+	for (guint i = 0; i < G_N_ELEMENTS (a->parts); i++) {
+		if (g_strcmp0 (a->parts[i], b->parts[i]) != 0)
+			return FALSE;
 	}
+	return TRUE;
+}
+
+static void
+gs_app_list_filter_key_iter_init (GsAppListFilterKeyIter *iter,
+				  GsApp                  *app,
+				  GsAppListFilterFlags    flags)
+{
+	iter->app = app;
+	iter->flags = flags;
+	iter->started = FALSE;
+	iter->provided_idx = 0;
+	iter->item_idx = 0;
+}
+
+static gboolean
+gs_app_list_filter_key_iter_next (GsAppListFilterKeyIter *iter,
+				  GsAppListFilterKey     *key)
+{
+	GsApp *app = iter->app;
+
+	key->parts[0] = key->parts[1] = key->parts[2] = NULL;
+
+	/* just use the unique ID */
+	if (iter->flags == GS_APP_LIST_FILTER_FLAG_NONE) {
+		if (iter->started)
+			return FALSE;
+		iter->started = TRUE;
+		key->parts[0] = gs_app_get_unique_id (app);
+		if (key->parts[0] == NULL)
+			return FALSE;
 
 	/* use the ID and any provided items */
-	if (flags & GS_APP_LIST_FILTER_FLAG_KEY_ID_PROVIDES) {
-		GPtrArray *provided = gs_app_get_provided (app);
-		g_ptr_array_add (keys, g_strdup (gs_app_get_id (app)));
-		for (guint i = 0; i < provided->len; i++) {
-			AsProvided *prov = g_ptr_array_index (provided, i);
-			GPtrArray *items;
-			if (as_provided_get_kind (prov) != AS_PROVIDED_KIND_ID)
-				continue;
-			items = as_provided_get_items (prov);
-			for (guint j = 0; j < items->len; j++)
-				g_ptr_array_add (keys, g_strdup (g_ptr_array_index (items, j)));
+	} else if (iter->flags & GS_APP_LIST_FILTER_FLAG_KEY_ID_PROVIDES) {
+		GPtrArray *provided;
+
+		if (!iter->started) {
+			iter->started = TRUE;
+			key->parts[0] = gs_app_get_id (app);
 		}
-		return keys;
-	}
+
+		provided = gs_app_get_provided (app);
+		while (key->parts[0] == NULL && iter->provided_idx < provided->len) {
+			AsProvided *prov = g_ptr_array_index (provided, iter->provided_idx);
+			GPtrArray *items = NULL;
+
+			if (as_provided_get_kind (prov) == AS_PROVIDED_KIND_ID)
+				items = as_provided_get_items (prov);
+			if (items != NULL && iter->item_idx < items->len) {
+				key->parts[0] = g_ptr_array_index (items, iter->item_idx++);
+			} else {
+				iter->provided_idx++;
+				iter->item_idx = 0;
+			}
+		}
+		if (key->parts[0] == NULL)
+			return FALSE;
 
 	/* specific compound type */
-	key = g_string_new (NULL);
-	if (flags & GS_APP_LIST_FILTER_FLAG_KEY_ID) {
-		const gchar *tmp = gs_app_get_id (app);
-		if (tmp != NULL)
-			g_string_append (key, gs_app_get_id (app));
+	} else {
+		if (iter->started)
+			return FALSE;
+		iter->started = TRUE;
+		if (iter->flags & GS_APP_LIST_FILTER_FLAG_KEY_ID) {
+			const gchar *tmp = gs_app_get_id (app);
+			if (tmp != NULL && *tmp != '\0')
+				key->parts[0] = tmp;
+		}
+		if (iter->flags & GS_APP_LIST_FILTER_FLAG_KEY_SOURCE)
+			key->parts[1] = gs_app_get_source_default (app);
+		if (iter->flags & GS_APP_LIST_FILTER_FLAG_KEY_VERSION)
+			key->parts[2] = gs_app_get_version (app);
+		if (key->parts[0] == NULL && key->parts[1] == NULL && key->parts[2] == NULL)
+			return FALSE;
 	}
-	if (flags & GS_APP_LIST_FILTER_FLAG_KEY_SOURCE) {
-		const gchar *tmp = gs_app_get_source_default (app);
-		if (tmp != NULL)
-			g_string_append_printf (key, ":%s", tmp);
+
+	key->hash = gs_app_list_filter_key_hash (key);
+	return TRUE;
+}
+
+/* open addressing with linear probing; the table is sized so it never fills */
+static GsAppListFilterSlot *
+gs_app_list_filter_table_find (GsAppListFilterSlot      *table,
+			       gsize                     mask,
+			       const GsAppListFilterKey *key)
+{
+	for (gsize i = key->hash & mask; ; i = (i + 1) & mask) {
+		GsAppListFilterSlot *slot = &table[i];
+		if (slot->idx == G_MAXUINT ||
+		    gs_app_list_filter_key_equal (&slot->key, key))
+			return slot;
 	}
-	if (flags & GS_APP_LIST_FILTER_FLAG_KEY_VERSION) {
-		const gchar *tmp = gs_app_get_version (app);
-		if (tmp != NULL)
-			g_string_append_printf (key, ":%s", tmp);
+}
+
+static void
+gs_app_list_filter_table_insert (GsAppListFilterSlot      *table,
+				 gsize                     mask,
+				 const GsAppListFilterKey *key,
+				 guint                     idx)
+{
+	GsAppListFilterSlot *slot = gs_app_list_filter_table_find (table, mask, key);
+	slot->key = *key;
+	slot->idx = idx;
+}
+
+/* insert all the keys of the app at @idx, re-iterating them if there were too
+ * many to remember in @keys */
+static void
+gs_app_list_filter_table_insert_all (GsAppListFilterSlot      *table,
+				     gsize                     mask,
+				     const GsAppListFilterKey *keys,
+				     guint                     n_keys,
+				     GsApp                    *app,
+				     GsAppListFilterFlags      flags,
+				     guint                     idx)
+{
+	if (n_keys <= GS_APP_LIST_FILTER_KEYS_MAX) {
+		for (guint j = 0; j < n_keys; j++)
+			gs_app_list_filter_table_insert (table, mask, &keys[j], idx);
+	} else {
+		GsAppListFilterKeyIter iter;
+		GsAppListFilterKey key;
+
+		gs_app_list_filter_key_iter_init (&iter, app, flags);
+		while (gs_app_list_filter_key_iter_next (&iter, &key))
+			gs_app_list_filter_table_insert (table, mask, &key, idx);
 	}
-	if (key->len == 0)
-		return keys;
-	g_ptr_array_add (keys, g_string_free (g_steal_pointer (&key), FALSE));
-	return keys;
 }
 
 /**
@@ -822,69 +1152,128 @@ gs_app_list_filter_app_get_keys (GsApp *app, GsAppListFilterFlags flags)
 void
 gs_app_list_filter_duplicates (GsAppList *list, GsAppListFilterFlags flags)
 {
-	g_autoptr(GHashTable) hash = NULL;
-	g_autoptr(GHashTable) kept_apps = NULL;
-	g_autoptr(GsAppList) old = NULL;
+	g_autofree GsAppListFilterSlot *table = NULL;
+	g_autofree gboolean *keep = NULL;
+	g_autoptr(GHashTable) kept_keyless = NULL;
 	g_autoptr(GMutexLocker) locker = NULL;
+	gsize n_keys_total = 0;
+	gsize n_slots = 16;
+	guint n_kept = 0;
+	gboolean watching;
 
 	g_return_if_fail (GS_IS_APP_LIST (list));
 
 	locker = g_mutex_locker_new (&list->mutex);
 
-	/* a hash table to hold apps with unique app ids */
-	hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-	/* a hash table containing apps we want to keep */
-	kept_apps = g_hash_table_new (g_direct_hash, g_direct_equal);
+	if (list->array->len == 0)
+		return;
+
+	/* size the table for a load factor of at most 0.5; only the provides
+	 * mode can have more than one key per app */
+	if (flags & GS_APP_LIST_FILTER_FLAG_KEY_ID_PROVIDES) {
+		for (guint i = 0; i < list->array->len; i++) {
+			GsAppListFilterKeyIter iter;
+			GsAppListFilterKey key;
+
+			gs_app_list_filter_key_iter_init (&iter, g_ptr_array_index (list->array, i), flags);
+			while (gs_app_list_filter_key_iter_next (&iter, &key))
+				n_keys_total++;
+		}
+	} else {
+		n_keys_total = list->array->len;
+	}
+	while (n_slots < n_keys_total * 2)
+		n_slots *= 2;
+
+	table = g_new (GsAppListFilterSlot, n_slots);
+	for (gsize i = 0; i < n_slots; i++)
+		table[i].idx = G_MAXUINT;
+	keep = g_new0 (gboolean, list->array->len);
 
 	for (guint i = 0; i < list->array->len; i++) {
-		GsApp *app = gs_app_list_index (list, i);
-		GsApp *found = NULL;
-		g_autoptr(GPtrArray) keys = NULL;
-
-		/* get all the keys used to identify this app */
-		keys = gs_app_list_filter_app_get_keys (app, flags);
-		for (guint j = 0; j < keys->len; j++) {
-			const gchar *key = g_ptr_array_index (keys, j);
-			found = g_hash_table_lookup (hash, key);
-			if (found != NULL)
+		GsApp *app = g_ptr_array_index (list->array, i);
+		GsAppListFilterKey keys[GS_APP_LIST_FILTER_KEYS_MAX];
+		GsAppListFilterKeyIter iter;
+		GsAppListFilterKey key;
+		GsAppListFilterSlot *slot = NULL;
+		guint n_keys = 0;
+
+		/* look up all the keys used to identify this app */
+		gs_app_list_filter_key_iter_init (&iter, app, flags);
+		while (gs_app_list_filter_key_iter_next (&iter, &key)) {
+			if (n_keys < G_N_ELEMENTS (keys))
+				keys[n_keys] = key;
+			n_keys++;
+			slot = gs_app_list_filter_table_find (table, n_slots - 1, &key);
+			if (slot->idx != G_MAXUINT)
 				break;
+			slot = NULL;
 		}
 
 		/* new app */
-		if (found == NULL) {
-			for (guint j = 0; j < keys->len; j++) {
-				const gchar *key = g_ptr_array_index (keys, j);
-				g_hash_table_insert (hash, g_strdup (key), app);
+		if (slot == NULL) {
+			/* an app without keys is only kept once per instance */
+			if (n_keys == 0) {
+				if (kept_keyless == NULL)
+					kept_keyless = g_hash_table_new (g_direct_hash, g_direct_equal);
+				if (!g_hash_table_add (kept_keyless, app))
+					continue;
 			}
-			g_hash_table_add (kept_apps, app);
+			gs_app_list_filter_table_insert_all (table, n_slots - 1, keys, n_keys,
+							     app, flags, i);
+			keep[i] = TRUE;
 			continue;
 		}
 
 		/* better? */
 		if (flags != GS_APP_LIST_FILTER_FLAG_NONE &&
-		    gs_app_list_filter_app_is_better (app, found, flags)) {
-			for (guint j = 0; j < keys->len; j++) {
-				const gchar *key = g_ptr_array_index (keys, j);
-				g_hash_table_insert (hash, g_strdup (key), app);
+		    gs_app_list_filter_app_is_better (app, g_ptr_array_index (list->array, slot->idx), flags)) {
+			guint found_idx = slot->idx;
+
+			/* the lookup stopped at the first match, so finish
+			 * collecting the keys before inserting them */
+			while (gs_app_list_filter_key_iter_next (&iter, &key)) {
+				if (n_keys < G_N_ELEMENTS (keys))
+					keys[n_keys] = key;
+				n_keys++;
 			}
-			g_hash_table_remove (kept_apps, found);
-			g_hash_table_add (kept_apps, app);
+			gs_app_list_filter_table_insert_all (table, n_slots - 1, keys, n_keys,
+							     app, flags, i);
+			keep[found_idx] = FALSE;
+			keep[i] = TRUE;
 		}
 	}
 
-	/* deep copy to a temp list and clear the current one */
-	old = gs_app_list_copy (list);
-	gs_app_list_remove_all_safe (list);
+	/* watched apps are disconnected by instance, so unwatch everything and
+	 * watch the survivors again, as if the list had been rebuilt */
+	watching = (list->flags & (GS_APP_LIST_FLAG_WATCH_APPS |
+				   GS_APP_LIST_FLAG_WATCH_APPS_RELATED |
+				   GS_APP_LIST_FLAG_WATCH_APPS_ADDONS)) != 0;
+	if (watching) {
+		for (guint i = 0; i < list->array->len; i++)
+			gs_app_list_maybe_unwatch_app (list, g_ptr_array_index (list->array, i));
+	}
 
-	/* add back the apps we want to keep */
-	for (guint i = 0; i < old->array->len; i++) {
-		GsApp *app = gs_app_list_index (old, i);
-		if (g_hash_table_contains (kept_apps, app)) {
-			gs_app_list_add_safe (list, app, GS_APP_LIST_ADD_FLAG_NONE);
-			/* In case the same instance is in the 'list' multiple times */
-			g_hash_table_remove (kept_apps, app);
+	/* compact the array in place, preserving the order of the kept apps and
+	 * moving the dropped ones to the end so they are unreffed when it is
+	 * shrunk */
+	for (guint i = 0; i < list->array->len; i++) {
+		if (keep[i]) {
+			gpointer tmp = list->array->pdata[n_kept];
+			list->array->pdata[n_kept] = list->array->pdata[i];
+			list->array->pdata[i] = tmp;
+			n_kept++;
 		}
 	}
+	g_ptr_array_set_size (list->array, n_kept);
+
+	if (watching) {
+		for (guint i = 0; i < list->array->len; i++)
+			gs_app_list_maybe_watch_app (list, g_ptr_array_index (list->array, i));
+	}
+
+	gs_app_list_invalidate_state (list);
+	gs_app_list_invalidate_progress (list);
 }
 
 /**
@@ -0,0 +1,614 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/**
+ * SECTION:gs-app-registry
+ * @short_description: A loader-wide registry of #GsApp objects
+ *
+ * #GsAppRegistry is a thread-safe map from unique ID to #GsApp which is shared
+ * between all the plugins of a #GsPluginLoader. Plugins opt in to it using
+ * gs_plugin_cache_set_shared(), after which the gs_plugin_cache_*() functions
+ * store apps keyed by their unique ID here rather than in the per-plugin
+ * cache.
+ *
+ * As with the per-plugin cache, unique IDs are compared using
+ * as_utils_data_id_equal(), so a lookup with a wildcard ID (for example, one
+ * with an unknown scope) returns the matching app.
+ *
+ * Each entry belongs to the plugin which added it, and lookups only return
+ * entries of the plugin doing the lookup, just as with the per-plugin cache.
+ * The registry therefore shares the memory budget between plugins, but does
+ * not deduplicate apps which several plugins create for the same unique ID.
+ *
+ * Entries are held in two tiers:
+ *
+ *  - every entry holds a weak reference to its app, so an app which is still
+ *    referenced elsewhere (typically by the UI) can always be looked up;
+ *  - the most recently used entries additionally hold a strong reference, in
+ *    LRU order. The estimated size of the apps in this tier is limited to the
+ *    memory budget; once it is exceeded, the least recently used apps lose
+ *    their strong reference and are freed if nothing else references them.
+ *
+ * A budget of zero disables the strong tier entirely.
+ *
+ * Since: 44
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+#include <appstream.h>
+
+#include "gs-app-registry.h"
+#include "gs-plugin.h"
+
+/* rough size of a #GsApp with no metadata, and of each screenshot, icon and
+ * other array item hanging off it */
+#define GS_APP_REGISTRY_APP_OVERHEAD	2048
+#define GS_APP_REGISTRY_ITEM_OVERHEAD	256
+
+/* how many additions between sweeps of entries whose app has been freed */
+#define GS_APP_REGISTRY_SWEEP_INTERVAL	256
+
+typedef struct {
+	gchar		*unique_id;  /* (owned) */
+	GWeakRef	 app_weak;  /* (element-type GsApp) */
+	GsApp		*app_strong;  /* (owned) (nullable); set while in the LRU tier */
+	GList		*lru_link;  /* (nullable); link in GsAppRegistry.lru */
+	GsPlugin	*owner;  /* (unowned) (nullable) */
+	gsize		 size;
+} GsAppRegistryEntry;
+
+struct _GsAppRegistry
+{
+	GObject			 parent;
+
+	GMutex			 mutex;
+	GHashTable		*entries;  /* (owned) (element-type utf8 GsAppRegistryEntry); keys compared with as_utils_data_id_equal() */
+	GQueue			 lru;  /* (element-type GsAppRegistryEntry); most recent at the head */
+	gsize			 lru_size;
+	gsize			 budget;
+	guint			 adds_since_sweep;
+
+	guint64			 hits;
+	guint64			 misses;
+	guint64			 evictions;
+};
+
+G_DEFINE_TYPE (GsAppRegistry, gs_app_registry, G_TYPE_OBJECT)
+
+static gsize
+strlen0 (const gchar *str)
+{
+	return (str != NULL) ? strlen (str) : 0;
+}
+
+static gsize
+array_len0 (GPtrArray *array)
+{
+	return (array != NULL) ? array->len : 0;
+}
+
+/* This is deliberately approximate: #GsApp has no way of reporting its real
+ * heap usage, and the budget is only meant to bound the order of magnitude of
+ * the cache. */
+static gsize
+gs_app_registry_estimate_size (GsApp *app)
+{
+	gsize size = GS_APP_REGISTRY_APP_OVERHEAD;
+
+	size += strlen0 (gs_app_get_unique_id (app));
+	size += strlen0 (gs_app_get_name (app));
+	size += strlen0 (gs_app_get_summary (app));
+	size += strlen0 (gs_app_get_description (app));
+	size += GS_APP_REGISTRY_ITEM_OVERHEAD *
+		(array_len0 (gs_app_get_screenshots (app)) +
+		 array_len0 (gs_app_get_icons (app)) +
+		 array_len0 (gs_app_get_categories (app)) +
+		 array_len0 (gs_app_get_version_history (app)));
+
+	return size;
+}
+
+static void
+gs_app_registry_entry_free (GsAppRegistryEntry *entry)
+{
+	g_free (entry->unique_id);
+	g_weak_ref_clear (&entry->app_weak);
+	g_clear_object (&entry->app_strong);
+	g_slice_free (GsAppRegistryEntry, entry);
+}
+
+/* must be called with the mutex held; the strong reference is moved into
+ * @unref_later so it is not dropped (and the app potentially finalized) while
+ * the mutex is held */
+static void
+gs_app_registry_demote_locked (GsAppRegistry      *self,
+                               GsAppRegistryEntry *entry,
+                               GPtrArray          *unref_later)
+{
+	if (entry->lru_link == NULL)
+		return;
+
+	g_queue_delete_link (&self->lru, entry->lru_link);
+	entry->lru_link = NULL;
+	self->lru_size -= entry->size;
+
+	if (entry->app_strong != NULL)
+		g_ptr_array_add (unref_later, g_steal_pointer (&entry->app_strong));
+}
+
+static void
+gs_app_registry_promote_locked (GsAppRegistry      *self,
+                                GsAppRegistryEntry *entry,
+                                GsApp              *app)
+{
+	if (entry->lru_link != NULL) {
+		/* move to the front */
+		g_queue_unlink (&self->lru, entry->lru_link);
+		g_queue_push_head_link (&self->lru, entry->lru_link);
+		return;
+	}
+
+	if (self->budget == 0)
+		return;
+
+	entry->app_strong = g_object_ref (app);
+	g_queue_push_head (&self->lru, entry);
+	entry->lru_link = self->lru.head;
+	self->lru_size += entry->size;
+}
+
+static void
+gs_app_registry_evict_locked (GsAppRegistry *self,
+                              GPtrArray     *unref_later)
+{
+	while (self->lru_size > self->budget && self->lru.tail != NULL) {
+		GsAppRegistryEntry *entry = self->lru.tail->data;
+		gs_app_registry_demote_locked (self, entry, unref_later);
+		self->evictions++;
+	}
+}
+
+/* drop entries whose app has been finalized */
+static void
+gs_app_registry_sweep_locked (GsAppRegistry *self)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init (&iter, self->entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GsAppRegistryEntry *entry = value;
+		g_autoptr(GsApp) app = NULL;
+
+		/* entries in the LRU tier are alive by definition */
+		if (entry->lru_link != NULL)
+			continue;
+
+		app = g_weak_ref_get (&entry->app_weak);
+		if (app == NULL)
+			g_hash_table_iter_remove (&iter);
+	}
+
+	self->adds_since_sweep = 0;
+}
+
+/**
+ * gs_app_registry_add:
+ * @self: a #GsAppRegistry
+ * @owner: (nullable): the #GsPlugin adding the app
+ * @app: a #GsApp with a unique ID
+ *
+ * Adds @app to the registry, replacing any existing app with the same unique
+ * ID, and marks it as the most recently used entry.
+ *
+ * Since: 44
+ */
+void
+gs_app_registry_add (GsAppRegistry *self,
+                     GsPlugin      *owner,
+                     GsApp         *app)
+{
+	GsAppRegistryEntry *entry;
+	const gchar *unique_id;
+	g_autoptr(GPtrArray) unref_later = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_APP_REGISTRY (self));
+	g_return_if_fail (GS_IS_APP (app));
+
+	unique_id = gs_app_get_unique_id (app);
+	g_return_if_fail (unique_id != NULL);
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	entry = g_hash_table_lookup (self->entries, unique_id);
+	if (entry != NULL) {
+		g_autoptr(GsApp) existing = g_weak_ref_get (&entry->app_weak);
+
+		if (existing != app) {
+			gs_app_registry_demote_locked (self, entry, unref_later);
+			g_weak_ref_set (&entry->app_weak, app);
+		} else if (entry->lru_link != NULL) {
+			/* re-estimate, as the app has probably been refined since */
+			self->lru_size -= entry->size;
+			entry->size = gs_app_registry_estimate_size (app);
+			self->lru_size += entry->size;
+		}
+
+		if (existing != NULL)
+			g_ptr_array_add (unref_later, g_steal_pointer (&existing));
+	} else {
+		entry = g_slice_new0 (GsAppRegistryEntry);
+		entry->unique_id = g_strdup (unique_id);
+		g_weak_ref_init (&entry->app_weak, app);
+		g_hash_table_insert (self->entries, entry->unique_id, entry);
+	}
+
+	entry->owner = owner;
+	if (entry->lru_link == NULL)
+		entry->size = gs_app_registry_estimate_size (app);
+	gs_app_registry_promote_locked (self, entry, app);
+	gs_app_registry_evict_locked (self, unref_later);
+
+	if (++self->adds_since_sweep >= GS_APP_REGISTRY_SWEEP_INTERVAL)
+		gs_app_registry_sweep_locked (self);
+
+	/* drop the references outside the lock */
+	g_clear_pointer (&locker, g_mutex_locker_free);
+}
+
+/**
+ * gs_app_registry_lookup:
+ * @self: a #GsAppRegistry
+ * @owner: (nullable): the #GsPlugin which must own the app, or %NULL to
+ *   return it regardless of which plugin added it
+ * @unique_id: the unique ID of the app
+ *
+ * Looks up an app by its unique ID. If found, the app is marked as the most
+ * recently used entry, moving it back into the LRU tier if necessary.
+ *
+ * Returns: (transfer full) (nullable): the #GsApp, or %NULL if not found
+ * Since: 44
+ */
+GsApp *
+gs_app_registry_lookup (GsAppRegistry *self,
+                        GsPlugin      *owner,
+                        const gchar   *unique_id)
+{
+	GsAppRegistryEntry *entry;
+	g_autoptr(GsApp) app = NULL;
+	g_autoptr(GPtrArray) unref_later = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_APP_REGISTRY (self), NULL);
+	g_return_val_if_fail (unique_id != NULL, NULL);
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	entry = g_hash_table_lookup (self->entries, unique_id);
+	if (entry == NULL || (owner != NULL && entry->owner != owner)) {
+		self->misses++;
+		return NULL;
+	}
+
+	app = g_weak_ref_get (&entry->app_weak);
+	if (app == NULL) {
+		g_hash_table_remove (self->entries, entry->unique_id);
+		self->misses++;
+		return NULL;
+	}
+
+	self->hits++;
+	gs_app_registry_promote_locked (self, entry, app);
+	gs_app_registry_evict_locked (self, unref_later);
+
+	g_clear_pointer (&locker, g_mutex_locker_free);
+
+	return g_steal_pointer (&app);
+}
+
+/**
+ * gs_app_registry_remove:
+ * @self: a #GsAppRegistry
+ * @owner: (nullable): the #GsPlugin which must own the app, or %NULL
+ * @unique_id: the unique ID of the app
+ *
+ * Removes the app with @unique_id from the registry, if it is present and
+ * owned by @owner.
+ *
+ * Since: 44
+ */
+void
+gs_app_registry_remove (GsAppRegistry *self,
+                        GsPlugin      *owner,
+                        const gchar   *unique_id)
+{
+	GsAppRegistryEntry *entry;
+	g_autoptr(GPtrArray) unref_later = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_APP_REGISTRY (self));
+	g_return_if_fail (unique_id != NULL);
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	entry = g_hash_table_lookup (self->entries, unique_id);
+	if (entry == NULL || (owner != NULL && entry->owner != owner))
+		return;
+
+	gs_app_registry_demote_locked (self, entry, unref_later);
+	g_hash_table_remove (self->entries, entry->unique_id);
+
+	g_clear_pointer (&locker, g_mutex_locker_free);
+}
+
+/**
+ * gs_app_registry_remove_all:
+ * @self: a #GsAppRegistry
+ * @owner: (nullable): the #GsPlugin whose apps to remove, or %NULL for all
+ *
+ * Removes all the apps owned by @owner from the registry.
+ *
+ * Since: 44
+ */
+void
+gs_app_registry_remove_all (GsAppRegistry *self,
+                            GsPlugin      *owner)
+{
+	GHashTableIter iter;
+	gpointer value;
+	g_autoptr(GPtrArray) unref_later = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_APP_REGISTRY (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	g_hash_table_iter_init (&iter, self->entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GsAppRegistryEntry *entry = value;
+
+		if (owner != NULL && entry->owner != owner)
+			continue;
+
+		gs_app_registry_demote_locked (self, entry, unref_later);
+		g_hash_table_iter_remove (&iter);
+	}
+
+	g_clear_pointer (&locker, g_mutex_locker_free);
+}
+
+/**
+ * gs_app_registry_add_to_list:
+ * @self: a #GsAppRegistry
+ * @owner: (nullable): the #GsPlugin whose apps to list, or %NULL for all
+ * @list: a #GsAppList to add the apps to
+ *
+ * Adds every live app owned by @owner to @list. This does not affect the LRU
+ * order of the entries.
+ *
+ * Since: 44
+ */
+void
+gs_app_registry_add_to_list (GsAppRegistry *self,
+                             GsPlugin      *owner,
+                             GsAppList     *list)
+{
+	GHashTableIter iter;
+	gpointer value;
+	g_autoptr(GPtrArray) apps = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_APP_REGISTRY (self));
+	g_return_if_fail (GS_IS_APP_LIST (list));
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	g_hash_table_iter_init (&iter, self->entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GsAppRegistryEntry *entry = value;
+		GsApp *app;
+
+		if (owner != NULL && entry->owner != owner)
+			continue;
+
+		app = g_weak_ref_get (&entry->app_weak);
+		if (app != NULL)
+			g_ptr_array_add (apps, app);
+	}
+
+	/* the list may emit signals, so add to it outside the lock */
+	g_clear_pointer (&locker, g_mutex_locker_free);
+
+	for (guint i = 0; i < apps->len; i++)
+		gs_app_list_add (list, g_ptr_array_index (apps, i));
+}
+
+/**
+ * gs_app_registry_get_occupancy:
+ * @self: a #GsAppRegistry
+ * @owner: (nullable): the #GsPlugin to report on, or %NULL for all plugins
+ * @out_n_apps: (out) (optional): return location for the number of entries
+ * @out_n_held: (out) (optional): return location for the number of entries in
+ *   the LRU tier
+ * @out_n_bytes: (out) (optional): return location for the estimated size of
+ *   the entries in the LRU tier, in bytes
+ *
+ * Reports how much of the registry is taken up by apps owned by @owner.
+ *
+ * Since: 44
+ */
+void
+gs_app_registry_get_occupancy (GsAppRegistry *self,
+                               GsPlugin      *owner,
+                               guint         *out_n_apps,
+                               guint         *out_n_held,
+                               gsize         *out_n_bytes)
+{
+	GHashTableIter iter;
+	gpointer value;
+	guint n_apps = 0, n_held = 0;
+	gsize n_bytes = 0;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_APP_REGISTRY (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	g_hash_table_iter_init (&iter, self->entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GsAppRegistryEntry *entry = value;
+
+		if (owner != NULL && entry->owner != owner)
+			continue;
+
+		n_apps++;
+		if (entry->lru_link != NULL) {
+			n_held++;
+			n_bytes += entry->size;
+		}
+	}
+
+	if (out_n_apps != NULL)
+		*out_n_apps = n_apps;
+	if (out_n_held != NULL)
+		*out_n_held = n_held;
+	if (out_n_bytes != NULL)
+		*out_n_bytes = n_bytes;
+}
+
+/**
+ * gs_app_registry_get_stats:
+ * @self: a #GsAppRegistry
+ * @out_hits: (out) (optional): return location for the number of lookup hits
+ * @out_misses: (out) (optional): return location for the number of lookup
+ *   misses
+ * @out_evictions: (out) (optional): return location for the number of apps
+ *   which have been evicted from the LRU tier
+ *
+ * Gets the cumulative lookup statistics for the registry.
+ *
+ * Since: 44
+ */
+void
+gs_app_registry_get_stats (GsAppRegistry *self,
+                           guint64       *out_hits,
+                           guint64       *out_misses,
+                           guint64       *out_evictions)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_APP_REGISTRY (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	if (out_hits != NULL)
+		*out_hits = self->hits;
+	if (out_misses != NULL)
+		*out_misses = self->misses;
+	if (out_evictions != NULL)
+		*out_evictions = self->evictions;
+}
+
+/**
+ * gs_app_registry_get_budget:
+ * @self: a #GsAppRegistry
+ *
+ * Gets the memory budget for the LRU tier.
+ *
+ * Returns: the budget, in bytes
+ * Since: 44
+ */
+gsize
+gs_app_registry_get_budget (GsAppRegistry *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_APP_REGISTRY (self), 0);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	return self->budget;
+}
+
+/**
+ * gs_app_registry_set_budget:
+ * @self: a #GsAppRegistry
+ * @budget: the new budget, in bytes
+ *
+ * Sets the memory budget for the LRU tier, evicting apps immediately if the
+ * tier is now over budget.
+ *
+ * Since: 44
+ */
+void
+gs_app_registry_set_budget (GsAppRegistry *self,
+                            gsize          budget)
+{
+	g_autoptr(GPtrArray) unref_later = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_APP_REGISTRY (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+	self->budget = budget;
+	gs_app_registry_evict_locked (self, unref_later);
+
+	g_clear_pointer (&locker, g_mutex_locker_free);
+}
+
+static void
+gs_app_registry_finalize (GObject *object)
+{
+	GsAppRegistry *self = GS_APP_REGISTRY (object);
+
+	/* the entries own their strong references, so just unlink them */
+	g_queue_clear (&self->lru);
+	g_hash_table_unref (self->entries);
+	g_mutex_clear (&self->mutex);
+
+	G_OBJECT_CLASS (gs_app_registry_parent_class)->finalize (object);
+}
+
+static void
+gs_app_registry_class_init (GsAppRegistryClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = gs_app_registry_finalize;
+}
+
+static void
+gs_app_registry_init (GsAppRegistry *self)
+{
+	g_mutex_init (&self->mutex);
+	g_queue_init (&self->lru);
+	self->entries = g_hash_table_new_full ((GHashFunc) as_utils_data_id_hash,
+					       (GEqualFunc) as_utils_data_id_equal,
+					       NULL, (GDestroyNotify) gs_app_registry_entry_free);
+}
+
+/**
+ * gs_app_registry_new:
+ * @budget: memory budget for the LRU tier, in bytes
+ *
+ * Create a new #GsAppRegistry.
+ *
+ * Returns: (transfer full): a new #GsAppRegistry
+ * Since: 44
+ */
+GsAppRegistry *
+gs_app_registry_new (gsize budget)
+{
+	GsAppRegistry *self = g_object_new (GS_TYPE_APP_REGISTRY, NULL);
+	self->budget = budget;
+	return self;
+}
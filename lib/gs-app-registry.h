@@ -0,0 +1,53 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "gs-app.h"
+#include "gs-app-list.h"
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_APP_REGISTRY (gs_app_registry_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsAppRegistry, gs_app_registry, GS, APP_REGISTRY, GObject)
+
+GsAppRegistry	*gs_app_registry_new			(gsize		 budget);
+
+gsize		 gs_app_registry_get_budget		(GsAppRegistry	*self);
+void		 gs_app_registry_set_budget		(GsAppRegistry	*self,
+							 gsize		 budget);
+
+void		 gs_app_registry_add			(GsAppRegistry	*self,
+							 GsPlugin	*owner,
+							 GsApp		*app);
+GsApp		*gs_app_registry_lookup			(GsAppRegistry	*self,
+							 GsPlugin	*owner,
+							 const gchar	*unique_id);
+void		 gs_app_registry_remove			(GsAppRegistry	*self,
+							 GsPlugin	*owner,
+							 const gchar	*unique_id);
+void		 gs_app_registry_remove_all		(GsAppRegistry	*self,
+							 GsPlugin	*owner);
+void		 gs_app_registry_add_to_list		(GsAppRegistry	*self,
+							 GsPlugin	*owner,
+							 GsAppList	*list);
+void		 gs_app_registry_get_occupancy		(GsAppRegistry	*self,
+							 GsPlugin	*owner,
+							 guint		*out_n_apps,
+							 guint		*out_n_held,
+							 gsize		*out_n_bytes);
+void		 gs_app_registry_get_stats		(GsAppRegistry	*self,
+							 guint64	*out_hits,
+							 guint64	*out_misses,
+							 guint64	*out_evictions);
+
+G_END_DECLS
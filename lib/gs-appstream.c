@@ -1450,9 +1450,12 @@ typedef struct {
 	const gchar		*xpath;
 } Query;
 
+/* If @candidates is non-%NULL, only those components of @silo are matched
+ * against @values, rather than all of them */
 static gboolean
 gs_appstream_do_search (GsPlugin *plugin,
 			XbSilo *silo,
+			GPtrArray *candidates,
 			const gchar * const *values,
 			const Query queries[],
 			GsAppList *list,
@@ -1484,12 +1487,16 @@ gs_appstream_do_search (GsPlugin *plugin,
 	}
 
 	/* get all components */
-	components = xb_silo_query (silo, "components/component", 0, &error_local);
-	if (components == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
+	if (candidates != NULL) {
+		components = g_ptr_array_ref (candidates);
+	} else {
+		components = xb_silo_query (silo, "components/component", 0, &error_local);
+		if (components == NULL) {
+			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+				return TRUE;
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			return FALSE;
+		}
 	}
 	for (guint i = 0; i < components->len; i++) {
 		XbNode *component = g_ptr_array_index (components, i);
@@ -1534,10 +1541,23 @@ gs_appstream_do_search (GsPlugin *plugin,
 		if (g_cancellable_set_error_if_cancelled (cancellable, error))
 			return FALSE;
 	}
-	g_debug ("search took %fms", g_timer_elapsed (timer, NULL) * 1000);
+	g_debug ("search of %u components took %fms", components->len,
+		 g_timer_elapsed (timer, NULL) * 1000);
 	return TRUE;
 }
 
+static const Query search_queries[] = {
+	{ AS_SEARCH_TOKEN_MATCH_MIMETYPE,	"mimetypes/mimetype[text()~=stem(?)]" },
+	{ AS_SEARCH_TOKEN_MATCH_PKGNAME,	"pkgname[text()~=stem(?)]" },
+	{ AS_SEARCH_TOKEN_MATCH_SUMMARY,	"summary[text()~=stem(?)]" },
+	{ AS_SEARCH_TOKEN_MATCH_NAME,	"name[text()~=stem(?)]" },
+	{ AS_SEARCH_TOKEN_MATCH_KEYWORD,	"keywords/keyword[text()~=stem(?)]" },
+	{ AS_SEARCH_TOKEN_MATCH_ID,	"id[text()~=stem(?)]" },
+	{ AS_SEARCH_TOKEN_MATCH_ID,	"launchable[text()~=stem(?)]" },
+	{ AS_SEARCH_TOKEN_MATCH_ORIGIN,	"../components[@origin~=stem(?)]" },
+	{ AS_SEARCH_TOKEN_MATCH_NONE,	NULL }
+};
+
 /* This tokenises and stems @values internally for comparison against the
  * already-stemmed tokens in the libxmlb silo */
 gboolean
@@ -1548,19 +1568,24 @@ gs_appstream_search (GsPlugin *plugin,
 		     GCancellable *cancellable,
 		     GError **error)
 {
-	const Query queries[] = {
-		{ AS_SEARCH_TOKEN_MATCH_MIMETYPE,	"mimetypes/mimetype[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_PKGNAME,	"pkgname[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_SUMMARY,	"summary[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_NAME,	"name[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_KEYWORD,	"keywords/keyword[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_ID,	"id[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_ID,	"launchable[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_ORIGIN,	"../components[@origin~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_NONE,	NULL }
-	};
+	return gs_appstream_do_search (plugin, silo, NULL, values, search_queries, list, cancellable, error);
+}
+
+/* As gs_appstream_search(), but only matches @values against @components,
+ * which must be `components/component` nodes from @silo. This allows the
+ * caller to narrow down the candidates using a prebuilt index first. */
+gboolean
+gs_appstream_search_components (GsPlugin *plugin,
+				XbSilo *silo,
+				GPtrArray *components,
+				const gchar * const *values,
+				GsAppList *list,
+				GCancellable *cancellable,
+				GError **error)
+{
+	g_return_val_if_fail (components != NULL, FALSE);
 
-	return gs_appstream_do_search (plugin, silo, values, queries, list, cancellable, error);
+	return gs_appstream_do_search (plugin, silo, components, values, search_queries, list, cancellable, error);
 }
 
 gboolean
@@ -1577,7 +1602,7 @@ gs_appstream_search_developer_apps (GsPlugin *plugin,
 		{ AS_SEARCH_TOKEN_MATCH_NONE,		NULL }
 	};
 
-	return gs_appstream_do_search (plugin, silo, values, queries, list, cancellable, error);
+	return gs_appstream_do_search (plugin, silo, NULL, values, queries, list, cancellable, error);
 }
 
 gboolean
@@ -29,6 +29,13 @@ gboolean	 gs_appstream_search			(GsPlugin	*plugin,
 							 GsAppList	*list,
 							 GCancellable	*cancellable,
 							 GError		**error);
+gboolean	 gs_appstream_search_components	(GsPlugin	*plugin,
+							 XbSilo		*silo,
+							 GPtrArray	*components,
+							 const gchar * const *values,
+							 GsAppList	*list,
+							 GCancellable	*cancellable,
+							 GError		**error);
 gboolean	 gs_appstream_search_developer_apps	(GsPlugin	*plugin,
 							 XbSilo		*silo,
 							 const gchar * const *values,
@@ -12,6 +12,9 @@
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
 #include <locale.h>
+#include <math.h>
+#include <unistd.h>
+#include <json-glib/json-glib.h>
 
 #include "gnome-software-private.h"
 
@@ -303,6 +306,276 @@ app_sort_kind_cb (GsApp *app1, GsApp *app2, gpointer user_data)
 	return 0;
 }
 
+typedef enum {
+	GS_CMD_BENCHMARK_SEARCH,
+	GS_CMD_BENCHMARK_LIST_APPS,
+	GS_CMD_BENCHMARK_REFINE,
+	GS_CMD_BENCHMARK_GET_UPDATES,
+	GS_CMD_BENCHMARK_GET_CATEGORIES,
+	GS_CMD_BENCHMARK_LAST
+} GsCmdBenchmark;
+
+static const gchar *
+gs_cmd_benchmark_to_string (GsCmdBenchmark benchmark)
+{
+	if (benchmark == GS_CMD_BENCHMARK_SEARCH)
+		return "search";
+	if (benchmark == GS_CMD_BENCHMARK_LIST_APPS)
+		return "list-apps";
+	if (benchmark == GS_CMD_BENCHMARK_REFINE)
+		return "refine";
+	if (benchmark == GS_CMD_BENCHMARK_GET_UPDATES)
+		return "get-updates";
+	if (benchmark == GS_CMD_BENCHMARK_GET_CATEGORIES)
+		return "get-categories";
+	return NULL;
+}
+
+/* resident set size in bytes, or 0 if unknown */
+static guint64
+gs_cmd_get_rss (void)
+{
+	g_autofree gchar *statm = NULL;
+	g_auto(GStrv) split = NULL;
+
+	if (!g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL))
+		return 0;
+	split = g_strsplit (statm, " ", -1);
+	if (g_strv_length (split) < 2)
+		return 0;
+	return g_ascii_strtoull (split[1], NULL, 10) * sysconf (_SC_PAGESIZE);
+}
+
+static gboolean
+gs_cmd_benchmark_run_once (GsCmdSelf *self,
+			   GsCmdBenchmark benchmark,
+			   const gchar *search,
+			   GsApp *app,
+			   GError **error)
+{
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+	g_autoptr(GsAppQuery) query = NULL;
+	g_autoptr(GsAppList) list = NULL;
+	GsPluginListAppsFlags flags = GS_PLUGIN_LIST_APPS_FLAGS_NONE;
+
+	if (self->interactive)
+		flags |= GS_PLUGIN_LIST_APPS_FLAGS_INTERACTIVE;
+
+	switch (benchmark) {
+	case GS_CMD_BENCHMARK_SEARCH: {
+		const gchar *keywords[2] = { search, NULL };
+		query = gs_app_query_new ("keywords", keywords,
+					  "refine-flags", self->refine_flags,
+					  "max-results", self->max_results,
+					  "dedupe-flags", GS_PLUGIN_JOB_DEDUPE_FLAGS_DEFAULT,
+					  "sort-func", gs_utils_app_sort_match_value,
+					  NULL);
+		plugin_job = gs_plugin_job_list_apps_new (query, flags);
+		break;
+	}
+	case GS_CMD_BENCHMARK_LIST_APPS:
+		query = gs_app_query_new ("is-installed", GS_APP_QUERY_TRISTATE_TRUE,
+					  "refine-flags", self->refine_flags,
+					  "max-results", self->max_results,
+					  "dedupe-flags", GS_PLUGIN_JOB_DEDUPE_FLAGS_DEFAULT,
+					  NULL);
+		plugin_job = gs_plugin_job_list_apps_new (query, flags);
+		break;
+	case GS_CMD_BENCHMARK_REFINE:
+		plugin_job = gs_plugin_job_refine_new_for_app (app, self->refine_flags);
+		return gs_plugin_loader_job_action (self->plugin_loader, plugin_job, NULL, error);
+	case GS_CMD_BENCHMARK_GET_UPDATES:
+		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_GET_UPDATES,
+						 "refine-flags", self->refine_flags,
+						 "max-results", self->max_results,
+						 "interactive", self->interactive,
+						 NULL);
+		break;
+	case GS_CMD_BENCHMARK_GET_CATEGORIES: {
+		GsPluginRefineCategoriesFlags categories_flags = GS_PLUGIN_REFINE_CATEGORIES_FLAGS_SIZE;
+		if (self->interactive)
+			categories_flags |= GS_PLUGIN_REFINE_CATEGORIES_FLAGS_INTERACTIVE;
+		plugin_job = gs_plugin_job_list_categories_new (categories_flags);
+		return gs_plugin_loader_job_action (self->plugin_loader, plugin_job, NULL, error);
+	}
+	default:
+		g_assert_not_reached ();
+	}
+
+	list = gs_plugin_loader_job_process (self->plugin_loader, plugin_job, NULL, error);
+	return list != NULL;
+}
+
+static gint
+gs_cmd_benchmark_sort_cb (gconstpointer a, gconstpointer b)
+{
+	gdouble a_val = *((const gdouble *) a);
+	gdouble b_val = *((const gdouble *) b);
+	return (a_val < b_val) ? -1 : (a_val > b_val) ? 1 : 0;
+}
+
+/* nearest-rank percentile of a sorted array */
+static gdouble
+gs_cmd_benchmark_percentile (GArray *sorted, guint pct)
+{
+	guint rank = (guint) ceil ((gdouble) pct / 100.0 * sorted->len);
+	return g_array_index (sorted, gdouble, MAX (rank, 1) - 1);
+}
+
+/* runs @benchmark @repeat times, clearing the plugin caches before each run if
+ * @cold is set, and adds the statistics to @builder */
+static gboolean
+gs_cmd_benchmark_run_phase (GsCmdSelf *self,
+			    GsCmdBenchmark benchmark,
+			    const gchar *search,
+			    GsApp *app,
+			    guint repeat,
+			    gboolean cold,
+			    JsonBuilder *builder,
+			    GError **error)
+{
+	g_autoptr(GArray) times = g_array_sized_new (FALSE, FALSE, sizeof (gdouble), repeat);
+	guint64 rss_before = gs_cmd_get_rss ();
+	gint64 rss_delta;
+	gdouble sum = 0.0;
+	gdouble mean, p50, p95, p99;
+
+	for (guint i = 0; i < repeat; i++) {
+		g_autoptr(GTimer) timer = NULL;
+		gdouble elapsed;
+
+		if (cold)
+			gs_plugin_loader_clear_caches (self->plugin_loader);
+		timer = g_timer_new ();
+		if (!gs_cmd_benchmark_run_once (self, benchmark, search, app, error))
+			return FALSE;
+		elapsed = g_timer_elapsed (timer, NULL) * 1000.0;
+		g_array_append_val (times, elapsed);
+		sum += elapsed;
+	}
+	rss_delta = (gint64) gs_cmd_get_rss () - (gint64) rss_before;
+
+	g_array_sort (times, gs_cmd_benchmark_sort_cb);
+	mean = sum / times->len;
+	p50 = gs_cmd_benchmark_percentile (times, 50);
+	p95 = gs_cmd_benchmark_percentile (times, 95);
+	p99 = gs_cmd_benchmark_percentile (times, 99);
+
+	g_print ("%-16s %-5s min %8.2fms mean %8.2fms p50 %8.2fms p95 %8.2fms p99 %8.2fms max %8.2fms rss %+" G_GINT64_FORMAT "kB\n",
+		 gs_cmd_benchmark_to_string (benchmark),
+		 cold ? "cold" : "warm",
+		 g_array_index (times, gdouble, 0),
+		 mean, p50, p95, p99,
+		 g_array_index (times, gdouble, times->len - 1),
+		 rss_delta / 1024);
+
+	json_builder_set_member_name (builder, cold ? "cold" : "warm");
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "iterations");
+	json_builder_add_int_value (builder, times->len);
+	json_builder_set_member_name (builder, "min_ms");
+	json_builder_add_double_value (builder, g_array_index (times, gdouble, 0));
+	json_builder_set_member_name (builder, "mean_ms");
+	json_builder_add_double_value (builder, mean);
+	json_builder_set_member_name (builder, "p50_ms");
+	json_builder_add_double_value (builder, p50);
+	json_builder_set_member_name (builder, "p95_ms");
+	json_builder_add_double_value (builder, p95);
+	json_builder_set_member_name (builder, "p99_ms");
+	json_builder_add_double_value (builder, p99);
+	json_builder_set_member_name (builder, "max_ms");
+	json_builder_add_double_value (builder, g_array_index (times, gdouble, times->len - 1));
+	json_builder_set_member_name (builder, "rss_delta_bytes");
+	json_builder_add_int_value (builder, rss_delta);
+	json_builder_end_object (builder);
+
+	return TRUE;
+}
+
+static gboolean
+gs_cmd_benchmark (GsCmdSelf *self,
+		  const gchar *search,
+		  const gchar *app_id,
+		  guint warmup,
+		  guint repeat,
+		  const gchar *json_filename,
+		  GError **error)
+{
+	g_autoptr(JsonBuilder) builder = json_builder_new ();
+	g_autoptr(JsonGenerator) generator = NULL;
+	g_autoptr(JsonNode) root = NULL;
+	g_autoptr(GsApp) app = NULL;
+
+	/* refine the named app, or the first installed one */
+	if (app_id != NULL) {
+		app = gs_app_new (app_id);
+	} else {
+		g_autoptr(GsAppQuery) query = NULL;
+		g_autoptr(GsPluginJob) plugin_job = NULL;
+		g_autoptr(GsAppList) list = NULL;
+
+		query = gs_app_query_new ("is-installed", GS_APP_QUERY_TRISTATE_TRUE,
+					  "max-results", 1,
+					  NULL);
+		plugin_job = gs_plugin_job_list_apps_new (query, GS_PLUGIN_LIST_APPS_FLAGS_NONE);
+		list = gs_plugin_loader_job_process (self->plugin_loader, plugin_job, NULL, error);
+		if (list == NULL)
+			return FALSE;
+		if (gs_app_list_length (list) == 0) {
+			g_set_error_literal (error,
+					     GS_PLUGIN_ERROR,
+					     GS_PLUGIN_ERROR_NOT_SUPPORTED,
+					     "No installed app to refine; specify an app ID");
+			return FALSE;
+		}
+		app = g_object_ref (gs_app_list_index (list, 0));
+	}
+
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "version");
+	json_builder_add_string_value (builder, PACKAGE_VERSION);
+	json_builder_set_member_name (builder, "search");
+	json_builder_add_string_value (builder, search);
+	json_builder_set_member_name (builder, "app");
+	json_builder_add_string_value (builder, gs_app_get_unique_id (app));
+	json_builder_set_member_name (builder, "refine_flags");
+	json_builder_add_int_value (builder, self->refine_flags);
+	json_builder_set_member_name (builder, "warmup");
+	json_builder_add_int_value (builder, warmup);
+	json_builder_set_member_name (builder, "actions");
+	json_builder_begin_object (builder);
+
+	for (GsCmdBenchmark benchmark = 0; benchmark < GS_CMD_BENCHMARK_LAST; benchmark++) {
+		json_builder_set_member_name (builder, gs_cmd_benchmark_to_string (benchmark));
+		json_builder_begin_object (builder);
+
+		if (!gs_cmd_benchmark_run_phase (self, benchmark, search, app, repeat, TRUE, builder, error))
+			return FALSE;
+
+		/* warm-up runs are not measured */
+		for (guint i = 0; i < warmup; i++) {
+			if (!gs_cmd_benchmark_run_once (self, benchmark, search, app, error))
+				return FALSE;
+		}
+		if (!gs_cmd_benchmark_run_phase (self, benchmark, search, app, repeat, FALSE, builder, error))
+			return FALSE;
+
+		json_builder_end_object (builder);
+	}
+
+	json_builder_end_object (builder);
+	json_builder_end_object (builder);
+
+	if (json_filename == NULL)
+		return TRUE;
+
+	root = json_builder_get_root (builder);
+	generator = json_generator_new ();
+	json_generator_set_pretty (generator, TRUE);
+	json_generator_set_root (generator, root);
+	return json_generator_to_file (generator, json_filename, error);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -314,6 +587,7 @@ main (int argc, char **argv)
 	gint i;
 	guint64 cache_age_secs = 0;
 	gint repeat = 1;
+	gint warmup = 1;
 	g_auto(GStrv) plugin_blocklist = NULL;
 	g_auto(GStrv) plugin_allowlist = NULL;
 	g_autoptr(GError) error = NULL;
@@ -323,6 +597,7 @@ main (int argc, char **argv)
 	g_autofree gchar *plugin_blocklist_str = NULL;
 	g_autofree gchar *plugin_allowlist_str = NULL;
 	g_autofree gchar *refine_flags_str = NULL;
+	g_autofree gchar *benchmark_json = NULL;
 	g_autoptr(GsApp) app = NULL;
 	g_autoptr(GFile) file = NULL;
 	g_autoptr(GsCmdSelf) self = g_new0 (GsCmdSelf, 1);
@@ -333,6 +608,10 @@ main (int argc, char **argv)
 		  "Set any refine flags required for the action", NULL },
 		{ "repeat", '\0', 0, G_OPTION_ARG_INT, &repeat,
 		  "Repeat the action this number of times", NULL },
+		{ "warmup", '\0', 0, G_OPTION_ARG_INT, &warmup,
+		  "Number of unmeasured runs before the warm-cache benchmark phase", NULL },
+		{ "benchmark-json", '\0', 0, G_OPTION_ARG_FILENAME, &benchmark_json,
+		  "Write the benchmark results as JSON to this file", NULL },
 		{ "cache-age", '\0', 0, G_OPTION_ARG_INT64, &cache_age_secs,
 		  "Use this maximum cache age in seconds", NULL },
 		{ "max-results", '\0', 0, G_OPTION_ARG_INT, &self->max_results,
@@ -813,6 +1092,14 @@ main (int argc, char **argv)
 		plugin_job = gs_plugin_job_refresh_metadata_new (cache_age_secs, refresh_metadata_flags);
 		ret = gs_plugin_loader_job_action (self->plugin_loader, plugin_job,
 						    NULL, &error);
+	} else if (argc >= 2 && argc <= 4 && g_strcmp0 (argv[1], "benchmark") == 0) {
+		ret = gs_cmd_benchmark (self,
+					(argc >= 3) ? argv[2] : "gnome",
+					(argc >= 4) ? argv[3] : NULL,
+					MAX (warmup, 0),
+					MAX (repeat, 1),
+					benchmark_json,
+					&error);
 	} else if (argc >= 1 && g_strcmp0 (argv[1], "user-hash") == 0) {
 		g_autofree gchar *user_hash = gs_utils_get_user_hash (&error);
 		if (user_hash == NULL) {
@@ -830,7 +1117,7 @@ main (int argc, char **argv)
 				     "'updates', 'popular', 'get-categories', "
 				     "'get-category-apps', 'get-alternates', 'filename-to-app', "
 				     "'action install', 'action remove', "
-				     "'sources', 'refresh', 'launch' or 'search'");
+				     "'sources', 'refresh', 'launch', 'benchmark' or 'search'");
 	}
 	if (!ret) {
 		g_print ("Failed: %s\n", error->message);
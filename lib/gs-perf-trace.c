@@ -0,0 +1,384 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/**
+ * SECTION:gs-perf-trace
+ * @short_description: A ring buffer of job and plugin timings
+ *
+ * #GsPerfTrace records how long each job, and each plugin operation within a
+ * job, took to run. Unlike the sysprof marks, it is always available, so it
+ * can be queried from a running production instance.
+ *
+ * Only the most recent records are kept, in a fixed-size ring buffer, so the
+ * cost of tracing is bounded. Job, plugin and vfunc names are interned, so
+ * adding a record does not allocate.
+ *
+ * gs_perf_trace_to_json() returns the records along with p50/p95/p99 run time
+ * aggregates per plugin and per job.
+ *
+ * Since: 44
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+#include <json-glib/json-glib.h>
+#include <math.h>
+
+#include "gs-perf-trace.h"
+
+typedef struct {
+	gint64		 timestamp_usec;  /* wall clock time when the record was added */
+	const gchar	*job;  /* (interned) */
+	const gchar	*plugin;  /* (interned) (nullable) */
+	const gchar	*vfunc;  /* (interned) (nullable) */
+	gint64		 queue_wait_usec;  /* -1 if not applicable */
+	gint64		 run_usec;
+	guint		 n_apps;
+	gboolean	 cancelled;
+	gboolean	 failed;
+} GsPerfRecord;
+
+struct _GsPerfTrace
+{
+	GObject			 parent;
+
+	GMutex			 mutex;
+	GsPerfRecord		*records;  /* (owned) (array length=capacity) */
+	guint			 capacity;
+	guint			 head;  /* index the next record will be written to */
+	guint			 length;
+};
+
+G_DEFINE_TYPE (GsPerfTrace, gs_perf_trace, G_TYPE_OBJECT)
+
+/**
+ * gs_perf_trace_add:
+ * @self: a #GsPerfTrace
+ * @job: the job type or action name
+ * @plugin: (nullable): the plugin name, or %NULL for a whole job
+ * @vfunc: (nullable): the plugin vfunc, or %NULL for a whole job
+ * @queue_wait_usec: how long the job waited before it started running, or -1
+ *   if not applicable
+ * @run_usec: how long the job or operation ran for
+ * @n_apps: how many apps it returned or operated on
+ * @cancelled: whether it was cancelled
+ * @failed: whether it failed for a reason other than being cancelled
+ *
+ * Adds a record, overwriting the oldest one if the buffer is full.
+ *
+ * This is thread-safe.
+ *
+ * Since: 44
+ */
+void
+gs_perf_trace_add (GsPerfTrace *self,
+                   const gchar *job,
+                   const gchar *plugin,
+                   const gchar *vfunc,
+                   gint64       queue_wait_usec,
+                   gint64       run_usec,
+                   guint        n_apps,
+                   gboolean     cancelled,
+                   gboolean     failed)
+{
+	GsPerfRecord *record;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PERF_TRACE (self));
+	g_return_if_fail (job != NULL);
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	record = &self->records[self->head];
+	record->timestamp_usec = g_get_real_time ();
+	record->job = g_intern_string (job);
+	record->plugin = g_intern_string (plugin);
+	record->vfunc = g_intern_string (vfunc);
+	record->queue_wait_usec = queue_wait_usec;
+	record->run_usec = run_usec;
+	record->n_apps = n_apps;
+	record->cancelled = cancelled;
+	record->failed = failed;
+
+	self->head = (self->head + 1) % self->capacity;
+	self->length = MIN (self->length + 1, self->capacity);
+}
+
+/**
+ * gs_perf_trace_get_length:
+ * @self: a #GsPerfTrace
+ *
+ * Gets the number of records currently held.
+ *
+ * Returns: number of records
+ * Since: 44
+ */
+guint
+gs_perf_trace_get_length (GsPerfTrace *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_PERF_TRACE (self), 0);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	return self->length;
+}
+
+/**
+ * gs_perf_trace_clear:
+ * @self: a #GsPerfTrace
+ *
+ * Removes all the records.
+ *
+ * Since: 44
+ */
+void
+gs_perf_trace_clear (GsPerfTrace *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PERF_TRACE (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+	self->head = 0;
+	self->length = 0;
+}
+
+static gint
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+	gint64 a_val = *((const gint64 *) a);
+	gint64 b_val = *((const gint64 *) b);
+	return (a_val < b_val) ? -1 : (a_val > b_val) ? 1 : 0;
+}
+
+/* nearest-rank percentile of a sorted array */
+static gint64
+percentile (GArray *sorted, guint pct)
+{
+	guint rank;
+
+	if (sorted->len == 0)
+		return 0;
+	rank = (guint) ceil ((gdouble) pct / 100.0 * sorted->len);
+	return g_array_index (sorted, gint64, MAX (rank, 1) - 1);
+}
+
+typedef struct {
+	GArray		*run_usec;  /* (owned) (element-type gint64) */
+	guint		 n_cancelled;
+	guint		 n_failed;
+} GsPerfAggregate;
+
+static void
+gs_perf_aggregate_free (GsPerfAggregate *aggregate)
+{
+	g_array_unref (aggregate->run_usec);
+	g_free (aggregate);
+}
+
+static void
+aggregate_add (GHashTable         *aggregates,
+               const gchar        *key,
+               const GsPerfRecord *record)
+{
+	GsPerfAggregate *aggregate = g_hash_table_lookup (aggregates, key);
+
+	if (aggregate == NULL) {
+		aggregate = g_new0 (GsPerfAggregate, 1);
+		aggregate->run_usec = g_array_new (FALSE, FALSE, sizeof (gint64));
+		g_hash_table_insert (aggregates, (gpointer) key, aggregate);
+	}
+
+	g_array_append_val (aggregate->run_usec, record->run_usec);
+	if (record->cancelled)
+		aggregate->n_cancelled++;
+	if (record->failed)
+		aggregate->n_failed++;
+}
+
+static gint
+compare_strv_element (gconstpointer a,
+                      gconstpointer b,
+                      gpointer      user_data)
+{
+	return g_strcmp0 (*((const gchar * const *) a), *((const gchar * const *) b));
+}
+
+static void
+build_aggregates (JsonBuilder *builder,
+                  GHashTable  *aggregates)
+{
+	g_autofree const gchar **keys = NULL;
+	guint n_keys = 0;
+
+	/* sort the keys so the output is stable */
+	keys = (const gchar **) g_hash_table_get_keys_as_array (aggregates, &n_keys);
+	g_qsort_with_data (keys, n_keys, sizeof (const gchar *),
+			   compare_strv_element, NULL);
+
+	json_builder_begin_object (builder);
+	for (guint i = 0; i < n_keys; i++) {
+		GsPerfAggregate *aggregate = g_hash_table_lookup (aggregates, keys[i]);
+		GArray *run_usec = aggregate->run_usec;
+
+		g_array_sort (run_usec, compare_gint64);
+
+		json_builder_set_member_name (builder, keys[i]);
+		json_builder_begin_object (builder);
+		json_builder_set_member_name (builder, "count");
+		json_builder_add_int_value (builder, run_usec->len);
+		json_builder_set_member_name (builder, "cancelled");
+		json_builder_add_int_value (builder, aggregate->n_cancelled);
+		json_builder_set_member_name (builder, "failed");
+		json_builder_add_int_value (builder, aggregate->n_failed);
+		json_builder_set_member_name (builder, "p50_usec");
+		json_builder_add_int_value (builder, percentile (run_usec, 50));
+		json_builder_set_member_name (builder, "p95_usec");
+		json_builder_add_int_value (builder, percentile (run_usec, 95));
+		json_builder_set_member_name (builder, "p99_usec");
+		json_builder_add_int_value (builder, percentile (run_usec, 99));
+		json_builder_set_member_name (builder, "max_usec");
+		json_builder_add_int_value (builder, g_array_index (run_usec, gint64, run_usec->len - 1));
+		json_builder_end_object (builder);
+	}
+	json_builder_end_object (builder);
+}
+
+/**
+ * gs_perf_trace_to_json:
+ * @self: a #GsPerfTrace
+ *
+ * Serialises the records, oldest first, along with aggregate run time
+ * percentiles per plugin (from the plugin operation records) and per job
+ * (from the whole job records).
+ *
+ * Returns: (transfer full): a JSON object
+ * Since: 44
+ */
+JsonNode *
+gs_perf_trace_to_json (GsPerfTrace *self)
+{
+	g_autoptr(JsonBuilder) builder = json_builder_new ();
+	g_autoptr(GHashTable) per_plugin = NULL;
+	g_autoptr(GHashTable) per_job = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_PERF_TRACE (self), NULL);
+
+	/* the keys are interned strings */
+	per_plugin = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) gs_perf_aggregate_free);
+	per_job = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) gs_perf_aggregate_free);
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "capacity");
+	json_builder_add_int_value (builder, self->capacity);
+
+	json_builder_set_member_name (builder, "records");
+	json_builder_begin_array (builder);
+	for (guint i = 0; i < self->length; i++) {
+		guint idx = (self->head + self->capacity - self->length + i) % self->capacity;
+		const GsPerfRecord *record = &self->records[idx];
+
+		if (record->plugin != NULL)
+			aggregate_add (per_plugin, record->plugin, record);
+		else
+			aggregate_add (per_job, record->job, record);
+
+		json_builder_begin_object (builder);
+		json_builder_set_member_name (builder, "timestamp");
+		json_builder_add_int_value (builder, record->timestamp_usec);
+		json_builder_set_member_name (builder, "job");
+		json_builder_add_string_value (builder, record->job);
+		if (record->plugin != NULL) {
+			json_builder_set_member_name (builder, "plugin");
+			json_builder_add_string_value (builder, record->plugin);
+		}
+		if (record->vfunc != NULL) {
+			json_builder_set_member_name (builder, "vfunc");
+			json_builder_add_string_value (builder, record->vfunc);
+		}
+		if (record->queue_wait_usec >= 0) {
+			json_builder_set_member_name (builder, "queue_wait_usec");
+			json_builder_add_int_value (builder, record->queue_wait_usec);
+		}
+		json_builder_set_member_name (builder, "run_usec");
+		json_builder_add_int_value (builder, record->run_usec);
+		json_builder_set_member_name (builder, "n_apps");
+		json_builder_add_int_value (builder, record->n_apps);
+		json_builder_set_member_name (builder, "cancelled");
+		json_builder_add_boolean_value (builder, record->cancelled);
+		json_builder_set_member_name (builder, "failed");
+		json_builder_add_boolean_value (builder, record->failed);
+		json_builder_end_object (builder);
+	}
+	json_builder_end_array (builder);
+
+	g_clear_pointer (&locker, g_mutex_locker_free);
+
+	json_builder_set_member_name (builder, "plugins");
+	build_aggregates (builder, per_plugin);
+	json_builder_set_member_name (builder, "jobs");
+	build_aggregates (builder, per_job);
+
+	json_builder_end_object (builder);
+
+	return json_builder_get_root (builder);
+}
+
+static void
+gs_perf_trace_finalize (GObject *object)
+{
+	GsPerfTrace *self = GS_PERF_TRACE (object);
+
+	g_free (self->records);
+	g_mutex_clear (&self->mutex);
+
+	G_OBJECT_CLASS (gs_perf_trace_parent_class)->finalize (object);
+}
+
+static void
+gs_perf_trace_class_init (GsPerfTraceClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = gs_perf_trace_finalize;
+}
+
+static void
+gs_perf_trace_init (GsPerfTrace *self)
+{
+	g_mutex_init (&self->mutex);
+}
+
+/**
+ * gs_perf_trace_new:
+ * @capacity: the maximum number of records to keep; must be non-zero
+ *
+ * Create a new #GsPerfTrace.
+ *
+ * Returns: (transfer full): a new #GsPerfTrace
+ * Since: 44
+ */
+GsPerfTrace *
+gs_perf_trace_new (guint capacity)
+{
+	GsPerfTrace *self;
+
+	g_return_val_if_fail (capacity > 0, NULL);
+
+	self = g_object_new (GS_TYPE_PERF_TRACE, NULL);
+	self->capacity = capacity;
+	self->records = g_new0 (GsPerfRecord, capacity);
+
+	return self;
+}
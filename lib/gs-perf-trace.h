@@ -0,0 +1,35 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <glib-object.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_PERF_TRACE (gs_perf_trace_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsPerfTrace, gs_perf_trace, GS, PERF_TRACE, GObject)
+
+GsPerfTrace	*gs_perf_trace_new		(guint		 capacity);
+void		 gs_perf_trace_add		(GsPerfTrace	*self,
+						 const gchar	*job,
+						 const gchar	*plugin,
+						 const gchar	*vfunc,
+						 gint64		 queue_wait_usec,
+						 gint64		 run_usec,
+						 guint		 n_apps,
+						 gboolean	 cancelled,
+						 gboolean	 failed);
+guint		 gs_perf_trace_get_length	(GsPerfTrace	*self);
+void		 gs_perf_trace_clear		(GsPerfTrace	*self);
+JsonNode	*gs_perf_trace_to_json		(GsPerfTrace	*self);
+
+G_END_DECLS
@@ -232,6 +232,7 @@ gs_plugin_job_list_apps_run_async (GsPluginJob         *job,
 
 		/* run the plugin */
 		self->n_pending_ops++;
+		gs_plugin_job_plugin_started (GS_PLUGIN_JOB (self), plugin);
 		plugin_class->list_apps_async (plugin, self->query, self->flags, cancellable, plugin_list_apps_cb, g_object_ref (task));
 	}
 
@@ -250,12 +251,18 @@ plugin_list_apps_cb (GObject      *source_object,
 	GsPluginClass *plugin_class = GS_PLUGIN_GET_CLASS (plugin);
 	g_autoptr(GTask) task = G_TASK (user_data);
 	GsPluginJobListApps *self = g_task_get_source_object (task);
+	GsPluginLoader *plugin_loader = g_task_get_task_data (task);
 	g_autoptr(GsAppList) plugin_apps = NULL;
 	g_autoptr(GError) local_error = NULL;
 
 	plugin_apps = plugin_class->list_apps_finish (plugin, result, &local_error);
 	gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
 
+	gs_plugin_job_plugin_finished (GS_PLUGIN_JOB (self), plugin_loader, plugin,
+				       "list_apps_async",
+				       (plugin_apps != NULL) ? gs_app_list_length (plugin_apps) : 0,
+				       local_error);
+
 	if (plugin_apps != NULL)
 		gs_app_list_add_list (self->merged_list, plugin_apps);
 
@@ -376,25 +383,31 @@ finish_task (GTask     *task,
 	if (dedupe_flags != GS_APP_LIST_FILTER_FLAG_NONE)
 		gs_app_list_filter_duplicates (merged_list, dedupe_flags);
 
-	/* Sort the results. The refine may have added useful metadata. */
-	if (self->query != NULL)
+	/* Sort the results, truncating them if needed. The refine may have
+	 * added useful metadata. When truncating, only the results which are
+	 * kept need to be fully sorted. */
+	if (self->query != NULL) {
 		sort_func = gs_app_query_get_sort_func (self->query, &sort_func_data);
-
-	if (sort_func != NULL) {
-		gs_app_list_sort (merged_list, sort_func, sort_func_data);
-	} else {
-		g_debug ("no ->sort_func() set, using random!");
-		gs_app_list_randomize (merged_list);
-	}
-
-	/* Truncate the results if needed. */
-	if (self->query != NULL)
 		max_results = gs_app_query_get_max_results (self->query);
+	}
 
 	if (max_results > 0 && gs_app_list_length (merged_list) > max_results) {
 		g_debug ("truncating results from %u to %u",
 			 gs_app_list_length (merged_list), max_results);
-		gs_app_list_truncate (merged_list, max_results);
+	} else {
+		max_results = 0;
+	}
+
+	if (sort_func != NULL && max_results > 0) {
+		gs_app_list_sort_truncate (merged_list, sort_func, sort_func_data, max_results);
+	} else if (sort_func != NULL) {
+		gs_app_list_sort (merged_list, sort_func, sort_func_data);
+	} else if (max_results > 0) {
+		g_debug ("no ->sort_func() set, using random!");
+		gs_app_list_randomize_truncate (merged_list, max_results);
+	} else {
+		g_debug ("no ->sort_func() set, using random!");
+		gs_app_list_randomize (merged_list);
 	}
 
 	/* show elapsed time */
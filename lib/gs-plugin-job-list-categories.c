@@ -171,6 +171,7 @@ gs_plugin_job_list_categories_run_async (GsPluginJob         *job,
 
 		/* run the plugin */
 		self->n_pending_ops++;
+		gs_plugin_job_plugin_started (GS_PLUGIN_JOB (self), plugin);
 		plugin_class->refine_categories_async (plugin, self->category_list, self->flags, cancellable, plugin_refine_categories_cb, g_object_ref (task));
 	}
 
@@ -188,9 +189,16 @@ plugin_refine_categories_cb (GObject      *source_object,
 	GsPlugin *plugin = GS_PLUGIN (source_object);
 	GsPluginClass *plugin_class = GS_PLUGIN_GET_CLASS (plugin);
 	g_autoptr(GTask) task = G_TASK (user_data);
+	GsPluginJob *self = g_task_get_source_object (task);
+	GsPluginLoader *plugin_loader = g_task_get_task_data (task);
 	g_autoptr(GError) local_error = NULL;
+	gboolean success;
 
-	if (!plugin_class->refine_categories_finish (plugin, result, &local_error)) {
+	success = plugin_class->refine_categories_finish (plugin, result, &local_error);
+	gs_plugin_job_plugin_finished (self, plugin_loader, plugin,
+				       "refine_categories_async", 0, local_error);
+
+	if (!success) {
 		finish_op (task, g_steal_pointer (&local_error));
 		return;
 	}
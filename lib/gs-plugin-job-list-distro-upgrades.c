@@ -200,6 +200,7 @@ gs_plugin_job_list_distro_upgrades_run_async (GsPluginJob         *job,
 
 		/* run the plugin */
 		self->n_pending_ops++;
+		gs_plugin_job_plugin_started (GS_PLUGIN_JOB (self), plugin);
 		plugin_class->list_distro_upgrades_async (plugin, self->flags, cancellable, plugin_list_distro_upgrades_cb, g_object_ref (task));
 	}
 
@@ -218,12 +219,18 @@ plugin_list_distro_upgrades_cb (GObject      *source_object,
 	GsPluginClass *plugin_class = GS_PLUGIN_GET_CLASS (plugin);
 	g_autoptr(GTask) task = G_TASK (user_data);
 	GsPluginJobListDistroUpgrades *self = g_task_get_source_object (task);
+	GsPluginLoader *plugin_loader = g_task_get_task_data (task);
 	g_autoptr(GsAppList) plugin_apps = NULL;
 	g_autoptr(GError) local_error = NULL;
 
 	plugin_apps = plugin_class->list_distro_upgrades_finish (plugin, result, &local_error);
 	gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
 
+	gs_plugin_job_plugin_finished (GS_PLUGIN_JOB (self), plugin_loader, plugin,
+				       "list_distro_upgrades_async",
+				       (plugin_apps != NULL) ? gs_app_list_length (plugin_apps) : 0,
+				       local_error);
+
 	if (plugin_apps != NULL)
 		gs_app_list_add_list (self->merged_list, plugin_apps);
 
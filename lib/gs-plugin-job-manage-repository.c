@@ -173,6 +173,7 @@ gs_plugin_job_manage_repository_run_async (GsPluginJob         *job,
 
 		/* run the plugin */
 		self->n_pending_ops++;
+		gs_plugin_job_plugin_started (GS_PLUGIN_JOB (self), plugin);
 		repository_func_async (plugin, self->repository, self->flags, cancellable, plugin_repository_func_cb, g_object_ref (task));
 	}
 
@@ -191,6 +192,7 @@ plugin_repository_func_cb (GObject      *source_object,
 	GsPluginClass *plugin_class = GS_PLUGIN_GET_CLASS (plugin);
 	g_autoptr(GTask) task = G_TASK (user_data);
 	GsPluginJobManageRepository *self = g_task_get_source_object (task);
+	GsPluginLoader *plugin_loader = g_task_get_task_data (task);
 	gboolean success;
 	g_autoptr(GError) local_error = NULL;
 	gboolean (* repository_func_finish) (GsPlugin *plugin,
@@ -211,6 +213,9 @@ plugin_repository_func_cb (GObject      *source_object,
 	success = repository_func_finish (plugin, result, &local_error);
 	gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
 
+	gs_plugin_job_plugin_finished (GS_PLUGIN_JOB (self), plugin_loader, plugin,
+				       "manage_repository_async", 1, local_error);
+
 	g_assert (success || local_error != NULL);
 
 	finish_op (task, g_steal_pointer (&local_error));
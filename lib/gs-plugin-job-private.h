@@ -11,6 +11,7 @@
 #include <glib-object.h>
 
 #include "gs-plugin-job.h"
+#include "gs-plugin-loader.h"
 
 G_BEGIN_DECLS
 
@@ -34,6 +35,17 @@ GsAppList		*gs_plugin_job_get_list			(GsPluginJob	*self);
 GFile			*gs_plugin_job_get_file			(GsPluginJob	*self);
 GsPlugin		*gs_plugin_job_get_plugin		(GsPluginJob	*self);
 gchar			*gs_plugin_job_to_string		(GsPluginJob	*self);
+gint64			 gs_plugin_job_get_time_created		(GsPluginJob	*self);
+void			 gs_plugin_job_mark_started		(GsPluginJob	*self);
+gint64			 gs_plugin_job_get_time_started		(GsPluginJob	*self);
+void			 gs_plugin_job_plugin_started		(GsPluginJob	*self,
+								 GsPlugin	*plugin);
+void			 gs_plugin_job_plugin_finished		(GsPluginJob	*self,
+								 GsPluginLoader	*plugin_loader,
+								 GsPlugin	*plugin,
+								 const gchar	*vfunc,
+								 guint		 n_apps,
+								 const GError	*error);
 void			 gs_plugin_job_set_action		(GsPluginJob	*self,
 								 GsPluginAction	 action);
 
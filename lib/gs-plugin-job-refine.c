@@ -317,6 +317,7 @@ run_refine_internal_async (GsPluginJobRefine   *self,
 
 		/* run the batched plugin symbol */
 		data->n_pending_ops++;
+		gs_plugin_job_plugin_started (GS_PLUGIN_JOB (self), plugin);
 		plugin_class->refine_async (plugin, list, flags,
 					    cancellable, plugin_refine_cb, g_object_ref (task));
 
@@ -336,10 +337,17 @@ plugin_refine_cb (GObject      *source_object,
 {
 	GsPlugin *plugin = GS_PLUGIN (source_object);
 	g_autoptr(GTask) task = g_steal_pointer (&user_data);
+	GsPluginJobRefine *self = g_task_get_source_object (task);
+	RefineInternalData *data = g_task_get_task_data (task);
 	GsPluginClass *plugin_class = GS_PLUGIN_GET_CLASS (plugin);
 	g_autoptr(GError) local_error = NULL;
+	gboolean success;
+
+	success = plugin_class->refine_finish (plugin, result, &local_error);
+	gs_plugin_job_plugin_finished (GS_PLUGIN_JOB (self), data->plugin_loader, plugin,
+				       "refine_async", gs_app_list_length (data->list), local_error);
 
-	if (!plugin_class->refine_finish (plugin, result, &local_error)) {
+	if (!success) {
 		finish_refine_internal_op (task, g_steal_pointer (&local_error));
 		return;
 	}
@@ -404,6 +412,7 @@ finish_refine_internal_op (GTask  *task,
 
 		/* run the batched plugin symbol */
 		data->n_pending_ops++;
+		gs_plugin_job_plugin_started (GS_PLUGIN_JOB (self), plugin);
 		plugin_class->refine_async (plugin, list, flags,
 					    cancellable, plugin_refine_cb, g_object_ref (task));
 
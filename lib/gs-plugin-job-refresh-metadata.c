@@ -240,6 +240,7 @@ gs_plugin_job_refresh_metadata_run_async (GsPluginJob         *job,
 
 		/* run the plugin */
 		self->n_pending_ops++;
+		gs_plugin_job_plugin_started (GS_PLUGIN_JOB (self), plugin);
 		plugin_class->refresh_metadata_async (plugin,
 						      self->cache_age_secs,
 						      self->flags,
@@ -374,9 +375,13 @@ plugin_refresh_metadata_cb (GObject      *source_object,
 	GsPluginClass *plugin_class = GS_PLUGIN_GET_CLASS (plugin);
 	g_autoptr(GTask) task = G_TASK (user_data);
 	GsPluginJobRefreshMetadata *self = g_task_get_source_object (task);
+	GsPluginLoader *plugin_loader = g_task_get_task_data (task);
 	g_autoptr(GError) local_error = NULL;
 
-	if (!plugin_class->refresh_metadata_finish (plugin, result, &local_error))
+	plugin_class->refresh_metadata_finish (plugin, result, &local_error);
+	gs_plugin_job_plugin_finished (GS_PLUGIN_JOB (self), plugin_loader, plugin,
+				       "refresh_metadata_async", 0, local_error);
+	if (local_error != NULL)
 		g_debug ("Failed to refresh plugin '%s': %s", gs_plugin_get_name (plugin), local_error->message);
 	gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
 
@@ -31,6 +31,8 @@ typedef struct
 	GsAppList		*list;
 	GFile			*file;
 	gint64			 time_created;
+	gint64			 time_started;  /* 0 until the job starts running */
+	GHashTable		*plugins_started;  /* (owned) (nullable) (element-type GsPlugin gint64); monotonic */
 } GsPluginJobPrivate;
 
 enum {
@@ -327,6 +329,76 @@ gs_plugin_job_get_plugin (GsPluginJob *self)
 	return priv->plugin;
 }
 
+gint64
+gs_plugin_job_get_time_created (GsPluginJob *self)
+{
+	GsPluginJobPrivate *priv = gs_plugin_job_get_instance_private (self);
+	g_return_val_if_fail (GS_IS_PLUGIN_JOB (self), 0);
+	return priv->time_created;
+}
+
+void
+gs_plugin_job_mark_started (GsPluginJob *self)
+{
+	GsPluginJobPrivate *priv = gs_plugin_job_get_instance_private (self);
+	g_return_if_fail (GS_IS_PLUGIN_JOB (self));
+	priv->time_started = g_get_monotonic_time ();
+}
+
+gint64
+gs_plugin_job_get_time_started (GsPluginJob *self)
+{
+	GsPluginJobPrivate *priv = gs_plugin_job_get_instance_private (self);
+	g_return_val_if_fail (GS_IS_PLUGIN_JOB (self), 0);
+	return priv->time_started;
+}
+
+/* Notes the time @plugin was asked to run its part of the job, for
+ * gs_plugin_job_plugin_finished(). */
+void
+gs_plugin_job_plugin_started (GsPluginJob *self,
+			      GsPlugin *plugin)
+{
+	GsPluginJobPrivate *priv = gs_plugin_job_get_instance_private (self);
+	gint64 *time_started;
+
+	g_return_if_fail (GS_IS_PLUGIN_JOB (self));
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+
+	if (priv->plugins_started == NULL)
+		priv->plugins_started = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	time_started = g_new (gint64, 1);
+	*time_started = g_get_monotonic_time ();
+	g_hash_table_replace (priv->plugins_started, plugin, time_started);
+}
+
+/* Adds a record of @plugin running its part of the job, from when
+ * gs_plugin_job_plugin_started() was called, to the performance trace. */
+void
+gs_plugin_job_plugin_finished (GsPluginJob *self,
+			       GsPluginLoader *plugin_loader,
+			       GsPlugin *plugin,
+			       const gchar *vfunc,
+			       guint n_apps,
+			       const GError *error)
+{
+	GsPluginJobPrivate *priv = gs_plugin_job_get_instance_private (self);
+	gint64 *time_started = NULL;
+
+	g_return_if_fail (GS_IS_PLUGIN_JOB (self));
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+
+	if (priv->plugins_started != NULL)
+		time_started = g_hash_table_lookup (priv->plugins_started, plugin);
+	if (time_started == NULL)
+		return;
+
+	gs_plugin_loader_add_trace_record (plugin_loader, self, plugin, vfunc, -1,
+					   g_get_monotonic_time () - *time_started,
+					   n_apps, error);
+	g_hash_table_remove (priv->plugins_started, plugin);
+}
+
 static void
 gs_plugin_job_get_property (GObject *obj, guint prop_id, GValue *value, GParamSpec *pspec)
 {
@@ -423,6 +495,7 @@ gs_plugin_job_finalize (GObject *obj)
 	g_clear_object (&priv->list);
 	g_clear_object (&priv->file);
 	g_clear_object (&priv->plugin);
+	g_clear_pointer (&priv->plugins_started, g_hash_table_unref);
 
 	G_OBJECT_CLASS (gs_plugin_job_parent_class)->finalize (obj);
 }
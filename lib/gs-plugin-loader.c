@@ -22,11 +22,13 @@
 #include "gs-app-collation.h"
 #include "gs-app-private.h"
 #include "gs-app-list-private.h"
+#include "gs-app-registry.h"
 #include "gs-category-manager.h"
 #include "gs-category-private.h"
 #include "gs-external-appstream-utils.h"
 #include "gs-ioprio.h"
 #include "gs-os-release.h"
+#include "gs-perf-trace.h"
 #include "gs-plugin-loader.h"
 #include "gs-plugin.h"
 #include "gs-plugin-event.h"
@@ -36,6 +38,7 @@
 
 #define GS_PLUGIN_LOADER_UPDATES_CHANGED_DELAY	3	/* s */
 #define GS_PLUGIN_LOADER_RELOAD_DELAY		5	/* s */
+#define GS_PLUGIN_LOADER_PERF_TRACE_SIZE	512	/* records */
 
 struct _GsPluginLoader
 {
@@ -78,6 +81,8 @@ struct _GsPluginLoader
 
 	GsCategoryManager	*category_manager;
 	GsOdrsProvider		*odrs_provider;  /* (owned) (nullable) */
+	GsAppRegistry		*app_registry;  /* (owned) */
+	GsPerfTrace		*perf_trace;  /* (owned) */
 
 #ifdef HAVE_SYSPROF
 	SysprofCaptureWriter	*sysprof_writer;  /* (owned) (nullable) */
@@ -686,6 +691,12 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 		ret = FALSE;
 	}
 
+	gs_plugin_loader_add_trace_record (plugin_loader, helper->plugin_job, plugin,
+					   helper->function_name, -1,
+					   (gint64) (g_timer_elapsed (timer, NULL) * G_USEC_PER_SEC),
+					   (list != NULL) ? gs_app_list_length (list) : 0,
+					   error_local);
+
 	/* failed */
 	if (!ret) {
 		return gs_plugin_error_handle_failure (helper,
@@ -779,11 +790,10 @@ gs_plugin_loader_job_sorted_truncation (GsPluginJob *plugin_job,
 		GsPluginAction action = gs_plugin_job_get_action (plugin_job);
 		g_debug ("no ->sort_func() set for %s, using random!",
 			 gs_plugin_action_to_string (action));
-		gs_app_list_randomize (list);
+		gs_app_list_randomize_truncate (list, max_results);
 	} else {
-		gs_app_list_sort (list, sort_func, sort_func_data);
+		gs_app_list_sort_truncate (list, sort_func, sort_func_data, max_results);
 	}
-	gs_app_list_truncate (list, max_results);
 }
 
 static gboolean
@@ -1658,6 +1668,7 @@ gs_plugin_loader_open_plugin (GsPluginLoader *plugin_loader,
 	gs_plugin_set_language (plugin, plugin_loader->language);
 	gs_plugin_set_scale (plugin, gs_plugin_loader_get_scale (plugin_loader));
 	gs_plugin_set_network_monitor (plugin, plugin_loader->network_monitor);
+	gs_plugin_set_app_registry (plugin, plugin_loader->app_registry);
 	g_debug ("opened plugin %s: %s", filename, gs_plugin_get_name (plugin));
 
 	/* add to array */
@@ -2461,6 +2472,103 @@ gs_plugin_loader_setup_finish (GsPluginLoader  *plugin_loader,
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+static const gchar *
+get_job_name (GsPluginJob *plugin_job)
+{
+	GsPluginAction action = gs_plugin_job_get_action (plugin_job);
+
+	/* new-style jobs don’t have an action */
+	if (action != GS_PLUGIN_ACTION_UNKNOWN)
+		return gs_plugin_action_to_string (action);
+	return G_OBJECT_TYPE_NAME (plugin_job);
+}
+
+/**
+ * gs_plugin_loader_add_trace_record:
+ * @plugin_loader: a #GsPluginLoader
+ * @plugin_job: the #GsPluginJob being run
+ * @plugin: (nullable): the #GsPlugin which ran, or %NULL for the whole job
+ * @vfunc: (nullable): the plugin function which ran, or %NULL for the whole job
+ * @queue_wait_usec: how long @plugin_job waited before starting, or -1
+ * @run_usec: how long it ran for
+ * @n_apps: how many apps it returned or operated on
+ * @error: (nullable): the error it failed with, or %NULL on success
+ *
+ * Adds a record to the performance trace, which can be retrieved using
+ * gs_plugin_loader_dump_perf().
+ *
+ * This is thread-safe.
+ *
+ * Since: 44
+ **/
+void
+gs_plugin_loader_add_trace_record (GsPluginLoader *plugin_loader,
+				   GsPluginJob *plugin_job,
+				   GsPlugin *plugin,
+				   const gchar *vfunc,
+				   gint64 queue_wait_usec,
+				   gint64 run_usec,
+				   guint n_apps,
+				   const GError *error)
+{
+	gboolean cancelled;
+
+	g_return_if_fail (GS_IS_PLUGIN_LOADER (plugin_loader));
+	g_return_if_fail (GS_IS_PLUGIN_JOB (plugin_job));
+
+	cancelled = (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) ||
+		     g_error_matches (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_CANCELLED));
+	gs_perf_trace_add (plugin_loader->perf_trace,
+			   get_job_name (plugin_job),
+			   (plugin != NULL) ? gs_plugin_get_name (plugin) : NULL,
+			   vfunc,
+			   queue_wait_usec,
+			   run_usec,
+			   n_apps,
+			   cancelled,
+			   error != NULL && !cancelled);
+}
+
+static void
+add_job_trace_record (GsPluginLoader *plugin_loader,
+		      GsPluginJob *plugin_job,
+		      guint n_apps,
+		      const GError *error)
+{
+	gint64 time_started = gs_plugin_job_get_time_started (plugin_job);
+
+	/* the job failed before it started running */
+	if (time_started == 0)
+		return;
+
+	gs_plugin_loader_add_trace_record (plugin_loader, plugin_job, NULL, NULL,
+					   time_started - gs_plugin_job_get_time_created (plugin_job),
+					   g_get_monotonic_time () - time_started,
+					   n_apps, error);
+}
+
+/**
+ * gs_plugin_loader_dump_perf:
+ * @plugin_loader: a #GsPluginLoader
+ *
+ * Serialises the performance trace of the most recent jobs and plugin
+ * operations as JSON, along with p50/p95/p99 run times per plugin and per
+ * job type.
+ *
+ * Returns: (transfer full): a JSON string
+ * Since: 44
+ **/
+gchar *
+gs_plugin_loader_dump_perf (GsPluginLoader *plugin_loader)
+{
+	g_autoptr(JsonNode) root = NULL;
+
+	g_return_val_if_fail (GS_IS_PLUGIN_LOADER (plugin_loader), NULL);
+
+	root = gs_perf_trace_to_json (plugin_loader->perf_trace);
+	return json_to_string (root, TRUE);
+}
+
 void
 gs_plugin_loader_dump_state (GsPluginLoader *plugin_loader)
 {
@@ -2483,6 +2591,29 @@ gs_plugin_loader_dump_state (GsPluginLoader *plugin_loader)
 		g_string_truncate (str_disabled, str_disabled->len - 2);
 	g_info ("enabled plugins: %s", str_enabled->str);
 	g_info ("disabled plugins: %s", str_disabled->str);
+
+	/* report how much of the shared app registry each plugin is using */
+	for (guint i = 0; i < plugin_loader->plugins->len; i++) {
+		GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
+		guint n_apps, n_held;
+		gsize n_bytes;
+
+		if (!gs_plugin_cache_get_shared (plugin))
+			continue;
+
+		gs_app_registry_get_occupancy (plugin_loader->app_registry, plugin,
+					       &n_apps, &n_held, &n_bytes);
+		g_debug ("app registry: %s has %u apps, %u held using %" G_GSIZE_FORMAT " bytes",
+			 gs_plugin_get_name (plugin), n_apps, n_held, n_bytes);
+	}
+
+	{
+		guint64 hits, misses, evictions;
+
+		gs_app_registry_get_stats (plugin_loader->app_registry, &hits, &misses, &evictions);
+		g_debug ("app registry: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses, %" G_GUINT64_FORMAT " evictions",
+			 hits, misses, evictions);
+	}
 }
 
 static void
@@ -2589,6 +2720,8 @@ gs_plugin_loader_dispose (GObject *object)
 	g_clear_object (&plugin_loader->pending_apps);
 	g_clear_object (&plugin_loader->category_manager);
 	g_clear_object (&plugin_loader->odrs_provider);
+	g_clear_object (&plugin_loader->app_registry);
+	g_clear_object (&plugin_loader->perf_trace);
 	g_clear_object (&plugin_loader->setup_complete_cancellable);
 	g_clear_object (&plugin_loader->pending_apps_cancellable);
 
@@ -2755,6 +2888,13 @@ gs_plugin_loader_allow_updates_recheck (GsPluginLoader *plugin_loader)
 	}
 }
 
+static gsize
+get_app_registry_budget (GSettings *settings)
+{
+	/* the key is in MiB */
+	return (gsize) g_settings_get_uint (settings, "app-cache-size-maximum") * 1024 * 1024;
+}
+
 static void
 gs_plugin_loader_settings_changed_cb (GSettings *settings,
 				      const gchar *key,
@@ -2762,6 +2902,9 @@ gs_plugin_loader_settings_changed_cb (GSettings *settings,
 {
 	if (g_strcmp0 (key, "allow-updates") == 0)
 		gs_plugin_loader_allow_updates_recheck (plugin_loader);
+	else if (g_strcmp0 (key, "app-cache-size-maximum") == 0)
+		gs_app_registry_set_budget (plugin_loader->app_registry,
+					    get_app_registry_budget (settings));
 }
 
 static gint
@@ -2814,6 +2957,10 @@ gs_plugin_loader_init (GsPluginLoader *plugin_loader)
 	/* get the category manager */
 	plugin_loader->category_manager = gs_category_manager_new ();
 
+	/* shared between all the plugins which opt in to it */
+	plugin_loader->app_registry = gs_app_registry_new (get_app_registry_budget (plugin_loader->settings));
+	plugin_loader->perf_trace = gs_perf_trace_new (GS_PLUGIN_LOADER_PERF_TRACE_SIZE);
+
 	/* set up the ODRS provider */
 
 	/* get the machine+user ID hash value */
@@ -2955,6 +3102,137 @@ gs_plugin_loader_get_network_metered (GsPluginLoader *plugin_loader)
 	return g_network_monitor_get_network_metered (plugin_loader->network_monitor);
 }
 
+static void
+gs_plugin_loader_install_pending_apps (GsPluginLoader *plugin_loader,
+                                       GsAppList      *queue)
+{
+	for (guint i = 0; i < gs_app_list_length (queue); i++) {
+		GsApp *app = gs_app_list_index (queue, i);
+		g_autoptr(GsPluginJob) plugin_job = NULL;
+
+		if (gs_app_get_kind (app) == AS_COMPONENT_KIND_REPOSITORY) {
+			plugin_job = gs_plugin_job_manage_repository_new (app,
+									  GS_PLUGIN_MANAGE_REPOSITORY_FLAGS_INTERACTIVE |
+									  GS_PLUGIN_MANAGE_REPOSITORY_FLAGS_INSTALL);
+		} else {
+			/* The 'interactive' is needed for credentials prompt, otherwise it just fails */
+			plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_INSTALL,
+							 "app", app,
+							 "interactive", TRUE,
+							 NULL);
+		}
+
+		gs_plugin_loader_job_process_async (plugin_loader, plugin_job,
+						    gs_app_get_cancellable (app),
+						    gs_plugin_loader_app_installed_cb,
+						    g_object_ref (app));
+	}
+}
+
+/* Downloading for several pending apps at once is a single job, so cancelling
+ * the install of any of the apps cancels it; the other apps are then installed
+ * as usual, each downloading whatever it still needs. */
+typedef struct {
+	GsAppList *queue;  /* (owned) */
+	GCancellable *cancellable;  /* (owned); of the download job */
+	GPtrArray *app_cancellables;  /* (owned) (element-type GCancellable); one per app in @queue */
+	GArray *handler_ids;  /* (owned) (element-type gulong); one per app in @queue */
+	GCancellable *pending_apps_cancellable;  /* (owned) */
+	gulong pending_apps_handler_id;
+} PendingAppsPlanData;
+
+static void
+pending_apps_plan_data_free (PendingAppsPlanData *data)
+{
+	for (guint i = 0; i < data->app_cancellables->len; i++)
+		g_cancellable_disconnect (g_ptr_array_index (data->app_cancellables, i),
+					  g_array_index (data->handler_ids, gulong, i));
+	g_cancellable_disconnect (data->pending_apps_cancellable, data->pending_apps_handler_id);
+
+	g_object_unref (data->pending_apps_cancellable);
+	g_array_unref (data->handler_ids);
+	g_ptr_array_unref (data->app_cancellables);
+	g_object_unref (data->cancellable);
+	g_object_unref (data->queue);
+	g_free (data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PendingAppsPlanData, pending_apps_plan_data_free)
+
+static void
+pending_apps_plan_cancelled_cb (GCancellable *cancellable,
+                                gpointer      user_data)
+{
+	g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+
+static PendingAppsPlanData *
+pending_apps_plan_data_new (GsPluginLoader *plugin_loader,
+                            GsAppList      *queue)
+{
+	PendingAppsPlanData *data = g_new0 (PendingAppsPlanData, 1);
+
+	data->queue = g_object_ref (queue);
+	data->cancellable = g_cancellable_new ();
+	data->app_cancellables = g_ptr_array_new_with_free_func (g_object_unref);
+	data->handler_ids = g_array_new (FALSE, FALSE, sizeof (gulong));
+	data->pending_apps_cancellable = g_object_ref (plugin_loader->pending_apps_cancellable);
+	data->pending_apps_handler_id =
+		g_cancellable_connect (data->pending_apps_cancellable,
+				       G_CALLBACK (pending_apps_plan_cancelled_cb),
+				       data->cancellable, NULL);
+
+	for (guint i = 0; i < gs_app_list_length (queue); i++) {
+		GsApp *app = gs_app_list_index (queue, i);
+		GCancellable *app_cancellable = gs_app_get_cancellable (app);
+		gulong handler_id;
+
+		handler_id = g_cancellable_connect (app_cancellable,
+						    G_CALLBACK (pending_apps_plan_cancelled_cb),
+						    data->cancellable, NULL);
+		g_ptr_array_add (data->app_cancellables, g_object_ref (app_cancellable));
+		g_array_append_val (data->handler_ids, handler_id);
+	}
+
+	return data;
+}
+
+static void
+gs_plugin_loader_pending_apps_planned_cb (GObject      *source,
+                                          GAsyncResult *res,
+                                          gpointer      user_data)
+{
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source);
+	g_autoptr(PendingAppsPlanData) data = user_data;
+	g_autoptr(GsAppList) queue = gs_app_list_new ();
+	g_autoptr(GError) error = NULL;
+
+	if (!gs_plugin_loader_job_action_finish (plugin_loader, res, &error)) {
+		/* the whole queue is being cancelled */
+		if (g_cancellable_is_cancelled (data->pending_apps_cancellable))
+			return;
+
+		/* the installs download whatever is still missing */
+		g_debug ("failed to download pending apps: %s", error->message);
+	}
+
+	/* drop the apps whose install was cancelled meanwhile */
+	for (guint i = 0; i < gs_app_list_length (data->queue); i++) {
+		GsApp *app = gs_app_list_index (data->queue, i);
+
+		if (g_cancellable_is_cancelled (g_ptr_array_index (data->app_cancellables, i))) {
+			g_debug ("install of %s cancelled", gs_app_get_unique_id (app));
+			remove_app_from_install_queue (plugin_loader, app);
+			continue;
+		}
+		gs_app_list_add (queue, app);
+	}
+
+	gs_plugin_loader_install_pending_apps (plugin_loader, queue);
+
+	g_clear_object (&plugin_loader->pending_apps_cancellable);
+}
+
 static void
 gs_plugin_loader_pending_apps_refined_cb (GObject      *source,
                                           GAsyncResult *res,
@@ -2963,6 +3241,7 @@ gs_plugin_loader_pending_apps_refined_cb (GObject      *source,
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source);
 	g_autoptr(GsAppList) old_queue = GS_APP_LIST (user_data);
 	g_autoptr(GsAppList) refined_queue = NULL;
+	g_autoptr(GsAppList) apps = NULL;
 	g_autoptr(GError) error = NULL;
 
 	refined_queue = gs_plugin_loader_job_process_finish (plugin_loader, res, &error);
@@ -2988,28 +3267,34 @@ gs_plugin_loader_pending_apps_refined_cb (GObject      *source,
 			remove_app_from_install_queue (plugin_loader, app);
 	}
 
+	/* Installing the queued apps one by one would have each of them
+	 * resolve and download its runtime and extensions separately, so first
+	 * let the plugins download everything the apps need in one go; runtimes
+	 * and extensions shared between the apps are then fetched only once. */
+	apps = gs_app_list_new ();
 	for (guint i = 0; i < gs_app_list_length (refined_queue); i++) {
 		GsApp *app = gs_app_list_index (refined_queue, i);
+		if (gs_app_get_kind (app) != AS_COMPONENT_KIND_REPOSITORY)
+			gs_app_list_add (apps, app);
+	}
+	if (gs_app_list_length (apps) > 1) {
 		g_autoptr(GsPluginJob) plugin_job = NULL;
+		PendingAppsPlanData *data = pending_apps_plan_data_new (plugin_loader, refined_queue);
 
-		if (gs_app_get_kind (app) == AS_COMPONENT_KIND_REPOSITORY) {
-			plugin_job = gs_plugin_job_manage_repository_new (app,
-									  GS_PLUGIN_MANAGE_REPOSITORY_FLAGS_INTERACTIVE |
-									  GS_PLUGIN_MANAGE_REPOSITORY_FLAGS_INSTALL);
-		} else {
-			/* The 'interactive' is needed for credentials prompt, otherwise it just fails */
-			plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_INSTALL,
-							 "app", app,
-							 "interactive", TRUE,
-							 NULL);
-		}
-
+		/* interactive, like the installs themselves */
+		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_DOWNLOAD,
+						 "list", apps,
+						 "interactive", TRUE,
+						 NULL);
 		gs_plugin_loader_job_process_async (plugin_loader, plugin_job,
-						    gs_app_get_cancellable (app),
-						    gs_plugin_loader_app_installed_cb,
-						    g_object_ref (app));
+						    data->cancellable,
+						    gs_plugin_loader_pending_apps_planned_cb,
+						    data);
+		return;
 	}
 
+	gs_plugin_loader_install_pending_apps (plugin_loader, refined_queue);
+
 	g_clear_object (&plugin_loader->pending_apps_cancellable);
 }
 
@@ -3546,8 +3831,23 @@ gs_plugin_loader_process_in_thread_pool_cb (gpointer data,
 
 	gs_ioprio_set (G_PRIORITY_LOW);
 
+	gs_plugin_job_mark_started (helper->plugin_job);
 	gs_plugin_loader_process_thread_cb (task, source_object, task_data, cancellable);
 
+	if (g_task_had_error (task)) {
+		g_autoptr(GError) error_trace = NULL;
+
+		if (g_cancellable_is_cancelled (cancellable))
+			error_trace = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "cancelled");
+		else
+			error_trace = g_error_new_literal (GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_FAILED, "failed");
+		add_job_trace_record (source_object, helper->plugin_job, 0, error_trace);
+	} else {
+		add_job_trace_record (source_object, helper->plugin_job,
+				      gs_app_list_length (gs_plugin_job_get_list (helper->plugin_job)),
+				      NULL);
+	}
+
 	/* Clear any pending action set in gs_plugin_loader_schedule_task() */
 	if (app != NULL && gs_app_get_pending_action (app) == action)
 		gs_app_set_pending_action (app, GS_PLUGIN_ACTION_UNKNOWN);
@@ -3594,8 +3894,9 @@ run_job_cb (GObject      *source_object,
 	GsPluginJobClass *job_class;
 	g_autoptr(GTask) task = g_steal_pointer (&user_data);
 	g_autoptr(GError) local_error = NULL;
-#ifdef HAVE_SYSPROF
 	GsPluginLoader *plugin_loader = g_task_get_source_object (task);
+	GsAppList *list = NULL;
+#ifdef HAVE_SYSPROF
 	gint64 begin_time_nsec = GPOINTER_TO_SIZE (g_task_get_task_data (task));
 
 	if (plugin_loader->sysprof_writer != NULL) {
@@ -3619,20 +3920,25 @@ run_job_cb (GObject      *source_object,
 	g_assert (job_class->run_finish != NULL);
 
 	if (!job_class->run_finish (plugin_job, result, &local_error)) {
+		add_job_trace_record (plugin_loader, plugin_job, 0, local_error);
 		g_task_return_error (task, g_steal_pointer (&local_error));
 		return;
 	}
 
-	if (GS_IS_PLUGIN_JOB_REFINE (plugin_job)) {
-		GsAppList *list = gs_plugin_job_refine_get_result_list (GS_PLUGIN_JOB_REFINE (plugin_job));
-		g_task_return_pointer (task, g_object_ref (list), (GDestroyNotify) g_object_unref);
-		return;
-	} else if (GS_IS_PLUGIN_JOB_LIST_APPS (plugin_job)) {
-		GsAppList *list = gs_plugin_job_list_apps_get_result_list (GS_PLUGIN_JOB_LIST_APPS (plugin_job));
-		g_task_return_pointer (task, g_object_ref (list), (GDestroyNotify) g_object_unref);
-		return;
-	} else if (GS_IS_PLUGIN_JOB_LIST_DISTRO_UPGRADES (plugin_job)) {
-		GsAppList *list = gs_plugin_job_list_distro_upgrades_get_result_list (GS_PLUGIN_JOB_LIST_DISTRO_UPGRADES (plugin_job));
+	if (GS_IS_PLUGIN_JOB_REFINE (plugin_job))
+		list = gs_plugin_job_refine_get_result_list (GS_PLUGIN_JOB_REFINE (plugin_job));
+	else if (GS_IS_PLUGIN_JOB_LIST_APPS (plugin_job))
+		list = gs_plugin_job_list_apps_get_result_list (GS_PLUGIN_JOB_LIST_APPS (plugin_job));
+	else if (GS_IS_PLUGIN_JOB_LIST_DISTRO_UPGRADES (plugin_job))
+		list = gs_plugin_job_list_distro_upgrades_get_result_list (GS_PLUGIN_JOB_LIST_DISTRO_UPGRADES (plugin_job));
+
+	add_job_trace_record (plugin_loader, plugin_job,
+			      (list != NULL) ? gs_app_list_length (list) : 0,
+			      NULL);
+
+	if (GS_IS_PLUGIN_JOB_REFINE (plugin_job) ||
+	    GS_IS_PLUGIN_JOB_LIST_APPS (plugin_job) ||
+	    GS_IS_PLUGIN_JOB_LIST_DISTRO_UPGRADES (plugin_job)) {
 		g_task_return_pointer (task, g_object_ref (list), (GDestroyNotify) g_object_unref);
 		return;
 	} else if (GS_IS_PLUGIN_JOB_REFRESH_METADATA (plugin_job)) {
@@ -3806,6 +4112,7 @@ job_process_cb (GTask *task)
 		g_task_set_task_data (task, GSIZE_TO_POINTER (begin_time_nsec), NULL);
 #endif
 
+		gs_plugin_job_mark_started (plugin_job);
 		job_class->run_async (plugin_job, plugin_loader, cancellable,
 				      run_job_cb, g_object_ref (task));
 		return;
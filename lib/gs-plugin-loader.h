@@ -52,6 +52,15 @@ void		 gs_plugin_loader_shutdown		(GsPluginLoader	*plugin_loader,
 							 GCancellable	*cancellable);
 
 void		 gs_plugin_loader_dump_state		(GsPluginLoader	*plugin_loader);
+gchar		*gs_plugin_loader_dump_perf		(GsPluginLoader	*plugin_loader);
+void		 gs_plugin_loader_add_trace_record	(GsPluginLoader	*plugin_loader,
+							 GsPluginJob	*plugin_job,
+							 GsPlugin	*plugin,
+							 const gchar	*vfunc,
+							 gint64		 queue_wait_usec,
+							 gint64		 run_usec,
+							 guint		 n_apps,
+							 const GError	*error);
 gboolean	 gs_plugin_loader_get_enabled		(GsPluginLoader	*plugin_loader,
 							 const gchar	*plugin_name);
 void		 gs_plugin_loader_add_location		(GsPluginLoader	*plugin_loader,
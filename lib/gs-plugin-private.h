@@ -12,6 +12,7 @@
 #include <glib-object.h>
 #include <gmodule.h>
 
+#include "gs-app-registry.h"
 #include "gs-plugin.h"
 
 G_BEGIN_DECLS
@@ -50,5 +51,7 @@ void		 gs_plugin_interactive_dec		(GsPlugin	*plugin);
 gchar		*gs_plugin_refine_flags_to_string	(GsPluginRefineFlags refine_flags);
 void		 gs_plugin_set_network_monitor		(GsPlugin		*plugin,
 							 GNetworkMonitor	*monitor);
+void		 gs_plugin_set_app_registry		(GsPlugin		*plugin,
+							 GsAppRegistry		*app_registry);
 
 G_END_DECLS
@@ -37,6 +37,7 @@
 #include <string.h>
 
 #include "gs-app-list-private.h"
+#include "gs-app-registry.h"
 #include "gs-download-utils.h"
 #include "gs-enums.h"
 #include "gs-os-release.h"
@@ -48,6 +49,8 @@ typedef struct
 {
 	GHashTable		*cache;
 	GMutex			 cache_mutex;
+	gboolean		 cache_shared;
+	GsAppRegistry		*app_registry;  /* (owned) (nullable) */
 	GModule			*module;
 	GsPluginFlags		 flags;
 	GPtrArray		*rules[GS_PLUGIN_RULE_LAST];
@@ -253,6 +256,7 @@ gs_plugin_finalize (GObject *object)
 	if (priv->network_monitor != NULL)
 		g_object_unref (priv->network_monitor);
 	g_hash_table_unref (priv->cache);
+	g_clear_object (&priv->app_registry);
 	g_hash_table_unref (priv->vfuncs);
 	g_mutex_clear (&priv->cache_mutex);
 	g_mutex_clear (&priv->interactive_mutex);
@@ -1343,9 +1347,11 @@ gs_plugin_cache_lookup (GsPlugin *plugin, const gchar *key)
 
 	locker = g_mutex_locker_new (&priv->cache_mutex);
 	app = g_hash_table_lookup (priv->cache, key);
-	if (app == NULL)
-		return NULL;
-	return g_object_ref (app);
+	if (app != NULL)
+		return g_object_ref (app);
+	if (priv->cache_shared && priv->app_registry != NULL)
+		return gs_app_registry_lookup (priv->app_registry, plugin, key);
+	return NULL;
 }
 
 /**
@@ -1384,6 +1390,19 @@ gs_plugin_cache_lookup_by_state (GsPlugin *plugin,
 		    state == gs_app_get_state (app))
 			gs_app_list_add (list, app);
 	}
+
+	if (priv->cache_shared && priv->app_registry != NULL) {
+		g_autoptr(GsAppList) shared = gs_app_list_new ();
+
+		gs_app_registry_add_to_list (priv->app_registry, plugin, shared);
+		for (guint i = 0; i < gs_app_list_length (shared); i++) {
+			GsApp *app = gs_app_list_index (shared, i);
+
+			if (state == GS_APP_STATE_UNKNOWN ||
+			    state == gs_app_get_state (app))
+				gs_app_list_add (list, app);
+		}
+	}
 }
 
 /**
@@ -1406,6 +1425,8 @@ gs_plugin_cache_remove (GsPlugin *plugin, const gchar *key)
 
 	locker = g_mutex_locker_new (&priv->cache_mutex);
 	g_hash_table_remove (priv->cache, key);
+	if (priv->cache_shared && priv->app_registry != NULL)
+		gs_app_registry_remove (priv->app_registry, plugin, key);
 }
 
 /**
@@ -1442,6 +1463,15 @@ gs_plugin_cache_add (GsPlugin *plugin, const gchar *key, GsApp *app)
 
 	g_return_if_fail (key != NULL);
 
+	/* apps keyed by their unique ID go in the loader-wide registry, if
+	 * the plugin has opted in to it */
+	if (priv->cache_shared && priv->app_registry != NULL &&
+	    g_strcmp0 (key, gs_app_get_unique_id (app)) == 0) {
+		g_hash_table_remove (priv->cache, key);
+		gs_app_registry_add (priv->app_registry, plugin, app);
+		return;
+	}
+
 	if (g_hash_table_lookup (priv->cache, key) == app)
 		return;
 	g_hash_table_insert (priv->cache, g_strdup (key), g_object_ref (app));
@@ -1471,6 +1501,83 @@ gs_plugin_cache_invalidate (GsPlugin *plugin)
 
 	locker = g_mutex_locker_new (&priv->cache_mutex);
 	g_hash_table_remove_all (priv->cache);
+	if (priv->app_registry != NULL)
+		gs_app_registry_remove_all (priv->app_registry, plugin);
+}
+
+/**
+ * gs_plugin_cache_set_shared:
+ * @plugin: a #GsPlugin
+ * @shared: %TRUE to use the shared app registry
+ *
+ * Opts the plugin in to (or out of) the app registry shared by all plugins
+ * of the #GsPluginLoader.
+ *
+ * While opted in, apps added with gs_plugin_cache_add() using their unique ID
+ * as the key (or a %NULL key) are stored in the shared registry, which keeps
+ * them only weakly referenced once they fall out of its memory budget. Apps
+ * added with any other key continue to be stored in the per-plugin cache.
+ * Lookups in the shared registry allow wildcards in the unique ID, just as
+ * in the per-plugin cache.
+ *
+ * This should be called from the plugin’s constructor or setup function,
+ * before anything is added to the cache.
+ *
+ * Since: 44
+ **/
+void
+gs_plugin_cache_set_shared (GsPlugin *plugin, gboolean shared)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+
+	locker = g_mutex_locker_new (&priv->cache_mutex);
+	priv->cache_shared = shared;
+}
+
+/**
+ * gs_plugin_cache_get_shared:
+ * @plugin: a #GsPlugin
+ *
+ * Gets whether the plugin has opted in to the shared app registry using
+ * gs_plugin_cache_set_shared().
+ *
+ * Returns: %TRUE if the shared registry is used
+ *
+ * Since: 44
+ **/
+gboolean
+gs_plugin_cache_get_shared (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+
+	g_return_val_if_fail (GS_IS_PLUGIN (plugin), FALSE);
+
+	return priv->cache_shared;
+}
+
+/**
+ * gs_plugin_set_app_registry:
+ * @plugin: a #GsPlugin
+ * @app_registry: (nullable): the loader-wide #GsAppRegistry
+ *
+ * Sets the registry to use for cached apps once the plugin has opted in with
+ * gs_plugin_cache_set_shared().
+ *
+ * Since: 44
+ **/
+void
+gs_plugin_set_app_registry (GsPlugin *plugin, GsAppRegistry *app_registry)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+
+	locker = g_mutex_locker_new (&priv->cache_mutex);
+	g_set_object (&priv->app_registry, app_registry);
 }
 
 /**
@@ -2087,6 +2194,7 @@ gs_plugin_update_cache_state_for_repository (GsPlugin *plugin,
 	GHashTableIter iter;
 	g_autoptr(GMutexLocker) locker = NULL;
 	g_autoptr(GsPlugin) repo_plugin = NULL;
+	g_autoptr(GPtrArray) apps = g_ptr_array_new_with_free_func (g_object_unref);
 	gpointer value;
 	const gchar *repo_id;
 	GsAppState repo_state;
@@ -2102,8 +2210,19 @@ gs_plugin_update_cache_state_for_repository (GsPlugin *plugin,
 	locker = g_mutex_locker_new (&priv->cache_mutex);
 
 	g_hash_table_iter_init (&iter, priv->cache);
-	while (g_hash_table_iter_next (&iter, NULL, &value)) {
-		GsApp *app = value;
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		g_ptr_array_add (apps, g_object_ref (value));
+
+	if (priv->cache_shared && priv->app_registry != NULL) {
+		g_autoptr(GsAppList) shared = gs_app_list_new ();
+
+		gs_app_registry_add_to_list (priv->app_registry, plugin, shared);
+		for (guint i = 0; i < gs_app_list_length (shared); i++)
+			g_ptr_array_add (apps, g_object_ref (gs_app_list_index (shared, i)));
+	}
+
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
 		GsAppState app_state = gs_app_get_state (app);
 		g_autoptr(GsPlugin) app_plugin = gs_app_dup_management_plugin (app);
 
@@ -274,6 +274,9 @@ void		 gs_plugin_cache_add			(GsPlugin	*plugin,
 void		 gs_plugin_cache_remove			(GsPlugin	*plugin,
 							 const gchar	*key);
 void		 gs_plugin_cache_invalidate		(GsPlugin	*plugin);
+void		 gs_plugin_cache_set_shared		(GsPlugin	*plugin,
+							 gboolean	 shared);
+gboolean	 gs_plugin_cache_get_shared		(GsPlugin	*plugin);
 void		 gs_plugin_status_update		(GsPlugin	*plugin,
 							 GsApp		*app,
 							 GsPluginStatus	 status);
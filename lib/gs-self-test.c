@@ -12,6 +12,7 @@
 #include "gnome-software-private.h"
 
 #include "gs-debug.h"
+#include "gs-perf-trace.h"
 #include "gs-test.h"
 
 static gboolean
@@ -736,6 +737,106 @@ gs_app_list_performance_func (void)
 	g_print ("%.2fms ", g_timer_elapsed (timer, NULL) * 1000);
 }
 
+static void
+gs_app_list_filter_duplicates_performance_func (void)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	const guint n_apps = 20000;
+
+	if (!g_test_perf ()) {
+		g_test_skip ("Only run in performance mode (-m perf)");
+		return;
+	}
+
+	/* create apps where roughly half are duplicates by ID, with a spread
+	 * of sources, versions and provided IDs, and a unique ID each */
+	for (guint i = 0; i < n_apps; i++) {
+		g_autofree gchar *id = g_strdup_printf ("org.example.App%05u", i % (n_apps / 2));
+		g_autofree gchar *unique_id = g_strdup_printf ("system/package/repo%u/%s/stable",
+							       i % 3, id);
+		g_autofree gchar *source = g_strdup_printf ("app%05u", i % (n_apps / 2));
+		g_autofree gchar *version = g_strdup_printf ("1.%u", i % 5);
+		g_autoptr(GsApp) app = gs_app_new (id);
+
+		gs_app_set_unique_id (app, unique_id);
+		gs_app_add_source (app, source);
+		gs_app_set_version (app, version);
+		gs_app_set_priority (app, i % 7);
+		if (i % 4 == 0) {
+			g_autofree gchar *provided = g_strdup_printf ("app%05u.desktop", i % (n_apps / 4));
+			gs_app_add_provided_item (app, AS_PROVIDED_KIND_ID, provided);
+		}
+		if (i % 2 == 0)
+			gs_app_set_state (app, GS_APP_STATE_INSTALLED);
+		else
+			gs_app_set_state (app, GS_APP_STATE_AVAILABLE);
+
+		gs_app_list_add (list, app);
+	}
+	g_assert_cmpuint (gs_app_list_length (list), ==, n_apps);
+
+	/* try every combination of filter flags */
+	for (guint64 flags = 0; flags < (GS_APP_LIST_FILTER_FLAG_KEY_ID_PROVIDES << 1); flags++) {
+		g_autoptr(GsAppList) copy = gs_app_list_copy (list);
+		g_autoptr(GTimer) timer = g_timer_new ();
+
+		gs_app_list_filter_duplicates (copy, flags);
+		g_test_minimized_result (g_timer_elapsed (timer, NULL),
+					 "filter_duplicates (0x%02" G_GINT64_MODIFIER "x): %u → %u apps in %.2fms",
+					 flags, n_apps, gs_app_list_length (copy),
+					 g_timer_elapsed (timer, NULL) * 1000);
+		g_assert_cmpuint (gs_app_list_length (copy), <=, n_apps);
+	}
+}
+
+static gint
+gs_app_list_sort_by_id_cb (GsApp *app1, GsApp *app2, gpointer user_data)
+{
+	return g_strcmp0 (gs_app_get_id (app1), gs_app_get_id (app2));
+}
+
+static void
+gs_app_list_sort_truncate_func (void)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsAppList) expected = NULL;
+	g_autoptr(GsAppList) random = NULL;
+
+	/* lots of ties, so the order of equal apps is checked too */
+	for (guint i = 0; i < 200; i++) {
+		g_autofree gchar *id = g_strdup_printf ("app%02u", (i * 37) % 13);
+		g_autofree gchar *unique_id = g_strdup_printf ("*/*/*/app%02u/%u", (i * 37) % 13, i);
+		g_autoptr(GsApp) app = gs_app_new (id);
+		gs_app_set_unique_id (app, unique_id);
+		gs_app_list_add (list, app);
+	}
+
+	expected = gs_app_list_copy (list);
+	gs_app_list_sort (expected, gs_app_list_sort_by_id_cb, NULL);
+	gs_app_list_truncate (expected, 20);
+
+	gs_app_list_sort_truncate (list, gs_app_list_sort_by_id_cb, NULL, 20);
+	g_assert_cmpuint (gs_app_list_length (list), ==, 20);
+	g_assert_true (gs_app_list_has_flag (list, GS_APP_LIST_FLAG_IS_TRUNCATED));
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		g_assert_true (gs_app_list_index (list, i) ==
+			       gs_app_list_index (expected, i));
+	}
+
+	/* random selection keeps distinct apps */
+	random = gs_app_list_copy (expected);
+	gs_app_list_randomize_truncate (random, 5);
+	g_assert_cmpuint (gs_app_list_length (random), ==, 5);
+	for (guint i = 0; i < gs_app_list_length (random); i++) {
+		for (guint j = i + 1; j < gs_app_list_length (random); j++)
+			g_assert_true (gs_app_list_index (random, i) != gs_app_list_index (random, j));
+	}
+
+	/* longer than the list */
+	gs_app_list_randomize_truncate (random, 10);
+	g_assert_cmpuint (gs_app_list_length (random), ==, 5);
+}
+
 static void
 gs_app_list_related_func (void)
 {
@@ -756,6 +857,139 @@ gs_app_list_related_func (void)
 	g_assert_cmpint (gs_app_list_get_progress (list), ==, 50);
 }
 
+static void
+gs_app_registry_func (void)
+{
+	g_autoptr(GsAppRegistry) registry = gs_app_registry_new (1024 * 1024);
+	g_autoptr(GsApp) app = NULL;
+	g_autoptr(GsApp) app_weak = NULL;
+	g_autofree gchar *unique_id = NULL;
+	guint n_apps = 0, n_held = 0;
+	guint64 hits = 0, misses = 0, evictions = 0;
+
+	/* held by the LRU tier once the caller drops its reference */
+	app = gs_app_new ("a");
+	unique_id = g_strdup (gs_app_get_unique_id (app));
+	gs_app_registry_add (registry, NULL, app);
+	g_clear_object (&app);
+	app = gs_app_registry_lookup (registry, NULL, unique_id);
+	g_assert_nonnull (app);
+	g_assert_cmpstr (gs_app_get_id (app), ==, "a");
+	gs_app_registry_get_occupancy (registry, NULL, &n_apps, &n_held, NULL);
+	g_assert_cmpuint (n_apps, ==, 1);
+	g_assert_cmpuint (n_held, ==, 1);
+
+	/* dropping the budget evicts it, but it is still reachable while
+	 * referenced elsewhere */
+	gs_app_registry_set_budget (registry, 0);
+	gs_app_registry_get_occupancy (registry, NULL, &n_apps, &n_held, NULL);
+	g_assert_cmpuint (n_held, ==, 0);
+	app_weak = gs_app_registry_lookup (registry, NULL, unique_id);
+	g_assert_true (app_weak == app);
+	g_clear_object (&app_weak);
+
+	/* and gone once the last reference is */
+	g_clear_object (&app);
+	app = gs_app_registry_lookup (registry, NULL, unique_id);
+	g_assert_null (app);
+
+	gs_app_registry_get_stats (registry, &hits, &misses, &evictions);
+	g_assert_cmpuint (hits, ==, 2);
+	g_assert_cmpuint (misses, ==, 1);
+	g_assert_cmpuint (evictions, ==, 1);
+}
+
+static void
+gs_perf_trace_func (void)
+{
+	g_autoptr(GsPerfTrace) trace = gs_perf_trace_new (100);
+	g_autoptr(JsonNode) root = NULL;
+	JsonObject *obj, *agg;
+	JsonArray *records;
+
+	/* the oldest records are overwritten once it wraps */
+	for (guint i = 1; i <= 150; i++)
+		gs_perf_trace_add (trace, "refine", "dummy", "refine_async", -1, i, 1, FALSE, FALSE);
+	gs_perf_trace_add (trace, "refine", NULL, NULL, 5, 1000, 2, TRUE, FALSE);
+	g_assert_cmpuint (gs_perf_trace_get_length (trace), ==, 100);
+
+	root = gs_perf_trace_to_json (trace);
+	obj = json_node_get_object (root);
+	records = json_object_get_array_member (obj, "records");
+	g_assert_cmpuint (json_array_get_length (records), ==, 100);
+	g_assert_cmpint (json_object_get_int_member (json_array_get_object_element (records, 0), "run_usec"), ==, 52);
+	g_assert_true (json_object_get_boolean_member (json_array_get_object_element (records, 99), "cancelled"));
+
+	/* nearest-rank percentiles of 52…150 */
+	agg = json_object_get_object_member (json_object_get_object_member (obj, "plugins"), "dummy");
+	g_assert_cmpint (json_object_get_int_member (agg, "count"), ==, 99);
+	g_assert_cmpint (json_object_get_int_member (agg, "p50_usec"), ==, 101);
+	g_assert_cmpint (json_object_get_int_member (agg, "p95_usec"), ==, 146);
+	g_assert_cmpint (json_object_get_int_member (agg, "p99_usec"), ==, 150);
+	agg = json_object_get_object_member (json_object_get_object_member (obj, "jobs"), "refine");
+	g_assert_cmpint (json_object_get_int_member (agg, "count"), ==, 1);
+	g_assert_cmpint (json_object_get_int_member (agg, "cancelled"), ==, 1);
+
+	gs_perf_trace_clear (trace);
+	g_assert_cmpuint (gs_perf_trace_get_length (trace), ==, 0);
+}
+
+/* #GsPlugin is abstract, so the cache tests need a trivial subclass */
+typedef GsPlugin GsPluginSelfTest;
+typedef GsPluginClass GsPluginSelfTestClass;
+
+G_DEFINE_TYPE (GsPluginSelfTest, gs_plugin_self_test, GS_TYPE_PLUGIN)
+
+static void
+gs_plugin_self_test_class_init (GsPluginSelfTestClass *klass)
+{
+}
+
+static void
+gs_plugin_self_test_init (GsPluginSelfTest *self)
+{
+}
+
+static void
+gs_app_registry_wildcard_func (void)
+{
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GDBusConnection) bus_connection = NULL;
+	g_autoptr(GsAppRegistry) registry = gs_app_registry_new (1024 * 1024);
+	g_autoptr(GsPlugin) plugin = NULL;
+	g_autoptr(GsApp) app = NULL;
+	g_autoptr(GsApp) app_found = NULL;
+
+	bus_connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+	g_assert_no_error (error);
+
+	plugin = g_object_new (gs_plugin_self_test_get_type (),
+			       "session-bus-connection", bus_connection,
+			       "system-bus-connection", bus_connection,
+			       NULL);
+	gs_plugin_set_name (plugin, "self-test");
+	gs_plugin_cache_set_shared (plugin, TRUE);
+	gs_plugin_set_app_registry (plugin, registry);
+
+	/* cached under its full unique ID, so it goes in the registry */
+	app = gs_app_new ("org.gnome.Platform");
+	gs_app_set_scope (app, AS_COMPONENT_SCOPE_SYSTEM);
+	gs_app_set_bundle_kind (app, AS_BUNDLE_KIND_FLATPAK);
+	gs_app_set_branch (app, "44");
+	gs_plugin_cache_add (plugin, NULL, app);
+
+	/* an unknown scope is a wildcard, as used for runtimes */
+	app_found = gs_plugin_cache_lookup (plugin, "*/flatpak/*/org.gnome.Platform/44");
+	g_assert_true (app_found == app);
+	g_clear_object (&app_found);
+
+	/* but the other parts must still match */
+	app_found = gs_plugin_cache_lookup (plugin, "*/flatpak/*/org.gnome.Platform/43");
+	g_assert_null (app_found);
+	app_found = gs_plugin_cache_lookup (plugin, "user/flatpak/*/org.gnome.Platform/44");
+	g_assert_null (app_found);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -778,7 +1012,12 @@ main (int argc, char **argv)
 	g_test_add_func ("/gnome-software/lib/app{list}", gs_app_list_func);
 	g_test_add_func ("/gnome-software/lib/app{list-wildcard-dedupe}", gs_app_list_wildcard_dedupe_func);
 	g_test_add_func ("/gnome-software/lib/app{list-performance}", gs_app_list_performance_func);
+	g_test_add_func ("/gnome-software/lib/app{list-filter-duplicates-performance}", gs_app_list_filter_duplicates_performance_func);
 	g_test_add_func ("/gnome-software/lib/app{list-related}", gs_app_list_related_func);
+	g_test_add_func ("/gnome-software/lib/app{list-sort-truncate}", gs_app_list_sort_truncate_func);
+	g_test_add_func ("/gnome-software/lib/app{registry}", gs_app_registry_func);
+	g_test_add_func ("/gnome-software/lib/app{registry-wildcard}", gs_app_registry_wildcard_func);
+	g_test_add_func ("/gnome-software/lib/perf-trace", gs_perf_trace_func);
 	g_test_add_func ("/gnome-software/lib/plugin", gs_plugin_func);
 	g_test_add_func ("/gnome-software/lib/plugin{download-rewrite}", gs_plugin_download_rewrite_func);
 
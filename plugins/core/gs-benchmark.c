@@ -0,0 +1,370 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/* Benchmarks the appstream plugin against a large synthetic catalog.
+ *
+ * This is run by `meson test --benchmark`. It generates a catalog of the
+ * requested number of components, then times compiling it into a silo
+ * (which happens in gs_plugin_appstream_check_silo() as the plugin is set
+ * up), and a number of iterations of searching, category sizing, refining
+ * and listing featured, popular and recent apps.
+ *
+ * The results are printed as one JSON object per line, with a fixed set of
+ * keys, so they can be compared between runs. */
+
+#include "config.h"
+
+#include <json-glib/json-glib.h>
+
+#include "gnome-software-private.h"
+
+#include "gs-test.h"
+
+static const gchar * const allowlist[] = {
+	"appstream",
+	NULL
+};
+
+static const gchar *categories[][2] = {
+	{ "AudioVideo", "Player" },
+	{ "Development", "IDE" },
+	{ "Education", "Math" },
+	{ "Game", "StrategyGame" },
+	{ "Graphics", "Photography" },
+	{ "Network", "WebBrowser" },
+	{ "Office", "WordProcessor" },
+	{ "Science", "Astronomy" },
+	{ "System", "Monitor" },
+	{ "Utility", "TextEditor" },
+};
+
+static const gchar *words[] = {
+	"editor", "player", "viewer", "manager", "browser", "music", "video",
+	"photo", "chat", "mail", "game", "office", "notes", "terminal",
+	"calendar", "maps", "weather", "backup", "download", "code", "draw",
+	"paint", "audio", "podcast", "reader", "scanner", "camera", "clock",
+};
+
+/* a skewed random index in [0, n), so a few values are much more common */
+static guint
+skewed_index (GRand *rand, guint n)
+{
+	gdouble r = g_rand_double (rand);
+	return MIN ((guint) (r * r * n), n - 1);
+}
+
+static gchar *
+generate_corpus (guint n_components)
+{
+	g_autoptr(GRand) rand = g_rand_new_with_seed (0);
+	GString *xml = g_string_sized_new (n_components * 1536);
+	guint64 now = (guint64) g_get_real_time () / G_USEC_PER_SEC;
+
+	g_string_append (xml, "<?xml version=\"1.0\"?>\n"
+			 "<components origin=\"synthetic\" version=\"0.14\">\n");
+	for (guint i = 0; i < n_components; i++) {
+		const gchar *word = words[skewed_index (rand, G_N_ELEMENTS (words))];
+		const gchar **category = categories[skewed_index (rand, G_N_ELEMENTS (categories))];
+
+		g_string_append_printf (xml,
+					"  <component type=\"desktop\">\n"
+					"    <id>org.example.App%u.desktop</id>\n"
+					"    <name>%s %u</name>\n"
+					"    <summary>A synthetic %s</summary>\n"
+					"    <description><p>This is a synthetic %s, number %u, "
+					"which is only used for benchmarking.</p><ul><li>Feature one</li>"
+					"<li>Feature two</li></ul></description>\n"
+					"    <pkgname>app%u</pkgname>\n"
+					"    <project_license>GPL-2.0+</project_license>\n"
+					"    <icon type=\"stock\">application-x-executable</icon>\n"
+					"    <url type=\"homepage\">https://example.org/app%u</url>\n"
+					"    <categories><category>%s</category><category>%s</category></categories>\n"
+					"    <keywords><keyword>%s</keyword><keyword>%s</keyword></keywords>\n"
+					"    <screenshots>\n",
+					i, word, i, word, word, i, i, i,
+					category[0], category[1],
+					word, words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))]);
+		for (guint j = 0; j < 3; j++) {
+			g_string_append_printf (xml,
+						"      <screenshot%s><caption>Screenshot %u</caption>"
+						"<image type=\"source\" width=\"1600\" height=\"900\">https://example.org/app%u/%u.png</image>"
+						"<image type=\"thumbnail\" width=\"624\" height=\"351\">https://example.org/app%u/%u-thumb.png</image>"
+						"</screenshot>\n",
+						(j == 0) ? " type=\"default\"" : "", j, i, j, i, j);
+		}
+		g_string_append (xml, "    </screenshots>\n    <releases>\n");
+		for (guint j = 0; j < 3; j++) {
+			/* about 5% were released in the last 30 days */
+			guint64 age = (j == 0 && g_rand_int_range (rand, 0, 100) < 5) ?
+				g_rand_int_range (rand, 0, 30 * 24 * 60 * 60) :
+				(guint64) (j + 1) * 60 * 24 * 60 * 60 + g_rand_int_range (rand, 0, 24 * 60 * 60);
+			g_string_append_printf (xml,
+						"      <release version=\"1.%u\" timestamp=\"%" G_GUINT64_FORMAT "\">"
+						"<description><p>Release 1.%u fixes some bugs.</p></description></release>\n",
+						3 - j, now - age, 3 - j);
+		}
+		g_string_append (xml, "    </releases>\n");
+		if (g_rand_int_range (rand, 0, 100) < 5)
+			g_string_append (xml, "    <kudos><kudo>GnomeSoftware::popular</kudo></kudos>\n");
+		if (g_rand_int_range (rand, 0, 100) < 1)
+			g_string_append (xml, "    <custom><value key=\"GnomeSoftware::FeatureTile\">True</value></custom>\n");
+		g_string_append (xml, "  </component>\n");
+	}
+	g_string_append (xml, "  <info><scope>user</scope></info>\n</components>\n");
+
+	return g_string_free (xml, FALSE);
+}
+
+static gint
+sort_double_cb (gconstpointer a, gconstpointer b)
+{
+	gdouble a_val = *((const gdouble *) a);
+	gdouble b_val = *((const gdouble *) b);
+	return (a_val < b_val) ? -1 : (a_val > b_val) ? 1 : 0;
+}
+
+static void
+print_result (const gchar *name,
+	      guint        n_components,
+	      GArray      *times,
+	      guint        n_results)
+{
+	g_autoptr(JsonBuilder) builder = json_builder_new ();
+	g_autoptr(JsonGenerator) generator = json_generator_new ();
+	g_autoptr(JsonNode) root = NULL;
+	g_autofree gchar *str = NULL;
+	gdouble sum = 0.0;
+
+	g_array_sort (times, sort_double_cb);
+	for (guint i = 0; i < times->len; i++)
+		sum += g_array_index (times, gdouble, i);
+
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "benchmark");
+	json_builder_add_string_value (builder, name);
+	json_builder_set_member_name (builder, "components");
+	json_builder_add_int_value (builder, n_components);
+	json_builder_set_member_name (builder, "iterations");
+	json_builder_add_int_value (builder, times->len);
+	json_builder_set_member_name (builder, "results");
+	json_builder_add_int_value (builder, n_results);
+	json_builder_set_member_name (builder, "min_ms");
+	json_builder_add_double_value (builder, g_array_index (times, gdouble, 0));
+	json_builder_set_member_name (builder, "median_ms");
+	json_builder_add_double_value (builder, g_array_index (times, gdouble, times->len / 2));
+	json_builder_set_member_name (builder, "mean_ms");
+	json_builder_add_double_value (builder, sum / times->len);
+	json_builder_set_member_name (builder, "max_ms");
+	json_builder_add_double_value (builder, g_array_index (times, gdouble, times->len - 1));
+	json_builder_end_object (builder);
+
+	root = json_builder_get_root (builder);
+	json_generator_set_root (generator, root);
+	str = json_generator_to_data (generator, NULL);
+	g_print ("%s\n", str);
+}
+
+typedef enum {
+	BENCHMARK_SEARCH,
+	BENCHMARK_CATEGORIES,
+	BENCHMARK_REFINE,
+	BENCHMARK_FEATURED,
+	BENCHMARK_POPULAR,
+	BENCHMARK_RECENT,
+	BENCHMARK_LAST
+} Benchmark;
+
+static const gchar *
+benchmark_to_string (Benchmark benchmark)
+{
+	if (benchmark == BENCHMARK_SEARCH)
+		return "search";
+	if (benchmark == BENCHMARK_CATEGORIES)
+		return "category-sizes";
+	if (benchmark == BENCHMARK_REFINE)
+		return "refine";
+	if (benchmark == BENCHMARK_FEATURED)
+		return "list-apps-featured";
+	if (benchmark == BENCHMARK_POPULAR)
+		return "list-apps-popular";
+	if (benchmark == BENCHMARK_RECENT)
+		return "list-apps-recent";
+	return NULL;
+}
+
+/* returns the number of results */
+static guint
+run_benchmark (GsPluginLoader *plugin_loader,
+	       Benchmark       benchmark,
+	       guint           n_components)
+{
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+	g_autoptr(GsAppQuery) query = NULL;
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GError) error = NULL;
+
+	switch (benchmark) {
+	case BENCHMARK_SEARCH: {
+		const gchar *keywords[] = { "photo", NULL };
+		query = gs_app_query_new ("keywords", keywords,
+					  "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+					  "dedupe-flags", GS_PLUGIN_JOB_DEDUPE_FLAGS_DEFAULT,
+					  "sort-func", gs_utils_app_sort_match_value,
+					  NULL);
+		break;
+	}
+	case BENCHMARK_CATEGORIES: {
+		GPtrArray *result;
+		gboolean ret;
+
+		plugin_job = gs_plugin_job_list_categories_new (GS_PLUGIN_REFINE_CATEGORIES_FLAGS_SIZE);
+		ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+		gs_test_flush_main_context ();
+		g_assert_no_error (error);
+		g_assert_true (ret);
+		result = gs_plugin_job_list_categories_get_result_list (GS_PLUGIN_JOB_LIST_CATEGORIES (plugin_job));
+		return result->len;
+	}
+	case BENCHMARK_REFINE: {
+		g_autoptr(GsAppList) apps = gs_app_list_new ();
+		GsAppList *result;
+		gboolean ret;
+
+		/* a page of apps, spread across the catalog */
+		for (guint i = 0; i < 100; i++) {
+			g_autofree gchar *id = g_strdup_printf ("org.example.App%u.desktop", (i * 7919) % n_components);
+			g_autoptr(GsApp) app = gs_app_new (id);
+			gs_app_list_add (apps, app);
+		}
+		plugin_job = gs_plugin_job_refine_new (apps,
+						       GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON |
+						       GS_PLUGIN_REFINE_FLAGS_REQUIRE_DESCRIPTION |
+						       GS_PLUGIN_REFINE_FLAGS_REQUIRE_SCREENSHOTS |
+						       GS_PLUGIN_REFINE_FLAGS_REQUIRE_CATEGORIES |
+						       GS_PLUGIN_REFINE_FLAGS_REQUIRE_VERSION |
+						       GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE |
+						       GS_PLUGIN_REFINE_FLAGS_REQUIRE_URL);
+		ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+		gs_test_flush_main_context ();
+		g_assert_no_error (error);
+		g_assert_true (ret);
+		result = gs_plugin_job_refine_get_result_list (GS_PLUGIN_JOB_REFINE (plugin_job));
+		return gs_app_list_length (result);
+	}
+	case BENCHMARK_FEATURED:
+		query = gs_app_query_new ("is-featured", GS_APP_QUERY_TRISTATE_TRUE,
+					  "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+					  "dedupe-flags", GS_PLUGIN_JOB_DEDUPE_FLAGS_DEFAULT,
+					  NULL);
+		break;
+	case BENCHMARK_POPULAR:
+		query = gs_app_query_new ("is-curated", GS_APP_QUERY_TRISTATE_TRUE,
+					  "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+					  "dedupe-flags", GS_PLUGIN_JOB_DEDUPE_FLAGS_DEFAULT,
+					  NULL);
+		break;
+	case BENCHMARK_RECENT: {
+		g_autoptr(GDateTime) now = g_date_time_new_now_local ();
+		g_autoptr(GDateTime) released_since = g_date_time_add_days (now, -30);
+		query = gs_app_query_new ("released-since", released_since,
+					  "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+					  "dedupe-flags", GS_PLUGIN_JOB_DEDUPE_FLAGS_DEFAULT,
+					  NULL);
+		break;
+	}
+	default:
+		g_assert_not_reached ();
+	}
+
+	plugin_job = gs_plugin_job_list_apps_new (query, GS_PLUGIN_LIST_APPS_FLAGS_NONE);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_nonnull (list);
+	return gs_app_list_length (list);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_autofree gchar *tmp_root = NULL;
+	g_autofree gchar *xml = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GOptionContext) context = NULL;
+	g_autoptr(GsPluginLoader) plugin_loader = NULL;
+	g_autoptr(GTimer) timer = NULL;
+	g_autoptr(GArray) times = NULL;
+	gint n_components = 10000;
+	gint iterations = 5;
+	gboolean verbose = FALSE;
+	gboolean ret;
+	gdouble elapsed;
+	const GOptionEntry options[] = {
+		{ "components", '\0', 0, G_OPTION_ARG_INT, &n_components,
+		  "Number of components in the synthetic catalog", NULL },
+		{ "iterations", '\0', 0, G_OPTION_ARG_INT, &iterations,
+		  "Number of times to run each benchmark", NULL },
+		{ "verbose", '\0', 0, G_OPTION_ARG_NONE, &verbose,
+		  "Show debug output", NULL },
+		{ NULL }
+	};
+
+	/* isolates the benchmark from the user’s directories */
+	gs_test_init (&argc, &argv);
+	if (!verbose)
+		g_unsetenv ("G_MESSAGES_DEBUG");
+
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, options, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("Failed to parse options: %s\n", error->message);
+		return EXIT_FAILURE;
+	}
+	n_components = MAX (n_components, 1);
+	iterations = MAX (iterations, 1);
+
+	tmp_root = g_dir_make_tmp ("gnome-software-core-benchmark-XXXXXX", NULL);
+	g_assert_nonnull (tmp_root);
+	g_setenv ("GS_SELF_TEST_CACHEDIR", tmp_root, TRUE);
+
+	xml = generate_corpus (n_components);
+	g_setenv ("GS_SELF_TEST_APPSTREAM_XML", xml, TRUE);
+	g_clear_pointer (&xml, g_free);
+
+	/* the silo is compiled in gs_plugin_appstream_check_silo() during
+	 * setup, and only once per process */
+	times = g_array_new (FALSE, FALSE, sizeof (gdouble));
+	plugin_loader = gs_plugin_loader_new (NULL, NULL);
+	gs_plugin_loader_add_location (plugin_loader, LOCALPLUGINDIR);
+	timer = g_timer_new ();
+	ret = gs_plugin_loader_setup (plugin_loader, allowlist, NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	elapsed = g_timer_elapsed (timer, NULL) * 1000.0;
+	g_array_append_val (times, elapsed);
+	print_result ("silo-compile", n_components, times, n_components);
+
+	for (Benchmark benchmark = 0; benchmark < BENCHMARK_LAST; benchmark++) {
+		guint n_results = 0;
+
+		g_array_set_size (times, 0);
+		for (gint i = 0; i < iterations; i++) {
+			gs_plugin_loader_clear_caches (plugin_loader);
+			g_timer_start (timer);
+			n_results = run_benchmark (plugin_loader, benchmark, n_components);
+			elapsed = g_timer_elapsed (timer, NULL) * 1000.0;
+			g_array_append_val (times, elapsed);
+		}
+		print_result (benchmark_to_string (benchmark), n_components, times, n_results);
+	}
+
+	g_clear_object (&plugin_loader);
+	gs_utils_rmtree (tmp_root, NULL);
+
+	return EXIT_SUCCESS;
+}
@@ -10,6 +10,8 @@
 #include <config.h>
 
 #include <gnome-software.h>
+#include <math.h>
+#include <string.h>
 
 #include "gs-plugin-dummy.h"
 
@@ -27,10 +29,213 @@ struct _GsPluginDummy {
 	GsApp			*cached_origin;
 	GHashTable		*installed_apps;	/* id:1 */
 	GHashTable		*available_apps;	/* id:1 */
+
+	/* synthetic catalog and fault injection; see below */
+	guint32			 synthetic_seed;
+	GPtrArray		*synthetic_apps;	/* (nullable) (element-type GsPluginDummySyntheticApp) */
+	GHashTable		*synthetic_apps_by_id;	/* (nullable) id:GsPluginDummySyntheticApp */
+	GHashTable		*latency_ms;		/* (nullable) vfunc:ms */
+	GHashTable		*jitter_ms;		/* (nullable) vfunc:ms */
+	GHashTable		*failure_percent;	/* (nullable) vfunc:percent */
+	GMutex			 rand_mutex;
+	GRand			*rand;			/* (owned) (locked-by rand_mutex) */
 };
 
 G_DEFINE_TYPE (GsPluginDummy, gs_plugin_dummy, GS_TYPE_PLUGIN)
 
+/* A synthetic catalog, for stress testing the plugin loader at a realistic
+ * scale. It is controlled by environment variables:
+ *
+ *  - GS_DUMMY_SYNTHETIC_APPS: number of synthetic apps to generate
+ *  - GS_DUMMY_SYNTHETIC_SEED: seed for generating them and injecting faults
+ *  - GS_DUMMY_LATENCY_MS: latency to add to each vfunc
+ *  - GS_DUMMY_JITTER_MS: maximum random jitter to add on top of the latency
+ *  - GS_DUMMY_FAILURE_PERCENT: percentage of vfunc calls which fail
+ *
+ * The last three take either a single number, which applies to all vfuncs,
+ * or a comma-separated list of `vfunc=number` pairs, where the vfunc is one
+ * of `refine`, `list-apps` or `add-updates`, and `*` matches any other. */
+typedef struct {
+	GsApp		*app;  /* (owned) */
+	gchar		**keywords;  /* (owned) */
+	gboolean	 has_update;
+} GsPluginDummySyntheticApp;
+
+static void
+gs_plugin_dummy_synthetic_app_free (GsPluginDummySyntheticApp *synthetic)
+{
+	g_object_unref (synthetic->app);
+	g_strfreev (synthetic->keywords);
+	g_free (synthetic);
+}
+
+static const gchar *synthetic_categories[][3] = {
+	{ "AudioVideo", "Audio", "Player" },
+	{ "AudioVideo", "Video", "Recorder" },
+	{ "Development", "IDE", "Debugger" },
+	{ "Education", "Math", "Languages" },
+	{ "Game", "ActionGame", "StrategyGame" },
+	{ "Graphics", "2DGraphics", "Photography" },
+	{ "Network", "WebBrowser", "Chat" },
+	{ "Office", "WordProcessor", "Spreadsheet" },
+	{ "Science", "Astronomy", "Chemistry" },
+	{ "System", "Monitor", "TerminalEmulator" },
+	{ "Utility", "TextEditor", "Archiving" },
+};
+
+static const gchar *synthetic_words[] = {
+	"editor", "player", "viewer", "manager", "browser", "music", "video",
+	"photo", "chat", "mail", "game", "office", "notes", "terminal",
+	"calendar", "maps", "weather", "backup", "download", "code", "draw",
+	"paint", "audio", "podcast", "reader", "scanner", "camera", "clock",
+	"calculator", "dictionary", "translate", "finance", "fitness", "recipe",
+	"astronomy", "chemistry", "physics", "math", "language", "puzzle",
+};
+
+/* a skewed random index in [0, n), so a few values are much more common than
+ * the rest, as is the case for real categories and keywords */
+static guint
+synthetic_skewed_index (GRand *rand, guint n)
+{
+	gdouble r = g_rand_double (rand);
+	return MIN ((guint) (r * r * r * n), n - 1);
+}
+
+static void
+gs_plugin_dummy_generate_synthetic (GsPluginDummy *self,
+				    guint          n_apps)
+{
+	GsPlugin *plugin = GS_PLUGIN (self);
+	g_autoptr(GRand) rand = g_rand_new_with_seed (self->synthetic_seed);
+	g_autoptr(GPtrArray) runtimes = g_ptr_array_new_with_free_func (g_object_unref);
+	guint n_runtimes = MAX (n_apps / 50, 1);
+
+	self->synthetic_apps = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_plugin_dummy_synthetic_app_free);
+	self->synthetic_apps_by_id = g_hash_table_new (g_str_hash, g_str_equal);
+
+	/* runtimes are shared by many apps */
+	for (guint i = 0; i < n_runtimes; i++) {
+		g_autofree gchar *id = g_strdup_printf ("org.example.Platform%u", i);
+		g_autoptr(GsApp) runtime = gs_app_new (id);
+		gs_app_set_kind (runtime, AS_COMPONENT_KIND_RUNTIME);
+		gs_app_set_name (runtime, GS_APP_QUALITY_NORMAL, id);
+		gs_app_set_summary (runtime, GS_APP_QUALITY_NORMAL, "Shared runtime");
+		gs_app_set_state (runtime, GS_APP_STATE_INSTALLED);
+		gs_app_set_size_installed (runtime, GS_SIZE_TYPE_VALID, 500 * 1024 * 1024);
+		gs_app_set_management_plugin (runtime, plugin);
+		g_ptr_array_add (runtimes, g_steal_pointer (&runtime));
+	}
+
+	for (guint i = 0; i < n_apps; i++) {
+		GsPluginDummySyntheticApp *synthetic = g_new0 (GsPluginDummySyntheticApp, 1);
+		g_autofree gchar *id = g_strdup_printf ("org.example.Synthetic%u.desktop", i);
+		g_autofree gchar *name = NULL;
+		g_autofree gchar *summary = NULL;
+		const gchar **category;
+		guint n_keywords = g_rand_int_range (rand, 1, 6);
+		gboolean installed = g_rand_int_range (rand, 0, 100) < 10;
+		g_autoptr(GsApp) app = gs_app_new (id);
+
+		/* keywords; the first also names the app */
+		synthetic->keywords = g_new0 (gchar *, n_keywords + 1);
+		for (guint j = 0; j < n_keywords; j++) {
+			guint idx = synthetic_skewed_index (rand, G_N_ELEMENTS (synthetic_words));
+			synthetic->keywords[j] = g_strdup (synthetic_words[idx]);
+		}
+		name = g_strdup_printf ("Synthetic %s %u", synthetic->keywords[0], i);
+		summary = g_strdup_printf ("A synthetic %s app", synthetic->keywords[0]);
+
+		gs_app_set_kind (app, AS_COMPONENT_KIND_DESKTOP_APP);
+		gs_app_set_name (app, GS_APP_QUALITY_NORMAL, name);
+		gs_app_set_summary (app, GS_APP_QUALITY_NORMAL, summary);
+		gs_app_set_description (app, GS_APP_QUALITY_NORMAL, summary);
+		gs_app_set_license (app, GS_APP_QUALITY_NORMAL,
+				    (g_rand_int_range (rand, 0, 100) < 80) ? "GPL-2.0+" : "LicenseRef-proprietary");
+		gs_app_set_developer_name (app, "Example Developers");
+		gs_app_set_version (app, "1.0");
+		gs_app_set_origin (app, "synthetic");
+		gs_app_add_kudo (app, GS_APP_KUDO_HAS_KEYWORDS);
+		gs_app_set_metadata (app, "GnomeSoftware::Creator", gs_plugin_get_name (plugin));
+		gs_app_set_state (app, installed ? GS_APP_STATE_INSTALLED : GS_APP_STATE_AVAILABLE);
+		gs_app_set_management_plugin (app, plugin);
+
+		/* sizes are roughly log-uniform between 1MB and 1GB */
+		gs_app_set_size_download (app, GS_SIZE_TYPE_VALID,
+					  (guint64) (1024 * 1024 * pow (1000.0, g_rand_double (rand))));
+		gs_app_set_size_installed (app, GS_SIZE_TYPE_VALID,
+					   (guint64) (2 * 1024 * 1024 * pow (1000.0, g_rand_double (rand))));
+
+		/* a main category and usually a subcategory */
+		category = synthetic_categories[synthetic_skewed_index (rand, G_N_ELEMENTS (synthetic_categories))];
+		gs_app_add_category (app, category[0]);
+		if (g_rand_boolean (rand))
+			gs_app_add_category (app, category[g_rand_int_range (rand, 1, 3)]);
+
+		/* most apps use a runtime, which is also related */
+		if (g_rand_int_range (rand, 0, 100) < 90) {
+			GsApp *runtime = g_ptr_array_index (runtimes,
+							    synthetic_skewed_index (rand, runtimes->len));
+			gs_app_set_runtime (app, runtime);
+			gs_app_add_related (app, runtime);
+		}
+
+		/* some apps have addons */
+		if (g_rand_int_range (rand, 0, 100) < 15) {
+			g_autoptr(GsAppList) addons = gs_app_list_new ();
+			guint n_addons = g_rand_int_range (rand, 1, 4);
+
+			for (guint j = 0; j < n_addons; j++) {
+				g_autofree gchar *addon_id = g_strdup_printf ("org.example.Synthetic%u.Addon%u", i, j);
+				g_autoptr(GsApp) addon = gs_app_new (addon_id);
+				gs_app_set_kind (addon, AS_COMPONENT_KIND_ADDON);
+				gs_app_set_name (addon, GS_APP_QUALITY_NORMAL, addon_id);
+				gs_app_set_summary (addon, GS_APP_QUALITY_NORMAL, "A synthetic addon");
+				gs_app_set_state (addon, GS_APP_STATE_AVAILABLE);
+				gs_app_set_management_plugin (addon, plugin);
+				gs_app_list_add (addons, addon);
+			}
+			gs_app_add_addons (app, addons);
+		}
+
+		synthetic->app = g_steal_pointer (&app);
+		synthetic->has_update = installed && g_rand_int_range (rand, 0, 100) < 30;
+		g_ptr_array_add (self->synthetic_apps, synthetic);
+		g_hash_table_insert (self->synthetic_apps_by_id,
+				     (gpointer) gs_app_get_id (synthetic->app),
+				     synthetic);
+	}
+
+	g_debug ("generated %u synthetic apps with %u runtimes", n_apps, n_runtimes);
+}
+
+/* parses a knob in the format described above; returns (nullable) */
+static GHashTable *
+gs_plugin_dummy_parse_knob (const gchar *env_name)
+{
+	const gchar *value = g_getenv (env_name);
+	g_autoptr(GHashTable) knob = NULL;
+	g_auto(GStrv) split = NULL;
+
+	if (value == NULL || value[0] == '\0')
+		return NULL;
+
+	knob = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	split = g_strsplit (value, ",", -1);
+	for (guint i = 0; split[i] != NULL; i++) {
+		const gchar *eq = strchr (split[i], '=');
+
+		if (eq == NULL) {
+			g_hash_table_insert (knob, g_strdup ("*"),
+					     GUINT_TO_POINTER (g_ascii_strtoull (split[i], NULL, 10)));
+		} else {
+			g_hash_table_insert (knob, g_strndup (split[i], eq - split[i]),
+					     GUINT_TO_POINTER (g_ascii_strtoull (eq + 1, NULL, 10)));
+		}
+	}
+
+	return g_steal_pointer (&knob);
+}
+
 /* just flip-flop this every few seconds */
 static gboolean
 gs_plugin_dummy_allow_updates_cb (gpointer user_data)
@@ -47,6 +252,8 @@ gs_plugin_dummy_init (GsPluginDummy *self)
 {
 	GsPlugin *plugin = GS_PLUGIN (self);
 
+	g_mutex_init (&self->rand_mutex);
+
 	if (g_getenv ("GS_SELF_TEST_DUMMY_ENABLE") == NULL) {
 		g_debug ("disabling '%s' as not in self test",
 			 gs_plugin_get_name (plugin));
@@ -68,10 +275,26 @@ gs_plugin_dummy_dispose (GObject *object)
 	g_clear_pointer (&self->available_apps, g_hash_table_unref);
 	g_clear_handle_id (&self->quirk_id, g_source_remove);
 	g_clear_object (&self->cached_origin);
+	g_clear_pointer (&self->synthetic_apps_by_id, g_hash_table_unref);
+	g_clear_pointer (&self->synthetic_apps, g_ptr_array_unref);
+	g_clear_pointer (&self->latency_ms, g_hash_table_unref);
+	g_clear_pointer (&self->jitter_ms, g_hash_table_unref);
+	g_clear_pointer (&self->failure_percent, g_hash_table_unref);
 
 	G_OBJECT_CLASS (gs_plugin_dummy_parent_class)->dispose (object);
 }
 
+static void
+gs_plugin_dummy_finalize (GObject *object)
+{
+	GsPluginDummy *self = GS_PLUGIN_DUMMY (object);
+
+	g_clear_pointer (&self->rand, g_rand_free);
+	g_mutex_clear (&self->rand_mutex);
+
+	G_OBJECT_CLASS (gs_plugin_dummy_parent_class)->finalize (object);
+}
+
 static void
 gs_plugin_dummy_setup_async (GsPlugin            *plugin,
                              GCancellable        *cancellable,
@@ -80,6 +303,7 @@ gs_plugin_dummy_setup_async (GsPlugin            *plugin,
 {
 	GsPluginDummy *self = GS_PLUGIN_DUMMY (plugin);
 	g_autoptr(GTask) task = NULL;
+	const gchar *tmp;
 
 	task = g_task_new (plugin, cancellable, callback, user_data);
 	g_task_set_source_tag (task, gs_plugin_dummy_setup_async);
@@ -116,6 +340,24 @@ gs_plugin_dummy_setup_async (GsPlugin            *plugin,
 			     g_strdup ("com.hughski.ColorHug2.driver"),
 			     GUINT_TO_POINTER (1));
 
+	/* synthetic catalog and fault injection; the self tests set these up
+	 * again with different knobs */
+	g_clear_pointer (&self->synthetic_apps_by_id, g_hash_table_unref);
+	g_clear_pointer (&self->synthetic_apps, g_ptr_array_unref);
+	g_clear_pointer (&self->latency_ms, g_hash_table_unref);
+	g_clear_pointer (&self->jitter_ms, g_hash_table_unref);
+	g_clear_pointer (&self->failure_percent, g_hash_table_unref);
+	g_clear_pointer (&self->rand, g_rand_free);
+	tmp = g_getenv ("GS_DUMMY_SYNTHETIC_SEED");
+	self->synthetic_seed = (tmp != NULL) ? (guint32) g_ascii_strtoull (tmp, NULL, 10) : 0;
+	self->rand = g_rand_new_with_seed (self->synthetic_seed);
+	self->latency_ms = gs_plugin_dummy_parse_knob ("GS_DUMMY_LATENCY_MS");
+	self->jitter_ms = gs_plugin_dummy_parse_knob ("GS_DUMMY_JITTER_MS");
+	self->failure_percent = gs_plugin_dummy_parse_knob ("GS_DUMMY_FAILURE_PERCENT");
+	tmp = g_getenv ("GS_DUMMY_SYNTHETIC_APPS");
+	if (tmp != NULL)
+		gs_plugin_dummy_generate_synthetic (self, (guint) g_ascii_strtoull (tmp, NULL, 10));
+
 	g_task_return_boolean (task, TRUE);
 }
 
@@ -355,12 +597,256 @@ gs_plugin_dummy_timeout_finish (GsPluginDummy  *self,
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+static guint
+gs_plugin_dummy_get_knob (GHashTable  *knob,
+			  const gchar *vfunc)
+{
+	gpointer value;
+
+	if (knob == NULL)
+		return 0;
+	if (g_hash_table_lookup_extended (knob, vfunc, NULL, &value))
+		return GPOINTER_TO_UINT (value);
+	if (g_hash_table_lookup_extended (knob, "*", NULL, &value))
+		return GPOINTER_TO_UINT (value);
+	return 0;
+}
+
+/* returns the latency in ms to inject into @vfunc, including jitter */
+static guint
+gs_plugin_dummy_get_injected_latency (GsPluginDummy *self,
+				      const gchar   *vfunc)
+{
+	guint latency = gs_plugin_dummy_get_knob (self->latency_ms, vfunc);
+	guint jitter = gs_plugin_dummy_get_knob (self->jitter_ms, vfunc);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	if (jitter == 0)
+		return latency;
+
+	locker = g_mutex_locker_new (&self->rand_mutex);
+	return latency + g_rand_int_range (self->rand, 0, jitter + 1);
+}
+
+/* returns %FALSE and sets @error if @vfunc should fail */
+static gboolean
+gs_plugin_dummy_check_injected_failure (GsPluginDummy  *self,
+					const gchar    *vfunc,
+					GError        **error)
+{
+	guint percent = gs_plugin_dummy_get_knob (self->failure_percent, vfunc);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	if (percent == 0)
+		return TRUE;
+
+	locker = g_mutex_locker_new (&self->rand_mutex);
+	if (g_rand_int_range (self->rand, 0, 100) >= (gint32) percent)
+		return TRUE;
+
+	g_set_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_FAILED,
+		     "Injected failure in %s", vfunc);
+	return FALSE;
+}
+
+/* for the old-style vfuncs, which run in a worker thread */
+static gboolean
+gs_plugin_dummy_inject_sync (GsPluginDummy  *self,
+			     const gchar    *vfunc,
+			     GCancellable   *cancellable,
+			     GError        **error)
+{
+	guint latency = gs_plugin_dummy_get_injected_latency (self, vfunc);
+
+	/* sleep in small increments so cancellation is responsive */
+	for (guint slept = 0; slept < latency; slept += 10) {
+		g_usleep (MIN (latency - slept, 10) * 1000);
+		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+			gs_utils_error_convert_gio (error);
+			return FALSE;
+		}
+	}
+
+	return gs_plugin_dummy_check_injected_failure (self, vfunc, error);
+}
+
+static void inject_timeout_cb (GObject      *object,
+                               GAsyncResult *result,
+                               gpointer      user_data);
+
+/* Return the result of @task, which must be from refine_async() or
+ * list_apps_async(), after the injected latency. @list is the result for
+ * list_apps_async() and %NULL for refine_async(). */
+static void
+gs_plugin_dummy_return_injected (GsPluginDummy *self,
+				 GTask         *task,
+				 GsAppList     *list)
+{
+	guint latency = gs_plugin_dummy_get_injected_latency (self, (list != NULL) ? "list-apps" : "refine");
+
+	if (list != NULL)
+		g_task_set_task_data (task, g_object_ref (list), g_object_unref);
+
+	gs_plugin_dummy_timeout_async (self, latency, g_task_get_cancellable (task),
+				       inject_timeout_cb, g_object_ref (task));
+}
+
+static void
+inject_timeout_cb (GObject      *object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+	GsPluginDummy *self = GS_PLUGIN_DUMMY (object);
+	g_autoptr(GTask) task = g_steal_pointer (&user_data);
+	GsAppList *list = g_task_get_task_data (task);
+	g_autoptr(GError) local_error = NULL;
+
+	if (!gs_plugin_dummy_timeout_finish (self, result, &local_error) ||
+	    !gs_plugin_dummy_check_injected_failure (self, (list != NULL) ? "list-apps" : "refine", &local_error)) {
+		gs_utils_error_convert_gio (&local_error);
+		g_task_return_error (task, g_steal_pointer (&local_error));
+		return;
+	}
+
+	if (list != NULL)
+		g_task_return_pointer (task, g_object_ref (list), (GDestroyNotify) g_object_unref);
+	else
+		g_task_return_boolean (task, TRUE);
+}
+
+static gboolean
+gs_plugin_dummy_get_injecting (GsPluginDummy *self)
+{
+	return self->latency_ms != NULL || self->jitter_ms != NULL || self->failure_percent != NULL;
+}
+
+static gboolean
+synthetic_app_matches_keywords (GsPluginDummySyntheticApp *synthetic,
+				const gchar * const       *keywords)
+{
+	for (gsize i = 0; keywords[i] != NULL; i++) {
+		if (g_strv_contains ((const gchar * const *) synthetic->keywords, keywords[i]))
+			continue;
+		if (strstr (gs_app_get_name (synthetic->app), keywords[i]) != NULL)
+			continue;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean
+synthetic_app_matches_category (GsPluginDummySyntheticApp *synthetic,
+				GsCategory                *category)
+{
+	GPtrArray *desktop_groups = gs_category_get_desktop_groups (category);
+
+	for (guint i = 0; i < desktop_groups->len; i++) {
+		g_auto(GStrv) split = g_strsplit (g_ptr_array_index (desktop_groups, i), "::", -1);
+		gboolean matches = TRUE;
+
+		for (guint j = 0; split[j] != NULL && matches; j++)
+			matches = gs_app_has_category (synthetic->app, split[j]);
+		if (matches)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* adds the synthetic apps matching the query to @list */
+static void
+gs_plugin_dummy_list_synthetic_apps (GsPluginDummy              *self,
+				     GsAppQueryTristate          is_installed,
+				     GsCategory                 *category,
+				     const gchar * const        *keywords,
+				     GsAppList                  *list)
+{
+	/* other queries are not supported for synthetic apps */
+	if (is_installed == GS_APP_QUERY_TRISTATE_UNSET &&
+	    category == NULL && keywords == NULL)
+		return;
+
+	for (guint i = 0; i < self->synthetic_apps->len; i++) {
+		GsPluginDummySyntheticApp *synthetic = g_ptr_array_index (self->synthetic_apps, i);
+
+		if (is_installed == GS_APP_QUERY_TRISTATE_TRUE &&
+		    !gs_app_is_installed (synthetic->app))
+			continue;
+		if (category != NULL &&
+		    !synthetic_app_matches_category (synthetic, category))
+			continue;
+		if (keywords != NULL) {
+			if (!synthetic_app_matches_keywords (synthetic, keywords))
+				continue;
+			gs_app_set_match_value (synthetic->app, 100);
+		}
+		gs_app_list_add (list, synthetic->app);
+	}
+}
+
+/* copies the requested metadata from the synthetic app onto @app, if it is
+ * a different object with the same ID */
+static void
+gs_plugin_dummy_refine_synthetic (GsPluginDummy       *self,
+				  GsApp               *app,
+				  GsPluginRefineFlags  flags)
+{
+	GsPluginDummySyntheticApp *synthetic;
+	GsApp *source;
+
+	if (self->synthetic_apps_by_id == NULL || gs_app_get_id (app) == NULL)
+		return;
+	synthetic = g_hash_table_lookup (self->synthetic_apps_by_id, gs_app_get_id (app));
+	if (synthetic == NULL || synthetic->app == app)
+		return;
+	source = synthetic->app;
+
+	if (gs_app_get_state (app) == GS_APP_STATE_UNKNOWN)
+		gs_app_set_state (app, gs_app_get_state (source));
+	if (gs_app_get_kind (app) == AS_COMPONENT_KIND_UNKNOWN)
+		gs_app_set_kind (app, gs_app_get_kind (source));
+	gs_app_set_name (app, GS_APP_QUALITY_NORMAL, gs_app_get_name (source));
+	gs_app_set_summary (app, GS_APP_QUALITY_NORMAL, gs_app_get_summary (source));
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE)
+		gs_app_set_license (app, GS_APP_QUALITY_NORMAL, gs_app_get_license (source));
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_DESCRIPTION)
+		gs_app_set_description (app, GS_APP_QUALITY_NORMAL, gs_app_get_description (source));
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_VERSION)
+		gs_app_set_version (app, gs_app_get_version (source));
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN)
+		gs_app_set_origin (app, gs_app_get_origin (source));
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_DEVELOPER_NAME)
+		gs_app_set_developer_name (app, gs_app_get_developer_name (source));
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_RUNTIME &&
+	    gs_app_get_runtime (source) != NULL)
+		gs_app_set_runtime (app, gs_app_get_runtime (source));
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE) {
+		guint64 size_bytes;
+		if (gs_app_get_size_download (source, &size_bytes) == GS_SIZE_TYPE_VALID)
+			gs_app_set_size_download (app, GS_SIZE_TYPE_VALID, size_bytes);
+		if (gs_app_get_size_installed (source, &size_bytes) == GS_SIZE_TYPE_VALID)
+			gs_app_set_size_installed (app, GS_SIZE_TYPE_VALID, size_bytes);
+	}
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_CATEGORIES) {
+		GPtrArray *categories = gs_app_get_categories (source);
+		for (guint i = 0; i < categories->len; i++)
+			gs_app_add_category (app, g_ptr_array_index (categories, i));
+	}
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ADDONS) {
+		g_autoptr(GsAppList) addons = gs_app_dup_addons (source);
+		if (addons != NULL)
+			gs_app_add_addons (app, addons);
+	}
+	if (gs_app_has_management_plugin (app, NULL))
+		gs_app_set_management_plugin (app, GS_PLUGIN (self));
+}
+
 gboolean
 gs_plugin_add_updates (GsPlugin *plugin,
 		       GsAppList *list,
 		       GCancellable *cancellable,
 		       GError **error)
 {
+	GsPluginDummy *self = GS_PLUGIN_DUMMY (plugin);
 	GsApp *app;
 	GsApp *proxy;
 	g_autoptr(GIcon) ic = NULL;
@@ -371,6 +857,19 @@ gs_plugin_add_updates (GsPlugin *plugin,
 	/* spin */
 	if (!gs_plugin_dummy_delay (plugin, NULL, 2000, cancellable, error))
 		return FALSE;
+	if (!gs_plugin_dummy_inject_sync (self, "add-updates", cancellable, error))
+		return FALSE;
+
+	/* synthetic apps */
+	for (guint i = 0; self->synthetic_apps != NULL && i < self->synthetic_apps->len; i++) {
+		GsPluginDummySyntheticApp *synthetic = g_ptr_array_index (self->synthetic_apps, i);
+
+		if (!synthetic->has_update)
+			continue;
+		if (gs_app_get_state (synthetic->app) == GS_APP_STATE_INSTALLED)
+			gs_app_set_state (synthetic->app, GS_APP_STATE_UPDATABLE_LIVE);
+		gs_app_list_add (list, synthetic->app);
+	}
 
 	/* use a generic stock icon */
 	ic = g_themed_icon_new ("drive-harddisk");
@@ -692,6 +1191,12 @@ gs_plugin_dummy_refine_async (GsPlugin            *plugin,
 			g_task_return_error (task, g_steal_pointer (&local_error));
 			return;
 		}
+		gs_plugin_dummy_refine_synthetic (self, app, flags);
+	}
+
+	if (gs_plugin_dummy_get_injecting (self)) {
+		gs_plugin_dummy_return_injected (self, task, NULL);
+		return;
 	}
 
 	g_task_return_boolean (task, TRUE);
@@ -887,6 +1392,14 @@ gs_plugin_dummy_list_apps_async (GsPlugin              *plugin,
 		}
 	}
 
+	if (self->synthetic_apps != NULL)
+		gs_plugin_dummy_list_synthetic_apps (self, is_installed, category, keywords, list);
+
+	if (gs_plugin_dummy_get_injecting (self)) {
+		gs_plugin_dummy_return_injected (self, task, list);
+		return;
+	}
+
 	g_task_return_pointer (task, g_steal_pointer (&list), (GDestroyNotify) g_object_unref);
 }
 
@@ -1084,6 +1597,7 @@ gs_plugin_dummy_class_init (GsPluginDummyClass *klass)
 	GsPluginClass *plugin_class = GS_PLUGIN_CLASS (klass);
 
 	object_class->dispose = gs_plugin_dummy_dispose;
+	object_class->finalize = gs_plugin_dummy_finalize;
 
 	plugin_class->setup_async = gs_plugin_dummy_setup_async;
 	plugin_class->setup_finish = gs_plugin_dummy_setup_finish;
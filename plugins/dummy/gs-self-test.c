@@ -802,6 +802,55 @@ gs_plugins_dummy_app_size_calc_func (GsPluginLoader *loader)
 	g_assert_cmpint (value, ==, 0);
 }
 
+static void
+gs_plugins_dummy_synthetic_func (GsPluginLoader *plugin_loader)
+{
+	const gchar *keywords[2] = { "Synthetic", NULL };
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GsAppQuery) query = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+
+	/* the knobs are read when the plugin is set up */
+	g_setenv ("GS_DUMMY_SYNTHETIC_APPS", "200", TRUE);
+	g_setenv ("GS_DUMMY_SYNTHETIC_SEED", "42", TRUE);
+	gs_test_reinitialise_plugin_loader (plugin_loader, allowlist, NULL);
+
+	/* every synthetic app has the keyword in its name */
+	query = gs_app_query_new ("keywords", keywords,
+				  "dedupe-flags", GS_PLUGIN_JOB_DEDUPE_FLAGS_DEFAULT,
+				  NULL);
+	plugin_job = gs_plugin_job_list_apps_new (query, GS_PLUGIN_LIST_APPS_FLAGS_NONE);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_nonnull (list);
+	g_assert_cmpint (gs_app_list_length (list), >, 0);
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		g_assert_true (g_str_has_prefix (gs_app_get_id (app), "org.example.Synthetic"));
+		g_assert_cmpint (gs_app_get_kind (app), ==, AS_COMPONENT_KIND_DESKTOP_APP);
+	}
+	g_clear_object (&list);
+	g_clear_object (&plugin_job);
+
+	/* make listing apps always fail */
+	g_setenv ("GS_DUMMY_FAILURE_PERCENT", "list-apps=100", TRUE);
+	gs_test_reinitialise_plugin_loader (plugin_loader, allowlist, NULL);
+
+	plugin_job = gs_plugin_job_list_apps_new (query, GS_PLUGIN_LIST_APPS_FLAGS_NONE);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_FAILED);
+	g_assert_null (list);
+
+	/* put things back for the other tests */
+	g_unsetenv ("GS_DUMMY_SYNTHETIC_APPS");
+	g_unsetenv ("GS_DUMMY_SYNTHETIC_SEED");
+	g_unsetenv ("GS_DUMMY_FAILURE_PERCENT");
+	gs_test_reinitialise_plugin_loader (plugin_loader, allowlist, NULL);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -957,6 +1006,9 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/gnome-software/plugins/dummy/app-size-calc",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_app_size_calc_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/synthetic",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_synthetic_func);
 	retval = g_test_run ();
 
 	/* Clean up. */
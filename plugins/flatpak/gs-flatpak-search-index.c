@@ -0,0 +1,271 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/* Notes:
+ *
+ * gs_appstream_search() runs every search query against every component in
+ * the silo, which means thousands of XPath evaluations per keystroke for
+ * Flathub. #GsFlatpakSearchIndex is built once when the silo is compiled, and
+ * maps a short prefix of each word in the searchable fields of a component to
+ * the components containing it. A search then only needs to run the (exact)
+ * XPath queries on the handful of components which could possibly match.
+ *
+ * The silo compares stemmed tokens, and the stemmer is not exposed by libxmlb.
+ * Stemming only ever rewrites the end of a word though, so the first two
+ * characters of a word and of its stem agree, apart from a trailing ‘y’ which
+ * may become an ‘i’ (‘spy’ → ‘spi’, ‘dying’ → ‘die’). Keying the index on the
+ * first two characters, with ‘y’ folded to ‘i’, therefore never loses a match;
+ * it just returns a few extra candidates which the XPath queries then reject.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "gs-flatpak-search-index.h"
+
+/* number of characters of each token used as the index key */
+#define GS_FLATPAK_SEARCH_INDEX_KEY_LENGTH	2
+
+struct _GsFlatpakSearchIndex {
+	GObject			 parent_instance;
+
+	XbSilo			*silo;  /* (owned) */
+	GPtrArray		*components;  /* (owned) (element-type XbNode) */
+	GHashTable		*keys;  /* (owned) (element-type utf8 GArray<guint>); key ~> sorted component indices */
+};
+
+G_DEFINE_TYPE (GsFlatpakSearchIndex, gs_flatpak_search_index, G_TYPE_OBJECT)
+
+static gchar *
+gs_flatpak_search_index_get_key (const gchar *token,
+				 guint n_chars)
+{
+	const gchar *end = token;
+	gchar *key;
+
+	for (guint i = 0; i < n_chars && *end != '\0'; i++)
+		end = g_utf8_next_char (end);
+	key = g_strndup (token, end - token);
+	g_strdelimit (key, "y", 'i');
+	return key;
+}
+
+static void
+gs_flatpak_search_index_add_key (GsFlatpakSearchIndex *self,
+				 guint idx,
+				 gchar *key)
+{
+	GArray *array = g_hash_table_lookup (self->keys, key);
+
+	if (array == NULL) {
+		array = g_array_new (FALSE, FALSE, sizeof (guint));
+		g_hash_table_insert (self->keys, key, array);
+	} else {
+		g_free (key);
+		/* components are added in order, so this is enough to dedupe */
+		if (g_array_index (array, guint, array->len - 1) == idx)
+			return;
+	}
+	g_array_append_val (array, idx);
+}
+
+static void
+gs_flatpak_search_index_add_token (GsFlatpakSearchIndex *self,
+				   guint idx,
+				   const gchar *token)
+{
+	/* a one-character search term needs the shorter key */
+	for (guint i = 1; i <= GS_FLATPAK_SEARCH_INDEX_KEY_LENGTH; i++)
+		gs_flatpak_search_index_add_key (self, idx, gs_flatpak_search_index_get_key (token, i));
+}
+
+static void
+gs_flatpak_search_index_add_text (GsFlatpakSearchIndex *self,
+				  guint idx,
+				  const gchar *text)
+{
+	g_auto(GStrv) tokens = NULL;
+	g_auto(GStrv) ascii_tokens = NULL;
+
+	if (text == NULL)
+		return;
+
+	tokens = g_str_tokenize_and_fold (text, NULL, &ascii_tokens);
+	for (guint i = 0; tokens[i] != NULL; i++)
+		gs_flatpak_search_index_add_token (self, idx, tokens[i]);
+	for (guint i = 0; ascii_tokens[i] != NULL; i++)
+		gs_flatpak_search_index_add_token (self, idx, ascii_tokens[i]);
+}
+
+/* these must cover all the fields queried by gs_appstream_search() */
+static void
+gs_flatpak_search_index_add_component (GsFlatpakSearchIndex *self,
+				       guint idx,
+				       XbNode *component)
+{
+	const gchar * const elements[] = {
+		"id", "pkgname", "name", "summary", "launchable", NULL };
+	const gchar * const lists[] = {
+		"keywords", "mimetypes", NULL };
+	g_autoptr(GPtrArray) children = xb_node_get_children (component);
+
+	gs_flatpak_search_index_add_text (self, idx, xb_node_query_attr (component, "..", "origin", NULL));
+
+	for (guint i = 0; i < children->len; i++) {
+		XbNode *child = g_ptr_array_index (children, i);
+		const gchar *element = xb_node_get_element (child);
+
+		if (element == NULL)
+			continue;
+		if (g_strv_contains (elements, element)) {
+			gs_flatpak_search_index_add_text (self, idx, xb_node_get_text (child));
+		} else if (g_strv_contains (lists, element)) {
+			g_autoptr(GPtrArray) items = xb_node_get_children (child);
+			for (guint j = 0; j < items->len; j++)
+				gs_flatpak_search_index_add_text (self, idx, xb_node_get_text (g_ptr_array_index (items, j)));
+		}
+	}
+}
+
+/* Returns the silo the index was built from. */
+XbSilo *
+gs_flatpak_search_index_get_silo (GsFlatpakSearchIndex *self)
+{
+	g_return_val_if_fail (GS_IS_FLATPAK_SEARCH_INDEX (self), NULL);
+	return self->silo;
+}
+
+/* Returns an estimate of the heap memory used by the index, in bytes. */
+gsize
+gs_flatpak_search_index_get_size (GsFlatpakSearchIndex *self)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	gsize size;
+
+	g_return_val_if_fail (GS_IS_FLATPAK_SEARCH_INDEX (self), 0);
+
+	size = self->components->len * sizeof (gpointer);
+	g_hash_table_iter_init (&iter, self->keys);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		GArray *array = value;
+		size += strlen (key) + 1 + sizeof (GArray) + array->len * sizeof (guint);
+	}
+	return size;
+}
+
+/* Gets the components of the silo which may match all of @values, for passing
+ * to gs_appstream_search_components(). Returns a new array. */
+GPtrArray *
+gs_flatpak_search_index_get_candidates (GsFlatpakSearchIndex *self,
+					const gchar * const *values)
+{
+	g_autofree guint *n_matched = NULL;
+	g_autofree guint *last_value = NULL;
+	GPtrArray *candidates;
+	guint n_values = 0;
+
+	g_return_val_if_fail (GS_IS_FLATPAK_SEARCH_INDEX (self), NULL);
+	g_return_val_if_fail (values != NULL, NULL);
+
+	n_matched = g_new0 (guint, self->components->len);
+	last_value = g_new0 (guint, self->components->len);
+
+	for (guint i = 0; values[i] != NULL; i++) {
+		g_auto(GStrv) tokens = NULL;
+		g_auto(GStrv) ascii_tokens = NULL;
+		g_autoptr(GPtrArray) all_tokens = g_ptr_array_new ();
+
+		/* nothing to narrow the search down with */
+		tokens = g_str_tokenize_and_fold (values[i], NULL, &ascii_tokens);
+		if (tokens[0] == NULL)
+			continue;
+		n_values++;
+
+		/* the silo matches a value if any of its tokens match */
+		for (guint j = 0; tokens[j] != NULL; j++)
+			g_ptr_array_add (all_tokens, tokens[j]);
+		for (guint j = 0; ascii_tokens[j] != NULL; j++)
+			g_ptr_array_add (all_tokens, ascii_tokens[j]);
+
+		for (guint j = 0; j < all_tokens->len; j++) {
+			g_autofree gchar *key = gs_flatpak_search_index_get_key (g_ptr_array_index (all_tokens, j),
+										 GS_FLATPAK_SEARCH_INDEX_KEY_LENGTH);
+			GArray *array = g_hash_table_lookup (self->keys, key);
+
+			for (guint k = 0; array != NULL && k < array->len; k++) {
+				guint idx = g_array_index (array, guint, k);
+				if (last_value[idx] == n_values)
+					continue;
+				last_value[idx] = n_values;
+				n_matched[idx]++;
+			}
+		}
+	}
+
+	/* every value must match */
+	candidates = g_ptr_array_new_with_free_func (g_object_unref);
+	for (guint i = 0; i < self->components->len; i++) {
+		if (n_matched[i] == n_values)
+			g_ptr_array_add (candidates, g_object_ref (g_ptr_array_index (self->components, i)));
+	}
+
+	return candidates;
+}
+
+static void
+gs_flatpak_search_index_finalize (GObject *object)
+{
+	GsFlatpakSearchIndex *self = GS_FLATPAK_SEARCH_INDEX (object);
+
+	g_hash_table_unref (self->keys);
+	g_ptr_array_unref (self->components);
+	g_clear_object (&self->silo);
+
+	G_OBJECT_CLASS (gs_flatpak_search_index_parent_class)->finalize (object);
+}
+
+static void
+gs_flatpak_search_index_class_init (GsFlatpakSearchIndexClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_flatpak_search_index_finalize;
+}
+
+static void
+gs_flatpak_search_index_init (GsFlatpakSearchIndex *self)
+{
+	self->keys = g_hash_table_new_full (g_str_hash, g_str_equal,
+					    g_free, (GDestroyNotify) g_array_unref);
+}
+
+/* Builds an index of all the components in @silo. */
+GsFlatpakSearchIndex *
+gs_flatpak_search_index_new (XbSilo *silo)
+{
+	GsFlatpakSearchIndex *self;
+	g_autoptr(GTimer) timer = g_timer_new ();
+
+	g_return_val_if_fail (XB_IS_SILO (silo), NULL);
+
+	self = g_object_new (GS_TYPE_FLATPAK_SEARCH_INDEX, NULL);
+	self->silo = g_object_ref (silo);
+	self->components = xb_silo_query (silo, "components/component", 0, NULL);
+	if (self->components == NULL)
+		self->components = g_ptr_array_new_with_free_func (g_object_unref);
+
+	for (guint i = 0; i < self->components->len; i++)
+		gs_flatpak_search_index_add_component (self, i, g_ptr_array_index (self->components, i));
+
+	g_debug ("indexed %u components under %u keys in %fms",
+		 self->components->len, g_hash_table_size (self->keys),
+		 g_timer_elapsed (timer, NULL) * 1000);
+
+	return self;
+}
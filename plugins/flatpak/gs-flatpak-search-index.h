@@ -0,0 +1,26 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <xmlb.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_FLATPAK_SEARCH_INDEX (gs_flatpak_search_index_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsFlatpakSearchIndex, gs_flatpak_search_index, GS, FLATPAK_SEARCH_INDEX, GObject)
+
+GsFlatpakSearchIndex	*gs_flatpak_search_index_new		(XbSilo			*silo);
+XbSilo			*gs_flatpak_search_index_get_silo	(GsFlatpakSearchIndex	*self);
+gsize			 gs_flatpak_search_index_get_size	(GsFlatpakSearchIndex	*self);
+GPtrArray		*gs_flatpak_search_index_get_candidates	(GsFlatpakSearchIndex	*self,
+								 const gchar * const	*values);
+
+G_END_DECLS
@@ -0,0 +1,338 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/* Notes:
+ *
+ * Working out how much space an app's user data takes means walking the whole
+ * of ~/.var/app/<id>/{cache,config,data}, which can take seconds for browsers
+ * and IDEs. #GsFlatpakSizeCache remembers the result on disk, along with a
+ * cheap signature of the directory (the mtimes of the directory and its
+ * immediate children) and when the size was computed.
+ *
+ * A cached size is always returned straight away. If the signature has changed
+ * or the size is more than %GS_FLATPAK_SIZE_CACHE_MAX_AGE seconds old, it is
+ * recomputed in a background thread at idle I/O priority, so the next lookup
+ * returns a number which is at most a few minutes old. Only the very first
+ * lookup for a directory walks it synchronously.
+ *
+ * Sizes which have not been recomputed for %GS_FLATPAK_SIZE_CACHE_EXPIRE_AGE
+ * seconds belong to directories nobody has asked about since, typically those
+ * of uninstalled apps, and are dropped when the cache is next saved.
+ */
+
+#include <config.h>
+
+#include <glib/gstdio.h>
+#include <gnome-software.h>
+
+#include "gs-flatpak-size-cache.h"
+#include "gs-ioprio.h"
+
+/* seconds after which a cached size is recomputed in the background */
+#define GS_FLATPAK_SIZE_CACHE_MAX_AGE	(5 * 60)
+
+/* seconds after which a cached size which has not been recomputed is dropped */
+#define GS_FLATPAK_SIZE_CACHE_EXPIRE_AGE	(30 * 24 * 60 * 60)
+
+typedef struct {
+	guint64		 size;
+	guint64		 signature;
+	gint64		 timestamp;  /* seconds since the epoch */
+} GsFlatpakSizeCacheEntry;
+
+struct _GsFlatpakSizeCache {
+	GObject			 parent_instance;
+
+	gchar			*filename;  /* (owned) */
+	GMutex			 mutex;
+	GHashTable		*entries;  /* (owned) (element-type utf8 GsFlatpakSizeCacheEntry) */
+	GHashTable		*pending;  /* (owned) (element-type utf8 utf8); paths queued for refresh */
+	GThreadPool		*pool;  /* (owned) */
+	gboolean		 dirty;
+	gboolean		 save_queued;
+};
+
+G_DEFINE_TYPE (GsFlatpakSizeCache, gs_flatpak_size_cache, G_TYPE_OBJECT)
+
+/* Sentinel pushed onto the pool to only save the cache */
+static gchar save_sentinel[] = "";
+
+/* Frees the queued items dropped when the pool is freed */
+static void
+gs_flatpak_size_cache_item_free (gpointer data)
+{
+	if (data != save_sentinel)
+		g_free (data);
+}
+
+static guint64
+gs_flatpak_size_cache_get_signature (const gchar *path)
+{
+	g_autoptr(GDir) dir = NULL;
+	GStatBuf st;
+	guint64 signature;
+	const gchar *name;
+
+	if (g_stat (path, &st) != 0)
+		return 0;
+	signature = (guint64) st.st_mtime;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (dir == NULL)
+		return signature;
+
+	/* the order of entries is stable for an unchanged directory, and any
+	 * added or removed entry changes the mtime of @path anyway */
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *child = g_build_filename (path, name, NULL);
+		if (g_lstat (child, &st) != 0 || !S_ISDIR (st.st_mode))
+			continue;
+		signature = signature * 31 + g_str_hash (name);
+		signature = signature * 31 + (guint64) st.st_mtime;
+	}
+
+	return signature;
+}
+
+static void
+gs_flatpak_size_cache_load (GsFlatpakSizeCache *self)
+{
+	g_autoptr(GKeyFile) kf = g_key_file_new ();
+	g_autoptr(GError) error_local = NULL;
+	g_auto(GStrv) groups = NULL;
+
+	if (!g_key_file_load_from_file (kf, self->filename, G_KEY_FILE_NONE, &error_local)) {
+		if (!g_error_matches (error_local, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_debug ("failed to load %s: %s", self->filename, error_local->message);
+		return;
+	}
+
+	groups = g_key_file_get_groups (kf, NULL);
+	for (guint i = 0; groups[i] != NULL; i++) {
+		GsFlatpakSizeCacheEntry *entry = g_new0 (GsFlatpakSizeCacheEntry, 1);
+		entry->size = g_key_file_get_uint64 (kf, groups[i], "Size", NULL);
+		entry->signature = g_key_file_get_uint64 (kf, groups[i], "Signature", NULL);
+		entry->timestamp = g_key_file_get_int64 (kf, groups[i], "Timestamp", NULL);
+		g_hash_table_insert (self->entries, g_strdup (groups[i]), entry);
+	}
+}
+
+/* must be called with @self->mutex held */
+static gchar *
+gs_flatpak_size_cache_to_data_locked (GsFlatpakSizeCache *self,
+				      gsize *length)
+{
+	g_autoptr(GKeyFile) kf = g_key_file_new ();
+	GHashTableIter iter;
+	gpointer key, value;
+	gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+
+	g_hash_table_iter_init (&iter, self->entries);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		const GsFlatpakSizeCacheEntry *entry = value;
+		if (now - entry->timestamp > GS_FLATPAK_SIZE_CACHE_EXPIRE_AGE) {
+			g_debug ("dropping expired size of %s", (const gchar *) key);
+			g_hash_table_iter_remove (&iter);
+			continue;
+		}
+		g_key_file_set_uint64 (kf, key, "Size", entry->size);
+		g_key_file_set_uint64 (kf, key, "Signature", entry->signature);
+		g_key_file_set_int64 (kf, key, "Timestamp", entry->timestamp);
+	}
+	return g_key_file_to_data (kf, length, NULL);
+}
+
+static void
+gs_flatpak_size_cache_save (GsFlatpakSizeCache *self)
+{
+	g_autofree gchar *data = NULL;
+	gsize length = 0;
+	g_autoptr(GError) error_local = NULL;
+
+	{
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->mutex);
+		self->save_queued = FALSE;
+		if (!self->dirty)
+			return;
+		self->dirty = FALSE;
+		data = gs_flatpak_size_cache_to_data_locked (self, &length);
+	}
+
+	if (!g_file_set_contents (self->filename, data, length, &error_local))
+		g_debug ("failed to save %s: %s", self->filename, error_local->message);
+}
+
+/* must be called with @self->mutex held */
+static void
+gs_flatpak_size_cache_set_locked (GsFlatpakSizeCache *self,
+				  const gchar *path,
+				  guint64 size,
+				  guint64 signature)
+{
+	GsFlatpakSizeCacheEntry *entry = g_new0 (GsFlatpakSizeCacheEntry, 1);
+
+	entry->size = size;
+	entry->signature = signature;
+	entry->timestamp = g_get_real_time () / G_USEC_PER_SEC;
+	g_hash_table_replace (self->entries, g_strdup (path), entry);
+	self->dirty = TRUE;
+}
+
+/* Run in @self->pool. */
+static void
+gs_flatpak_size_cache_refresh_cb (gpointer data,
+				  gpointer user_data)
+{
+	GsFlatpakSizeCache *self = GS_FLATPAK_SIZE_CACHE (user_data);
+	g_autofree gchar *path = (data != save_sentinel) ? data : NULL;
+
+	/* walking big trees should not compete with the user's I/O */
+	gs_ioprio_set (G_PRIORITY_LOW);
+
+	if (path != NULL) {
+		guint64 signature = gs_flatpak_size_cache_get_signature (path);
+		guint64 size = gs_utils_get_file_size (path, NULL, NULL, NULL);
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->mutex);
+
+		g_debug ("refreshed size of %s: %" G_GUINT64_FORMAT, path, size);
+		gs_flatpak_size_cache_set_locked (self, path, size, signature);
+		g_hash_table_remove (self->pending, path);
+	}
+
+	gs_flatpak_size_cache_save (self);
+}
+
+/**
+ * gs_flatpak_size_cache_get_size:
+ * @self: a #GsFlatpakSizeCache
+ * @path: a directory to get the size of
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ *
+ * Gets the disk size of @path, as gs_utils_get_file_size() would.
+ *
+ * If a size for @path has been cached it is returned immediately, and it is
+ * recomputed in the background if it may be out of date.
+ *
+ * Returns: disk size of @path; or 0 when not found
+ *
+ * Since: 44
+ **/
+guint64
+gs_flatpak_size_cache_get_size (GsFlatpakSizeCache *self,
+				const gchar *path,
+				GCancellable *cancellable)
+{
+	GsFlatpakSizeCacheEntry *entry;
+	guint64 signature;
+	guint64 size;
+	gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+	gboolean queue_save = FALSE;
+
+	g_return_val_if_fail (GS_IS_FLATPAK_SIZE_CACHE (self), 0);
+	g_return_val_if_fail (path != NULL, 0);
+
+	signature = gs_flatpak_size_cache_get_signature (path);
+
+	/* nothing there, so nothing to walk */
+	if (signature == 0)
+		return 0;
+
+	/* cache hit */
+	{
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->mutex);
+		entry = g_hash_table_lookup (self->entries, path);
+		if (entry != NULL) {
+			size = entry->size;
+			if ((entry->signature != signature ||
+			     now - entry->timestamp > GS_FLATPAK_SIZE_CACHE_MAX_AGE) &&
+			    !g_hash_table_contains (self->pending, path)) {
+				g_hash_table_add (self->pending, g_strdup (path));
+				g_thread_pool_push (self->pool, g_strdup (path), NULL);
+			}
+			return size;
+		}
+	}
+
+	/* first time this directory has been seen, so walk it now */
+	size = gs_utils_get_file_size (path, NULL, NULL, cancellable);
+	if (g_cancellable_is_cancelled (cancellable))
+		return size;
+
+	{
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->mutex);
+		gs_flatpak_size_cache_set_locked (self, path, size, signature);
+		if (!self->save_queued) {
+			self->save_queued = TRUE;
+			queue_save = TRUE;
+		}
+	}
+	if (queue_save)
+		g_thread_pool_push (self->pool, save_sentinel, NULL);
+
+	return size;
+}
+
+static void
+gs_flatpak_size_cache_finalize (GObject *object)
+{
+	GsFlatpakSizeCache *self = GS_FLATPAK_SIZE_CACHE (object);
+
+	/* drop any queued refreshes, but wait for one in progress */
+	g_thread_pool_free (self->pool, TRUE, TRUE);
+	gs_flatpak_size_cache_save (self);
+
+	g_hash_table_unref (self->entries);
+	g_hash_table_unref (self->pending);
+	g_mutex_clear (&self->mutex);
+	g_free (self->filename);
+
+	G_OBJECT_CLASS (gs_flatpak_size_cache_parent_class)->finalize (object);
+}
+
+static void
+gs_flatpak_size_cache_class_init (GsFlatpakSizeCacheClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_flatpak_size_cache_finalize;
+}
+
+static void
+gs_flatpak_size_cache_init (GsFlatpakSizeCache *self)
+{
+	g_mutex_init (&self->mutex);
+	self->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	self->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	/* exclusive, as the thread's I/O priority is lowered */
+	self->pool = g_thread_pool_new_full (gs_flatpak_size_cache_refresh_cb, self,
+					     gs_flatpak_size_cache_item_free,
+					     1, TRUE, NULL);
+}
+
+/**
+ * gs_flatpak_size_cache_new:
+ * @filename: file to persist the cache to
+ *
+ * Creates a new #GsFlatpakSizeCache, loading any sizes previously saved to
+ * @filename.
+ *
+ * Returns: (transfer full): a new #GsFlatpakSizeCache
+ *
+ * Since: 44
+ **/
+GsFlatpakSizeCache *
+gs_flatpak_size_cache_new (const gchar *filename)
+{
+	GsFlatpakSizeCache *self;
+
+	g_return_val_if_fail (filename != NULL, NULL);
+
+	self = g_object_new (GS_TYPE_FLATPAK_SIZE_CACHE, NULL);
+	self->filename = g_strdup (filename);
+	gs_flatpak_size_cache_load (self);
+	return self;
+}
@@ -0,0 +1,24 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_FLATPAK_SIZE_CACHE (gs_flatpak_size_cache_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsFlatpakSizeCache, gs_flatpak_size_cache, GS, FLATPAK_SIZE_CACHE, GObject)
+
+GsFlatpakSizeCache	*gs_flatpak_size_cache_new	(const gchar		*filename);
+guint64			 gs_flatpak_size_cache_get_size	(GsFlatpakSizeCache	*self,
+							 const gchar		*path,
+							 GCancellable		*cancellable);
+
+G_END_DECLS
@@ -566,11 +566,22 @@ _transaction_operation_done (FlatpakTransaction *transaction,
 	switch (flatpak_transaction_operation_get_operation_type (operation)) {
 	case FLATPAK_TRANSACTION_OPERATION_INSTALL:
 	case FLATPAK_TRANSACTION_OPERATION_INSTALL_BUNDLE:
+		/* pulled ahead of the install, which still has to happen */
+		if (flatpak_transaction_get_no_deploy (transaction)) {
+			gs_app_set_state_recover (app);
+			break;
+		}
 		gs_app_set_state (app, GS_APP_STATE_INSTALLED);
 
 		set_skipped_related_apps_to_installed (self, transaction, operation);
 		break;
 	case FLATPAK_TRANSACTION_OPERATION_UPDATE:
+		/* pulled ahead of deploying it as part of the same update,
+		 * which will finish the job */
+		if (flatpak_transaction_get_no_deploy (transaction) &&
+		    gs_app_get_state (app) == GS_APP_STATE_INSTALLING)
+			break;
+
 		gs_app_set_version (app, gs_app_get_update_version (app));
 		gs_app_set_update_details_markup (app, NULL);
 		gs_app_set_update_urgency (app, AS_URGENCY_KIND_UNKNOWN);
@@ -269,3 +269,74 @@ gs_flatpak_app_set_packaging_info (GsApp *app)
 	gs_app_set_metadata (app, "GnomeSoftware::PackagingBaseCssColor", "accent_color");
 	gs_app_set_metadata (app, "GnomeSoftware::PackagingIcon", "flatpak-symbolic");
 }
+
+GsFlatpakSnapshot *
+gs_flatpak_snapshot_new (void)
+{
+	GsFlatpakSnapshot *snapshot = g_new0 (GsFlatpakSnapshot, 1);
+
+	snapshot->installed_refs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	snapshot->remotes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	snapshot->appstream = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	return snapshot;
+}
+
+void
+gs_flatpak_snapshot_free (GsFlatpakSnapshot *snapshot)
+{
+	g_hash_table_unref (snapshot->installed_refs);
+	g_hash_table_unref (snapshot->remotes);
+	g_hash_table_unref (snapshot->appstream);
+	g_free (snapshot);
+}
+
+/* Compares two snapshots of the same installation. The refs which were
+ * installed, removed or updated are added to @changed_refs, and the remotes
+ * whose AppStream data was updated to @changed_appstream. */
+GsFlatpakChangeFlags
+gs_flatpak_snapshot_compare (GsFlatpakSnapshot *old_snapshot,
+			     GsFlatpakSnapshot *new_snapshot,
+			     GPtrArray *changed_refs,
+			     GPtrArray *changed_appstream)
+{
+	GsFlatpakChangeFlags flags = GS_FLATPAK_CHANGE_NONE;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	/* any remote added, removed or reconfigured */
+	if (g_hash_table_size (new_snapshot->remotes) != g_hash_table_size (old_snapshot->remotes))
+		flags |= GS_FLATPAK_CHANGE_REMOTES;
+	g_hash_table_iter_init (&iter, new_snapshot->remotes);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (g_strcmp0 (value, g_hash_table_lookup (old_snapshot->remotes, key)) != 0)
+			flags |= GS_FLATPAK_CHANGE_REMOTES;
+	}
+
+	/* AppStream data downloaded for a remote */
+	g_hash_table_iter_init (&iter, new_snapshot->appstream);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (g_strcmp0 (value, g_hash_table_lookup (old_snapshot->appstream, key)) != 0) {
+			g_ptr_array_add (changed_appstream, g_strdup (key));
+			flags |= GS_FLATPAK_CHANGE_APPSTREAM;
+		}
+	}
+
+	/* refs installed, removed or updated */
+	g_hash_table_iter_init (&iter, new_snapshot->installed_refs);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (!g_hash_table_contains (old_snapshot->installed_refs, key) ||
+		    g_strcmp0 (value, g_hash_table_lookup (old_snapshot->installed_refs, key)) != 0) {
+			g_ptr_array_add (changed_refs, g_strdup (key));
+			flags |= GS_FLATPAK_CHANGE_INSTALLED_REFS;
+		}
+	}
+	g_hash_table_iter_init (&iter, old_snapshot->installed_refs);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (!g_hash_table_contains (new_snapshot->installed_refs, key)) {
+			g_ptr_array_add (changed_refs, g_strdup (key));
+			flags |= GS_FLATPAK_CHANGE_INSTALLED_REFS;
+		}
+	}
+
+	return flags;
+}
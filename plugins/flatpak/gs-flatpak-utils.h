@@ -21,4 +21,28 @@ GsApp		*gs_flatpak_app_new_from_repo_file	(GFile		*file,
 							 GError		**error);
 void		 gs_flatpak_app_set_packaging_info	(GsApp		*app);
 
+typedef enum {
+	GS_FLATPAK_CHANGE_NONE			= 0,
+	GS_FLATPAK_CHANGE_INSTALLED_REFS	= 1 << 0,
+	GS_FLATPAK_CHANGE_APPSTREAM		= 1 << 1,
+	GS_FLATPAK_CHANGE_REMOTES		= 1 << 2,
+} GsFlatpakChangeFlags;
+
+/* A cheap summary of the state of an installation, compared between change
+ * notifications to work out what changed */
+typedef struct {
+	GHashTable	*installed_refs;  /* (owned) (element-type utf8 utf8); formatted ref ~> commit */
+	GHashTable	*remotes;  /* (owned) (element-type utf8 utf8); remote name ~> configuration */
+	GHashTable	*appstream;  /* (owned) (element-type utf8 utf8); remote name ~> AppStream timestamp */
+} GsFlatpakSnapshot;
+
+GsFlatpakSnapshot *gs_flatpak_snapshot_new		(void);
+void		 gs_flatpak_snapshot_free		(GsFlatpakSnapshot *snapshot);
+GsFlatpakChangeFlags gs_flatpak_snapshot_compare	(GsFlatpakSnapshot *old_snapshot,
+							 GsFlatpakSnapshot *new_snapshot,
+							 GPtrArray	*changed_refs,
+							 GPtrArray	*changed_appstream);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GsFlatpakSnapshot, gs_flatpak_snapshot_free)
+
 G_END_DECLS
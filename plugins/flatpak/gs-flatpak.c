@@ -30,6 +30,7 @@
 #include <config.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <xmlb.h>
 
 #include "gs-appstream.h"
@@ -44,6 +45,7 @@ struct _GsFlatpak {
 	FlatpakInstallation	*installation_noninteractive;  /* (owned) */
 	FlatpakInstallation	*installation_interactive;  /* (owned) */
 	GPtrArray		*installed_refs;  /* must be entirely replaced rather than updated internally */
+	GHashTable		*installed_refs_by_ref;  /* (nullable) (owned) formatted ref ~> FlatpakInstalledRef, replaced along with installed_refs */
 	GMutex			 installed_refs_mutex;
 	GHashTable		*broken_remotes;
 	GMutex			 broken_remotes_mutex;
@@ -51,16 +53,26 @@ struct _GsFlatpak {
 	AsComponentScope	 scope;
 	GsPlugin		*plugin;
 	XbSilo			*silo;
+	GsFlatpakSearchIndex	*search_index;  /* (owned) (nullable); built along with silo */
 	GRWLock			 silo_lock;
+	gint			 silo_last_used;  /* (atomic) monotonic time in seconds */
 	gchar			*id;
 	guint			 changed_id;
 	GHashTable		*app_silos;
+	GQueue			 app_silos_lru;  /* (element-type utf8); refs in app_silos, most recently used first */
+	GHashTable		*app_silo_files;  /* (owned) (element-type utf8 filename); ref ~> cached silo, to reload app_silos after trimming */
+	gint			 app_silos_last_used;  /* monotonic time in seconds; protected by app_silos_mutex */
 	GMutex			 app_silos_mutex;
 	GHashTable		*remote_title; /* gchar *remote name ~> gchar *remote title */
 	GMutex			 remote_title_mutex;
 	gboolean		 requires_full_rescan;
 	gint			 busy; /* (atomic) */
-	gboolean		 changed_while_busy;
+	gint			 changed_while_busy; /* (atomic) */
+	GMainContext		*monitor_context;  /* (owned) (nullable); where change notifications are handled */
+	/* state as of the last change notification, to work out what changed */
+	GsFlatpakSnapshot	*change_snapshot;  /* (owned) (nullable); locked by change_mutex */
+	GMutex			 change_mutex;
+	GsFlatpakSizeCache	*size_cache;  /* (owned) (nullable) */
 };
 
 G_DEFINE_TYPE (GsFlatpak, gs_flatpak, G_TYPE_OBJECT)
@@ -629,6 +641,7 @@ gs_flatpak_internal_data_changed (GsFlatpak *self)
 	/* drop the installed refs cache */
 	locker = g_mutex_locker_new (&self->installed_refs_mutex);
 	g_clear_pointer (&self->installed_refs, g_ptr_array_unref);
+	g_clear_pointer (&self->installed_refs_by_ref, g_hash_table_unref);
 	g_clear_pointer (&locker, g_mutex_locker_free);
 
 	/* drop the remote title cache */
@@ -646,13 +659,222 @@ gs_flatpak_internal_data_changed (GsFlatpak *self)
 	self->requires_full_rescan = TRUE;
 }
 
+static gchar *
+gs_flatpak_get_remote_config (FlatpakRemote *xremote)
+{
+	g_autofree gchar *url = flatpak_remote_get_url (xremote);
+	g_autofree gchar *title = flatpak_remote_get_title (xremote);
+	g_autofree gchar *collection_id = flatpak_remote_get_collection_id (xremote);
+	g_autofree gchar *filter = flatpak_remote_get_filter (xremote);
+
+	return g_strdup_printf ("%s\n%s\n%s\n%s\n%i\n%i\n%i",
+				url != NULL ? url : "",
+				title != NULL ? title : "",
+				collection_id != NULL ? collection_id : "",
+				filter != NULL ? filter : "",
+				flatpak_remote_get_prio (xremote),
+				flatpak_remote_get_disabled (xremote),
+				flatpak_remote_get_noenumerate (xremote));
+}
+
+static gchar *
+gs_flatpak_get_remote_appstream_timestamp (FlatpakRemote *xremote)
+{
+	g_autoptr(GFile) file = flatpak_remote_get_appstream_timestamp (xremote, NULL);
+	g_autofree gchar *path = g_file_get_path (file);
+	GStatBuf st;
+
+	if (path == NULL || g_stat (path, &st) != 0)
+		return g_strdup ("0");
+	return g_strdup_printf ("%" G_GINT64_FORMAT, (gint64) st.st_mtime);
+}
+
+/* Takes a cheap snapshot of the installed refs and remotes of @self. This
+ * does I/O, so must not be called from the main thread. Returns %NULL on
+ * error. */
+static GsFlatpakSnapshot *
+gs_flatpak_take_snapshot (GsFlatpak *self)
+{
+	g_autoptr(GPtrArray) xrefs = NULL;
+	g_autoptr(GPtrArray) xremotes = NULL;
+	g_autoptr(GsFlatpakSnapshot) snapshot = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* both installation instances need to agree on the content */
+	if (!flatpak_installation_drop_caches (self->installation_noninteractive, NULL, &error_local) ||
+	    !flatpak_installation_drop_caches (self->installation_interactive, NULL, &error_local) ||
+	    (xrefs = flatpak_installation_list_installed_refs (self->installation_noninteractive,
+							       NULL, &error_local)) == NULL ||
+	    (xremotes = flatpak_installation_list_remotes (self->installation_noninteractive,
+							   NULL, &error_local)) == NULL) {
+		g_debug ("failed to work out what changed in %s: %s",
+			 self->id, error_local->message);
+		return NULL;
+	}
+
+	snapshot = gs_flatpak_snapshot_new ();
+	for (guint i = 0; i < xrefs->len; i++) {
+		FlatpakRef *xref = g_ptr_array_index (xrefs, i);
+		g_hash_table_insert (snapshot->installed_refs,
+				     flatpak_ref_format_ref (xref),
+				     g_strdup (flatpak_ref_get_commit (xref)));
+	}
+	for (guint i = 0; i < xremotes->len; i++) {
+		FlatpakRemote *xremote = g_ptr_array_index (xremotes, i);
+		const gchar *name = flatpak_remote_get_name (xremote);
+		g_hash_table_insert (snapshot->remotes, g_strdup (name),
+				     gs_flatpak_get_remote_config (xremote));
+		g_hash_table_insert (snapshot->appstream, g_strdup (name),
+				     gs_flatpak_get_remote_appstream_timestamp (xremote));
+	}
+
+	return g_steal_pointer (&snapshot);
+}
+
+/* Takes a new snapshot of @self and compares it to the previous one. The refs
+ * and remotes which have changed are added to @changed_refs and
+ * @changed_appstream. */
+static GsFlatpakChangeFlags
+gs_flatpak_classify_change (GsFlatpak *self,
+			    GPtrArray *changed_refs,
+			    GPtrArray *changed_appstream)
+{
+	g_autoptr(GsFlatpakSnapshot) snapshot = gs_flatpak_take_snapshot (self);
+	g_autoptr(GsFlatpakSnapshot) old_snapshot = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->change_mutex);
+
+	old_snapshot = g_steal_pointer (&self->change_snapshot);
+	self->change_snapshot = g_steal_pointer (&snapshot);
+
+	/* nothing to compare against, so assume anything changed */
+	if (old_snapshot == NULL || self->change_snapshot == NULL)
+		return GS_FLATPAK_CHANGE_REMOTES;
+
+	return gs_flatpak_snapshot_compare (old_snapshot, self->change_snapshot,
+					    changed_refs, changed_appstream);
+}
+
+/* Resets the state of the cached apps for @changed_refs, so it is worked out
+ * again on the next refine. Other cached apps are left alone. */
+static void
+gs_flatpak_reset_changed_apps (GsFlatpak *self,
+			       GPtrArray *changed_refs)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+
+	gs_plugin_cache_lookup_by_state (self->plugin, list, GS_APP_STATE_UNKNOWN);
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		g_autofree gchar *ref_display = NULL;
+		gboolean installed, stale;
+
+		if (g_strcmp0 (gs_flatpak_app_get_object_id (app), self->id) != 0 ||
+		    gs_flatpak_app_get_ref_name (app) == NULL ||
+		    gs_flatpak_app_get_ref_arch (app) == NULL ||
+		    gs_app_get_branch (app) == NULL)
+			continue;
+
+		ref_display = gs_flatpak_app_get_ref_display (app);
+		if (!g_ptr_array_find_with_equal_func (changed_refs, ref_display, g_str_equal, NULL))
+			continue;
+
+		/* only where the state no longer matches what is installed,
+		 * which is not the case for changes gnome-software made itself;
+		 * apps in the middle of an operation are left to it */
+		{
+			g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->change_mutex);
+			installed = (self->change_snapshot != NULL &&
+				     g_hash_table_contains (self->change_snapshot->installed_refs, ref_display));
+		}
+		switch (gs_app_get_state (app)) {
+		case GS_APP_STATE_INSTALLED:
+			stale = !installed;
+			break;
+		case GS_APP_STATE_UPDATABLE:
+		case GS_APP_STATE_UPDATABLE_LIVE:
+			/* updated, or removed */
+			stale = TRUE;
+			break;
+		case GS_APP_STATE_AVAILABLE:
+		case GS_APP_STATE_UNAVAILABLE:
+			stale = installed;
+			break;
+		default:
+			stale = FALSE;
+			break;
+		}
+
+		if (stale) {
+			g_debug ("%s changed, resetting state of %s",
+				 ref_display, gs_app_get_unique_id (app));
+			gs_app_set_state (app, GS_APP_STATE_UNKNOWN);
+		}
+	}
+}
+
+/* Drops the cached apps which are not installed and come from one of
+ * @changed_remotes, as their AppStream data may have changed. */
+static void
+gs_flatpak_forget_remote_apps (GsFlatpak *self,
+			       GPtrArray *changed_remotes)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+
+	gs_plugin_cache_lookup_by_state (self->plugin, list, GS_APP_STATE_AVAILABLE);
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+
+		if (g_strcmp0 (gs_flatpak_app_get_object_id (app), self->id) != 0 ||
+		    gs_app_get_origin (app) == NULL ||
+		    !g_ptr_array_find_with_equal_func (changed_remotes, gs_app_get_origin (app), g_str_equal, NULL))
+			continue;
+
+		gs_plugin_cache_remove (self->plugin, gs_app_get_unique_id (app));
+	}
+}
+
+/* Run in @monitor_context, which is not the main thread. */
 static gboolean
 gs_flatpak_claim_changed_idle_cb (gpointer user_data)
 {
 	GsFlatpak *self = user_data;
+	g_autoptr(GPtrArray) changed_refs = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) changed_appstream = g_ptr_array_new_with_free_func (g_free);
+	GsFlatpakChangeFlags flags;
+
+	flags = gs_flatpak_classify_change (self, changed_refs, changed_appstream);
+	g_debug ("%s changed: %s%s%s", self->id,
+		 (flags & GS_FLATPAK_CHANGE_INSTALLED_REFS) ? "installed-refs " : "",
+		 (flags & GS_FLATPAK_CHANGE_APPSTREAM) ? "appstream " : "",
+		 (flags & GS_FLATPAK_CHANGE_REMOTES) ? "remotes" : "");
+	if (flags == GS_FLATPAK_CHANGE_NONE)
+		return G_SOURCE_REMOVE;
+
+	/* a remote was added, removed or reconfigured, which can affect
+	 * anything, so start again from scratch */
+	if (flags & GS_FLATPAK_CHANGE_REMOTES) {
+		gs_flatpak_internal_data_changed (self);
+		gs_plugin_cache_invalidate (self->plugin);
+		gs_plugin_reload (self->plugin);
+		return G_SOURCE_REMOVE;
+	}
 
-	gs_flatpak_internal_data_changed (self);
-	gs_plugin_cache_invalidate (self->plugin);
+	if (flags & GS_FLATPAK_CHANGE_INSTALLED_REFS) {
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->installed_refs_mutex);
+		g_clear_pointer (&self->installed_refs, g_ptr_array_unref);
+		g_clear_pointer (&self->installed_refs_by_ref, g_hash_table_unref);
+		g_clear_pointer (&locker, g_mutex_locker_free);
+
+		gs_flatpak_reset_changed_apps (self, changed_refs);
+	}
+
+	if (flags & GS_FLATPAK_CHANGE_APPSTREAM)
+		gs_flatpak_forget_remote_apps (self, changed_appstream);
+
+	/* the silo is built from both the remotes’ AppStream data and the
+	 * installed apps; rebuilding it reuses the compiled blob if neither
+	 * actually changed its contents */
+	gs_flatpak_invalidate_silo (self);
 	gs_plugin_reload (self->plugin);
 
 	return G_SOURCE_REMOVE;
@@ -666,7 +888,7 @@ gs_plugin_flatpak_changed_cb (GFileMonitor *monitor,
 			      GsFlatpak *self)
 {
 	if (gs_flatpak_get_busy (self)) {
-		self->changed_while_busy = TRUE;
+		g_atomic_int_set (&self->changed_while_busy, TRUE);
 	} else {
 		gs_flatpak_claim_changed_idle_cb (self);
 	}
@@ -1171,6 +1393,7 @@ gs_flatpak_rescan_appstream_store (GsFlatpak *self,
 	/* drat! silo needs regenerating */
 	writer_locker = g_rw_lock_writer_locker_new (&self->silo_lock);
 	g_clear_object (&self->silo);
+	g_clear_object (&self->search_index);
 
 	/* FIXME: https://gitlab.gnome.org/GNOME/gnome-software/-/issues/1422 */
 	old_thread_default = g_main_context_ref_thread_default ();
@@ -1251,6 +1474,9 @@ gs_flatpak_rescan_appstream_store (GsFlatpak *self,
 	if (self->silo == NULL)
 		return FALSE;
 
+	/* so searches do not have to look at every component */
+	self->search_index = gs_flatpak_search_index_new (self->silo);
+
 	/* success */
 	return TRUE;
 }
@@ -1310,6 +1536,8 @@ ensure_flatpak_silo_with_locker (GsFlatpak            *self,
 		*locker = g_rw_lock_reader_locker_new (&self->silo_lock);
 	}
 
+	g_atomic_int_set (&self->silo_last_used, g_get_monotonic_time () / G_USEC_PER_SEC);
+
 	return TRUE;
 }
 
@@ -1324,6 +1552,14 @@ gs_flatpak_setup (GsFlatpak *self, GCancellable *cancellable, GError **error)
 		gs_flatpak_error_convert (error);
 		return FALSE;
 	}
+
+	/* so the first change can be classified */
+	gs_flatpak_classify_change (self, NULL, NULL);
+
+	/* the monitor emits its signals in this context, and any changes
+	 * deferred while busy are handled here too */
+	self->monitor_context = g_main_context_ref_thread_default ();
+
 	self->changed_id =
 		g_signal_connect (self->monitor, "changed",
 				  G_CALLBACK (gs_plugin_flatpak_changed_cb), self);
@@ -1434,6 +1670,51 @@ gs_flatpak_refresh_appstream_remote (GsFlatpak *self,
 	return TRUE;
 }
 
+/* Maximum number of remotes to refresh at the same time; most of the time is
+ * spent waiting on the network, so this mostly bounds the number of open
+ * connections and the memory used by concurrent OSTree pulls. */
+#define GS_FLATPAK_REFRESH_MAX_PARALLEL 4
+
+typedef struct {
+	gchar		*remote_name;
+	GError		*error;
+	gint64		 elapsed_usec;
+} GsFlatpakRefreshRemote;
+
+static void
+gs_flatpak_refresh_remote_free (GsFlatpakRefreshRemote *item)
+{
+	g_free (item->remote_name);
+	g_clear_error (&item->error);
+	g_free (item);
+}
+
+typedef struct {
+	GsFlatpak	*self;
+	gboolean	 interactive;
+	GCancellable	*cancellable;
+} GsFlatpakRefreshHelper;
+
+static void
+gs_flatpak_refresh_appstream_worker_cb (gpointer data,
+					gpointer user_data)
+{
+	GsFlatpakRefreshRemote *item = data;
+	GsFlatpakRefreshHelper *helper = user_data;
+	gint64 begin_time_usec = g_get_monotonic_time ();
+
+	gs_flatpak_refresh_appstream_remote (helper->self,
+					     item->remote_name,
+					     helper->interactive,
+					     helper->cancellable,
+					     &item->error);
+	item->elapsed_usec = g_get_monotonic_time () - begin_time_usec;
+	g_debug ("refreshing AppStream metadata for remote %s took %.1f ms%s",
+		 item->remote_name,
+		 (gdouble) item->elapsed_usec / 1000.0,
+		 (item->error != NULL) ? " (failed)" : "");
+}
+
 static gboolean
 gs_flatpak_refresh_appstream (GsFlatpak     *self,
                               guint64        cache_age_secs,
@@ -1441,8 +1722,11 @@ gs_flatpak_refresh_appstream (GsFlatpak     *self,
                               GCancellable  *cancellable,
                               GError       **error)
 {
-	gboolean ret;
 	g_autoptr(GPtrArray) xremotes = NULL;
+	g_autoptr(GPtrArray) pending = NULL;
+	GsFlatpakRefreshHelper helper = { self, interactive, cancellable };
+	GThreadPool *pool;
+	gint64 begin_time_usec;
 
 	/* get remotes */
 	xremotes = flatpak_installation_list_remotes (gs_flatpak_get_installation (self, interactive),
@@ -1452,31 +1736,31 @@ gs_flatpak_refresh_appstream (GsFlatpak     *self,
 		gs_flatpak_error_convert (error);
 		return FALSE;
 	}
+
+	/* work out which remotes need new data */
+	pending = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_flatpak_refresh_remote_free);
 	for (guint i = 0; i < xremotes->len; i++) {
 		const gchar *remote_name;
 		guint64 tmp;
-		g_autoptr(GError) error_local = NULL;
-		g_autoptr(GFile) file = NULL;
 		g_autoptr(GFile) file_timestamp = NULL;
-		g_autofree gchar *appstream_fn = NULL;
 		FlatpakRemote *xremote = g_ptr_array_index (xremotes, i);
-		g_autoptr(GMutexLocker) locker = NULL;
+		GsFlatpakRefreshRemote *item;
 
 		/* not enabled */
 		if (flatpak_remote_get_disabled (xremote))
 			continue;
 
 		remote_name = flatpak_remote_get_name (xremote);
-		locker = g_mutex_locker_new (&self->broken_remotes_mutex);
 
 		/* skip known-broken repos */
-		if (g_hash_table_lookup (self->broken_remotes, remote_name) != NULL) {
-			g_debug ("skipping known broken remote: %s", remote_name);
-			continue;
+		{
+			g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->broken_remotes_mutex);
+			if (g_hash_table_lookup (self->broken_remotes, remote_name) != NULL) {
+				g_debug ("skipping known broken remote: %s", remote_name);
+				continue;
+			}
 		}
 
-		g_clear_pointer (&locker, g_mutex_locker_free);
-
 		/* is the timestamp new enough */
 		file_timestamp = flatpak_remote_get_appstream_timestamp (xremote, NULL);
 		tmp = gs_utils_get_file_age (file_timestamp);
@@ -1487,48 +1771,71 @@ gs_flatpak_refresh_appstream (GsFlatpak     *self,
 			continue;
 		}
 
-		/* download new data */
 		g_debug ("%s is %" G_GUINT64_FORMAT " seconds old, so downloading new data",
 			 remote_name, tmp);
-		ret = gs_flatpak_refresh_appstream_remote (self,
-							   remote_name,
-							   interactive,
-							   cancellable,
-							   &error_local);
-		if (!ret) {
-			g_autoptr(GsPluginEvent) event = NULL;
-			if (g_error_matches (error_local,
-					     GS_PLUGIN_ERROR,
-					     GS_PLUGIN_ERROR_FAILED)) {
-				g_debug ("Failed to get AppStream metadata: %s",
-					 error_local->message);
+		item = g_new0 (GsFlatpakRefreshRemote, 1);
+		item->remote_name = g_strdup (remote_name);
+		g_ptr_array_add (pending, item);
+	}
+
+	/* download new data for all the stale remotes at once, so the total
+	 * time is bounded by the slowest remote rather than the sum of all of
+	 * them; the pool is freed with wait=TRUE so this blocks until every
+	 * remote has finished */
+	begin_time_usec = g_get_monotonic_time ();
+	if (pending->len > 1) {
+		pool = g_thread_pool_new (gs_flatpak_refresh_appstream_worker_cb,
+					  &helper,
+					  MIN (pending->len, GS_FLATPAK_REFRESH_MAX_PARALLEL),
+					  FALSE,
+					  NULL);
+		for (guint i = 0; i < pending->len; i++)
+			g_thread_pool_push (pool, g_ptr_array_index (pending, i), NULL);
+		g_thread_pool_free (pool, FALSE, TRUE);
+	} else if (pending->len == 1) {
+		gs_flatpak_refresh_appstream_worker_cb (g_ptr_array_index (pending, 0), &helper);
+	}
+	if (pending->len > 0) {
+		g_debug ("refreshing AppStream metadata for %u remotes took %.1f ms",
+			 pending->len,
+			 (gdouble) (g_get_monotonic_time () - begin_time_usec) / 1000.0);
+	}
+
+	/* handle failures in remote order, from this thread */
+	for (guint i = 0; i < pending->len; i++) {
+		GsFlatpakRefreshRemote *item = g_ptr_array_index (pending, i);
+		g_autoptr(GsPluginEvent) event = NULL;
 
-				locker = g_mutex_locker_new (&self->broken_remotes_mutex);
+		if (item->error == NULL)
+			continue;
 
-				/* don't try to fetch this again until refresh() */
-				g_hash_table_insert (self->broken_remotes,
-						     g_strdup (remote_name),
-						     GUINT_TO_POINTER (1));
-				continue;
-			}
+		if (g_error_matches (item->error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_FAILED)) {
+			g_autoptr(GMutexLocker) locker = NULL;
+
+			g_debug ("Failed to get AppStream metadata: %s",
+				 item->error->message);
+
+			locker = g_mutex_locker_new (&self->broken_remotes_mutex);
 
-			/* allow the plugin loader to decide if this should be
-			 * shown the user, possibly only for interactive jobs */
-			gs_flatpak_error_convert (&error_local);
-			event = gs_plugin_event_new ("error", error_local,
-						     NULL);
-			gs_plugin_event_add_flag (event, GS_PLUGIN_EVENT_FLAG_WARNING);
-			gs_plugin_report_event (self->plugin, event);
+			/* don't try to fetch this again until refresh() */
+			g_hash_table_insert (self->broken_remotes,
+					     g_strdup (item->remote_name),
+					     GUINT_TO_POINTER (1));
 			continue;
 		}
 
-		/* add the new AppStream repo to the shared silo */
-		file = flatpak_remote_get_appstream_dir (xremote, NULL);
-		appstream_fn = g_file_get_path (file);
-		g_debug ("using AppStream metadata found at: %s", appstream_fn);
+		/* allow the plugin loader to decide if this should be
+		 * shown the user, possibly only for interactive jobs */
+		gs_flatpak_error_convert (&item->error);
+		event = gs_plugin_event_new ("error", item->error,
+					     NULL);
+		gs_plugin_event_add_flag (event, GS_PLUGIN_EVENT_FLAG_WARNING);
+		gs_plugin_report_event (self->plugin, event);
 	}
 
-	/* ensure the AppStream silo is up to date */
+	/* ensure the AppStream silo is up to date, once for all remotes */
 	if (!gs_flatpak_rescan_appstream_store (self, interactive, cancellable, error)) {
 		gs_flatpak_internal_data_changed (self);
 		return FALSE;
@@ -1537,6 +1844,63 @@ gs_flatpak_refresh_appstream (GsFlatpak     *self,
 	return TRUE;
 }
 
+/* Must be called with @self->installed_refs_mutex held. Builds the snapshot of
+ * installed refs with a single flatpak_installation_list_installed_refs() call,
+ * so refining many apps does not query the installation once per app. */
+static gboolean
+gs_flatpak_ensure_installed_refs_locked (GsFlatpak *self,
+					 gboolean interactive,
+					 GCancellable *cancellable,
+					 GError **error)
+{
+	FlatpakInstallation *installation = gs_flatpak_get_installation (self, interactive);
+
+	if (self->installed_refs != NULL && self->installed_refs_by_ref != NULL)
+		return TRUE;
+
+	if (self->installed_refs == NULL) {
+		self->installed_refs = flatpak_installation_list_installed_refs (installation,
+										 cancellable, error);
+		if (self->installed_refs == NULL) {
+			gs_flatpak_error_convert (error);
+			return FALSE;
+		}
+	}
+
+	self->installed_refs_by_ref = g_hash_table_new_full (g_str_hash, g_str_equal,
+							     g_free, g_object_unref);
+	for (guint i = 0; i < self->installed_refs->len; i++) {
+		FlatpakInstalledRef *xref = g_ptr_array_index (self->installed_refs, i);
+		g_hash_table_insert (self->installed_refs_by_ref,
+				     flatpak_ref_format_ref (FLATPAK_REF (xref)),
+				     g_object_ref (xref));
+	}
+
+	return TRUE;
+}
+
+/* Returns the installed ref for @formatted_ref from the snapshot, or %NULL
+ * if it is not installed. Returns %FALSE only if the snapshot could not be
+ * built. */
+static gboolean
+gs_flatpak_lookup_installed_ref (GsFlatpak *self,
+				 const gchar *formatted_ref,
+				 FlatpakInstalledRef **out_xref,
+				 gboolean interactive,
+				 GCancellable *cancellable,
+				 GError **error)
+{
+	FlatpakInstalledRef *xref;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->installed_refs_mutex);
+
+	if (!gs_flatpak_ensure_installed_refs_locked (self, interactive, cancellable, error))
+		return FALSE;
+
+	xref = g_hash_table_lookup (self->installed_refs_by_ref, formatted_ref);
+	*out_xref = (xref != NULL) ? g_object_ref (xref) : NULL;
+	return TRUE;
+}
+
 static void
 gs_flatpak_set_metadata_installed (GsFlatpak *self,
 				   GsApp *app,
@@ -1760,33 +2124,16 @@ gs_flatpak_ref_to_app (GsFlatpak *self,
 		       GError **error)
 {
 	g_autoptr(GPtrArray) xremotes = NULL;
+	g_autoptr(FlatpakInstalledRef) xref_installed = NULL;
 	FlatpakInstallation *installation = gs_flatpak_get_installation (self, interactive);
 
 	g_return_val_if_fail (ref != NULL, NULL);
 
-	g_mutex_lock (&self->installed_refs_mutex);
-
-	if (self->installed_refs == NULL) {
-		self->installed_refs = flatpak_installation_list_installed_refs (installation,
-								 cancellable, error);
-
-		if (self->installed_refs == NULL) {
-			g_mutex_unlock (&self->installed_refs_mutex);
-			gs_flatpak_error_convert (error);
-			return NULL;
-		}
-	}
-
-	for (guint i = 0; i < self->installed_refs->len; i++) {
-		g_autoptr(FlatpakInstalledRef) xref = g_object_ref (g_ptr_array_index (self->installed_refs, i));
-		g_autofree gchar *ref_tmp = flatpak_ref_format_ref (FLATPAK_REF (xref));
-		if (g_strcmp0 (ref, ref_tmp) == 0) {
-			g_mutex_unlock (&self->installed_refs_mutex);
-			return gs_flatpak_create_installed (self, xref, NULL, interactive, cancellable);
-		}
-	}
-
-	g_mutex_unlock (&self->installed_refs_mutex);
+	if (!gs_flatpak_lookup_installed_ref (self, ref, &xref_installed,
+					      interactive, cancellable, error))
+		return NULL;
+	if (xref_installed != NULL)
+		return gs_flatpak_create_installed (self, xref_installed, NULL, interactive, cancellable);
 
 	/* look at each remote xref */
 	xremotes = flatpak_installation_list_remotes (installation,
@@ -2191,6 +2538,7 @@ gs_flatpak_refresh (GsFlatpak *self,
 	/* drop the installed refs cache */
 	g_mutex_lock (&self->installed_refs_mutex);
 	g_clear_pointer (&self->installed_refs, g_ptr_array_unref);
+	g_clear_pointer (&self->installed_refs_by_ref, g_hash_table_unref);
 	g_mutex_unlock (&self->installed_refs_mutex);
 
 	/* manually do this in case we created the first appstream file */
@@ -2394,7 +2742,7 @@ gs_flatpak_refine_app_state_unlocked (GsFlatpak *self,
                                       GError **error)
 {
 	g_autoptr(FlatpakInstalledRef) ref = NULL;
-	g_autoptr(GPtrArray) installed_refs = NULL;
+	g_autofree gchar *ref_display = NULL;
 	FlatpakInstallation *installation = gs_flatpak_get_installation (self, interactive);
 
 	/* already found */
@@ -2410,36 +2758,17 @@ gs_flatpak_refine_app_state_unlocked (GsFlatpak *self,
 		return FALSE;
 
 	/* find the app using the origin and the ID */
-	g_mutex_lock (&self->installed_refs_mutex);
-
-	if (self->installed_refs == NULL) {
-		self->installed_refs = flatpak_installation_list_installed_refs (installation,
-								 cancellable, error);
-
-		if (self->installed_refs == NULL) {
-			g_mutex_unlock (&self->installed_refs_mutex);
-			gs_flatpak_error_convert (error);
+	if (gs_flatpak_app_get_ref_name (app) != NULL &&
+	    gs_flatpak_app_get_ref_arch (app) != NULL &&
+	    gs_app_get_branch (app) != NULL) {
+		ref_display = gs_flatpak_app_get_ref_display (app);
+		if (!gs_flatpak_lookup_installed_ref (self, ref_display, &ref,
+						      interactive, cancellable, error))
 			return FALSE;
-		}
+		if (ref != NULL &&
+		    g_strcmp0 (flatpak_installed_ref_get_origin (ref), gs_app_get_origin (app)) != 0)
+			g_clear_object (&ref);
 	}
-
-	installed_refs = g_ptr_array_ref (self->installed_refs);
-
-	for (guint i = 0; i < installed_refs->len; i++) {
-		FlatpakInstalledRef *ref_tmp = g_ptr_array_index (installed_refs, i);
-		const gchar *origin = flatpak_installed_ref_get_origin (ref_tmp);
-		const gchar *name = flatpak_ref_get_name (FLATPAK_REF (ref_tmp));
-		const gchar *arch = flatpak_ref_get_arch (FLATPAK_REF (ref_tmp));
-		const gchar *branch = flatpak_ref_get_branch (FLATPAK_REF (ref_tmp));
-		if (g_strcmp0 (origin, gs_app_get_origin (app)) == 0 &&
-		    g_strcmp0 (name, gs_flatpak_app_get_ref_name (app)) == 0 &&
-		    g_strcmp0 (arch, gs_flatpak_app_get_ref_arch (app)) == 0 &&
-		    g_strcmp0 (branch, gs_app_get_branch (app)) == 0) {
-			ref = g_object_ref (ref_tmp);
-			break;
-		}
-	}
-	g_mutex_unlock (&self->installed_refs_mutex);
 	if (ref != NULL) {
 		g_debug ("marking %s as installed with flatpak",
 			 gs_app_get_unique_id (app));
@@ -2666,6 +2995,199 @@ gs_flatpak_set_app_metadata (GsFlatpak *self,
 	return TRUE;
 }
 
+static gint
+gs_flatpak_cache_dir_sort_cb (gconstpointer a, gconstpointer b)
+{
+	GFileInfo *info_a = *((GFileInfo **) a);
+	GFileInfo *info_b = *((GFileInfo **) b);
+	guint64 mtime_a = g_file_info_get_attribute_uint64 (info_a, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	guint64 mtime_b = g_file_info_get_attribute_uint64 (info_b, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+	/* newest first */
+	if (mtime_a > mtime_b)
+		return -1;
+	if (mtime_a < mtime_b)
+		return 1;
+	return 0;
+}
+
+/* How often, in seconds, to update the modification time of a cached file
+ * which is in use */
+#define GS_FLATPAK_CACHE_TOUCH_INTERVAL		(24 * 60 * 60)
+
+/* Marks @file in a cache directory as recently used, so that
+ * gs_flatpak_prune_cache_dir() keeps it. This only needs to be roughly right,
+ * so the file is written to at most once per %GS_FLATPAK_CACHE_TOUCH_INTERVAL
+ * rather than every time it is used. */
+static void
+gs_flatpak_touch_cache_file (GFile *file,
+			     GCancellable *cancellable)
+{
+	g_autoptr(GFileInfo) info = NULL;
+	g_autoptr(GError) error_local = NULL;
+	guint64 mtime, now;
+
+	info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  G_FILE_QUERY_INFO_NONE, cancellable, &error_local);
+	if (info == NULL) {
+		g_debug ("failed to touch cached file: %s", error_local->message);
+		return;
+	}
+
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	now = (guint64) (g_get_real_time () / G_USEC_PER_SEC);
+	if (now < mtime + GS_FLATPAK_CACHE_TOUCH_INTERVAL)
+		return;
+
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, now);
+	if (!g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE,
+					      cancellable, &error_local))
+		g_debug ("failed to touch cached file: %s", error_local->message);
+}
+
+/* Remove the least recently used files ending in @suffix from @cache_dir so it
+ * stays bounded; failures are not fatal as the cache is only an optimisation */
+static void
+gs_flatpak_prune_cache_dir (GFile *cache_dir,
+			    const gchar *suffix,
+			    guint max_entries)
+{
+	g_autoptr(GFileEnumerator) enumerator = NULL;
+	g_autoptr(GPtrArray) infos = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GError) error_local = NULL;
+
+	enumerator = g_file_enumerate_children (cache_dir,
+						G_FILE_ATTRIBUTE_STANDARD_NAME ","
+						G_FILE_ATTRIBUTE_TIME_MODIFIED,
+						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						NULL, &error_local);
+	if (enumerator == NULL) {
+		g_debug ("failed to enumerate cache: %s", error_local->message);
+		return;
+	}
+	while (TRUE) {
+		GFileInfo *info = g_file_enumerator_next_file (enumerator, NULL, &error_local);
+		if (info == NULL)
+			break;
+		if (!g_str_has_suffix (g_file_info_get_name (info), suffix)) {
+			g_object_unref (info);
+			continue;
+		}
+		g_ptr_array_add (infos, info);
+	}
+	if (error_local != NULL) {
+		g_debug ("failed to enumerate cache: %s", error_local->message);
+		return;
+	}
+	if (infos->len <= max_entries)
+		return;
+
+	g_ptr_array_sort (infos, gs_flatpak_cache_dir_sort_cb);
+	for (guint i = max_entries; i < infos->len; i++) {
+		GFileInfo *info = g_ptr_array_index (infos, i);
+		g_autoptr(GFile) file = g_file_get_child (cache_dir, g_file_info_get_name (info));
+		g_autoptr(GError) error_delete = NULL;
+
+		if (!g_file_delete (file, NULL, &error_delete))
+			g_debug ("failed to prune cache: %s", error_delete->message);
+	}
+}
+
+/* Number of remote metadata files to keep on disk for each remote */
+#define GS_FLATPAK_REMOTE_METADATA_CACHE_MAX	1024
+
+/* The metadata for a given commit never changes, so it is cached on disk keyed
+ * by the remote and commit. The commit is looked up in the cached summary so
+ * no network access is needed to find the cache entry; newer summaries also
+ * carry the metadata itself. The network is only used if neither is there. */
+static GBytes *
+gs_flatpak_fetch_remote_metadata_for_ref (GsFlatpak *self,
+					  const gchar *origin,
+					  FlatpakRef *xref,
+					  gboolean interactive,
+					  GCancellable *cancellable,
+					  GError **error)
+{
+	FlatpakInstallation *installation = gs_flatpak_get_installation (self, interactive);
+	g_autoptr(FlatpakRemoteRef) remote_ref = NULL;
+	g_autoptr(GBytes) data = NULL;
+	g_autoptr(GFile) cache_file = NULL;
+	const gchar *commit = NULL;
+
+	remote_ref = flatpak_installation_fetch_remote_ref_sync_full (installation,
+								      origin,
+								      flatpak_ref_get_kind (xref),
+								      flatpak_ref_get_name (xref),
+								      flatpak_ref_get_arch (xref),
+								      flatpak_ref_get_branch (xref),
+								      FLATPAK_QUERY_FLAGS_ONLY_CACHED,
+								      cancellable,
+								      NULL);
+	if (remote_ref != NULL)
+		commit = flatpak_ref_get_commit (FLATPAK_REF (remote_ref));
+
+	if (commit != NULL) {
+		g_autofree gchar *cache_kind = g_build_filename ("flatpak", "remote-metadata", origin, NULL);
+		g_autofree gchar *cache_basename = g_strdup_printf ("%s.metadata", commit);
+		g_autofree gchar *cache_fn = NULL;
+		g_autoptr(GError) error_local = NULL;
+
+		cache_fn = gs_utils_get_cache_filename (cache_kind, cache_basename,
+							GS_UTILS_CACHE_FLAG_WRITEABLE |
+							GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+							&error_local);
+		if (cache_fn == NULL) {
+			g_debug ("not caching remote metadata: %s", error_local->message);
+		} else {
+			g_autofree gchar *contents = NULL;
+			gsize len = 0;
+
+			cache_file = g_file_new_for_path (cache_fn);
+			if (g_file_get_contents (cache_fn, &contents, &len, NULL)) {
+				gs_flatpak_touch_cache_file (cache_file, cancellable);
+				return g_bytes_new_take (g_steal_pointer (&contents), len);
+			}
+		}
+	}
+
+	/* newer summaries include the metadata, which saves a round-trip */
+	if (remote_ref != NULL) {
+		GBytes *metadata = flatpak_remote_ref_get_metadata (remote_ref);
+		if (metadata != NULL)
+			data = g_bytes_ref (metadata);
+	}
+
+	/* fetch from the server */
+	if (data == NULL) {
+		data = flatpak_installation_fetch_remote_metadata_sync (installation,
+									origin,
+									xref,
+									cancellable,
+									error);
+		if (data == NULL)
+			return NULL;
+	}
+
+	/* save for next time */
+	if (cache_file != NULL) {
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GFile) cache_dir = g_file_get_parent (cache_file);
+
+		if (!g_file_replace_contents (cache_file,
+					      g_bytes_get_data (data, NULL),
+					      g_bytes_get_size (data),
+					      NULL, FALSE, G_FILE_CREATE_NONE,
+					      NULL, cancellable, &error_local)) {
+			g_debug ("failed to cache remote metadata: %s", error_local->message);
+		} else {
+			gs_flatpak_prune_cache_dir (cache_dir, ".metadata",
+						    GS_FLATPAK_REMOTE_METADATA_CACHE_MAX);
+		}
+	}
+
+	return g_steal_pointer (&data);
+}
+
 static GBytes *
 gs_flatpak_fetch_remote_metadata (GsFlatpak *self,
 				  GsApp *app,
@@ -2687,15 +3209,16 @@ gs_flatpak_fetch_remote_metadata (GsFlatpak *self,
 		return NULL;
 	}
 
-	/* fetch from the server */
+	/* fetch from the cache or the server */
 	xref = gs_flatpak_create_fake_ref (app, error);
 	if (xref == NULL)
 		return NULL;
-	data = flatpak_installation_fetch_remote_metadata_sync (gs_flatpak_get_installation (self, interactive),
-								gs_app_get_origin (app),
-								xref,
-								cancellable,
-								&local_error);
+	data = gs_flatpak_fetch_remote_metadata_for_ref (self,
+							 gs_app_get_origin (app),
+							 xref,
+							 interactive,
+							 cancellable,
+							 &local_error);
 	if (data == NULL) {
 		if (g_error_matches (local_error, FLATPAK_ERROR, FLATPAK_ERROR_REF_NOT_FOUND) &&
 		    !gs_plugin_get_network_available (self->plugin)) {
@@ -2710,6 +3233,37 @@ gs_flatpak_fetch_remote_metadata (GsFlatpak *self,
 	return g_steal_pointer (&data);
 }
 
+/* Fetches the remote metadata for @app into the on-disk cache, so a later
+ * refine of its permissions does not need a network round-trip. This does not
+ * modify @app, and errors are ignored. */
+void
+gs_flatpak_prefetch_remote_metadata (GsFlatpak *self,
+				     GsApp *app,
+				     GCancellable *cancellable)
+{
+	g_autoptr(FlatpakRef) xref = NULL;
+	g_autoptr(GBytes) data = NULL;
+	g_autoptr(GError) error_local = NULL;
+	const gchar *source = gs_app_get_source_default (app);
+	const gchar *origin = gs_app_get_origin (app);
+
+	/* only uninstalled apps need the remote metadata */
+	if (gs_app_is_installed (app) ||
+	    gs_app_has_kudo (app, GS_APP_KUDO_SANDBOXED) ||
+	    gs_app_get_kind (app) == AS_COMPONENT_KIND_REPOSITORY ||
+	    source == NULL || origin == NULL)
+		return;
+
+	xref = flatpak_ref_parse (source, NULL);
+	if (xref == NULL || flatpak_ref_get_kind (xref) != FLATPAK_REF_KIND_APP)
+		return;
+
+	data = gs_flatpak_fetch_remote_metadata_for_ref (self, origin, xref, FALSE,
+							 cancellable, &error_local);
+	if (data == NULL)
+		g_debug ("failed to prefetch metadata for %s: %s", source, error_local->message);
+}
+
 static gboolean
 gs_plugin_refine_item_metadata (GsFlatpak *self,
 				GsApp *app,
@@ -2772,7 +3326,19 @@ gs_flatpak_get_installed_ref (GsFlatpak *self,
 			      GCancellable *cancellable,
 			      GError **error)
 {
-	FlatpakInstalledRef *ref;
+	FlatpakInstalledRef *ref = NULL;
+
+	/* try the snapshot first; it can be slightly out of date after an
+	 * install, so fall back to asking flatpak if it is not found */
+	if (gs_flatpak_app_get_ref_name (app) != NULL &&
+	    gs_flatpak_app_get_ref_arch (app) != NULL &&
+	    gs_app_get_branch (app) != NULL) {
+		g_autofree gchar *ref_display = gs_flatpak_app_get_ref_display (app);
+		if (gs_flatpak_lookup_installed_ref (self, ref_display, &ref, interactive, cancellable, NULL) &&
+		    ref != NULL)
+			return ref;
+	}
+
 	ref = flatpak_installation_get_installed_ref (gs_flatpak_get_installation (self, interactive),
 						      gs_flatpak_app_get_ref_kind (app),
 						      gs_flatpak_app_get_ref_name (app),
@@ -2922,12 +3488,15 @@ gs_flatpak_prune_addons_list (GsFlatpak *self,
 }
 
 static guint64
-gs_flatpak_get_app_directory_size (GsApp *app,
+gs_flatpak_get_app_directory_size (GsFlatpak *self,
+				   GsApp *app,
 				   const gchar *subdir_name,
 				   GCancellable *cancellable)
 {
 	g_autofree gchar *filename = NULL;
 	filename = g_build_filename (g_get_home_dir (), ".var", "app", gs_app_get_id (app), subdir_name, NULL);
+	if (self->size_cache != NULL)
+		return gs_flatpak_size_cache_get_size (self->size_cache, filename, cancellable);
 	return gs_utils_get_file_size (filename, NULL, NULL, cancellable);
 }
 
@@ -3069,28 +3638,131 @@ gs_flatpak_refine_appstream_release (XbNode *component, GsApp *app)
 	}
 }
 
-/* This function is like gs_flatpak_refine_appstream(), but takes gzip
- * compressed appstream data as a GBytes and assumes they are already uniquely
- * tied to the app (and therefore app ID alone can be used to find the right
- * component).
- */
-static gboolean
-gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
-					GsApp *app,
-					const char *origin, /* (nullable) */
-					FlatpakInstalledRef *installed_ref, /* (nullable) */
-					GBytes *appstream_gz,
-					GsPluginRefineFlags flags,
-					gboolean interactive,
-					GCancellable *cancellable,
-					GError **error)
+/* Bump this when the fixups applied in gs_flatpak_build_app_silo() change, so
+ * stale cached silos are not reused */
+#define GS_FLATPAK_APP_SILO_CACHE_VERSION	1
+
+/* Number of compiled per-app silos to keep on disk */
+#define GS_FLATPAK_APP_SILO_CACHE_MAX		64
+
+/* Number of per-app silos to keep loaded; the least recently used ones beyond
+ * this are reloaded from the cache directory when next needed */
+#define GS_FLATPAK_APP_SILOS_LOADED_MAX		16
+
+/* Must be called with @self->app_silos_mutex held. */
+static void
+gs_flatpak_app_silos_remove_locked (GsFlatpak *self,
+				    const gchar *ref)
+{
+	GList *link = g_queue_find_custom (&self->app_silos_lru, ref, (GCompareFunc) g_strcmp0);
+
+	if (link != NULL) {
+		g_free (link->data);
+		g_queue_delete_link (&self->app_silos_lru, link);
+	}
+	g_hash_table_remove (self->app_silos, ref);
+}
+
+/* Marks the app silo for @ref as the most recently used, and unloads the least
+ * recently used ones beyond %GS_FLATPAK_APP_SILOS_LOADED_MAX. Only silos which
+ * can be reloaded from disk are unloaded.
+ *
+ * Must be called with @self->app_silos_mutex held. */
+static void
+gs_flatpak_app_silos_touch_locked (GsFlatpak *self,
+				   const gchar *ref)
+{
+	GList *link = g_queue_find_custom (&self->app_silos_lru, ref, (GCompareFunc) g_strcmp0);
+
+	if (link != NULL)
+		g_queue_unlink (&self->app_silos_lru, link);
+	else
+		link = g_list_prepend (NULL, g_strdup (ref));
+	g_queue_push_head_link (&self->app_silos_lru, link);
+
+	link = self->app_silos_lru.tail;
+	while (link != NULL && g_queue_get_length (&self->app_silos_lru) > GS_FLATPAK_APP_SILOS_LOADED_MAX) {
+		GList *prev = link->prev;
+		const gchar *lru_ref = link->data;
+
+		if (g_hash_table_contains (self->app_silo_files, lru_ref)) {
+			g_debug ("unloading least recently used app silo for %s", lru_ref);
+			g_hash_table_remove (self->app_silos, lru_ref);
+			g_free (link->data);
+			g_queue_delete_link (&self->app_silos_lru, link);
+		}
+		link = prev;
+	}
+}
+
+/* Must be called with @self->app_silos_mutex held. */
+static void
+gs_flatpak_app_silos_insert_locked (GsFlatpak *self,
+				    const gchar *ref,
+				    XbSilo *silo)
+{
+	g_hash_table_replace (self->app_silos, g_strdup (ref), g_object_ref (silo));
+	gs_flatpak_app_silos_touch_locked (self, ref);
+}
+
+static gchar *
+gs_flatpak_get_app_silo_cache_key (GsFlatpak *self,
+				   GsApp *app,
+				   const gchar *origin,
+				   FlatpakInstalledRef *installed_ref,
+				   const gchar *commit,
+				   GBytes *appstream_gz)
+{
+	const gchar *const *locales = g_get_language_names ();
+	g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	g_autofree gchar *ref_display = gs_flatpak_app_get_ref_display (app);
+	g_autofree gchar *scratch = NULL;
+
+	scratch = g_strdup_printf ("%u\n%s\n%s\n%s\n",
+				   (guint) GS_FLATPAK_APP_SILO_CACHE_VERSION,
+				   ref_display,
+				   origin != NULL ? origin : "",
+				   as_component_scope_to_string (self->scope));
+	g_checksum_update (checksum, (const guchar *) scratch, -1);
+
+	/* the deploy dir is used for the icon prefix, and changes on update */
+	if (installed_ref != NULL) {
+		const gchar *deploy_dir = flatpak_installed_ref_get_deploy_dir (installed_ref);
+		g_checksum_update (checksum, (const guchar *) deploy_dir, -1);
+	}
+
+	/* the commit identifies the AppStream data; fall back to hashing the
+	 * data itself if it is not known */
+	if (commit != NULL) {
+		g_checksum_update (checksum, (const guchar *) commit, -1);
+	} else {
+		gsize appstream_gz_sz;
+		gconstpointer appstream_gz_data = g_bytes_get_data (appstream_gz, &appstream_gz_sz);
+		g_checksum_update (checksum, appstream_gz_data, appstream_gz_sz);
+	}
+
+	/* the silo is compiled for the current locales only */
+	for (guint i = 0; locales[i] != NULL; i++)
+		g_checksum_update (checksum, (const guchar *) locales[i], -1);
+
+	return g_strdup (g_checksum_get_string (checksum));
+}
+
+/* Compiles @appstream_gz into a silo, writing it to @file if it is non-%NULL
+ * so it can be reused by gs_flatpak_load_app_silo() */
+static XbSilo *
+gs_flatpak_build_app_silo (GsFlatpak *self,
+			   GsApp *app,
+			   const char *origin, /* (nullable) */
+			   FlatpakInstalledRef *installed_ref, /* (nullable) */
+			   GBytes *appstream_gz,
+			   GFile *file, /* (nullable) */
+			   GCancellable *cancellable,
+			   GError **error)
 {
 	const gchar *const *locales = g_get_language_names ();
-	g_autofree gchar *xpath = NULL;
 	g_autoptr(XbBuilder) builder = NULL;
 	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
-	g_autoptr(XbNode) component_node = NULL;
-	g_autoptr(XbNode) n = NULL;
 	g_autoptr(XbSilo) silo = NULL;
 	g_autoptr(XbBuilderFixup) bundle_fixup = NULL;
 	g_autoptr(GBytes) appstream = NULL;
@@ -3122,7 +3794,7 @@ gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
 			     GS_PLUGIN_ERROR,
 			     GS_PLUGIN_ERROR_INVALID_FORMAT,
 			     "unable to decompress appstream data");
-		return FALSE;
+		return NULL;
 	}
 	stream_data = g_converter_input_stream_new (stream_gz,
 						    G_CONVERTER (decompressor));
@@ -3133,14 +3805,14 @@ gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
 					       error);
 	if (appstream == NULL) {
 		gs_flatpak_error_convert (error);
-		return FALSE;
+		return NULL;
 	}
 
 	/* build silo */
 	if (!xb_builder_source_load_bytes (source, appstream,
 					   XB_BUILDER_SOURCE_FLAG_NONE,
 					   error))
-		return FALSE;
+		return NULL;
 
 	/* Appdata from flatpak_installed_ref_load_appdata() may be missing the
 	 * <bundle> tag but for this function we know it's the right component.
@@ -3175,16 +3847,111 @@ gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
 	if (old_thread_default != NULL)
 		g_main_context_pop_thread_default (old_thread_default);
 
-	silo = xb_builder_compile (builder,
-				   XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
-				   cancellable,
-				   error);
+	if (file != NULL) {
+		silo = xb_builder_ensure (builder, file,
+					  XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
+					  cancellable,
+					  error);
+	} else {
+		silo = xb_builder_compile (builder,
+					   XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
+					   cancellable,
+					   error);
+	}
 
 	if (old_thread_default != NULL)
 		g_main_context_push_thread_default (old_thread_default);
 
-	if (silo == NULL)
-		return FALSE;
+	return g_steal_pointer (&silo);
+}
+
+/* Loads a silo previously written by gs_flatpak_build_app_silo(), returning
+ * %NULL if it is missing or unusable */
+static XbSilo *
+gs_flatpak_load_app_silo (GFile *file,
+			  GCancellable *cancellable)
+{
+	g_autoptr(XbSilo) silo = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	if (!g_file_query_exists (file, cancellable))
+		return NULL;
+
+	silo = xb_silo_new ();
+	if (!xb_silo_load_from_file (silo, file, XB_SILO_LOAD_FLAG_NONE,
+				     cancellable, &error_local)) {
+		g_debug ("ignoring cached app silo: %s", error_local->message);
+		return NULL;
+	}
+
+	/* mark as recently used, so it is not pruned */
+	gs_flatpak_touch_cache_file (file, cancellable);
+
+	return g_steal_pointer (&silo);
+}
+
+/* This function is like gs_flatpak_refine_appstream(), but takes gzip
+ * compressed appstream data as a GBytes and assumes they are already uniquely
+ * tied to the app (and therefore app ID alone can be used to find the right
+ * component).
+ *
+ * The compiled silo is cached on disk, keyed by @commit (or a checksum of
+ * @appstream_gz if that is %NULL), so refining the same app again does not
+ * need to decompress and compile the XML again.
+ */
+static gboolean
+gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
+					GsApp *app,
+					const char *origin, /* (nullable) */
+					FlatpakInstalledRef *installed_ref, /* (nullable) */
+					const gchar *commit, /* (nullable) */
+					GBytes *appstream_gz,
+					GsPluginRefineFlags flags,
+					gboolean interactive,
+					GCancellable *cancellable,
+					GError **error)
+{
+	g_autofree gchar *xpath = NULL;
+	g_autofree gchar *cache_key = NULL;
+	g_autofree gchar *cache_kind = NULL;
+	g_autofree gchar *cache_basename = NULL;
+	g_autofree gchar *cache_fn = NULL;
+	g_autoptr(GFile) cache_file = NULL;
+	g_autoptr(XbNode) component_node = NULL;
+	g_autoptr(XbNode) n = NULL;
+	g_autoptr(XbSilo) silo = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* find the on-disk cache location; the cache is optional */
+	cache_key = gs_flatpak_get_app_silo_cache_key (self, app, origin, installed_ref,
+						       commit, appstream_gz);
+	cache_kind = g_build_filename (gs_flatpak_get_id (self), "app-silos", NULL);
+	cache_basename = g_strdup_printf ("%s.xmlb", cache_key);
+	cache_fn = gs_utils_get_cache_filename (cache_kind, cache_basename,
+						GS_UTILS_CACHE_FLAG_WRITEABLE |
+						GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+						&error_local);
+	if (cache_fn == NULL)
+		g_debug ("not caching app silo: %s", error_local->message);
+	else
+		cache_file = g_file_new_for_path (cache_fn);
+
+	if (cache_file != NULL)
+		silo = gs_flatpak_load_app_silo (cache_file, cancellable);
+	if (silo != NULL) {
+		g_debug ("using cached app silo %s", cache_fn);
+	} else {
+		silo = gs_flatpak_build_app_silo (self, app, origin, installed_ref,
+						  appstream_gz, cache_file,
+						  cancellable, error);
+		if (silo == NULL)
+			return FALSE;
+		if (cache_file != NULL) {
+			g_autoptr(GFile) cache_dir = g_file_get_parent (cache_file);
+			gs_flatpak_prune_cache_dir (cache_dir, ".xmlb", GS_FLATPAK_APP_SILO_CACHE_MAX);
+		}
+	}
+
 	if (g_getenv ("GS_XMLB_VERBOSE") != NULL) {
 		g_autofree gchar *xml = NULL;
 		xml = xb_silo_export (silo,
@@ -3230,9 +3997,12 @@ gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
 	/* save the silo so it can be used for searches */
 	{
 		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->app_silos_mutex);
-		g_hash_table_replace (self->app_silos,
-				      gs_flatpak_app_get_ref_display (app),
-				      g_steal_pointer (&silo));
+		g_autofree gchar *ref_display = gs_flatpak_app_get_ref_display (app);
+		if (cache_fn != NULL)
+			g_hash_table_replace (self->app_silo_files,
+					      g_strdup (ref_display),
+					      g_strdup (cache_fn));
+		gs_flatpak_app_silos_insert_locked (self, ref_display, silo);
 	}
 
 	return TRUE;
@@ -3290,12 +4060,8 @@ get_renamed_component (GsFlatpak *self,
 		g_autoptr(FlatpakInstalledRef) installed_ref = NULL;
 		const gchar *installed_name = NULL;
 
-		installed_ref = flatpak_installation_get_installed_ref (installation,
-									gs_flatpak_app_get_ref_kind (app),
-									gs_flatpak_app_get_ref_name (app),
-									gs_flatpak_app_get_ref_arch (app),
-									gs_app_get_branch (app),
-									cancellable, error);
+		installed_ref = gs_flatpak_get_installed_ref (self, app, interactive,
+							      cancellable, error);
 		if (installed_ref != NULL)
 			installed_name = flatpak_installed_ref_get_appdata_name (installed_ref);
 		if (installed_name != NULL)
@@ -3377,13 +4143,8 @@ gs_flatpak_refine_appstream (GsFlatpak *self,
 		 * appstream data in @silo for it, so use the appstream data from
 		 * within the app.
 		 */
-		installed_ref = flatpak_installation_get_installed_ref (gs_flatpak_get_installation (self, interactive),
-									gs_flatpak_app_get_ref_kind (app),
-									gs_flatpak_app_get_ref_name (app),
-									gs_flatpak_app_get_ref_arch (app),
-									gs_app_get_branch (app),
-									cancellable,
-									&error_local);
+		installed_ref = gs_flatpak_get_installed_ref (self, app, interactive,
+							      cancellable, &error_local);
 
 		if (installed_ref == NULL)
 			return !propagate_cancelled_error (error, &error_local); /* the app may not be installed */
@@ -3399,6 +4160,7 @@ gs_flatpak_refine_appstream (GsFlatpak *self,
 				                               app,
 							       flatpak_installed_ref_get_origin (installed_ref),
 							       installed_ref,
+							       flatpak_ref_get_commit (FLATPAK_REF (installed_ref)),
 							       appstream_gz,
 							       flags,
 							       interactive,
@@ -3499,11 +4261,11 @@ gs_flatpak_refine_app_unlocked (GsFlatpak *self,
 	    gs_app_get_kind (app) != AS_COMPONENT_KIND_RUNTIME) {
 		if (gs_app_get_size_cache_data (app, NULL) != GS_SIZE_TYPE_VALID)
 			gs_app_set_size_cache_data (app, GS_SIZE_TYPE_VALID,
-						    gs_flatpak_get_app_directory_size (app, "cache", cancellable));
+						    gs_flatpak_get_app_directory_size (self, app, "cache", cancellable));
 		if (gs_app_get_size_user_data (app, NULL) != GS_SIZE_TYPE_VALID)
 			gs_app_set_size_user_data (app, GS_SIZE_TYPE_VALID,
-						   gs_flatpak_get_app_directory_size (app, "config", cancellable) +
-						   gs_flatpak_get_app_directory_size (app, "data", cancellable));
+						   gs_flatpak_get_app_directory_size (self, app, "config", cancellable) +
+						   gs_flatpak_get_app_directory_size (self, app, "data", cancellable));
 
 		if (g_cancellable_is_cancelled (cancellable)) {
 			gs_app_set_size_cache_data (app, GS_SIZE_TYPE_UNKNOWABLE, 0);
@@ -3779,6 +4541,7 @@ gs_flatpak_file_to_app_bundle (GsFlatpak *self,
 	appstream_gz = flatpak_bundle_ref_get_appstream (xref_bundle);
 	if (appstream_gz != NULL) {
 		if (!gs_flatpak_refine_appstream_from_bytes (self, app, NULL, NULL,
+							     flatpak_ref_get_commit (FLATPAK_REF (xref_bundle)),
 							     appstream_gz,
 							     GS_PLUGIN_REFINE_FLAGS_REQUIRE_ID,
 							     interactive,
@@ -4174,6 +4937,64 @@ gs_flatpak_file_to_app_ref (GsFlatpak *self,
 	return g_steal_pointer (&app);
 }
 
+/* Returns the refs of all the app silos, whether or not they are loaded.
+ * Must be called with @self->app_silos_mutex held. */
+static GPtrArray *
+gs_flatpak_app_silos_get_refs_locked (GsFlatpak *self)
+{
+	g_autoptr(GPtrArray) refs = g_ptr_array_new_with_free_func (g_free);
+	GHashTableIter iter;
+	gpointer key;
+
+	self->app_silos_last_used = g_get_monotonic_time () / G_USEC_PER_SEC;
+
+	g_hash_table_iter_init (&iter, self->app_silo_files);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		g_ptr_array_add (refs, g_strdup (key));
+	g_hash_table_iter_init (&iter, self->app_silos);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (!g_hash_table_contains (self->app_silo_files, key))
+			g_ptr_array_add (refs, g_strdup (key));
+	}
+
+	return g_steal_pointer (&refs);
+}
+
+/* Returns the app silo for @ref, reading it from its on-disk cache if it has
+ * been unloaded by gs_flatpak_trim() or to stay within
+ * %GS_FLATPAK_APP_SILOS_LOADED_MAX.
+ *
+ * This is used when searching, which goes through every app silo, so it
+ * neither marks the silo as recently used nor keeps it loaded: that would
+ * unload each silo just before the next search needs it.
+ *
+ * Must be called with @self->app_silos_mutex held. */
+static XbSilo *
+gs_flatpak_app_silos_lookup_locked (GsFlatpak *self,
+				    const gchar *ref,
+				    GCancellable *cancellable)
+{
+	XbSilo *silo;
+	const gchar *filename;
+	g_autoptr(GFile) file = NULL;
+
+	silo = g_hash_table_lookup (self->app_silos, ref);
+	if (silo != NULL)
+		return g_object_ref (silo);
+
+	filename = g_hash_table_lookup (self->app_silo_files, ref);
+	if (filename == NULL)
+		return NULL;
+	file = g_file_new_for_path (filename);
+	silo = gs_flatpak_load_app_silo (file, cancellable);
+
+	/* the cached silo is only forgotten if it is really unusable */
+	if (silo == NULL && !g_cancellable_is_cancelled (cancellable))
+		g_hash_table_remove (self->app_silo_files, ref);
+
+	return silo;
+}
+
 gboolean
 gs_flatpak_search (GsFlatpak *self,
 		   const gchar * const *values,
@@ -4185,16 +5006,21 @@ gs_flatpak_search (GsFlatpak *self,
 	g_autoptr(GsAppList) list_tmp = gs_app_list_new ();
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
 	g_autoptr(GMutexLocker) app_silo_locker = NULL;
+	g_autoptr(GPtrArray) app_silo_refs = NULL;
 	g_autoptr(GPtrArray) silos_to_remove = g_ptr_array_new ();
-	GHashTableIter iter;
-	gpointer key, value;
 
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	if (!gs_appstream_search (self->plugin, self->silo, values, list_tmp,
-				  cancellable, error))
+	if (self->search_index != NULL) {
+		g_autoptr(GPtrArray) candidates = gs_flatpak_search_index_get_candidates (self->search_index, values);
+		if (!gs_appstream_search_components (self->plugin, self->silo, candidates, values, list_tmp,
+						     cancellable, error))
+			return FALSE;
+	} else if (!gs_appstream_search (self->plugin, self->silo, values, list_tmp,
+					 cancellable, error)) {
 		return FALSE;
+	}
 
 	gs_flatpak_ensure_remote_title (self, interactive, cancellable);
 
@@ -4203,34 +5029,29 @@ gs_flatpak_search (GsFlatpak *self,
 
 	/* Also search silos from installed apps which were missing from self->silo */
 	app_silo_locker = g_mutex_locker_new (&self->app_silos_mutex);
-	g_hash_table_iter_init (&iter, self->app_silos);
-	while (g_hash_table_iter_next (&iter, &key, &value)) {
-		g_autoptr(XbSilo) app_silo = g_object_ref (value);
+	app_silo_refs = gs_flatpak_app_silos_get_refs_locked (self);
+	for (guint i = 0; i < app_silo_refs->len; i++) {
+		g_autoptr(XbSilo) app_silo = NULL;
 		g_autoptr(GsAppList) app_list_tmp = gs_app_list_new ();
-		const char *app_ref = (char *)key;
+		const char *app_ref = g_ptr_array_index (app_silo_refs, i);
 		g_autoptr(FlatpakInstalledRef) installed_ref = NULL;
-		g_auto(GStrv) split = NULL;
-		FlatpakRefKind kind;
-
-		/* Ignore any silos of apps that have since been removed.
-		 * FIXME: can we use self->installed_refs here? */
-		split = g_strsplit (app_ref, "/", -1);
-		g_assert (g_strv_length (split) == 4);
-		if (g_strcmp0 (split[0], "app") == 0)
-			kind = FLATPAK_REF_KIND_APP;
-		else
-			kind = FLATPAK_REF_KIND_RUNTIME;
-		installed_ref = flatpak_installation_get_installed_ref (gs_flatpak_get_installation (self, interactive),
-									kind,
-									split[1],
-									split[2],
-									split[3],
-									NULL, NULL);
-		if (installed_ref == NULL) {
+		g_autoptr(GError) error_local = NULL;
+
+		/* Ignore any silos of apps that have since been removed; if
+		 * that cannot be checked, keep the silo and search it anyway */
+		if (!gs_flatpak_lookup_installed_ref (self, app_ref, &installed_ref,
+						      interactive, cancellable, &error_local)) {
+			g_debug ("failed to check whether %s is installed: %s",
+				 app_ref, error_local->message);
+		} else if (installed_ref == NULL) {
 			g_ptr_array_add (silos_to_remove, (gpointer) app_ref);
 			continue;
 		}
 
+		app_silo = gs_flatpak_app_silos_lookup_locked (self, app_ref, cancellable);
+		if (app_silo == NULL)
+			continue;
+
 		if (!gs_appstream_search (self->plugin, app_silo, values, app_list_tmp,
 					  cancellable, error))
 			return FALSE;
@@ -4241,7 +5062,8 @@ gs_flatpak_search (GsFlatpak *self,
 
 	for (guint i = 0; i < silos_to_remove->len; i++) {
 		const char *silo = g_ptr_array_index (silos_to_remove, i);
-		g_hash_table_remove (self->app_silos, silo);
+		g_hash_table_remove (self->app_silo_files, silo);
+		gs_flatpak_app_silos_remove_locked (self, silo);
 	}
 
 	return TRUE;
@@ -4258,9 +5080,8 @@ gs_flatpak_search_developer_apps (GsFlatpak *self,
 	g_autoptr(GsAppList) list_tmp = gs_app_list_new ();
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
 	g_autoptr(GMutexLocker) app_silo_locker = NULL;
+	g_autoptr(GPtrArray) app_silo_refs = NULL;
 	g_autoptr(GPtrArray) silos_to_remove = g_ptr_array_new ();
-	GHashTableIter iter;
-	gpointer key, value;
 
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
@@ -4276,34 +5097,29 @@ gs_flatpak_search_developer_apps (GsFlatpak *self,
 
 	/* Also search silos from installed apps which were missing from self->silo */
 	app_silo_locker = g_mutex_locker_new (&self->app_silos_mutex);
-	g_hash_table_iter_init (&iter, self->app_silos);
-	while (g_hash_table_iter_next (&iter, &key, &value)) {
-		g_autoptr(XbSilo) app_silo = g_object_ref (value);
+	app_silo_refs = gs_flatpak_app_silos_get_refs_locked (self);
+	for (guint i = 0; i < app_silo_refs->len; i++) {
+		g_autoptr(XbSilo) app_silo = NULL;
 		g_autoptr(GsAppList) app_list_tmp = gs_app_list_new ();
-		const char *app_ref = (char *)key;
+		const char *app_ref = g_ptr_array_index (app_silo_refs, i);
 		g_autoptr(FlatpakInstalledRef) installed_ref = NULL;
-		g_auto(GStrv) split = NULL;
-		FlatpakRefKind kind;
-
-		/* Ignore any silos of apps that have since been removed.
-		 * FIXME: can we use self->installed_refs here? */
-		split = g_strsplit (app_ref, "/", -1);
-		g_assert (g_strv_length (split) == 4);
-		if (g_strcmp0 (split[0], "app") == 0)
-			kind = FLATPAK_REF_KIND_APP;
-		else
-			kind = FLATPAK_REF_KIND_RUNTIME;
-		installed_ref = flatpak_installation_get_installed_ref (gs_flatpak_get_installation (self, interactive),
-									kind,
-									split[1],
-									split[2],
-									split[3],
-									NULL, NULL);
-		if (installed_ref == NULL) {
+		g_autoptr(GError) error_local = NULL;
+
+		/* Ignore any silos of apps that have since been removed; if
+		 * that cannot be checked, keep the silo and search it anyway */
+		if (!gs_flatpak_lookup_installed_ref (self, app_ref, &installed_ref,
+						      interactive, cancellable, &error_local)) {
+			g_debug ("failed to check whether %s is installed: %s",
+				 app_ref, error_local->message);
+		} else if (installed_ref == NULL) {
 			g_ptr_array_add (silos_to_remove, (gpointer) app_ref);
 			continue;
 		}
 
+		app_silo = gs_flatpak_app_silos_lookup_locked (self, app_ref, cancellable);
+		if (app_silo == NULL)
+			continue;
+
 		if (!gs_appstream_search_developer_apps (self->plugin, app_silo, values, app_list_tmp,
 							 cancellable, error))
 			return FALSE;
@@ -4314,7 +5130,8 @@ gs_flatpak_search_developer_apps (GsFlatpak *self,
 
 	for (guint i = 0; i < silos_to_remove->len; i++) {
 		const char *silo = g_ptr_array_index (silos_to_remove, i);
-		g_hash_table_remove (self->app_silos, silo);
+		g_hash_table_remove (self->app_silo_files, silo);
+		gs_flatpak_app_silos_remove_locked (self, silo);
 	}
 
 	return TRUE;
@@ -4527,6 +5344,7 @@ gs_flatpak_finalize (GObject *object)
 	}
 	if (self->silo != NULL)
 		g_object_unref (self->silo);
+	g_clear_object (&self->search_index);
 	if (self->monitor != NULL)
 		g_object_unref (self->monitor);
 
@@ -4534,15 +5352,22 @@ gs_flatpak_finalize (GObject *object)
 	g_object_unref (self->installation_noninteractive);
 	g_object_unref (self->installation_interactive);
 	g_clear_pointer (&self->installed_refs, g_ptr_array_unref);
+	g_clear_pointer (&self->installed_refs_by_ref, g_hash_table_unref);
 	g_mutex_clear (&self->installed_refs_mutex);
 	g_object_unref (self->plugin);
 	g_hash_table_unref (self->broken_remotes);
 	g_mutex_clear (&self->broken_remotes_mutex);
 	g_rw_lock_clear (&self->silo_lock);
 	g_hash_table_unref (self->app_silos);
+	g_queue_clear_full (&self->app_silos_lru, g_free);
+	g_hash_table_unref (self->app_silo_files);
 	g_mutex_clear (&self->app_silos_mutex);
 	g_clear_pointer (&self->remote_title, g_hash_table_unref);
 	g_mutex_clear (&self->remote_title_mutex);
+	g_clear_object (&self->size_cache);
+	g_clear_pointer (&self->change_snapshot, gs_flatpak_snapshot_free);
+	g_mutex_clear (&self->change_mutex);
+	g_clear_pointer (&self->monitor_context, g_main_context_unref);
 
 	G_OBJECT_CLASS (gs_flatpak_parent_class)->finalize (object);
 }
@@ -4567,9 +5392,12 @@ gs_flatpak_init (GsFlatpak *self)
 	self->broken_remotes = g_hash_table_new_full (g_str_hash, g_str_equal,
 						      g_free, NULL);
 	self->app_silos = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+	g_queue_init (&self->app_silos_lru);
+	self->app_silo_files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 	g_mutex_init (&self->app_silos_mutex);
 	self->remote_title = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 	g_mutex_init (&self->remote_title_mutex);
+	g_mutex_init (&self->change_mutex);
 }
 
 GsFlatpak *
@@ -4608,12 +5436,17 @@ gs_flatpak_set_busy (GsFlatpak *self,
 		g_atomic_int_inc (&self->busy);
 	} else {
 		g_return_if_fail (g_atomic_int_get (&self->busy) > 0);
-		if (g_atomic_int_dec_and_test (&self->busy)) {
-			if (self->changed_while_busy) {
-				self->changed_while_busy = FALSE;
-				g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, gs_flatpak_claim_changed_idle_cb,
-					g_object_ref (self), g_object_unref);
-			}
+		if (g_atomic_int_dec_and_test (&self->busy) &&
+		    g_atomic_int_compare_and_exchange (&self->changed_while_busy, TRUE, FALSE)) {
+			g_autoptr(GSource) source = g_idle_source_new ();
+
+			/* working out what changed does I/O, so keep it off
+			 * the main thread */
+			g_source_set_priority (source, G_PRIORITY_DEFAULT_IDLE);
+			g_source_set_callback (source, gs_flatpak_claim_changed_idle_cb,
+					       g_object_ref (self), g_object_unref);
+			g_source_set_static_name (source, "gs_flatpak_claim_changed_idle_cb");
+			g_source_attach (source, self->monitor_context);
 		}
 	}
 }
@@ -4625,6 +5458,106 @@ gs_flatpak_get_busy (GsFlatpak *self)
 	return g_atomic_int_get (&self->busy) > 0;
 }
 
+/* Must be called before @self is used from more than one thread. */
+void
+gs_flatpak_set_size_cache (GsFlatpak *self,
+			   GsFlatpakSizeCache *size_cache)
+{
+	g_return_if_fail (GS_IS_FLATPAK (self));
+	g_return_if_fail (size_cache == NULL || GS_IS_FLATPAK_SIZE_CACHE (size_cache));
+	g_set_object (&self->size_cache, size_cache);
+}
+
+static gsize
+gs_flatpak_get_silo_size (XbSilo *silo)
+{
+	g_autoptr(GBytes) blob = xb_silo_get_bytes (silo);
+	return (blob != NULL) ? g_bytes_get_size (blob) : 0;
+}
+
+/* Fills @out_usage with an estimate of the memory held by the silos of @self.
+ * The silos are mostly mapped from the cache directory, so their size is
+ * reported separately from the heap allocated tables built on top of them. */
+void
+gs_flatpak_get_memory_usage (GsFlatpak *self,
+			     GsFlatpakMemoryUsage *out_usage)
+{
+	g_return_if_fail (GS_IS_FLATPAK (self));
+	g_return_if_fail (out_usage != NULL);
+
+	*out_usage = (GsFlatpakMemoryUsage) { 0, };
+
+	{
+		g_autoptr(GRWLockReaderLocker) locker = g_rw_lock_reader_locker_new (&self->silo_lock);
+		if (self->silo != NULL)
+			out_usage->silo_size = gs_flatpak_get_silo_size (self->silo);
+		if (self->search_index != NULL)
+			out_usage->heap_size += gs_flatpak_search_index_get_size (self->search_index);
+	}
+
+	{
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->app_silos_mutex);
+		GHashTableIter iter;
+		gpointer value;
+
+		out_usage->n_app_silos = g_hash_table_size (self->app_silos);
+		g_hash_table_iter_init (&iter, self->app_silos);
+		while (g_hash_table_iter_next (&iter, NULL, &value))
+			out_usage->app_silos_size += gs_flatpak_get_silo_size (value);
+	}
+
+	{
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->installed_refs_mutex);
+		if (self->installed_refs_by_ref != NULL)
+			out_usage->heap_size += g_hash_table_size (self->installed_refs_by_ref) * 3 * sizeof (gpointer);
+	}
+}
+
+/* Unloads the silo and app silos of @self if they have not been used for
+ * @max_idle_secs; pass zero to unload them regardless. They are reloaded from
+ * the cache directory the next time they are needed.
+ *
+ * Returns %TRUE if anything was unloaded. */
+gboolean
+gs_flatpak_trim (GsFlatpak *self,
+		 guint max_idle_secs)
+{
+	gint now = g_get_monotonic_time () / G_USEC_PER_SEC;
+	gboolean trimmed = FALSE;
+
+	g_return_val_if_fail (GS_IS_FLATPAK (self), FALSE);
+
+	if (now - g_atomic_int_get (&self->silo_last_used) >= (gint) max_idle_secs) {
+		g_autoptr(GRWLockWriterLocker) locker = g_rw_lock_writer_locker_new (&self->silo_lock);
+		if (self->silo != NULL) {
+			g_debug ("unloading idle silo for %s", gs_flatpak_get_id (self));
+			g_clear_object (&self->silo);
+			g_clear_object (&self->search_index);
+			trimmed = TRUE;
+		}
+	}
+
+	{
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->app_silos_mutex);
+		GList *link, *next;
+
+		/* only those which can be reloaded from disk */
+		if (now - self->app_silos_last_used >= (gint) max_idle_secs) {
+			for (link = self->app_silos_lru.head; link != NULL; link = next) {
+				next = link->next;
+				if (!g_hash_table_contains (self->app_silo_files, link->data))
+					continue;
+				g_hash_table_remove (self->app_silos, link->data);
+				g_free (link->data);
+				g_queue_delete_link (&self->app_silos_lru, link);
+				trimmed = TRUE;
+			}
+		}
+	}
+
+	return trimmed;
+}
+
 gboolean
 gs_flatpak_purge_sync (GsFlatpak    *self,
 		       GCancellable *cancellable,
@@ -12,12 +12,22 @@
 #include <gnome-software.h>
 #include <flatpak.h>
 
+#include "gs-flatpak-search-index.h"
+#include "gs-flatpak-size-cache.h"
+
 G_BEGIN_DECLS
 
 #define GS_TYPE_FLATPAK (gs_flatpak_get_type ())
 
 G_DECLARE_FINAL_TYPE (GsFlatpak, gs_flatpak, GS, FLATPAK, GObject)
 
+typedef struct {
+	gsize		 silo_size;  /* mapped */
+	gsize		 app_silos_size;  /* mapped */
+	guint		 n_app_silos;
+	gsize		 heap_size;  /* search index and installed ref tables, estimated */
+} GsFlatpakMemoryUsage;
+
 typedef enum {
 	GS_FLATPAK_FLAG_NONE			= 0,
 	GS_FLATPAK_FLAG_IS_TEMPORARY		= 1 << 0,
@@ -180,6 +190,16 @@ gboolean	gs_flatpak_url_to_app		(GsFlatpak		*self,
 void		gs_flatpak_set_busy		(GsFlatpak		*self,
 						 gboolean		 busy);
 gboolean	gs_flatpak_get_busy		(GsFlatpak		*self);
+void		gs_flatpak_set_size_cache	(GsFlatpak		*self,
+						 GsFlatpakSizeCache	*size_cache);
+void		gs_flatpak_prefetch_remote_metadata
+						(GsFlatpak		*self,
+						 GsApp			*app,
+						 GCancellable		*cancellable);
+void		gs_flatpak_get_memory_usage	(GsFlatpak		*self,
+						 GsFlatpakMemoryUsage	*out_usage);
+gboolean	gs_flatpak_trim			(GsFlatpak		*self,
+						 guint			 max_idle_secs);
 gboolean	gs_flatpak_purge_sync		(GsFlatpak              *self,
 						 GCancellable           *cancellable,
 						 GError                **error);
@@ -61,8 +61,61 @@ struct _GsPluginFlatpak
 
 	GCancellable		*purge_cancellable;
 	guint			 purge_timeout_id;
+
+	GsFlatpakSizeCache	*size_cache;  /* (owned) (nullable); shared by all installations */
+
+	GThreadPool		*prefetch_pool;  /* (owned) (element-type PrefetchItem) */
+	GCancellable		*prefetch_cancellable;  /* (owned) */
+	GMutex			 prefetch_mutex;
+	GHashTable		*prefetch_queued;  /* (owned) (element-type utf8); keys of the items in prefetch_pool; locked by prefetch_mutex */
+	GHashTable		*prefetch_wanted;  /* (owned) (element-type utf8); IDs of wildcard apps to prefetch once refined; locked by prefetch_mutex */
+
+	GMemoryMonitor		*memory_monitor;  /* (owned) (nullable) */
+	gulong			 low_memory_warning_id;
 };
 
+/* Number of apps from the top of an overview or category list to prefetch the
+ * remote metadata for, and the number of prefetches to run at once */
+#define GS_FLATPAK_PREFETCH_MAX_APPS		20
+#define GS_FLATPAK_PREFETCH_MAX_PARALLEL	2
+
+/* Number of wildcard app IDs to remember for prefetching, in case many of
+ * them are never refined */
+#define GS_FLATPAK_PREFETCH_MAX_WANTED		(4 * GS_FLATPAK_PREFETCH_MAX_APPS)
+
+typedef struct {
+	GsFlatpak	*flatpak;  /* (owned) */
+	GsApp		*app;  /* (owned) */
+	gchar		*key;  /* (owned); in prefetch_queued */
+} PrefetchItem;
+
+static void
+prefetch_item_free (PrefetchItem *item)
+{
+	g_object_unref (item->flatpak);
+	g_object_unref (item->app);
+	g_free (item->key);
+	g_free (item);
+}
+
+/* Run in @prefetch_pool. */
+static void
+prefetch_thread_cb (gpointer data,
+		    gpointer user_data)
+{
+	PrefetchItem *item = data;
+	GsPluginFlatpak *self = GS_PLUGIN_FLATPAK (user_data);
+
+	gs_flatpak_prefetch_remote_metadata (item->flatpak, item->app, self->prefetch_cancellable);
+
+	{
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->prefetch_mutex);
+		g_hash_table_remove (self->prefetch_queued, item->key);
+	}
+
+	prefetch_item_free (item);
+}
+
 G_DEFINE_TYPE (GsPluginFlatpak, gs_plugin_flatpak, GS_TYPE_PLUGIN)
 
 #define assert_in_worker(self) \
@@ -90,13 +143,38 @@ gs_plugin_flatpak_dispose (GObject *object)
 	g_cancellable_cancel (self->purge_cancellable);
 	g_assert (self->purge_timeout_id == 0);
 
+	/* drop any queued prefetches, and wait for the running ones */
+	g_cancellable_cancel (self->prefetch_cancellable);
+	if (self->prefetch_pool != NULL) {
+		g_thread_pool_free (self->prefetch_pool, TRUE, TRUE);
+		self->prefetch_pool = NULL;
+	}
+
+	if (self->memory_monitor != NULL)
+		g_clear_signal_handler (&self->low_memory_warning_id, self->memory_monitor);
+	g_clear_object (&self->memory_monitor);
+
 	g_clear_pointer (&self->installations, g_ptr_array_unref);
+	g_clear_object (&self->size_cache);
+	g_clear_object (&self->prefetch_cancellable);
 	g_clear_object (&self->purge_cancellable);
 	g_clear_object (&self->worker);
 
 	G_OBJECT_CLASS (gs_plugin_flatpak_parent_class)->dispose (object);
 }
 
+static void
+gs_plugin_flatpak_finalize (GObject *object)
+{
+	GsPluginFlatpak *self = GS_PLUGIN_FLATPAK (object);
+
+	g_hash_table_unref (self->prefetch_queued);
+	g_hash_table_unref (self->prefetch_wanted);
+	g_mutex_clear (&self->prefetch_mutex);
+
+	G_OBJECT_CLASS (gs_plugin_flatpak_parent_class)->finalize (object);
+}
+
 static void
 gs_plugin_flatpak_init (GsPluginFlatpak *self)
 {
@@ -104,6 +182,15 @@ gs_plugin_flatpak_init (GsPluginFlatpak *self)
 
 	self->installations = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 
+	self->prefetch_cancellable = g_cancellable_new ();
+	g_mutex_init (&self->prefetch_mutex);
+	self->prefetch_queued = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	self->prefetch_wanted = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	self->prefetch_pool = g_thread_pool_new_full (prefetch_thread_cb, self,
+						      (GDestroyNotify) prefetch_item_free,
+						      GS_FLATPAK_PREFETCH_MAX_PARALLEL,
+						      FALSE, NULL);
+
 	/* getting app properties from appstream is quicker */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_AFTER, "appstream");
 
@@ -117,6 +204,9 @@ gs_plugin_flatpak_init (GsPluginFlatpak *self)
 	/* set name of MetaInfo file */
 	gs_plugin_set_appstream_id (plugin, "org.gnome.Software.Plugin.Flatpak");
 
+	/* share cached apps with the other plugins, within the memory budget */
+	gs_plugin_cache_set_shared (plugin, TRUE);
+
 	/* used for self tests */
 	self->destdir_for_tests = g_getenv ("GS_SELF_TEST_FLATPAK_DATADIR");
 }
@@ -186,6 +276,70 @@ gs_plugin_flatpak_purge_timeout_cb (gpointer user_data)
 	return G_SOURCE_CONTINUE;
 }
 
+/* Run in @worker. */
+static void
+gs_plugin_flatpak_trim_thread_cb (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+	GsPluginFlatpak *self = GS_PLUGIN_FLATPAK (source_object);
+	guint max_idle_secs = GPOINTER_TO_UINT (task_data);
+
+	assert_in_worker (self);
+
+	for (guint i = 0; self->installations != NULL && i < self->installations->len; i++) {
+		GsFlatpak *flatpak = g_ptr_array_index (self->installations, i);
+		GsFlatpakMemoryUsage usage;
+
+		gs_flatpak_get_memory_usage (flatpak, &usage);
+		g_debug ("silos of %s: %" G_GSIZE_FORMAT " bytes mapped, "
+			 "%u app silos with %" G_GSIZE_FORMAT " bytes mapped, "
+			 "%" G_GSIZE_FORMAT " bytes of tables",
+			 gs_flatpak_get_id (flatpak), usage.silo_size,
+			 usage.n_app_silos, usage.app_silos_size, usage.heap_size);
+
+		if (gs_flatpak_get_busy (flatpak)) {
+			g_debug ("Not trimming '%s', it's busy right now", gs_flatpak_get_id (flatpak));
+			continue;
+		}
+		gs_flatpak_trim (flatpak, max_idle_secs);
+	}
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+gs_plugin_flatpak_low_memory_warning_cb (GMemoryMonitor             *monitor,
+                                         GMemoryMonitorWarningLevel  level,
+                                         gpointer                    user_data)
+{
+	GsPluginFlatpak *self = GS_PLUGIN_FLATPAK (user_data);
+	g_autoptr(GTask) task = NULL;
+	guint max_idle_secs;
+
+	if (self->worker == NULL || !gs_plugin_get_enabled (GS_PLUGIN (self)))
+		return;
+
+	/* the more pressure, the more recently used silos are dropped */
+	if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL)
+		max_idle_secs = 0;
+	else if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM)
+		max_idle_secs = 60;
+	else
+		max_idle_secs = 10 * 60;
+
+	g_debug ("Low memory warning (level %u), trimming silos idle for %us",
+		 (guint) level, max_idle_secs);
+
+	task = g_task_new (self, NULL, NULL, NULL);
+	g_task_set_source_tag (task, gs_plugin_flatpak_low_memory_warning_cb);
+	g_task_set_task_data (task, GUINT_TO_POINTER (max_idle_secs), NULL);
+
+	gs_worker_thread_queue (self->worker, G_PRIORITY_LOW,
+				gs_plugin_flatpak_trim_thread_cb, g_steal_pointer (&task));
+}
+
 static gboolean
 _as_component_scope_is_compatible (AsComponentScope scope1, AsComponentScope scope2)
 {
@@ -213,6 +367,7 @@ gs_plugin_flatpak_add_installation (GsPluginFlatpak      *self,
 
 	/* create and set up */
 	flatpak = gs_flatpak_new (GS_PLUGIN (self), installation, GS_FLATPAK_FLAG_NONE);
+	gs_flatpak_set_size_cache (flatpak, self->size_cache);
 	if (!gs_flatpak_setup (flatpak, cancellable, error))
 		return FALSE;
 	g_debug ("successfully set up %s", gs_flatpak_get_id (flatpak));
@@ -280,6 +435,14 @@ gs_plugin_flatpak_setup_async (GsPlugin            *plugin,
 		self->purge_timeout_id = g_timeout_add_seconds (PURGE_TIMEOUT_SECONDS,
 								gs_plugin_flatpak_purge_timeout_cb,
 								self);
+
+	/* Unload silos which are not being used when memory gets tight. */
+	if (self->memory_monitor == NULL) {
+		self->memory_monitor = g_memory_monitor_dup_default ();
+		self->low_memory_warning_id = g_signal_connect (self->memory_monitor, "low-memory-warning",
+								G_CALLBACK (gs_plugin_flatpak_low_memory_warning_cb),
+								self);
+	}
 }
 
 /* Run in @worker. */
@@ -363,6 +526,22 @@ setup_thread_cb (GTask        *task,
 		g_ptr_array_add (installations, g_steal_pointer (&installation));
 	}
 
+	/* user data sizes are per-user, so one cache is shared by all installations */
+	if (self->size_cache == NULL) {
+		g_autoptr(GError) error_local = NULL;
+		g_autofree gchar *size_cache_fn = NULL;
+
+		size_cache_fn = gs_utils_get_cache_filename ("flatpak",
+							     "user-data-sizes.ini",
+							     GS_UTILS_CACHE_FLAG_WRITEABLE |
+							     GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+							     &error_local);
+		if (size_cache_fn == NULL)
+			g_debug ("not caching user data sizes: %s", error_local->message);
+		else
+			self->size_cache = gs_flatpak_size_cache_new (size_cache_fn);
+	}
+
 	/* add the installations */
 	for (guint i = 0; installations != NULL && i < installations->len; i++) {
 		g_autoptr(GError) error_local = NULL;
@@ -413,6 +592,10 @@ gs_plugin_flatpak_shutdown_async (GsPlugin            *plugin,
 
 	g_clear_handle_id (&self->purge_timeout_id, g_source_remove);
 	g_cancellable_cancel (self->purge_cancellable);
+	g_cancellable_cancel (self->prefetch_cancellable);
+	if (self->memory_monitor != NULL)
+		g_clear_signal_handler (&self->low_memory_warning_id, self->memory_monitor);
+	g_clear_object (&self->memory_monitor);
 
 	task = g_task_new (self, cancellable, callback, user_data);
 	g_task_set_source_tag (task, gs_plugin_flatpak_shutdown_async);
@@ -576,6 +759,78 @@ gs_plugin_flatpak_get_handler (GsPluginFlatpak *self,
 	return NULL;
 }
 
+/* Queues fetching the remote metadata of the first few apps in an overview or
+ * category @list which are not installed, so that showing their details page
+ * does not have to wait for the network.
+ *
+ * Most such lists are wildcards until they are refined, so the IDs of wildcard
+ * apps are remembered, and the refine of @list calls this again with
+ * @wanted_only set to queue the apps which have since been resolved. */
+static void
+gs_plugin_flatpak_prefetch_metadata (GsPluginFlatpak *self,
+                                     GsAppList       *list,
+                                     gboolean         wanted_only)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	guint n_queued = 0;
+
+	/* this is speculative, so should not use up a metered connection */
+	if (!gs_plugin_get_network_available (GS_PLUGIN (self)) ||
+	    g_network_monitor_get_network_metered (g_network_monitor_get_default ()))
+		return;
+
+	locker = g_mutex_locker_new (&self->prefetch_mutex);
+
+	if (wanted_only && g_hash_table_size (self->prefetch_wanted) == 0)
+		return;
+
+	for (guint i = 0; i < gs_app_list_length (list) && n_queued < GS_FLATPAK_PREFETCH_MAX_APPS; i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		const gchar *id = gs_app_get_id (app);
+		const gchar *origin = gs_app_get_origin (app);
+		const gchar *source = gs_app_get_source_default (app);
+		GsFlatpak *flatpak;
+		PrefetchItem *item;
+		g_autofree gchar *key = NULL;
+
+		if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD)) {
+			if (wanted_only || id == NULL)
+				continue;
+			if (g_hash_table_size (self->prefetch_wanted) >= GS_FLATPAK_PREFETCH_MAX_WANTED)
+				g_hash_table_remove_all (self->prefetch_wanted);
+			g_hash_table_add (self->prefetch_wanted, g_strdup (id));
+			n_queued++;
+			continue;
+		}
+
+		if (wanted_only &&
+		    (id == NULL || !g_hash_table_remove (self->prefetch_wanted, id)))
+			continue;
+
+		if (gs_app_get_kind (app) != AS_COMPONENT_KIND_DESKTOP_APP ||
+		    gs_app_get_state (app) != GS_APP_STATE_AVAILABLE ||
+		    origin == NULL || source == NULL)
+			continue;
+
+		flatpak = gs_plugin_flatpak_get_handler (self, app);
+		if (flatpak == NULL)
+			continue;
+
+		/* skip it if it is already queued by an earlier list */
+		n_queued++;
+		key = g_strdup_printf ("%s:%s:%s", gs_flatpak_get_id (flatpak), origin, source);
+		if (g_hash_table_contains (self->prefetch_queued, key))
+			continue;
+
+		item = g_new0 (PrefetchItem, 1);
+		item->flatpak = g_object_ref (flatpak);
+		item->app = g_object_ref (app);
+		item->key = g_strdup (key);
+		g_hash_table_add (self->prefetch_queued, g_steal_pointer (&key));
+		g_thread_pool_push (self->prefetch_pool, item, NULL);
+	}
+}
+
 static gboolean
 gs_plugin_flatpak_refine_app (GsPluginFlatpak      *self,
                               GsApp                *app,
@@ -721,6 +976,13 @@ refine_thread_cb (GTask        *task,
 		}
 	}
 
+	/* queue the apps from overview and category lists which have now been
+	 * resolved; the metadata has already been fetched if these were
+	 * requested */
+	if (!(flags & (GS_PLUGIN_REFINE_FLAGS_REQUIRE_RUNTIME |
+		       GS_PLUGIN_REFINE_FLAGS_REQUIRE_PERMISSIONS)))
+		gs_plugin_flatpak_prefetch_metadata (self, list, TRUE);
+
 	g_task_return_boolean (task, TRUE);
 }
 
@@ -1003,6 +1265,51 @@ remove_schedule_entry (gpointer schedule_entry_handle)
 		g_warning ("Failed to remove schedule entry: %s", error_local->message);
 }
 
+/* Apps which are not installed yet are in the list passed to
+ * gs_plugin_download() when the loader plans a batch of queued installs. */
+static gboolean
+_app_is_planned_install (GsApp *app)
+{
+	return gs_app_get_state (app) == GS_APP_STATE_AVAILABLE &&
+	       gs_flatpak_app_get_file_kind (app) == GS_FLATPAK_APP_FILE_KIND_UNKNOWN &&
+	       gs_app_get_origin (app) != NULL;
+}
+
+/* Pull @app and the addons selected for it, without deploying them. The
+ * transaction resolves the runtimes and extensions of all the apps added to it
+ * together, so ones shared between them are only fetched once; the installs
+ * which follow then find everything in the local repo. */
+static void
+_transaction_add_planned_install (FlatpakTransaction *transaction,
+				  GsApp *app)
+{
+	g_autoptr(GsAppList) addons = gs_app_dup_addons (app);
+	g_autofree gchar *ref = gs_flatpak_app_get_ref_display (app);
+	g_autoptr(GError) error_local = NULL;
+
+	gs_flatpak_transaction_add_app (transaction, app);
+	if (!flatpak_transaction_add_install (transaction, gs_app_get_origin (app),
+					      ref, NULL, &error_local) &&
+	    !g_error_matches (error_local, FLATPAK_ERROR, FLATPAK_ERROR_ALREADY_INSTALLED)) {
+		g_debug ("not prefetching %s: %s", ref, error_local->message);
+		return;
+	}
+
+	for (guint i = 0; addons != NULL && i < gs_app_list_length (addons); i++) {
+		GsApp *addon = gs_app_list_index (addons, i);
+		g_autofree gchar *addon_ref = NULL;
+		g_autoptr(GError) error_addon = NULL;
+
+		if (!gs_app_get_to_be_installed (addon) || gs_app_get_origin (addon) == NULL)
+			continue;
+		addon_ref = gs_flatpak_app_get_ref_display (addon);
+		if (!flatpak_transaction_add_install (transaction, gs_app_get_origin (addon),
+						      addon_ref, NULL, &error_addon) &&
+		    !g_error_matches (error_addon, FLATPAK_ERROR, FLATPAK_ERROR_ALREADY_INSTALLED))
+			g_debug ("not prefetching %s: %s", addon_ref, error_addon->message);
+	}
+}
+
 gboolean
 gs_plugin_download (GsPlugin *plugin, GsAppList *list,
 		    GCancellable *cancellable, GError **error)
@@ -1050,6 +1357,11 @@ gs_plugin_download (GsPlugin *plugin, GsAppList *list,
 			g_autofree gchar *ref = NULL;
 			g_autoptr(GError) error_local = NULL;
 
+			if (_app_is_planned_install (app)) {
+				_transaction_add_planned_install (transaction, app);
+				continue;
+			}
+
 			ref = gs_flatpak_app_get_ref_display (app);
 			if (flatpak_transaction_add_update (transaction, ref, NULL, NULL, &error_local))
 				continue;
@@ -1086,7 +1398,8 @@ gs_plugin_download (GsPlugin *plugin, GsAppList *list,
 		 * for the apps. */
 		for (guint i = 0; i < gs_app_list_length (list_tmp); i++) {
 			GsApp *app = gs_app_list_index (list_tmp, i);
-			gs_app_set_is_update_downloaded (app, TRUE);
+			if (!_app_is_planned_install (app))
+				gs_app_set_is_update_downloaded (app, TRUE);
 		}
 	}
 
@@ -1456,27 +1769,20 @@ gs_plugin_app_install (GsPlugin *plugin,
 	return TRUE;
 }
 
+/* Runs a single update transaction for @list_tmp, pulling and deploying.
+ * Nothing is pulled if @is_pulled, or if all the updates were previously
+ * downloaded. */
 static gboolean
-gs_plugin_flatpak_update (GsPlugin *plugin,
-			  GsFlatpak *flatpak,
-			  GsAppList *list_tmp,
-			  gboolean interactive,
-			  GCancellable *cancellable,
-			  GError **error)
+gs_plugin_flatpak_run_update (GsPlugin *plugin,
+			      GsFlatpak *flatpak,
+			      GsAppList *list_tmp,
+			      gboolean is_pulled,
+			      gboolean interactive,
+			      GCancellable *cancellable,
+			      GError **error)
 {
 	g_autoptr(FlatpakTransaction) transaction = NULL;
 	gboolean is_update_downloaded = TRUE;
-	gpointer schedule_entry_handle = NULL;
-
-	if (!interactive) {
-		g_autoptr(GError) error_local = NULL;
-
-		if (!gs_metered_block_app_list_on_download_scheduler (list_tmp, &schedule_entry_handle, cancellable, &error_local)) {
-			g_warning ("Failed to block on download scheduler: %s",
-				   error_local->message);
-			g_clear_error (&error_local);
-		}
-	}
 
 	/* build and run transaction */
 	transaction = _build_transaction (plugin, flatpak, interactive, cancellable, error);
@@ -1530,7 +1836,7 @@ gs_plugin_flatpak_update (GsPlugin *plugin,
 		is_update_downloaded &= gs_app_get_is_update_downloaded (app);
 	}
 
-	if (is_update_downloaded) {
+	if (is_pulled || is_update_downloaded) {
 		flatpak_transaction_set_no_pull (transaction, TRUE);
 	}
 
@@ -1543,7 +1849,6 @@ gs_plugin_flatpak_update (GsPlugin *plugin,
 			gs_app_set_state_recover (app);
 		}
 		gs_flatpak_error_convert (error);
-		remove_schedule_entry (schedule_entry_handle);
 		return FALSE;
 	} else {
 		/* Reset the state to have it updated */
@@ -1553,7 +1858,230 @@ gs_plugin_flatpak_update (GsPlugin *plugin,
 		}
 	}
 
+	return TRUE;
+}
+
+/* Maximum number of refs to pull at the same time when updating several apps;
+ * this bounds the number of concurrent connections to the remotes */
+#define GS_FLATPAK_UPDATE_MAX_PARALLEL_PULLS 4
+
+typedef struct {
+	GsPlugin	*plugin;  /* (unowned) */
+	GsFlatpak	*flatpak;  /* (unowned) */
+	gboolean	 interactive;
+	GCancellable	*cancellable;  /* (unowned) */
+	GAsyncQueue	*done;  /* (unowned) (element-type UpdatePullItem) */
+} UpdatePullHelper;
+
+typedef struct {
+	GsApp		*app;  /* (owned) */
+	GError		*error;  /* (owned) (nullable) */
+} UpdatePullItem;
+
+static void
+update_pull_item_free (UpdatePullItem *item)
+{
+	g_object_unref (item->app);
+	g_clear_error (&item->error);
+	g_free (item);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (UpdatePullItem, update_pull_item_free)
+
+/* Run in the pull thread pool: downloads the update for a single ref without
+ * deploying it, then hands it back to gs_plugin_flatpak_update_pipelined().
+ * Like gs_plugin_download(), this also pulls the dependencies and related
+ * refs, so the ref can then be deployed without pulling anything. */
+static void
+update_pull_thread_cb (gpointer data,
+		       gpointer user_data)
+{
+	UpdatePullItem *item = data;
+	UpdatePullHelper *helper = user_data;
+	g_autoptr(FlatpakTransaction) transaction = NULL;
+	g_autofree gchar *ref = gs_flatpak_app_get_ref_display (item->app);
+
+	transaction = _build_transaction (helper->plugin, helper->flatpak,
+					  helper->interactive, helper->cancellable,
+					  &item->error);
+	if (transaction != NULL) {
+		flatpak_transaction_set_no_deploy (transaction, TRUE);
+
+		if (flatpak_transaction_add_update (transaction, ref, NULL, NULL, &item->error)) {
+			gs_flatpak_transaction_add_app (transaction, item->app);
+			gs_flatpak_transaction_run (transaction, helper->cancellable, &item->error);
+		}
+	}
+
+	g_async_queue_push (helper->done, item);
+}
+
+static void
+update_pull_cancelled_cb (GCancellable *cancellable,
+			  gpointer      user_data)
+{
+	g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+
+static gboolean
+update_deploy (GsPlugin *plugin,
+	       GsFlatpak *flatpak,
+	       GsApp *app,
+	       gboolean is_pulled,
+	       gboolean interactive,
+	       GCancellable *cancellable,
+	       GError **error)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	gs_app_list_add (list, app);
+	return gs_plugin_flatpak_run_update (plugin, flatpak, list, is_pulled, interactive, cancellable, error);
+}
+
+/* Updates @list_tmp by pulling up to %GS_FLATPAK_UPDATE_MAX_PARALLEL_PULLS refs
+ * at once, and deploying each one as soon as it has been pulled. Runtimes are
+ * pulled first, and apps are only deployed once all the runtimes in the list
+ * have been, so that an app is never deployed before a runtime it needs. */
+static gboolean
+gs_plugin_flatpak_update_pipelined (GsPlugin *plugin,
+				    GsFlatpak *flatpak,
+				    GsAppList *list_tmp,
+				    gboolean interactive,
+				    GCancellable *cancellable,
+				    GError **error)
+{
+	g_autoptr(GAsyncQueue) done = g_async_queue_new ();
+	g_autoptr(GCancellable) pull_cancellable = g_cancellable_new ();
+	g_autoptr(GsAppList) deferred = gs_app_list_new ();
+	g_autoptr(GError) error_deploy = NULL;
+	UpdatePullHelper helper = { plugin, flatpak, interactive, pull_cancellable, done };
+	GThreadPool *pool;
+	guint n_pending_runtimes = 0;
+	guint n_queued = 0;
+	gboolean deferred_pulled = TRUE;
+	gulong cancelled_id = 0;
+
+	if (cancellable != NULL)
+		cancelled_id = g_cancellable_connect (cancellable,
+						      G_CALLBACK (update_pull_cancelled_cb),
+						      pull_cancellable, NULL);
+
+	pool = g_thread_pool_new (update_pull_thread_cb, &helper,
+				  GS_FLATPAK_UPDATE_MAX_PARALLEL_PULLS,
+				  FALSE, NULL);
+
+	/* queue runtimes first, as the apps need them */
+	for (guint pass = 0; pass < 2; pass++) {
+		for (guint i = 0; i < gs_app_list_length (list_tmp); i++) {
+			GsApp *app = gs_app_list_index (list_tmp, i);
+			gboolean is_runtime = gs_flatpak_app_get_ref_kind (app) == FLATPAK_REF_KIND_RUNTIME;
+			UpdatePullItem *item;
+
+			if (is_runtime != (pass == 0))
+				continue;
+			if (is_runtime)
+				n_pending_runtimes++;
+
+			gs_app_set_state (app, GS_APP_STATE_INSTALLING);
+
+			item = g_new0 (UpdatePullItem, 1);
+			item->app = g_object_ref (app);
+			if (gs_app_get_is_update_downloaded (app))
+				g_async_queue_push (done, item);
+			else
+				g_thread_pool_push (pool, item, NULL);
+			n_queued++;
+		}
+	}
+
+	/* deploy refs as their pulls complete */
+	for (guint i = 0; i < n_queued; i++) {
+		g_autoptr(UpdatePullItem) item = g_async_queue_pop (done);
+		gboolean is_runtime = gs_flatpak_app_get_ref_kind (item->app) == FLATPAK_REF_KIND_RUNTIME;
+
+		/* not fatal, as it will be pulled again when deploying */
+		if (item->error != NULL) {
+			g_debug ("failed to pull %s ahead of deploying it: %s",
+				 gs_app_get_unique_id (item->app), item->error->message);
+		}
+
+		if (error_deploy == NULL) {
+			if (is_runtime || n_pending_runtimes == 0) {
+				update_deploy (plugin, flatpak, item->app, item->error == NULL,
+					       interactive, cancellable, &error_deploy);
+			} else {
+				gs_app_list_add (deferred, item->app);
+				deferred_pulled &= item->error == NULL;
+			}
+		}
+
+		if (is_runtime && --n_pending_runtimes == 0 &&
+		    error_deploy == NULL && gs_app_list_length (deferred) > 0) {
+			gs_plugin_flatpak_run_update (plugin, flatpak, deferred, deferred_pulled,
+						      interactive, cancellable, &error_deploy);
+		}
+
+		/* stop pulling anything else on failure, but keep draining */
+		if (error_deploy != NULL)
+			g_cancellable_cancel (pull_cancellable);
+	}
+
+	g_thread_pool_free (pool, FALSE, TRUE);
+	if (cancelled_id != 0)
+		g_cancellable_disconnect (cancellable, cancelled_id);
+
+	if (error_deploy != NULL) {
+		for (guint i = 0; i < gs_app_list_length (list_tmp); i++) {
+			GsApp *app = gs_app_list_index (list_tmp, i);
+			/* only the apps which were not deployed are
+			 * still installing */
+			if (gs_app_get_state (app) == GS_APP_STATE_INSTALLING)
+				gs_app_set_state_recover (app);
+		}
+		g_propagate_error (error, g_steal_pointer (&error_deploy));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+gs_plugin_flatpak_update (GsPlugin *plugin,
+			  GsFlatpak *flatpak,
+			  GsAppList *list_tmp,
+			  gboolean interactive,
+			  GCancellable *cancellable,
+			  GError **error)
+{
+	gboolean is_update_downloaded = TRUE;
+	gpointer schedule_entry_handle = NULL;
+	gboolean ret;
+
+	if (!interactive) {
+		g_autoptr(GError) error_local = NULL;
+
+		if (!gs_metered_block_app_list_on_download_scheduler (list_tmp, &schedule_entry_handle, cancellable, &error_local)) {
+			g_warning ("Failed to block on download scheduler: %s",
+				   error_local->message);
+			g_clear_error (&error_local);
+		}
+	}
+
+	for (guint i = 0; i < gs_app_list_length (list_tmp); i++) {
+		GsApp *app = gs_app_list_index (list_tmp, i);
+		is_update_downloaded &= gs_app_get_is_update_downloaded (app);
+	}
+
+	/* a single transaction pulls its refs one after another, so when
+	 * several updates still need downloading pull them concurrently */
+	if (gs_app_list_length (list_tmp) > 1 && !is_update_downloaded)
+		ret = gs_plugin_flatpak_update_pipelined (plugin, flatpak, list_tmp, interactive, cancellable, error);
+	else
+		ret = gs_plugin_flatpak_run_update (plugin, flatpak, list_tmp, FALSE, interactive, cancellable, error);
+
 	remove_schedule_entry (schedule_entry_handle);
+	if (!ret)
+		return FALSE;
+
 	gs_plugin_updates_changed (plugin);
 
 	/* get any new state */
@@ -2072,6 +2600,14 @@ list_apps_thread_cb (GTask        *task,
 		}
 	}
 
+	/* the apps on the overview and category pages are the ones most likely
+	 * to have their details shown next */
+	if (is_curated != GS_APP_QUERY_TRISTATE_UNSET ||
+	    is_featured != GS_APP_QUERY_TRISTATE_UNSET ||
+	    category != NULL ||
+	    deployment_featured != NULL)
+		gs_plugin_flatpak_prefetch_metadata (self, list, FALSE);
+
 	g_task_return_pointer (task, g_steal_pointer (&list), g_object_unref);
 }
 
@@ -2390,6 +2926,7 @@ gs_plugin_flatpak_class_init (GsPluginFlatpakClass *klass)
 	GsPluginClass *plugin_class = GS_PLUGIN_CLASS (klass);
 
 	object_class->dispose = gs_plugin_flatpak_dispose;
+	object_class->finalize = gs_plugin_flatpak_finalize;
 
 	plugin_class->setup_async = gs_plugin_flatpak_setup_async;
 	plugin_class->setup_finish = gs_plugin_flatpak_setup_finish;
@@ -13,7 +13,10 @@
 
 #include "gnome-software-private.h"
 
+#include "gs-appstream.h"
 #include "gs-flatpak-app.h"
+#include "gs-flatpak-search-index.h"
+#include "gs-flatpak-utils.h"
 
 #include "gs-test.h"
 
@@ -1904,6 +1907,508 @@ gs_plugins_flatpak_runtime_extension_func (GsPluginLoader *plugin_loader)
 	g_assert_false (gs_app_is_installed (extension));
 }
 
+/* records the states the app goes through */
+static void
+update_pipelined_state_notify_cb (GsApp *app, GParamSpec *pspec, gpointer user_data)
+{
+	GArray *states = user_data;
+	GsAppState state = gs_app_get_state (app);
+
+	g_array_append_val (states, state);
+}
+
+static void
+gs_plugins_flatpak_app_update_pipelined_func (GsPluginLoader *plugin_loader)
+{
+	GsApp *app;
+	GsApp *runtime;
+	gboolean ret;
+	gulong notify_state_id;
+	g_autofree gchar *repodir1_fn = NULL;
+	g_autofree gchar *repodir2_fn = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsApp) app_source = NULL;
+	g_autoptr(GsApp) extension = NULL;
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GsAppList) list_update = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+	g_autoptr(GArray) states = g_array_new (FALSE, FALSE, sizeof (GsAppState));
+	g_autofree gchar *repo_path = NULL;
+	g_autofree gchar *repo_url = NULL;
+	GsPlugin *plugin;
+	g_autoptr(GsAppQuery) query = NULL;
+	const gchar *keywords[2] = { NULL, };
+
+	/* drop all caches */
+	gs_utils_rmtree (g_getenv ("GS_SELF_TEST_CACHEDIR"), NULL);
+	gs_test_reinitialise_plugin_loader (plugin_loader, allowlist, NULL);
+
+	/* no flatpak, abort */
+	g_assert_true (gs_plugin_loader_get_enabled (plugin_loader, "flatpak"));
+
+	/* no files to use */
+	repodir1_fn = gs_test_get_filename (TESTDATADIR, "app-extension/repo");
+	if (repodir1_fn == NULL ||
+	    !g_file_test (repodir1_fn, G_FILE_TEST_EXISTS)) {
+		g_test_skip ("no flatpak test repo");
+		return;
+	}
+	repodir2_fn = gs_test_get_filename (TESTDATADIR, "app-extension-update/repo");
+	if (repodir2_fn == NULL ||
+	    !g_file_test (repodir2_fn, G_FILE_TEST_EXISTS)) {
+		g_test_skip ("no flatpak test repo");
+		return;
+	}
+
+	/* add indirection so we can switch this after install */
+	repo_path = g_build_filename (g_getenv ("GS_SELF_TEST_FLATPAK_DATADIR"), "repo", NULL);
+	unlink (repo_path);
+	g_assert_cmpint (symlink (repodir1_fn, repo_path), ==, 0);
+
+	/* add a remote */
+	app_source = gs_flatpak_app_new ("test");
+	gs_app_set_kind (app_source, AS_COMPONENT_KIND_REPOSITORY);
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "flatpak");
+	gs_app_set_management_plugin (app_source, plugin);
+	gs_app_set_state (app_source, GS_APP_STATE_AVAILABLE);
+	repo_url = g_strdup_printf ("file://%s", repo_path);
+	gs_flatpak_app_set_repo_url (app_source, repo_url);
+	plugin_job = gs_plugin_job_manage_repository_new (app_source, GS_PLUGIN_MANAGE_REPOSITORY_FLAGS_INSTALL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* refresh the appstream metadata */
+	g_object_unref (plugin_job);
+	plugin_job = gs_plugin_job_refresh_metadata_new (G_MAXUINT64,
+							 GS_PLUGIN_REFRESH_METADATA_FLAGS_NONE);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* find the app and install it, with its runtime and extension */
+	g_object_unref (plugin_job);
+	keywords[0] = "Bingo";
+	query = gs_app_query_new ("keywords", keywords,
+				  "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_RUNTIME,
+				  "dedupe-flags", GS_PLUGIN_JOB_DEDUPE_FLAGS_DEFAULT,
+				  "sort-func", gs_utils_app_sort_match_value,
+				  NULL);
+	plugin_job = gs_plugin_job_list_apps_new (query, GS_PLUGIN_LIST_APPS_FLAGS_NONE);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_nonnull (list);
+	g_assert_cmpint (gs_app_list_length (list), ==, 1);
+	app = gs_app_list_index (list, 0);
+	g_assert_cmpstr (gs_app_get_id (app), ==, "org.test.Chiron");
+
+	g_object_unref (plugin_job);
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_INSTALL,
+					 "app", app,
+					 NULL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (gs_app_get_state (app), ==, GS_APP_STATE_INSTALLED);
+
+	extension = gs_plugin_loader_app_create (plugin_loader,
+			"user/flatpak/*/org.test.Chiron.Extension/master",
+			NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_nonnull (extension);
+	g_assert_cmpint (gs_app_get_state (extension), ==, GS_APP_STATE_INSTALLED);
+
+	/* switch to the new repo, which has an update for the extension */
+	g_assert_cmpint (unlink (repo_path), ==, 0);
+	g_assert_cmpint (symlink (repodir2_fn, repo_path), ==, 0);
+
+	g_object_unref (plugin_job);
+	plugin_job = gs_plugin_job_refresh_metadata_new (0,  /* force now */
+							 GS_PLUGIN_REFRESH_METADATA_FLAGS_NONE);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* updating more than one ref which still needs downloading pulls
+	 * them ahead of deploying them, and deploys them without pulling
+	 * them again */
+	gs_app_set_state (app, GS_APP_STATE_UPDATABLE_LIVE);
+	gs_app_set_state (extension, GS_APP_STATE_UPDATABLE_LIVE);
+	list_update = gs_app_list_new ();
+	gs_app_list_add (list_update, extension);
+	gs_app_list_add (list_update, app);
+	notify_state_id = g_signal_connect (extension, "notify::state",
+					    G_CALLBACK (update_pipelined_state_notify_cb),
+					    states);
+
+	g_object_unref (plugin_job);
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_UPDATE,
+					 "list", list_update,
+					 NULL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_signal_handler_disconnect (extension, notify_state_id);
+
+	/* the extension must not look updatable again between being pulled
+	 * and being deployed */
+	g_assert_cmpuint (states->len, >, 0);
+	for (guint i = 0; i < states->len; i++)
+		g_assert_cmpint (g_array_index (states, GsAppState, i), !=, GS_APP_STATE_UPDATABLE_LIVE);
+	g_assert_cmpint (gs_app_get_state (app), ==, GS_APP_STATE_INSTALLED);
+	g_assert_cmpint (gs_app_get_state (extension), ==, GS_APP_STATE_INSTALLED);
+
+	/* the update was deployed */
+	g_object_unref (plugin_job);
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_GET_UPDATES, NULL);
+	g_clear_object (&list);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_nonnull (list);
+	g_assert_null (gs_app_list_lookup (list, "*/flatpak/test/org.test.Chiron/*"));
+	g_assert_null (gs_app_list_lookup (list, "*/flatpak/test/org.test.Chiron.Extension/*"));
+
+	/* remove the app, and then the runtime */
+	runtime = gs_app_get_runtime (app);
+	g_assert_nonnull (runtime);
+	g_object_ref (runtime);
+	g_object_unref (plugin_job);
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REMOVE,
+					 "app", app,
+					 NULL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	g_object_unref (plugin_job);
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REMOVE,
+					 "app", runtime,
+					 NULL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_object_unref (runtime);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* remove the remote */
+	g_object_unref (plugin_job);
+	plugin_job = gs_plugin_job_manage_repository_new (app_source, GS_PLUGIN_MANAGE_REPOSITORY_FLAGS_REMOVE);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (gs_app_get_state (app_source), ==, GS_APP_STATE_UNAVAILABLE);
+}
+
+#if LIBXMLB_CHECK_VERSION(0,3,0)
+static gboolean
+gs_flatpak_test_tokenize_cb (XbBuilderFixup *self,
+			     XbBuilderNode *bn,
+			     gpointer user_data,
+			     GError **error)
+{
+	const gchar * const elements_to_tokenize[] = {
+		"id",
+		"keyword",
+		"launchable",
+		"mimetype",
+		"name",
+		"summary",
+		NULL };
+	if (xb_builder_node_get_element (bn) != NULL &&
+	    g_strv_contains (elements_to_tokenize, xb_builder_node_get_element (bn)))
+		xb_builder_node_tokenize_text (bn);
+	return TRUE;
+}
+#endif
+
+/* returns the IDs and match values of @list, one per line, in a stable order */
+static gchar *
+gs_flatpak_test_search_results_to_string (GsAppList *list)
+{
+	g_autoptr(GPtrArray) lines = g_ptr_array_new_with_free_func (g_free);
+
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		g_ptr_array_add (lines, g_strdup_printf ("%s:%u",
+							 gs_app_get_id (app),
+							 gs_app_get_match_value (app)));
+	}
+	g_ptr_array_sort (lines, (GCompareFunc) g_strcmp0);
+	g_ptr_array_add (lines, NULL);
+
+	return g_strjoinv ("\n", (gchar **) lines->pdata);
+}
+
+static void
+gs_plugins_flatpak_search_index_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *plugin;
+	gboolean ret;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(XbBuilder) builder = xb_builder_new ();
+	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
+	g_autoptr(XbSilo) silo = NULL;
+	g_autoptr(GsFlatpakSearchIndex) search_index = NULL;
+#if LIBXMLB_CHECK_VERSION(0,3,0)
+	g_autoptr(XbBuilderFixup) fixup = NULL;
+#endif
+	const gchar *xml =
+		"<?xml version=\"1.0\"?>\n"
+		"<components origin=\"flathub\" version=\"0.9\">\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>org.example.Spy</id>\n"
+		"    <name>Spy Tools</name>\n"
+		"    <summary>Watching the watchers</summary>\n"
+		"  </component>\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>org.example.Dying</id>\n"
+		"    <name>Dying Light</name>\n"
+		"    <summary>Survive the night</summary>\n"
+		"  </component>\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>org.example.Editor</id>\n"
+		"    <name>Text Editor</name>\n"
+		"    <summary>Edit plain files</summary>\n"
+		"    <keywords>\n"
+		"      <keyword>writing</keyword>\n"
+		"      <keyword>editors</keyword>\n"
+		"    </keywords>\n"
+		"  </component>\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>org.example.Player</id>\n"
+		"    <name>Music Player</name>\n"
+		"    <summary>Plays your audio collection</summary>\n"
+		"    <mimetypes>\n"
+		"      <mimetype>audio/ogg</mimetype>\n"
+		"    </mimetypes>\n"
+		"  </component>\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>org.example.Yak</id>\n"
+		"    <name>Yak</name>\n"
+		"    <summary>Shaving yaks quickly</summary>\n"
+		"  </component>\n"
+		"</components>\n";
+	const gchar * const queries[][3] = {
+		/* exact and stemmed words */
+		{ "spy", NULL },
+		{ "spies", NULL },
+		{ "dying", NULL },
+		{ "die", NULL },
+		{ "editing", NULL },
+		{ "edits", NULL },
+		{ "writes", NULL },
+		{ "yaks", NULL },
+		{ "yak", NULL },
+		/* ‘y’ folded to ‘i’ in the key */
+		{ "iak", NULL },
+		{ "spi", NULL },
+		/* shorter than the key */
+		{ "y", NULL },
+		{ "i", NULL },
+		{ "e", NULL },
+		{ "x", NULL },
+		/* several values, all of which must match */
+		{ "music", "player", NULL },
+		{ "music", "editor", NULL },
+		/* other fields */
+		{ "audio", NULL },
+		{ "flathub", NULL },
+		{ "example", NULL },
+		{ "nothing", NULL },
+	};
+
+	/* use the same tokenization as the real silo */
+	ret = xb_builder_source_load_xml (source, xml, XB_BUILDER_SOURCE_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+#if LIBXMLB_CHECK_VERSION(0,3,0)
+	fixup = xb_builder_fixup_new ("TextTokenize", gs_flatpak_test_tokenize_cb, NULL, NULL);
+	xb_builder_fixup_set_max_depth (fixup, 2);
+	xb_builder_source_add_fixup (source, fixup);
+#endif
+	xb_builder_import_source (builder, source);
+	silo = xb_builder_compile (builder, XB_BUILDER_COMPILE_FLAG_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (silo);
+
+	search_index = gs_flatpak_search_index_new (silo);
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "flatpak");
+	g_assert_nonnull (plugin);
+
+	/* searching only the candidates from the index must give exactly the
+	 * same results as searching every component */
+	for (guint i = 0; i < G_N_ELEMENTS (queries); i++) {
+		g_autoptr(GsAppList) list_full = gs_app_list_new ();
+		g_autoptr(GsAppList) list_indexed = gs_app_list_new ();
+		g_autoptr(GPtrArray) candidates = NULL;
+		g_autofree gchar *results_full = NULL;
+		g_autofree gchar *results_indexed = NULL;
+
+		ret = gs_appstream_search (plugin, silo, queries[i], list_full, NULL, &error);
+		g_assert_no_error (error);
+		g_assert_true (ret);
+		results_full = gs_flatpak_test_search_results_to_string (list_full);
+
+		candidates = gs_flatpak_search_index_get_candidates (search_index, queries[i]);
+		g_assert_cmpuint (candidates->len, <=, 5);
+		ret = gs_appstream_search_components (plugin, silo, candidates, queries[i],
+						      list_indexed, NULL, &error);
+		g_assert_no_error (error);
+		g_assert_true (ret);
+		results_indexed = gs_flatpak_test_search_results_to_string (list_indexed);
+
+		g_test_message ("%s %s: %s", queries[i][0],
+				queries[i][1] != NULL ? queries[i][1] : "",
+				results_full);
+		g_assert_cmpstr (results_indexed, ==, results_full);
+	}
+
+	/* and the index should actually narrow the search down */
+	{
+		const gchar * const values[] = { "music", NULL };
+		g_autoptr(GPtrArray) candidates = gs_flatpak_search_index_get_candidates (search_index, values);
+		g_autoptr(GsAppList) list = gs_app_list_new ();
+
+		g_assert_cmpuint (candidates->len, ==, 1);
+		ret = gs_appstream_search_components (plugin, silo, candidates, values,
+						      list, NULL, &error);
+		g_assert_no_error (error);
+		g_assert_true (ret);
+		g_assert_cmpuint (gs_app_list_length (list), ==, 1);
+		g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "org.example.Player");
+	}
+}
+
+/* @refs are “ref=commit” and @remotes are “name=configuration=timestamp” */
+static GsFlatpakSnapshot *
+gs_flatpak_test_snapshot_new (const gchar * const *refs,
+			      const gchar * const *remotes)
+{
+	GsFlatpakSnapshot *snapshot = gs_flatpak_snapshot_new ();
+
+	for (guint i = 0; refs[i] != NULL; i++) {
+		g_auto(GStrv) split = g_strsplit (refs[i], "=", 2);
+		g_hash_table_insert (snapshot->installed_refs,
+				     g_strdup (split[0]), g_strdup (split[1]));
+	}
+	for (guint i = 0; remotes[i] != NULL; i++) {
+		g_auto(GStrv) split = g_strsplit (remotes[i], "=", 3);
+		g_hash_table_insert (snapshot->remotes,
+				     g_strdup (split[0]), g_strdup (split[1]));
+		g_hash_table_insert (snapshot->appstream,
+				     g_strdup (split[0]), g_strdup (split[2]));
+	}
+
+	return snapshot;
+}
+
+static gchar *
+gs_flatpak_test_join_sorted (GPtrArray *array)
+{
+	g_ptr_array_sort (array, (GCompareFunc) g_strcmp0);
+	g_ptr_array_add (array, NULL);
+	return g_strjoinv (",", (gchar **) array->pdata);
+}
+
+static void
+gs_flatpak_test_snapshot_compare (const gchar * const *old_refs,
+				  const gchar * const *old_remotes,
+				  const gchar * const *new_refs,
+				  const gchar * const *new_remotes,
+				  GsFlatpakChangeFlags expected_flags,
+				  const gchar *expected_refs,
+				  const gchar *expected_appstream)
+{
+	g_autoptr(GsFlatpakSnapshot) old_snapshot = gs_flatpak_test_snapshot_new (old_refs, old_remotes);
+	g_autoptr(GsFlatpakSnapshot) new_snapshot = gs_flatpak_test_snapshot_new (new_refs, new_remotes);
+	g_autoptr(GPtrArray) changed_refs = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) changed_appstream = g_ptr_array_new_with_free_func (g_free);
+	g_autofree gchar *changed_refs_str = NULL;
+	g_autofree gchar *changed_appstream_str = NULL;
+	GsFlatpakChangeFlags flags;
+
+	flags = gs_flatpak_snapshot_compare (old_snapshot, new_snapshot,
+					     changed_refs, changed_appstream);
+	g_assert_cmpint (flags, ==, expected_flags);
+	changed_refs_str = gs_flatpak_test_join_sorted (changed_refs);
+	g_assert_cmpstr (changed_refs_str, ==, expected_refs);
+	changed_appstream_str = gs_flatpak_test_join_sorted (changed_appstream);
+	g_assert_cmpstr (changed_appstream_str, ==, expected_appstream);
+}
+
+static void
+gs_plugins_flatpak_snapshot_compare_func (void)
+{
+	const gchar * const refs[] = {
+		"app/org.example.App/x86_64/stable=c1",
+		"runtime/org.example.Platform/x86_64/1=c2",
+		NULL };
+	const gchar * const refs_updated[] = {
+		"app/org.example.App/x86_64/stable=c3",
+		"runtime/org.example.Platform/x86_64/1=c2",
+		NULL };
+	const gchar * const refs_installed_removed[] = {
+		"app/org.example.App/x86_64/stable=c1",
+		"app/org.example.Other/x86_64/stable=c4",
+		NULL };
+	const gchar * const remotes[] = {
+		"flathub=https://dl.flathub.org/repo/=100",
+		"test=file:///srv/repo=200",
+		NULL };
+	const gchar * const remotes_appstream[] = {
+		"flathub=https://dl.flathub.org/repo/=101",
+		"test=file:///srv/repo=200",
+		NULL };
+	const gchar * const remotes_reconfigured[] = {
+		"flathub=https://dl.flathub.org/repo/=100",
+		"test=file:///srv/other-repo=200",
+		NULL };
+	const gchar * const remotes_removed[] = {
+		"flathub=https://dl.flathub.org/repo/=100",
+		NULL };
+
+	/* nothing changed, e.g. only a lock file was touched */
+	gs_flatpak_test_snapshot_compare (refs, remotes, refs, remotes,
+					  GS_FLATPAK_CHANGE_NONE, "", "");
+
+	/* an app was updated */
+	gs_flatpak_test_snapshot_compare (refs, remotes, refs_updated, remotes,
+					  GS_FLATPAK_CHANGE_INSTALLED_REFS,
+					  "app/org.example.App/x86_64/stable", "");
+
+	/* an app was installed and a runtime removed */
+	gs_flatpak_test_snapshot_compare (refs, remotes, refs_installed_removed, remotes,
+					  GS_FLATPAK_CHANGE_INSTALLED_REFS,
+					  "app/org.example.Other/x86_64/stable,runtime/org.example.Platform/x86_64/1", "");
+
+	/* new AppStream data was downloaded for one remote */
+	gs_flatpak_test_snapshot_compare (refs, remotes, refs, remotes_appstream,
+					  GS_FLATPAK_CHANGE_APPSTREAM, "", "flathub");
+
+	/* a remote was reconfigured, or removed */
+	gs_flatpak_test_snapshot_compare (refs, remotes, refs, remotes_reconfigured,
+					  GS_FLATPAK_CHANGE_REMOTES, "", "");
+	gs_flatpak_test_snapshot_compare (refs, remotes, refs, remotes_removed,
+					  GS_FLATPAK_CHANGE_REMOTES, "", "");
+
+	/* a remote was added, which has AppStream data of its own */
+	gs_flatpak_test_snapshot_compare (refs, remotes_removed, refs, remotes,
+					  GS_FLATPAK_CHANGE_REMOTES | GS_FLATPAK_CHANGE_APPSTREAM, "", "test");
+
+	/* several things at once */
+	gs_flatpak_test_snapshot_compare (refs, remotes, refs_updated, remotes_appstream,
+					  GS_FLATPAK_CHANGE_INSTALLED_REFS | GS_FLATPAK_CHANGE_APPSTREAM,
+					  "app/org.example.App/x86_64/stable", "flathub");
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1985,6 +2490,9 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/gnome-software/plugins/flatpak/app-runtime-extension",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_flatpak_runtime_extension_func);
+	g_test_add_data_func ("/gnome-software/plugins/flatpak/app-update-pipelined",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_flatpak_app_update_pipelined_func);
 	g_test_add_data_func ("/gnome-software/plugins/flatpak/app-update-runtime",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_flatpak_app_update_func);
@@ -1994,6 +2502,11 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/gnome-software/plugins/flatpak/repo{non-ascii}",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_flatpak_repo_non_ascii_func);
+	g_test_add_data_func ("/gnome-software/plugins/flatpak/search-index",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_flatpak_search_index_func);
+	g_test_add_func ("/gnome-software/plugins/flatpak/snapshot-compare",
+			 gs_plugins_flatpak_snapshot_compare_func);
 	retval = g_test_run ();
 
 	/* Clean up. */
@@ -0,0 +1,420 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/* Notes:
+ *
+ * Refining a page of tiles or rows, or answering the shell search provider,
+ * sends several small refine jobs to the plugin within a few milliseconds, and
+ * each of them used to start its own Resolve, GetDetails, GetUpdateDetail and
+ * SearchFiles transactions. Every transaction costs D-Bus round trips and
+ * waits for the packagekitd backend lock.
+ *
+ * #GsPackagekitBatcher holds each request for %GS_PACKAGEKIT_BATCHER_WINDOW_MS
+ * and merges the requests of the same kind (and filter, and interactivity)
+ * that arrive in the meantime into one transaction. Every waiting request gets
+ * the full #PkResults; the callers already pick out the packages they asked
+ * for by name or package ID. SearchFiles results do not say which file each
+ * package owns, so only identical SearchFiles requests are merged.
+ *
+ * If a merged transaction fails, each of its requests is retried on its own,
+ * so one bad package ID cannot fail requests which would otherwise succeed.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gs-packagekit-batcher.h"
+
+/* how long a batch waits for more requests before it is sent */
+#define GS_PACKAGEKIT_BATCHER_WINDOW_MS		10
+
+struct _GsPackagekitBatcher {
+	GObject			 parent_instance;
+	GMutex			 mutex;
+	GHashTable		*pending;  /* (owned) (element-type utf8 Batch); batches still accepting requests */
+};
+
+G_DEFINE_TYPE (GsPackagekitBatcher, gs_packagekit_batcher, G_TYPE_OBJECT)
+
+typedef struct {
+	GsPackagekitBatcher	*batcher;  /* (owned) */
+	GsPackagekitBatchKind	 kind;
+	PkBitfield		 filter;
+	gboolean		 interactive;
+	gchar			*key;  /* (owned) (nullable); set while in @batcher->pending */
+	GMainContext		*context;  /* (owned) */
+	GPtrArray		*requests;  /* (owned) (element-type GTask) */
+	GPtrArray		*values;  /* (owned) (element-type utf8) */
+	GHashTable		*values_set;  /* (owned) (element-type utf8); strings owned by @values */
+	GCancellable		*cancellable;  /* (owned); cancelled once every request is */
+	gint			 n_live;  /* (atomic); requests not cancelled yet */
+} Batch;
+
+typedef struct {
+	gchar			**values;  /* (owned) */
+	GsPackagekitHelper	*helper;  /* (owned) (nullable) */
+	gulong			 cancelled_id;
+} Request;
+
+static void
+request_free (Request *request)
+{
+	g_strfreev (request->values);
+	g_clear_object (&request->helper);
+	g_free (request);
+}
+
+static const gchar *
+batch_kind_to_string (GsPackagekitBatchKind kind)
+{
+	if (kind == GS_PACKAGEKIT_BATCH_KIND_RESOLVE)
+		return "resolve";
+	if (kind == GS_PACKAGEKIT_BATCH_KIND_GET_DETAILS)
+		return "get-details";
+	if (kind == GS_PACKAGEKIT_BATCH_KIND_GET_UPDATE_DETAIL)
+		return "get-update-detail";
+	if (kind == GS_PACKAGEKIT_BATCH_KIND_SEARCH_FILES)
+		return "search-files";
+	return NULL;
+}
+
+static gchar *
+batch_build_key (GsPackagekitBatchKind kind,
+		 PkBitfield filter,
+		 gboolean interactive,
+		 const gchar * const *values,
+		 GMainContext *context)
+{
+	GString *key = g_string_new (NULL);
+
+	/* the callbacks of a transaction are all invoked in one context */
+	g_string_append_printf (key, "%p:%u:%" G_GUINT64_FORMAT ":%u",
+				context, kind, (guint64) filter, (guint) interactive);
+	if (kind == GS_PACKAGEKIT_BATCH_KIND_SEARCH_FILES) {
+		for (guint i = 0; values[i] != NULL; i++)
+			g_string_append_printf (key, "\n%s", values[i]);
+	}
+	return g_string_free (key, FALSE);
+}
+
+static Batch *
+batch_new (GsPackagekitBatcher *batcher,
+	   GsPackagekitBatchKind kind,
+	   PkBitfield filter,
+	   gboolean interactive,
+	   GMainContext *context)
+{
+	Batch *batch = g_new0 (Batch, 1);
+
+	batch->batcher = g_object_ref (batcher);
+	batch->kind = kind;
+	batch->filter = filter;
+	batch->interactive = interactive;
+	batch->context = g_main_context_ref (context);
+	batch->requests = g_ptr_array_new_with_free_func (g_object_unref);
+	batch->values = g_ptr_array_new_with_free_func (g_free);
+	batch->values_set = g_hash_table_new (g_str_hash, g_str_equal);
+	batch->cancellable = g_cancellable_new ();
+	return batch;
+}
+
+static void
+batch_free (Batch *batch)
+{
+	g_object_unref (batch->cancellable);
+	g_hash_table_unref (batch->values_set);
+	g_ptr_array_unref (batch->values);
+	g_ptr_array_unref (batch->requests);
+	g_main_context_unref (batch->context);
+	g_free (batch->key);
+	g_object_unref (batch->batcher);
+	g_free (batch);
+}
+
+static void
+batch_request_cancelled_cb (GCancellable *cancellable,
+			    gpointer user_data)
+{
+	Batch *batch = user_data;
+
+	/* keep the transaction going while anybody still wants it */
+	if (g_atomic_int_dec_and_test (&batch->n_live))
+		g_cancellable_cancel (batch->cancellable);
+}
+
+static void
+batch_add_request (Batch *batch,
+		   GTask *task)
+{
+	Request *request = g_task_get_task_data (task);
+	GCancellable *cancellable = g_task_get_cancellable (task);
+
+	for (guint i = 0; request->values[i] != NULL; i++) {
+		gchar *value;
+		if (g_hash_table_contains (batch->values_set, request->values[i]))
+			continue;
+		value = g_strdup (request->values[i]);
+		g_ptr_array_add (batch->values, value);
+		g_hash_table_add (batch->values_set, value);
+	}
+
+	g_ptr_array_add (batch->requests, g_object_ref (task));
+	g_atomic_int_inc (&batch->n_live);
+	if (cancellable != NULL) {
+		request->cancelled_id = g_cancellable_connect (cancellable,
+							       G_CALLBACK (batch_request_cancelled_cb),
+							       batch, NULL);
+	}
+}
+
+static void
+batch_remove_request (Batch *batch,
+		      GTask *task)
+{
+	Request *request = g_task_get_task_data (task);
+
+	if (request->cancelled_id != 0) {
+		g_cancellable_disconnect (g_task_get_cancellable (task), request->cancelled_id);
+		request->cancelled_id = 0;
+	}
+}
+
+static void
+batch_progress_cb (PkProgress *progress,
+		   PkProgressType type,
+		   gpointer user_data)
+{
+	Batch *batch = user_data;
+
+	for (guint i = 0; i < batch->requests->len; i++) {
+		Request *request = g_task_get_task_data (g_ptr_array_index (batch->requests, i));
+		if (request->helper != NULL)
+			gs_packagekit_helper_cb (progress, type, request->helper);
+	}
+}
+
+static void batch_done_cb (GObject      *source_object,
+                           GAsyncResult *result,
+                           gpointer      user_data);
+
+static void
+batch_dispatch (Batch *batch)
+{
+	g_autoptr(PkClient) client = pk_client_new ();
+	gchar **values;
+
+	g_debug ("running %s for %u values from %u requests",
+		 batch_kind_to_string (batch->kind),
+		 batch->values->len, batch->requests->len);
+
+	pk_client_set_interactive (client, batch->interactive);
+
+	/* NULL-terminate the array */
+	g_ptr_array_add (batch->values, NULL);
+	values = (gchar **) batch->values->pdata;
+
+	switch (batch->kind) {
+	case GS_PACKAGEKIT_BATCH_KIND_RESOLVE:
+		pk_client_resolve_async (client, batch->filter, values,
+					 batch->cancellable,
+					 batch_progress_cb, batch,
+					 batch_done_cb, batch);
+		break;
+	case GS_PACKAGEKIT_BATCH_KIND_GET_DETAILS:
+		pk_client_get_details_async (client, values,
+					     batch->cancellable,
+					     batch_progress_cb, batch,
+					     batch_done_cb, batch);
+		break;
+	case GS_PACKAGEKIT_BATCH_KIND_GET_UPDATE_DETAIL:
+		pk_client_get_update_detail_async (client, values,
+						   batch->cancellable,
+						   batch_progress_cb, batch,
+						   batch_done_cb, batch);
+		break;
+	case GS_PACKAGEKIT_BATCH_KIND_SEARCH_FILES:
+		pk_client_search_files_async (client, batch->filter, values,
+					      batch->cancellable,
+					      batch_progress_cb, batch,
+					      batch_done_cb, batch);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+static gboolean
+batch_dispatch_cb (gpointer user_data)
+{
+	Batch *batch = user_data;
+	GsPackagekitBatcher *self = batch->batcher;
+
+	/* stop accepting requests */
+	g_mutex_lock (&self->mutex);
+	if (batch->key != NULL && g_hash_table_lookup (self->pending, batch->key) == batch)
+		g_hash_table_remove (self->pending, batch->key);
+	g_mutex_unlock (&self->mutex);
+
+	batch_dispatch (batch);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+batch_done_cb (GObject      *source_object,
+               GAsyncResult *result,
+               gpointer      user_data)
+{
+	PkClient *client = PK_CLIENT (source_object);
+	Batch *batch = user_data;
+	g_autoptr(PkResults) results = NULL;
+	g_autoptr(PkError) error_code = NULL;
+	g_autoptr(GError) local_error = NULL;
+
+	results = pk_client_generic_finish (client, result, &local_error);
+	if (results != NULL)
+		error_code = pk_results_get_error_code (results);
+
+	if ((results == NULL || error_code != NULL) &&
+	    batch->requests->len > 1 &&
+	    !g_cancellable_is_cancelled (batch->cancellable)) {
+		g_debug ("%s for %u requests failed, retrying them separately: %s",
+			 batch_kind_to_string (batch->kind), batch->requests->len,
+			 local_error != NULL ? local_error->message : pk_error_get_details (error_code));
+
+		for (guint i = 0; i < batch->requests->len; i++) {
+			GTask *task = g_ptr_array_index (batch->requests, i);
+			Batch *single = batch_new (batch->batcher, batch->kind, batch->filter,
+						   batch->interactive, batch->context);
+
+			batch_remove_request (batch, task);
+			batch_add_request (single, task);
+			batch_dispatch (single);
+		}
+
+		batch_free (batch);
+		return;
+	}
+
+	for (guint i = 0; i < batch->requests->len; i++) {
+		GTask *task = g_ptr_array_index (batch->requests, i);
+
+		batch_remove_request (batch, task);
+		if (results != NULL)
+			g_task_return_pointer (task, g_object_ref (results), g_object_unref);
+		else
+			g_task_return_error (task, g_error_copy (local_error));
+	}
+
+	batch_free (batch);
+}
+
+/* Runs a PackageKit transaction of @kind for @values, merged with the other
+ * requests of the same kind started from the same main context in the next
+ * few milliseconds. Progress is reported through @helper. */
+void
+gs_packagekit_batcher_run_async (GsPackagekitBatcher	*self,
+				 GsPackagekitBatchKind	 kind,
+				 PkBitfield		 filter,
+				 const gchar * const	*values,
+				 gboolean		 interactive,
+				 GsPackagekitHelper	*helper,
+				 GCancellable		*cancellable,
+				 GAsyncReadyCallback	 callback,
+				 gpointer		 user_data)
+{
+	g_autoptr(GTask) task = NULL;
+	g_autoptr(GMainContext) context = g_main_context_ref_thread_default ();
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autofree gchar *key = NULL;
+	Request *request;
+	Batch *batch;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_BATCHER (self));
+	g_return_if_fail (kind < GS_PACKAGEKIT_BATCH_KIND_LAST);
+	g_return_if_fail (values != NULL && values[0] != NULL);
+
+	task = g_task_new (self, cancellable, callback, user_data);
+	g_task_set_source_tag (task, gs_packagekit_batcher_run_async);
+
+	request = g_new0 (Request, 1);
+	request->values = g_strdupv ((gchar **) values);
+	request->helper = (helper != NULL) ? g_object_ref (helper) : NULL;
+	g_task_set_task_data (task, request, (GDestroyNotify) request_free);
+
+	key = batch_build_key (kind, filter, interactive, values, context);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	batch = g_hash_table_lookup (self->pending, key);
+
+	/* everybody waiting on it has gone away, so it is only going to fail */
+	if (batch != NULL && g_cancellable_is_cancelled (batch->cancellable)) {
+		g_hash_table_remove (self->pending, key);
+		batch = NULL;
+	}
+
+	if (batch == NULL) {
+		g_autoptr(GSource) source = NULL;
+
+		batch = batch_new (self, kind, filter, interactive, context);
+		batch->key = g_steal_pointer (&key);
+		g_hash_table_insert (self->pending, batch->key, batch);
+
+		source = g_timeout_source_new (GS_PACKAGEKIT_BATCHER_WINDOW_MS);
+		g_source_set_callback (source, batch_dispatch_cb, batch, NULL);
+		g_source_attach (source, context);
+	}
+
+	batch_add_request (batch, task);
+}
+
+PkResults *
+gs_packagekit_batcher_run_finish (GsPackagekitBatcher	*self,
+				  GAsyncResult		*result,
+				  GError		**error)
+{
+	g_return_val_if_fail (GS_IS_PACKAGEKIT_BATCHER (self), NULL);
+	g_return_val_if_fail (g_task_is_valid (result, self), NULL);
+
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+gs_packagekit_batcher_finalize (GObject *object)
+{
+	GsPackagekitBatcher *self = GS_PACKAGEKIT_BATCHER (object);
+
+	/* every pending batch holds a reference on the batcher */
+	g_assert (g_hash_table_size (self->pending) == 0);
+
+	g_hash_table_unref (self->pending);
+	g_mutex_clear (&self->mutex);
+
+	G_OBJECT_CLASS (gs_packagekit_batcher_parent_class)->finalize (object);
+}
+
+static void
+gs_packagekit_batcher_class_init (GsPackagekitBatcherClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_packagekit_batcher_finalize;
+}
+
+static void
+gs_packagekit_batcher_init (GsPackagekitBatcher *self)
+{
+	g_mutex_init (&self->mutex);
+	self->pending = g_hash_table_new (g_str_hash, g_str_equal);
+}
+
+GsPackagekitBatcher *
+gs_packagekit_batcher_new (void)
+{
+	return g_object_new (GS_TYPE_PACKAGEKIT_BATCHER, NULL);
+}
@@ -0,0 +1,44 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <packagekit-glib2/packagekit.h>
+
+#include "gs-packagekit-helper.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+	GS_PACKAGEKIT_BATCH_KIND_RESOLVE,
+	GS_PACKAGEKIT_BATCH_KIND_GET_DETAILS,
+	GS_PACKAGEKIT_BATCH_KIND_GET_UPDATE_DETAIL,
+	GS_PACKAGEKIT_BATCH_KIND_SEARCH_FILES,
+	GS_PACKAGEKIT_BATCH_KIND_LAST
+} GsPackagekitBatchKind;
+
+#define GS_TYPE_PACKAGEKIT_BATCHER (gs_packagekit_batcher_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsPackagekitBatcher, gs_packagekit_batcher, GS, PACKAGEKIT_BATCHER, GObject)
+
+GsPackagekitBatcher *gs_packagekit_batcher_new		(void);
+void		 gs_packagekit_batcher_run_async	(GsPackagekitBatcher	*self,
+							 GsPackagekitBatchKind	 kind,
+							 PkBitfield		 filter,
+							 const gchar * const	*values,
+							 gboolean		 interactive,
+							 GsPackagekitHelper	*helper,
+							 GCancellable		*cancellable,
+							 GAsyncReadyCallback	 callback,
+							 gpointer		 user_data);
+PkResults	*gs_packagekit_batcher_run_finish	(GsPackagekitBatcher	*self,
+							 GAsyncResult		*result,
+							 GError			**error);
+
+G_END_DECLS
@@ -0,0 +1,269 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/* Notes:
+ *
+ * The details (license, URL, description, sizes) and the update text of a
+ * package never change for a given package ID, as any new build of the
+ * package has a new version and so a new ID. #GsPackagekitDetailsCache keeps
+ * what GetDetails and GetUpdateDetail returned in a key file, one group per
+ * package ID, so that later sessions only need to ask packagekitd about
+ * packages they have not seen before.
+ *
+ * The plugin invalidates the whole cache when the repositories or the
+ * available updates change, so it never grows beyond what is in use. Saving
+ * happens in a background thread, and several changes in a row are written
+ * out together.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gs-packagekit-details-cache.h"
+
+struct _GsPackagekitDetailsCache {
+	GObject			 parent_instance;
+
+	gchar			*filename;  /* (owned) */
+	GMutex			 mutex;
+	GKeyFile		*kf;  /* (owned); one group per package ID */
+	GThreadPool		*pool;  /* (owned) */
+	gboolean		 dirty;
+	gboolean		 save_queued;
+};
+
+G_DEFINE_TYPE (GsPackagekitDetailsCache, gs_packagekit_details_cache, G_TYPE_OBJECT)
+
+static void
+gs_packagekit_details_cache_save (GsPackagekitDetailsCache *self)
+{
+	g_autofree gchar *data = NULL;
+	gsize length = 0;
+	g_autoptr(GError) error_local = NULL;
+
+	{
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->mutex);
+		self->save_queued = FALSE;
+		if (!self->dirty)
+			return;
+		self->dirty = FALSE;
+		data = g_key_file_to_data (self->kf, &length, NULL);
+	}
+
+	if (!g_file_set_contents (self->filename, data, length, &error_local))
+		g_debug ("failed to save %s: %s", self->filename, error_local->message);
+}
+
+/* Run in @self->pool. */
+static void
+gs_packagekit_details_cache_save_cb (gpointer data,
+				     gpointer user_data)
+{
+	gs_packagekit_details_cache_save (GS_PACKAGEKIT_DETAILS_CACHE (user_data));
+}
+
+/* must be called with @self->mutex held */
+static void
+gs_packagekit_details_cache_queue_save_locked (GsPackagekitDetailsCache *self)
+{
+	self->dirty = TRUE;
+	if (self->save_queued)
+		return;
+	self->save_queued = TRUE;
+	g_thread_pool_push (self->pool, self, NULL);
+}
+
+/* Returns the cached details of @package_id, or %NULL if there are none. */
+PkDetails *
+gs_packagekit_details_cache_lookup_details (GsPackagekitDetailsCache *self,
+					    const gchar *package_id)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autofree gchar *license = NULL;
+	g_autofree gchar *url = NULL;
+	g_autofree gchar *description = NULL;
+	guint64 size;
+
+	g_return_val_if_fail (GS_IS_PACKAGEKIT_DETAILS_CACHE (self), NULL);
+	g_return_val_if_fail (package_id != NULL, NULL);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	if (!g_key_file_has_key (self->kf, package_id, "Size", NULL))
+		return NULL;
+
+	license = g_key_file_get_string (self->kf, package_id, "License", NULL);
+	url = g_key_file_get_string (self->kf, package_id, "Url", NULL);
+	description = g_key_file_get_string (self->kf, package_id, "Description", NULL);
+	size = g_key_file_get_uint64 (self->kf, package_id, "Size", NULL);
+
+	return g_object_new (PK_TYPE_DETAILS,
+			     "package-id", package_id,
+			     "license", license,
+			     "url", url,
+			     "description", description,
+			     "size", size,
+#ifdef HAVE_PK_DETAILS_GET_DOWNLOAD_SIZE
+			     "download-size", g_key_file_get_uint64 (self->kf, package_id, "DownloadSize", NULL),
+#endif
+			     NULL);
+}
+
+/* Remembers the results of a GetDetails transaction. */
+void
+gs_packagekit_details_cache_add_details (GsPackagekitDetailsCache *self,
+					 GPtrArray *details_array)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_DETAILS_CACHE (self));
+	g_return_if_fail (details_array != NULL);
+
+	if (details_array->len == 0)
+		return;
+
+	locker = g_mutex_locker_new (&self->mutex);
+	for (guint i = 0; i < details_array->len; i++) {
+		PkDetails *details = g_ptr_array_index (details_array, i);
+		const gchar *package_id = pk_details_get_package_id (details);
+		const gchar *tmp;
+
+		if (package_id == NULL)
+			continue;
+		if ((tmp = pk_details_get_license (details)) != NULL)
+			g_key_file_set_string (self->kf, package_id, "License", tmp);
+		if ((tmp = pk_details_get_url (details)) != NULL)
+			g_key_file_set_string (self->kf, package_id, "Url", tmp);
+		if ((tmp = pk_details_get_description (details)) != NULL)
+			g_key_file_set_string (self->kf, package_id, "Description", tmp);
+#ifdef HAVE_PK_DETAILS_GET_DOWNLOAD_SIZE
+		g_key_file_set_uint64 (self->kf, package_id, "DownloadSize", pk_details_get_download_size (details));
+#endif
+		/* set last, as its presence marks the details as complete */
+		g_key_file_set_uint64 (self->kf, package_id, "Size", pk_details_get_size (details));
+	}
+	gs_packagekit_details_cache_queue_save_locked (self);
+}
+
+/* Gets the cached update text of @package_id, which may be %NULL even if
+ * the package is known to have no update text. Returns %FALSE if nothing is
+ * cached for it. */
+gboolean
+gs_packagekit_details_cache_lookup_update_text (GsPackagekitDetailsCache *self,
+						const gchar *package_id,
+						gchar **out_update_text)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autofree gchar *update_text = NULL;
+
+	g_return_val_if_fail (GS_IS_PACKAGEKIT_DETAILS_CACHE (self), FALSE);
+	g_return_val_if_fail (package_id != NULL, FALSE);
+	g_return_val_if_fail (out_update_text != NULL, FALSE);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	update_text = g_key_file_get_string (self->kf, package_id, "UpdateText", NULL);
+	if (update_text == NULL)
+		return FALSE;
+
+	*out_update_text = (*update_text != '\0') ? g_steal_pointer (&update_text) : NULL;
+	return TRUE;
+}
+
+/* Remembers the results of a GetUpdateDetail transaction. */
+void
+gs_packagekit_details_cache_add_update_details (GsPackagekitDetailsCache *self,
+						GPtrArray *update_details_array)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_DETAILS_CACHE (self));
+	g_return_if_fail (update_details_array != NULL);
+
+	if (update_details_array->len == 0)
+		return;
+
+	locker = g_mutex_locker_new (&self->mutex);
+	for (guint i = 0; i < update_details_array->len; i++) {
+		PkUpdateDetail *update_detail = g_ptr_array_index (update_details_array, i);
+		const gchar *package_id = pk_update_detail_get_package_id (update_detail);
+		const gchar *update_text = pk_update_detail_get_update_text (update_detail);
+
+		if (package_id == NULL)
+			continue;
+		g_key_file_set_string (self->kf, package_id, "UpdateText",
+				       (update_text != NULL) ? update_text : "");
+	}
+	gs_packagekit_details_cache_queue_save_locked (self);
+}
+
+/* Forgets everything, both in memory and on disk. */
+void
+gs_packagekit_details_cache_invalidate (GsPackagekitDetailsCache *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_DETAILS_CACHE (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+	g_debug ("invalidating cached package details");
+	g_key_file_free (self->kf);
+	self->kf = g_key_file_new ();
+	gs_packagekit_details_cache_queue_save_locked (self);
+}
+
+static void
+gs_packagekit_details_cache_finalize (GObject *object)
+{
+	GsPackagekitDetailsCache *self = GS_PACKAGEKIT_DETAILS_CACHE (object);
+
+	/* a queued save may have been dropped, so save again */
+	g_thread_pool_free (self->pool, TRUE, TRUE);
+	gs_packagekit_details_cache_save (self);
+
+	g_key_file_free (self->kf);
+	g_mutex_clear (&self->mutex);
+	g_free (self->filename);
+
+	G_OBJECT_CLASS (gs_packagekit_details_cache_parent_class)->finalize (object);
+}
+
+static void
+gs_packagekit_details_cache_class_init (GsPackagekitDetailsCacheClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_packagekit_details_cache_finalize;
+}
+
+static void
+gs_packagekit_details_cache_init (GsPackagekitDetailsCache *self)
+{
+	g_mutex_init (&self->mutex);
+	self->kf = g_key_file_new ();
+	self->pool = g_thread_pool_new (gs_packagekit_details_cache_save_cb, self,
+					1, TRUE, NULL);
+}
+
+/* Creates a cache persisted to @filename, loading any details saved there. */
+GsPackagekitDetailsCache *
+gs_packagekit_details_cache_new (const gchar *filename)
+{
+	GsPackagekitDetailsCache *self;
+	g_autoptr(GError) error_local = NULL;
+
+	g_return_val_if_fail (filename != NULL, NULL);
+
+	self = g_object_new (GS_TYPE_PACKAGEKIT_DETAILS_CACHE, NULL);
+	self->filename = g_strdup (filename);
+	if (!g_key_file_load_from_file (self->kf, filename, G_KEY_FILE_NONE, &error_local)) {
+		if (!g_error_matches (error_local, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_debug ("failed to load %s: %s", filename, error_local->message);
+		g_key_file_free (self->kf);
+		self->kf = g_key_file_new ();
+	}
+	return self;
+}
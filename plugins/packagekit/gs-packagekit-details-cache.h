@@ -0,0 +1,32 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <packagekit-glib2/packagekit.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_PACKAGEKIT_DETAILS_CACHE (gs_packagekit_details_cache_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsPackagekitDetailsCache, gs_packagekit_details_cache, GS, PACKAGEKIT_DETAILS_CACHE, GObject)
+
+GsPackagekitDetailsCache *gs_packagekit_details_cache_new	(const gchar			*filename);
+PkDetails	*gs_packagekit_details_cache_lookup_details	(GsPackagekitDetailsCache	*self,
+								 const gchar			*package_id);
+void		 gs_packagekit_details_cache_add_details	(GsPackagekitDetailsCache	*self,
+								 GPtrArray			*details_array);
+gboolean	 gs_packagekit_details_cache_lookup_update_text	(GsPackagekitDetailsCache	*self,
+								 const gchar			*package_id,
+								 gchar				**out_update_text);
+void		 gs_packagekit_details_cache_add_update_details	(GsPackagekitDetailsCache	*self,
+								 GPtrArray			*update_details_array);
+void		 gs_packagekit_details_cache_invalidate		(GsPackagekitDetailsCache	*self);
+
+G_END_DECLS
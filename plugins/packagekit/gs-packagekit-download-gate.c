@@ -0,0 +1,193 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/* Notes:
+ *
+ * Updates are staged in the background a few packages at a time, and
+ * #GsPackagekitDownloadGate decides when that may happen: it is closed while
+ * the network is metered or power saving is enabled, and open otherwise.
+ *
+ * The staging thread waits for the gate before each transfer. Closing the
+ * gate also cancels the transfer in progress, which is retried once the
+ * gate opens again; the packages it had already downloaded are still in the
+ * PackageKit cache, so little is lost.
+ *
+ * The monitors emit their notifications in the main context the gate was
+ * created in, while waiting happens in worker threads.
+ */
+
+#include "config.h"
+
+#include "gs-packagekit-download-gate.h"
+
+struct _GsPackagekitDownloadGate {
+	GObject			 parent_instance;
+
+	GNetworkMonitor		*network_monitor;  /* (owned) */
+	GPowerProfileMonitor	*power_profile_monitor;  /* (owned) */
+
+	GMutex			 mutex;
+	GCond			 cond;
+	gboolean		 open;
+	GCancellable		*transfer_cancellable;  /* (owned) (nullable) */
+};
+
+G_DEFINE_TYPE (GsPackagekitDownloadGate, gs_packagekit_download_gate, G_TYPE_OBJECT)
+
+/* Opens or closes the gate, cancelling the transfer in progress if it
+ * closes. This is done whenever the monitors change, and by the tests. */
+void
+gs_packagekit_download_gate_set_open (GsPackagekitDownloadGate *self,
+				      gboolean open)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_DOWNLOAD_GATE (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+	if (open == self->open)
+		return;
+
+	self->open = open;
+	if (!open && self->transfer_cancellable != NULL)
+		g_cancellable_cancel (self->transfer_cancellable);
+	g_cond_broadcast (&self->cond);
+}
+
+static void
+gs_packagekit_download_gate_update (GsPackagekitDownloadGate *self)
+{
+	gboolean metered = g_network_monitor_get_network_metered (self->network_monitor);
+	gboolean power_saver = g_power_profile_monitor_get_power_saver_enabled (self->power_profile_monitor);
+
+	g_debug ("staged downloads %s (metered: %s, power saver: %s)",
+		 (!metered && !power_saver) ? "allowed" : "paused",
+		 metered ? "yes" : "no",
+		 power_saver ? "yes" : "no");
+	gs_packagekit_download_gate_set_open (self, !metered && !power_saver);
+}
+
+static void
+gs_packagekit_download_gate_notify_cb (GObject    *object,
+				       GParamSpec *pspec,
+				       gpointer    user_data)
+{
+	gs_packagekit_download_gate_update (GS_PACKAGEKIT_DOWNLOAD_GATE (user_data));
+}
+
+static void
+gs_packagekit_download_gate_cancelled_cb (GCancellable *cancellable,
+					  gpointer      user_data)
+{
+	GsPackagekitDownloadGate *self = GS_PACKAGEKIT_DOWNLOAD_GATE (user_data);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->mutex);
+
+	g_cond_broadcast (&self->cond);
+}
+
+/* Blocks until downloads may go ahead. Returns %FALSE if @cancellable was
+ * cancelled first. */
+gboolean
+gs_packagekit_download_gate_wait (GsPackagekitDownloadGate *self,
+				  GCancellable *cancellable)
+{
+	gulong handler_id = 0;
+
+	g_return_val_if_fail (GS_IS_PACKAGEKIT_DOWNLOAD_GATE (self), FALSE);
+
+	if (cancellable != NULL)
+		handler_id = g_cancellable_connect (cancellable,
+						    G_CALLBACK (gs_packagekit_download_gate_cancelled_cb),
+						    self, NULL);
+
+	g_mutex_lock (&self->mutex);
+	if (!self->open)
+		g_debug ("waiting for staged downloads to be allowed");
+	while (!self->open && !g_cancellable_is_cancelled (cancellable))
+		g_cond_wait (&self->cond, &self->mutex);
+	g_mutex_unlock (&self->mutex);
+
+	g_cancellable_disconnect (cancellable, handler_id);
+
+	return !g_cancellable_is_cancelled (cancellable);
+}
+
+/* Sets the cancellable of the transfer in progress, which is cancelled as
+ * soon as the gate closes, or %NULL once it is over. */
+void
+gs_packagekit_download_gate_set_transfer (GsPackagekitDownloadGate *self,
+					  GCancellable *transfer_cancellable)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_DOWNLOAD_GATE (self));
+	g_return_if_fail (transfer_cancellable == NULL || G_IS_CANCELLABLE (transfer_cancellable));
+
+	locker = g_mutex_locker_new (&self->mutex);
+	g_set_object (&self->transfer_cancellable, transfer_cancellable);
+	if (!self->open && transfer_cancellable != NULL)
+		g_cancellable_cancel (transfer_cancellable);
+}
+
+static void
+gs_packagekit_download_gate_dispose (GObject *object)
+{
+	GsPackagekitDownloadGate *self = GS_PACKAGEKIT_DOWNLOAD_GATE (object);
+
+	if (self->network_monitor != NULL)
+		g_signal_handlers_disconnect_by_data (self->network_monitor, self);
+	g_clear_object (&self->network_monitor);
+	if (self->power_profile_monitor != NULL)
+		g_signal_handlers_disconnect_by_data (self->power_profile_monitor, self);
+	g_clear_object (&self->power_profile_monitor);
+	g_clear_object (&self->transfer_cancellable);
+
+	G_OBJECT_CLASS (gs_packagekit_download_gate_parent_class)->dispose (object);
+}
+
+static void
+gs_packagekit_download_gate_finalize (GObject *object)
+{
+	GsPackagekitDownloadGate *self = GS_PACKAGEKIT_DOWNLOAD_GATE (object);
+
+	g_cond_clear (&self->cond);
+	g_mutex_clear (&self->mutex);
+
+	G_OBJECT_CLASS (gs_packagekit_download_gate_parent_class)->finalize (object);
+}
+
+static void
+gs_packagekit_download_gate_class_init (GsPackagekitDownloadGateClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->dispose = gs_packagekit_download_gate_dispose;
+	object_class->finalize = gs_packagekit_download_gate_finalize;
+}
+
+static void
+gs_packagekit_download_gate_init (GsPackagekitDownloadGate *self)
+{
+	g_mutex_init (&self->mutex);
+	g_cond_init (&self->cond);
+	self->open = TRUE;
+
+	self->network_monitor = g_object_ref (g_network_monitor_get_default ());
+	g_signal_connect (self->network_monitor, "notify::network-metered",
+			  G_CALLBACK (gs_packagekit_download_gate_notify_cb), self);
+	self->power_profile_monitor = g_power_profile_monitor_dup_default ();
+	g_signal_connect (self->power_profile_monitor, "notify::power-saver-enabled",
+			  G_CALLBACK (gs_packagekit_download_gate_notify_cb), self);
+
+	gs_packagekit_download_gate_update (self);
+}
+
+GsPackagekitDownloadGate *
+gs_packagekit_download_gate_new (void)
+{
+	return g_object_new (GS_TYPE_PACKAGEKIT_DOWNLOAD_GATE, NULL);
+}
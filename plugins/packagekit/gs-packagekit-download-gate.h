@@ -0,0 +1,27 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_PACKAGEKIT_DOWNLOAD_GATE (gs_packagekit_download_gate_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsPackagekitDownloadGate, gs_packagekit_download_gate, GS, PACKAGEKIT_DOWNLOAD_GATE, GObject)
+
+GsPackagekitDownloadGate *gs_packagekit_download_gate_new	(void);
+gboolean	 gs_packagekit_download_gate_wait		(GsPackagekitDownloadGate	*self,
+								 GCancellable			*cancellable);
+void		 gs_packagekit_download_gate_set_transfer	(GsPackagekitDownloadGate	*self,
+								 GCancellable			*transfer_cancellable);
+void		 gs_packagekit_download_gate_set_open		(GsPackagekitDownloadGate	*self,
+								 gboolean			 open);
+
+G_END_DECLS
@@ -0,0 +1,489 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/* Notes:
+ *
+ * Refining the setup action of an app, or the package of a repository,
+ * means finding the installed package which owns a desktop file, metainfo
+ * file or .repo file; asking packagekitd with SearchFiles takes a round trip
+ * through the backend for every single file.
+ *
+ * #GsPackagekitFileIndex maps every file in the few directories those
+ * lookups are about to the installed package owning it. It is built with just
+ * three transactions: one SearchFiles for all the files at once, which finds
+ * the packages but not which file each of them owns, one GetFiles for those
+ * packages to tell them apart, and one Resolve for their names to find the
+ * newest version of each, which is what a provides-files query returns.
+ *
+ * Files owned by more than one installed package, such as those shared by the
+ * multilib variants of a package, are left out so that packagekitd decides.
+ *
+ * The index is dropped and rebuilt in the background whenever the installed
+ * packages or the repositories may have changed; until it is ready, and for
+ * any file it does not know about, callers fall back to asking packagekitd.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gs-packagekit-file-index.h"
+
+/* only files directly in these directories are indexed */
+static const gchar * const indexed_dirs[] = {
+	"/usr/share/applications",
+	"/usr/share/metainfo",
+	"/usr/share/appdata",
+	"/etc/yum.repos.d",
+	"/etc/apt/sources.list.d",
+	NULL
+};
+
+struct _GsPackagekitFileIndex {
+	GObject			 parent_instance;
+
+	GMutex			 mutex;
+	GHashTable		*files;  /* (owned) (nullable) (element-type filename PkPackage); %NULL until built */
+	GHashTable		*newest;  /* (owned) (nullable) (element-type filename PkPackage); %NULL until built */
+	GCancellable		*cancellable;  /* (owned) (nullable); of the build in progress */
+};
+
+G_DEFINE_TYPE (GsPackagekitFileIndex, gs_packagekit_file_index, G_TYPE_OBJECT)
+
+typedef struct {
+	GsPackagekitFileIndex	*self;  /* (owned) */
+	GCancellable		*cancellable;  /* (owned) */
+	GHashTable		*wanted;  /* (owned) (element-type filename); the files to index */
+	GHashTable		*packages;  /* (owned) (element-type utf8 PkPackage); by package ID */
+	GHashTable		*files;  /* (owned) (nullable) (element-type filename PkPackage); installed owners */
+	GTimer			*timer;  /* (owned) */
+} BuildData;
+
+static void
+build_data_free (BuildData *data)
+{
+	g_timer_destroy (data->timer);
+	g_clear_pointer (&data->files, g_hash_table_unref);
+	g_hash_table_unref (data->packages);
+	g_hash_table_unref (data->wanted);
+	g_object_unref (data->cancellable);
+	g_object_unref (data->self);
+	g_free (data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (BuildData, build_data_free)
+
+/* Drops the index and starts a new build, cancelling any build still in
+ * progress. Returns the cancellable of the new build, to pass to
+ * gs_packagekit_file_index_finish_build(). */
+GCancellable *
+gs_packagekit_file_index_begin_build (GsPackagekitFileIndex *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+
+	g_return_val_if_fail (GS_IS_PACKAGEKIT_FILE_INDEX (self), NULL);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	g_cancellable_cancel (self->cancellable);
+	g_set_object (&self->cancellable, cancellable);
+	g_clear_pointer (&self->files, g_hash_table_unref);
+	g_clear_pointer (&self->newest, g_hash_table_unref);
+
+	return g_steal_pointer (&cancellable);
+}
+
+/* Makes @files and @newest the index, unless the build started with
+ * @cancellable has since been superseded or cancelled. Returns whether
+ * they were used. */
+gboolean
+gs_packagekit_file_index_finish_build (GsPackagekitFileIndex *self,
+				       GCancellable *cancellable,
+				       GHashTable *files,
+				       GHashTable *newest)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_PACKAGEKIT_FILE_INDEX (self), FALSE);
+	g_return_val_if_fail (G_IS_CANCELLABLE (cancellable), FALSE);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	if (self->cancellable != cancellable)
+		return FALSE;
+
+	g_clear_pointer (&self->files, g_hash_table_unref);
+	g_clear_pointer (&self->newest, g_hash_table_unref);
+	self->files = g_hash_table_ref (files);
+	self->newest = g_hash_table_ref (newest);
+	g_clear_object (&self->cancellable);
+
+	return TRUE;
+}
+
+static void
+build_finish (BuildData *data,
+	      GHashTable *files,
+	      GHashTable *newest)
+{
+	if (!gs_packagekit_file_index_finish_build (data->self, data->cancellable, files, newest))
+		return;
+
+	g_debug ("indexed %u files in %fms",
+		 g_hash_table_size (files), g_timer_elapsed (data->timer, NULL) * 1000);
+}
+
+/* Maps each of the @wanted files listed in @files, an array of #PkFiles from
+ * GetFiles, to the package in @packages (by package ID) which owns it. Files
+ * owned by more than one package, e.g. the multilib variants of a package,
+ * are left out. */
+GHashTable *
+gs_packagekit_file_index_map_owners (GHashTable *wanted,
+				     GHashTable *packages,
+				     GPtrArray *files)
+{
+	g_autoptr(GHashTable) owners = NULL;
+	g_autoptr(GHashTable) conflicts = NULL;
+	GHashTableIter iter;
+	gpointer key;
+
+	owners = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+	conflicts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (guint i = 0; i < files->len; i++) {
+		PkFiles *item = g_ptr_array_index (files, i);
+		PkPackage *package = g_hash_table_lookup (packages, pk_files_get_package_id (item));
+		gchar **fns = pk_files_get_files (item);
+
+		for (guint j = 0; package != NULL && fns != NULL && fns[j] != NULL; j++) {
+			PkPackage *owner;
+
+			if (!g_hash_table_contains (wanted, fns[j]))
+				continue;
+
+			owner = g_hash_table_lookup (owners, fns[j]);
+			if (owner != NULL && owner != package)
+				g_hash_table_add (conflicts, g_strdup (fns[j]));
+			else
+				g_hash_table_replace (owners, g_strdup (fns[j]), g_object_ref (package));
+		}
+	}
+
+	g_hash_table_iter_init (&iter, conflicts);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		g_hash_table_remove (owners, key);
+
+	return g_steal_pointer (&owners);
+}
+
+/* Maps each file in @owners to the newest version of its owner, from
+ * @packages, an array of #PkPackage from a Resolve of the owners' names.
+ * Files whose owner is missing from @packages are left out. */
+GHashTable *
+gs_packagekit_file_index_map_newest (GHashTable *owners,
+				     GPtrArray *packages)
+{
+	g_autoptr(GHashTable) by_name = NULL;
+	g_autoptr(GHashTable) newest = NULL;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	by_name = g_hash_table_new (g_str_hash, g_str_equal);
+	for (guint i = 0; i < packages->len; i++) {
+		PkPackage *package = g_ptr_array_index (packages, i);
+		g_hash_table_insert (by_name, (gpointer) pk_package_get_name (package), package);
+	}
+
+	newest = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+	g_hash_table_iter_init (&iter, owners);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		PkPackage *package = g_hash_table_lookup (by_name, pk_package_get_name (PK_PACKAGE (value)));
+		if (package != NULL)
+			g_hash_table_insert (newest, g_strdup (key), g_object_ref (package));
+	}
+
+	return g_steal_pointer (&newest);
+}
+
+static gboolean
+build_results_valid (PkResults *results,
+		     const GError *error)
+{
+	g_autoptr(PkError) error_code = NULL;
+
+	if (results == NULL) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_debug ("failed to index package files: %s", error->message);
+		return FALSE;
+	}
+
+	error_code = pk_results_get_error_code (results);
+	if (error_code != NULL) {
+		g_debug ("failed to index package files: %s", pk_error_get_details (error_code));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+resolve_cb (GObject      *source_object,
+            GAsyncResult *result,
+            gpointer      user_data)
+{
+	PkClient *client = PK_CLIENT (source_object);
+	g_autoptr(BuildData) data = user_data;
+	g_autoptr(PkResults) results = NULL;
+	g_autoptr(GPtrArray) array = NULL;
+	g_autoptr(GHashTable) newest = NULL;
+	g_autoptr(GError) local_error = NULL;
+
+	results = pk_client_generic_finish (client, result, &local_error);
+	if (!build_results_valid (results, local_error))
+		return;
+
+	/* the newest version of each package name, installed or not */
+	array = pk_results_get_package_array (results);
+	newest = gs_packagekit_file_index_map_newest (data->files, array);
+
+	build_finish (data, data->files, newest);
+}
+
+static void
+get_files_cb (GObject      *source_object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+	PkClient *client = PK_CLIENT (source_object);
+	g_autoptr(BuildData) data = user_data;
+	g_autoptr(PkResults) results = NULL;
+	g_autoptr(GPtrArray) array = NULL;
+	g_autoptr(GHashTable) names = NULL;
+	g_autoptr(GPtrArray) names_array = NULL;
+	g_autoptr(GError) local_error = NULL;
+	GHashTableIter iter;
+	gpointer value;
+
+	results = pk_client_generic_finish (client, result, &local_error);
+	if (!build_results_valid (results, local_error))
+		return;
+
+	array = pk_results_get_files_array (results);
+	data->files = gs_packagekit_file_index_map_owners (data->wanted, data->packages, array);
+
+	/* look up the newest version of every owner by name */
+	names = g_hash_table_new (g_str_hash, g_str_equal);
+	names_array = g_ptr_array_new ();
+	g_hash_table_iter_init (&iter, data->files);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		const gchar *name = pk_package_get_name (PK_PACKAGE (value));
+		if (g_hash_table_add (names, (gpointer) name))
+			g_ptr_array_add (names_array, (gpointer) name);
+	}
+
+	if (names_array->len == 0) {
+		g_autoptr(GHashTable) newest = g_hash_table_new (g_str_hash, g_str_equal);
+		build_finish (data, data->files, newest);
+		return;
+	}
+
+	/* NULL-terminate the array */
+	g_ptr_array_add (names_array, NULL);
+
+	pk_client_resolve_async (client,
+				 pk_bitfield_from_enums (PK_FILTER_ENUM_NEWEST,
+							 PK_FILTER_ENUM_ARCH,
+							 -1),
+				 (gchar **) names_array->pdata,
+				 data->cancellable,
+				 NULL, NULL,
+				 resolve_cb,
+				 g_steal_pointer (&data));
+}
+
+static void
+search_files_cb (GObject      *source_object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+	PkClient *client = PK_CLIENT (source_object);
+	g_autoptr(BuildData) data = user_data;
+	g_autoptr(PkResults) results = NULL;
+	g_autoptr(GPtrArray) packages = NULL;
+	g_autoptr(GPtrArray) package_ids = NULL;
+	g_autoptr(GError) local_error = NULL;
+
+	results = pk_client_generic_finish (client, result, &local_error);
+	if (!build_results_valid (results, local_error))
+		return;
+
+	package_ids = g_ptr_array_new ();
+	packages = pk_results_get_package_array (results);
+	for (guint i = 0; i < packages->len; i++) {
+		PkPackage *package = g_ptr_array_index (packages, i);
+		if (g_hash_table_contains (data->packages, pk_package_get_id (package)))
+			continue;
+		g_hash_table_insert (data->packages, g_strdup (pk_package_get_id (package)), g_object_ref (package));
+		g_ptr_array_add (package_ids, (gpointer) pk_package_get_id (package));
+	}
+
+	/* none of the files belongs to a package */
+	if (package_ids->len == 0) {
+		g_autoptr(GHashTable) files = g_hash_table_new (g_str_hash, g_str_equal);
+		build_finish (data, files, files);
+		return;
+	}
+
+	/* NULL-terminate the array */
+	g_ptr_array_add (package_ids, NULL);
+
+	pk_client_get_files_async (client,
+				   (gchar **) package_ids->pdata,
+				   data->cancellable,
+				   NULL, NULL,
+				   get_files_cb,
+				   g_steal_pointer (&data));
+}
+
+/* Drops the index and starts building it again in the background. Any
+ * build still in progress is cancelled. */
+void
+gs_packagekit_file_index_rebuild (GsPackagekitFileIndex *self)
+{
+	g_autoptr(BuildData) data = NULL;
+	g_autoptr(PkClient) client = NULL;
+	g_autoptr(GPtrArray) filenames = NULL;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_FILE_INDEX (self));
+
+	data = g_new0 (BuildData, 1);
+	data->self = g_object_ref (self);
+	data->cancellable = gs_packagekit_file_index_begin_build (self);
+	data->wanted = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	data->packages = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+	data->timer = g_timer_new ();
+
+	filenames = g_ptr_array_new ();
+	for (guint i = 0; indexed_dirs[i] != NULL; i++) {
+		g_autoptr(GDir) dir = g_dir_open (indexed_dirs[i], 0, NULL);
+		const gchar *name;
+
+		while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+			gchar *fn = g_build_filename (indexed_dirs[i], name, NULL);
+			if (!g_file_test (fn, G_FILE_TEST_IS_REGULAR)) {
+				g_free (fn);
+				continue;
+			}
+			g_hash_table_add (data->wanted, fn);
+			g_ptr_array_add (filenames, fn);
+		}
+	}
+
+	if (filenames->len == 0) {
+		g_autoptr(GHashTable) files = g_hash_table_new (g_str_hash, g_str_equal);
+		build_finish (data, files, files);
+		return;
+	}
+
+	/* NULL-terminate the array */
+	g_ptr_array_add (filenames, NULL);
+
+	client = pk_client_new ();
+	pk_client_set_background (client, TRUE);
+	pk_client_search_files_async (client,
+				      pk_bitfield_from_enums (PK_FILTER_ENUM_INSTALLED, -1),
+				      (gchar **) filenames->pdata,
+				      data->cancellable,
+				      NULL, NULL,
+				      search_files_cb,
+				      g_steal_pointer (&data));
+}
+
+/* Cancels any build in progress and drops the index. */
+void
+gs_packagekit_file_index_cancel (GsPackagekitFileIndex *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_FILE_INDEX (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+	g_cancellable_cancel (self->cancellable);
+	g_clear_object (&self->cancellable);
+	g_clear_pointer (&self->files, g_hash_table_unref);
+	g_clear_pointer (&self->newest, g_hash_table_unref);
+}
+
+/* Gets the installed package owning @filename, or %NULL if the index is not
+ * ready or does not know about the file. */
+PkPackage *
+gs_packagekit_file_index_lookup (GsPackagekitFileIndex *self,
+				 const gchar *filename)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	PkPackage *package;
+
+	g_return_val_if_fail (GS_IS_PACKAGEKIT_FILE_INDEX (self), NULL);
+	g_return_val_if_fail (filename != NULL, NULL);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	if (self->files == NULL)
+		return NULL;
+	package = g_hash_table_lookup (self->files, filename);
+	return (package != NULL) ? g_object_ref (package) : NULL;
+}
+
+/* Gets the newest version of the installed package owning @filename, which
+ * may be an update available from a repository, or %NULL if the index is not
+ * ready or does not know about the file. */
+PkPackage *
+gs_packagekit_file_index_lookup_newest (GsPackagekitFileIndex *self,
+					const gchar *filename)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	PkPackage *package;
+
+	g_return_val_if_fail (GS_IS_PACKAGEKIT_FILE_INDEX (self), NULL);
+	g_return_val_if_fail (filename != NULL, NULL);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	if (self->newest == NULL)
+		return NULL;
+	package = g_hash_table_lookup (self->newest, filename);
+	return (package != NULL) ? g_object_ref (package) : NULL;
+}
+
+static void
+gs_packagekit_file_index_finalize (GObject *object)
+{
+	GsPackagekitFileIndex *self = GS_PACKAGEKIT_FILE_INDEX (object);
+
+	g_clear_pointer (&self->files, g_hash_table_unref);
+	g_clear_pointer (&self->newest, g_hash_table_unref);
+	g_clear_object (&self->cancellable);
+	g_mutex_clear (&self->mutex);
+
+	G_OBJECT_CLASS (gs_packagekit_file_index_parent_class)->finalize (object);
+}
+
+static void
+gs_packagekit_file_index_class_init (GsPackagekitFileIndexClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_packagekit_file_index_finalize;
+}
+
+static void
+gs_packagekit_file_index_init (GsPackagekitFileIndex *self)
+{
+	g_mutex_init (&self->mutex);
+}
+
+GsPackagekitFileIndex *
+gs_packagekit_file_index_new (void)
+{
+	return g_object_new (GS_TYPE_PACKAGEKIT_FILE_INDEX, NULL);
+}
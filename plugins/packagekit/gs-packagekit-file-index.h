@@ -0,0 +1,40 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <packagekit-glib2/packagekit.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_PACKAGEKIT_FILE_INDEX (gs_packagekit_file_index_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsPackagekitFileIndex, gs_packagekit_file_index, GS, PACKAGEKIT_FILE_INDEX, GObject)
+
+GsPackagekitFileIndex *gs_packagekit_file_index_new	(void);
+void		 gs_packagekit_file_index_rebuild	(GsPackagekitFileIndex	*self);
+void		 gs_packagekit_file_index_cancel	(GsPackagekitFileIndex	*self);
+PkPackage	*gs_packagekit_file_index_lookup	(GsPackagekitFileIndex	*self,
+							 const gchar		*filename);
+PkPackage	*gs_packagekit_file_index_lookup_newest	(GsPackagekitFileIndex	*self,
+							 const gchar		*filename);
+
+/* the steps of building the index, also used by the self tests */
+GCancellable	*gs_packagekit_file_index_begin_build	(GsPackagekitFileIndex	*self);
+gboolean	 gs_packagekit_file_index_finish_build	(GsPackagekitFileIndex	*self,
+							 GCancellable		*cancellable,
+							 GHashTable		*files,
+							 GHashTable		*newest);
+GHashTable	*gs_packagekit_file_index_map_owners	(GHashTable		*wanted,
+							 GHashTable		*packages,
+							 GPtrArray		*files);
+GHashTable	*gs_packagekit_file_index_map_newest	(GHashTable		*owners,
+							 GPtrArray		*packages);
+
+G_END_DECLS
@@ -19,6 +19,8 @@ struct _GsPackagekitHelper {
 	GHashTable		*apps;
 	GsApp			*progress_app;
 	GsAppList		*progress_list;
+	guint			 progress_start;
+	guint			 progress_end;
 	GsPlugin		*plugin;
 };
 
@@ -45,6 +47,9 @@ gs_packagekit_helper_cb (PkProgress *progress, PkProgressType type, gpointer use
 			gs_plugin_status_update (plugin, app, plugin_status);
 	} else if (type == PK_PROGRESS_TYPE_PERCENTAGE) {
 		gint percentage = pk_progress_get_percentage (progress);
+		if (percentage >= 0 && percentage <= 100)
+			percentage = (gint) (self->progress_start +
+					     (guint) percentage * (self->progress_end - self->progress_start) / 100);
 		if (app != NULL && percentage >= 0 && percentage <= 100)
 			gs_app_set_progress (app, (guint) percentage);
 		if (self->progress_list != NULL && percentage >= 0 && percentage <= 100)
@@ -85,6 +90,17 @@ gs_packagekit_helper_set_progress_list (GsPackagekitHelper *self, GsAppList *pro
 	g_set_object (&self->progress_list, progress_list);
 }
 
+/* Maps the progress of the next transactions to the range from @start to
+ * @end percent, for when they are each a part of a bigger operation. */
+void
+gs_packagekit_helper_set_progress_range (GsPackagekitHelper *self, guint start, guint end)
+{
+	g_return_if_fail (GS_IS_PACKAGEKIT_HELPER (self));
+	g_return_if_fail (start <= end && end <= 100);
+	self->progress_start = start;
+	self->progress_end = end;
+}
+
 GsPlugin *
 gs_packagekit_helper_get_plugin (GsPackagekitHelper *self)
 {
@@ -129,6 +145,7 @@ gs_packagekit_helper_init (GsPackagekitHelper *self)
 {
 	self->apps = g_hash_table_new_full (g_str_hash, g_str_equal,
 					      g_free, (GDestroyNotify) g_object_unref);
+	self->progress_end = 100;
 }
 
 GsPackagekitHelper *
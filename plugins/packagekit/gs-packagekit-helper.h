@@ -27,6 +27,9 @@ void		 gs_packagekit_helper_set_progress_app	(GsPackagekitHelper	*self,
 							 GsApp			*progress_app);
 void		 gs_packagekit_helper_set_progress_list	(GsPackagekitHelper	*self,
 							 GsAppList		*progress_list);
+void		 gs_packagekit_helper_set_progress_range	(GsPackagekitHelper	*self,
+							 guint			 start,
+							 guint			 end);
 GsApp		*gs_packagekit_helper_get_app_by_id	(GsPackagekitHelper	*self,
 							 const gchar		*package_id);
 void		 gs_packagekit_helper_cb		(PkProgress		*progress,
@@ -0,0 +1,480 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/* Notes:
+ *
+ * GetUpdates makes the backend work out the whole list of updates from
+ * scratch, and the list only changes when the repository metadata or the
+ * installed packages do. #GsPackagekitUpdatesCache keeps the last list, in
+ * memory and in a key file, together with a fingerprint of the files it was
+ * computed from, and hands it out for as long as the fingerprint still
+ * matches.
+ *
+ * PackageKit does not expose checksums of the repository metadata, so the
+ * fingerprint covers the size and modification time of the files every
+ * backend rewrites when it refreshes a repository (repomd.xml, the apt
+ * (In)Release files, which hold the checksums of the rest of the metadata)
+ * and of the installed package database. The plugin also invalidates the
+ * cache whenever PackageKit says the updates or repositories changed.
+ *
+ * If none of those metadata files or no package database can be found, the
+ * backend keeps its state somewhere the fingerprint does not cover, so
+ * changes could go unnoticed; the cache then stays disabled.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "gs-packagekit-updates-cache.h"
+
+/* searched for repository metadata, up to this many levels deep */
+#define METADATA_MAX_DEPTH	4
+
+static const gchar * const default_metadata_dirs[] = {
+	"/var/cache/PackageKit",
+	"/var/cache/dnf",
+	"/var/cache/zypp/raw",
+	"/var/lib/apt/lists",
+	NULL
+};
+
+static const gchar * const default_database_files[] = {
+	"/usr/lib/sysimage/rpm/rpmdb.sqlite",
+	"/var/lib/rpm/rpmdb.sqlite",
+	"/var/lib/rpm/Packages",
+	"/var/lib/dpkg/status",
+	NULL
+};
+
+struct _GsPackagekitUpdatesCache {
+	GObject			 parent_instance;
+
+	gchar			*filename;  /* (owned) */
+	gchar			**metadata_dirs;  /* (owned) (array zero-terminated=1) */
+	gchar			**database_files;  /* (owned) (array zero-terminated=1) */
+	GMutex			 mutex;
+	guint			 generation;  /* incremented on every invalidation */
+	gchar			*fingerprint;  /* (owned) (nullable); of the files @packages was computed from */
+	GPtrArray		*packages;  /* (owned) (nullable) (element-type PkPackage) */
+	GThreadPool		*pool;  /* (owned) */
+	gboolean		 dirty;
+	gboolean		 save_queued;
+};
+
+G_DEFINE_TYPE (GsPackagekitUpdatesCache, gs_packagekit_updates_cache, G_TYPE_OBJECT)
+
+static gboolean
+is_metadata_file (const gchar *name)
+{
+	return g_str_equal (name, "repomd.xml") ||
+	       g_str_has_suffix (name, "InRelease") ||
+	       g_str_has_suffix (name, "_Release");
+}
+
+static void
+collect_metadata_files (const gchar *path,
+			guint        depth,
+			GPtrArray   *filenames)
+{
+	g_autoptr(GDir) dir = g_dir_open (path, 0, NULL);
+	const gchar *name;
+
+	while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *fn = g_build_filename (path, name, NULL);
+
+		if (is_metadata_file (name)) {
+			g_ptr_array_add (filenames, g_steal_pointer (&fn));
+			continue;
+		}
+
+		/* downloaded packages are never metadata */
+		if (depth < METADATA_MAX_DEPTH &&
+		    !g_str_equal (name, "packages") &&
+		    !g_file_test (fn, G_FILE_TEST_IS_SYMLINK) &&
+		    g_file_test (fn, G_FILE_TEST_IS_DIR))
+			collect_metadata_files (fn, depth + 1, filenames);
+	}
+}
+
+static gint
+compare_filenames (gconstpointer a,
+		   gconstpointer b)
+{
+	return g_strcmp0 (*((const gchar **) a), *((const gchar **) b));
+}
+
+/* Returns %FALSE if @filename does not exist. */
+static gboolean
+checksum_add_file (GChecksum   *checksum,
+		   const gchar *filename)
+{
+	GStatBuf st;
+	g_autofree gchar *line = NULL;
+
+	if (g_stat (filename, &st) != 0)
+		return FALSE;
+
+	line = g_strdup_printf ("%s\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT "\n",
+				filename, (guint64) st.st_size, (gint64) st.st_mtime);
+	g_checksum_update (checksum, (const guchar *) line, -1);
+	return TRUE;
+}
+
+/* Returns %NULL if there is no metadata or package database to cover. */
+static gchar *
+compute_fingerprint (GsPackagekitUpdatesCache *self)
+{
+	g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	g_autoptr(GPtrArray) filenames = g_ptr_array_new_with_free_func (g_free);
+	guint n_databases = 0;
+
+	for (guint i = 0; self->metadata_dirs[i] != NULL; i++)
+		collect_metadata_files (self->metadata_dirs[i], 0, filenames);
+	g_ptr_array_sort (filenames, compare_filenames);
+
+	for (guint i = 0; i < filenames->len; i++)
+		checksum_add_file (checksum, g_ptr_array_index (filenames, i));
+	for (guint i = 0; self->database_files[i] != NULL; i++) {
+		if (checksum_add_file (checksum, self->database_files[i]))
+			n_databases++;
+	}
+
+	if (filenames->len == 0 || n_databases == 0)
+		return NULL;
+
+	return g_strdup (g_checksum_get_string (checksum));
+}
+
+static void
+gs_packagekit_updates_cache_save (GsPackagekitUpdatesCache *self)
+{
+	g_autoptr(GKeyFile) kf = g_key_file_new ();
+	g_autofree gchar *data = NULL;
+	gsize length = 0;
+	g_autoptr(GError) error_local = NULL;
+
+	{
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->mutex);
+		self->save_queued = FALSE;
+		if (!self->dirty)
+			return;
+		self->dirty = FALSE;
+
+		if (self->packages != NULL) {
+			g_key_file_set_string (kf, "Updates", "Fingerprint", self->fingerprint);
+			for (guint i = 0; i < self->packages->len; i++) {
+				PkPackage *package = g_ptr_array_index (self->packages, i);
+				const gchar *package_id = pk_package_get_id (package);
+
+				g_key_file_set_string (kf, package_id, "Info",
+						       pk_info_enum_to_string (pk_package_get_info (package)));
+				if (pk_package_get_summary (package) != NULL)
+					g_key_file_set_string (kf, package_id, "Summary",
+							       pk_package_get_summary (package));
+#ifdef HAVE_PK_PACKAGE_GET_UPDATE_SEVERITY
+				g_key_file_set_string (kf, package_id, "UpdateSeverity",
+						       pk_info_enum_to_string (pk_package_get_update_severity (package)));
+#endif
+			}
+		}
+	}
+
+	data = g_key_file_to_data (kf, &length, NULL);
+	if (!g_file_set_contents (self->filename, data, length, &error_local))
+		g_debug ("failed to save %s: %s", self->filename, error_local->message);
+}
+
+/* Run in @self->pool. */
+static void
+gs_packagekit_updates_cache_save_cb (gpointer data,
+				     gpointer user_data)
+{
+	gs_packagekit_updates_cache_save (GS_PACKAGEKIT_UPDATES_CACHE (user_data));
+}
+
+/* must be called with @self->mutex held */
+static void
+gs_packagekit_updates_cache_queue_save_locked (GsPackagekitUpdatesCache *self)
+{
+	self->dirty = TRUE;
+	if (self->save_queued)
+		return;
+	self->save_queued = TRUE;
+	g_thread_pool_push (self->pool, self, NULL);
+}
+
+/* Returns the cached updates, or %NULL if there are none or the repository
+ * metadata or installed packages changed since they were computed.
+ *
+ * @out_stamp is set to an opaque string identifying the current state of
+ * those, to pass to gs_packagekit_updates_cache_set() once the updates have
+ * been computed again, or to %NULL if the cache is disabled because that
+ * state cannot be found. */
+GPtrArray *
+gs_packagekit_updates_cache_lookup (GsPackagekitUpdatesCache *self,
+				    gchar **out_stamp)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autofree gchar *fingerprint = NULL;
+
+	g_return_val_if_fail (GS_IS_PACKAGEKIT_UPDATES_CACHE (self), NULL);
+	g_return_val_if_fail (out_stamp != NULL, NULL);
+
+	fingerprint = compute_fingerprint (self);
+	if (fingerprint == NULL) {
+		*out_stamp = NULL;
+		return NULL;
+	}
+
+	locker = g_mutex_locker_new (&self->mutex);
+	*out_stamp = g_strdup_printf ("%u:%s", self->generation, fingerprint);
+	if (self->packages == NULL || g_strcmp0 (self->fingerprint, fingerprint) != 0)
+		return NULL;
+
+	return g_ptr_array_copy (self->packages, (GCopyFunc) g_object_ref, NULL);
+}
+
+typedef struct {
+	GPtrArray	*packages;  /* (owned) (nullable) (element-type PkPackage) */
+	gchar		*stamp;  /* (owned) */
+} LookupData;
+
+static void
+lookup_data_free (LookupData *data)
+{
+	g_clear_pointer (&data->packages, g_ptr_array_unref);
+	g_free (data->stamp);
+	g_free (data);
+}
+
+static void
+lookup_thread_cb (GTask        *task,
+		  gpointer      source_object,
+		  gpointer      task_data,
+		  GCancellable *cancellable)
+{
+	GsPackagekitUpdatesCache *self = GS_PACKAGEKIT_UPDATES_CACHE (source_object);
+	LookupData *data = g_new0 (LookupData, 1);
+
+	data->packages = gs_packagekit_updates_cache_lookup (self, &data->stamp);
+	g_task_return_pointer (task, data, (GDestroyNotify) lookup_data_free);
+}
+
+/* Like gs_packagekit_updates_cache_lookup(), but checks the fingerprint in a
+ * thread, as it has to walk the repository metadata directories. */
+void
+gs_packagekit_updates_cache_lookup_async (GsPackagekitUpdatesCache *self,
+					  GCancellable *cancellable,
+					  GAsyncReadyCallback callback,
+					  gpointer user_data)
+{
+	g_autoptr(GTask) task = NULL;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_UPDATES_CACHE (self));
+
+	task = g_task_new (self, cancellable, callback, user_data);
+	g_task_set_source_tag (task, gs_packagekit_updates_cache_lookup_async);
+	/* always return the stamp, even if cancelled */
+	g_task_set_check_cancellable (task, FALSE);
+	g_task_run_in_thread (task, lookup_thread_cb);
+}
+
+/* Finishes gs_packagekit_updates_cache_lookup_async(); the cached updates
+ * and @out_stamp are as for gs_packagekit_updates_cache_lookup(). */
+GPtrArray *
+gs_packagekit_updates_cache_lookup_finish (GsPackagekitUpdatesCache *self,
+					   GAsyncResult *result,
+					   gchar **out_stamp)
+{
+	LookupData *data;
+	GPtrArray *packages;
+
+	g_return_val_if_fail (GS_IS_PACKAGEKIT_UPDATES_CACHE (self), NULL);
+	g_return_val_if_fail (g_task_is_valid (result, self), NULL);
+	g_return_val_if_fail (out_stamp != NULL, NULL);
+
+	/* the lookup cannot fail, so there is no error to propagate */
+	data = g_task_propagate_pointer (G_TASK (result), NULL);
+	*out_stamp = g_steal_pointer (&data->stamp);
+	packages = g_steal_pointer (&data->packages);
+	lookup_data_free (data);
+	return packages;
+}
+
+/* Remembers @packages, the results of a GetUpdates started after @stamp was
+ * returned by gs_packagekit_updates_cache_lookup(). They are dropped if the
+ * cache was invalidated in the meantime, or if @stamp is %NULL because the
+ * cache is disabled. */
+void
+gs_packagekit_updates_cache_set (GsPackagekitUpdatesCache *self,
+				 const gchar *stamp,
+				 GPtrArray *packages)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autofree gchar *prefix = NULL;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_UPDATES_CACHE (self));
+	g_return_if_fail (packages != NULL);
+
+	if (stamp == NULL)
+		return;
+
+	locker = g_mutex_locker_new (&self->mutex);
+	prefix = g_strdup_printf ("%u:", self->generation);
+	if (!g_str_has_prefix (stamp, prefix)) {
+		g_debug ("not caching updates computed before the last invalidation");
+		return;
+	}
+
+	g_free (self->fingerprint);
+	self->fingerprint = g_strdup (stamp + strlen (prefix));
+	g_clear_pointer (&self->packages, g_ptr_array_unref);
+	self->packages = g_ptr_array_copy (packages, (GCopyFunc) g_object_ref, NULL);
+	g_ptr_array_set_free_func (self->packages, g_object_unref);
+	gs_packagekit_updates_cache_queue_save_locked (self);
+}
+
+/* Forgets the cached updates, both in memory and on disk. */
+void
+gs_packagekit_updates_cache_invalidate (GsPackagekitUpdatesCache *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PACKAGEKIT_UPDATES_CACHE (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+	g_debug ("invalidating cached updates");
+	self->generation++;
+	g_clear_pointer (&self->fingerprint, g_free);
+	g_clear_pointer (&self->packages, g_ptr_array_unref);
+	gs_packagekit_updates_cache_queue_save_locked (self);
+}
+
+static void
+gs_packagekit_updates_cache_load (GsPackagekitUpdatesCache *self)
+{
+	g_autoptr(GKeyFile) kf = g_key_file_new ();
+	g_autoptr(GPtrArray) packages = g_ptr_array_new_with_free_func (g_object_unref);
+	g_auto(GStrv) groups = NULL;
+	g_autofree gchar *fingerprint = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	if (!g_key_file_load_from_file (kf, self->filename, G_KEY_FILE_NONE, &error_local)) {
+		if (!g_error_matches (error_local, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_debug ("failed to load %s: %s", self->filename, error_local->message);
+		return;
+	}
+
+	fingerprint = g_key_file_get_string (kf, "Updates", "Fingerprint", NULL);
+	if (fingerprint == NULL)
+		return;
+
+	groups = g_key_file_get_groups (kf, NULL);
+	for (guint i = 0; groups[i] != NULL; i++) {
+		g_autoptr(PkPackage) package = NULL;
+		g_autofree gchar *info = NULL;
+		g_autofree gchar *summary = NULL;
+#ifdef HAVE_PK_PACKAGE_GET_UPDATE_SEVERITY
+		g_autofree gchar *update_severity = NULL;
+#endif
+
+		if (g_str_equal (groups[i], "Updates"))
+			continue;
+
+		package = pk_package_new ();
+		if (!pk_package_set_id (package, groups[i], &error_local)) {
+			g_debug ("ignoring cached update %s: %s", groups[i], error_local->message);
+			g_clear_error (&error_local);
+			continue;
+		}
+		info = g_key_file_get_string (kf, groups[i], "Info", NULL);
+		if (info != NULL)
+			pk_package_set_info (package, pk_info_enum_from_string (info));
+		summary = g_key_file_get_string (kf, groups[i], "Summary", NULL);
+		if (summary != NULL)
+			pk_package_set_summary (package, summary);
+#ifdef HAVE_PK_PACKAGE_GET_UPDATE_SEVERITY
+		update_severity = g_key_file_get_string (kf, groups[i], "UpdateSeverity", NULL);
+		if (update_severity != NULL)
+			pk_package_set_update_severity (package, pk_info_enum_from_string (update_severity));
+#endif
+		g_ptr_array_add (packages, g_steal_pointer (&package));
+	}
+
+	self->fingerprint = g_steal_pointer (&fingerprint);
+	self->packages = g_steal_pointer (&packages);
+}
+
+static void
+gs_packagekit_updates_cache_finalize (GObject *object)
+{
+	GsPackagekitUpdatesCache *self = GS_PACKAGEKIT_UPDATES_CACHE (object);
+
+	/* a queued save may have been dropped, so save again */
+	g_thread_pool_free (self->pool, TRUE, TRUE);
+	gs_packagekit_updates_cache_save (self);
+
+	g_clear_pointer (&self->packages, g_ptr_array_unref);
+	g_free (self->fingerprint);
+	g_mutex_clear (&self->mutex);
+	g_strfreev (self->database_files);
+	g_strfreev (self->metadata_dirs);
+	g_free (self->filename);
+
+	G_OBJECT_CLASS (gs_packagekit_updates_cache_parent_class)->finalize (object);
+}
+
+static void
+gs_packagekit_updates_cache_class_init (GsPackagekitUpdatesCacheClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_packagekit_updates_cache_finalize;
+}
+
+static void
+gs_packagekit_updates_cache_init (GsPackagekitUpdatesCache *self)
+{
+	g_mutex_init (&self->mutex);
+	self->pool = g_thread_pool_new (gs_packagekit_updates_cache_save_cb, self,
+					1, TRUE, NULL);
+}
+
+/* Creates a cache persisted to @filename, loading any updates saved there,
+ * which fingerprints the repository metadata found in @metadata_dirs and the
+ * package databases in @database_files. */
+GsPackagekitUpdatesCache *
+gs_packagekit_updates_cache_new_for_paths (const gchar		*filename,
+					   const gchar * const	*metadata_dirs,
+					   const gchar * const	*database_files)
+{
+	GsPackagekitUpdatesCache *self;
+
+	g_return_val_if_fail (filename != NULL, NULL);
+	g_return_val_if_fail (metadata_dirs != NULL, NULL);
+	g_return_val_if_fail (database_files != NULL, NULL);
+
+	self = g_object_new (GS_TYPE_PACKAGEKIT_UPDATES_CACHE, NULL);
+	self->filename = g_strdup (filename);
+	self->metadata_dirs = g_strdupv ((gchar **) metadata_dirs);
+	self->database_files = g_strdupv ((gchar **) database_files);
+	gs_packagekit_updates_cache_load (self);
+	return self;
+}
+
+/* Creates a cache persisted to @filename, loading any updates saved there,
+ * which fingerprints the files of the known PackageKit backends. */
+GsPackagekitUpdatesCache *
+gs_packagekit_updates_cache_new (const gchar *filename)
+{
+	return gs_packagekit_updates_cache_new_for_paths (filename,
+							  default_metadata_dirs,
+							  default_database_files);
+}
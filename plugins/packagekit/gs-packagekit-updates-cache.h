@@ -0,0 +1,39 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <packagekit-glib2/packagekit.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_PACKAGEKIT_UPDATES_CACHE (gs_packagekit_updates_cache_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsPackagekitUpdatesCache, gs_packagekit_updates_cache, GS, PACKAGEKIT_UPDATES_CACHE, GObject)
+
+GsPackagekitUpdatesCache *gs_packagekit_updates_cache_new	(const gchar			*filename);
+GsPackagekitUpdatesCache *gs_packagekit_updates_cache_new_for_paths
+								(const gchar			*filename,
+								 const gchar * const		*metadata_dirs,
+								 const gchar * const		*database_files);
+GPtrArray	*gs_packagekit_updates_cache_lookup		(GsPackagekitUpdatesCache	*self,
+								 gchar				**out_stamp);
+void		 gs_packagekit_updates_cache_lookup_async	(GsPackagekitUpdatesCache	*self,
+								 GCancellable			*cancellable,
+								 GAsyncReadyCallback		 callback,
+								 gpointer			 user_data);
+GPtrArray	*gs_packagekit_updates_cache_lookup_finish	(GsPackagekitUpdatesCache	*self,
+								 GAsyncResult			*result,
+								 gchar				**out_stamp);
+void		 gs_packagekit_updates_cache_set		(GsPackagekitUpdatesCache	*self,
+								 const gchar			*stamp,
+								 GPtrArray			*packages);
+void		 gs_packagekit_updates_cache_invalidate		(GsPackagekitUpdatesCache	*self);
+
+G_END_DECLS
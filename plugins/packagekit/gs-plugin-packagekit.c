@@ -12,15 +12,22 @@
 #include <config.h>
 
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 #include <gnome-software.h>
 #include <gsettings-desktop-schemas/gdesktop-enums.h>
 #include <packagekit-glib2/packagekit.h>
 #include <string.h>
 
 #include "packagekit-common.h"
+#include "gs-ioprio.h"
 #include "gs-markdown.h"
+#include "gs-packagekit-batcher.h"
+#include "gs-packagekit-details-cache.h"
+#include "gs-packagekit-download-gate.h"
+#include "gs-packagekit-file-index.h"
 #include "gs-packagekit-helper.h"
 #include "gs-packagekit-task.h"
+#include "gs-packagekit-updates-cache.h"
 #include "gs-plugin-private.h"
 
 #include "gs-plugin-packagekit.h"
@@ -54,6 +61,11 @@ struct _GsPluginPackagekit {
 	GsPlugin		 parent;
 
 	PkControl		*control_refine;
+	GsPackagekitBatcher	*batcher;
+	GsPackagekitDetailsCache *details_cache;  /* (nullable) (owned) */
+	GsPackagekitUpdatesCache *updates_cache;  /* (nullable) (owned) */
+	GsPackagekitFileIndex	*file_index;
+	GsPackagekitDownloadGate *download_gate;
 
 	PkControl		*control_proxy;
 	GSettings		*settings_proxy;
@@ -107,6 +119,9 @@ gs_plugin_packagekit_init (GsPluginPackagekit *self)
 			  G_CALLBACK (gs_plugin_packagekit_updates_changed_cb), plugin);
 	g_signal_connect (self->control_refine, "repo-list-changed",
 			  G_CALLBACK (gs_plugin_packagekit_repo_list_changed_cb), plugin);
+	self->batcher = gs_packagekit_batcher_new ();
+	self->file_index = gs_packagekit_file_index_new ();
+	self->download_gate = gs_packagekit_download_gate_new ();
 
 	/* proxy */
 	self->control_proxy = pk_control_new ();
@@ -160,6 +175,13 @@ gs_plugin_packagekit_dispose (GObject *object)
 
 	/* refine */
 	g_clear_object (&self->control_refine);
+	g_clear_object (&self->batcher);
+	g_clear_object (&self->details_cache);
+	g_clear_object (&self->updates_cache);
+	if (self->file_index != NULL)
+		gs_packagekit_file_index_cancel (self->file_index);
+	g_clear_object (&self->file_index);
+	g_clear_object (&self->download_gate);
 
 	/* proxy */
 	g_clear_object (&self->control_proxy);
@@ -749,6 +771,44 @@ gs_plugin_packagekit_build_update_app (GsPlugin *plugin, PkPackage *package)
 	return app;
 }
 
+/* Gets the packages which can be updated, as a GetUpdates with @client
+ * would. The list is only computed again if the repository metadata or the
+ * installed packages changed since it was last computed. */
+static GPtrArray *
+gs_plugin_packagekit_get_updates (GsPluginPackagekit  *self,
+                                  PkClient            *client,
+                                  GsPackagekitHelper  *helper,
+                                  GCancellable        *cancellable,
+                                  GError             **error)
+{
+	g_autoptr(PkResults) results = NULL;
+	g_autoptr(GPtrArray) packages = NULL;
+	g_autofree gchar *stamp = NULL;
+
+	if (self->updates_cache != NULL) {
+		packages = gs_packagekit_updates_cache_lookup (self->updates_cache, &stamp);
+		if (packages != NULL) {
+			g_debug ("using %u cached updates", packages->len);
+			return g_steal_pointer (&packages);
+		}
+	}
+
+	results = pk_client_get_updates (client,
+					 pk_bitfield_value (PK_FILTER_ENUM_NONE),
+					 cancellable,
+					 gs_packagekit_helper_cb, helper,
+					 error);
+
+	if (!gs_plugin_packagekit_results_valid (results, error))
+		return NULL;
+
+	packages = pk_results_get_package_array (results);
+	if (self->updates_cache != NULL)
+		gs_packagekit_updates_cache_set (self->updates_cache, stamp, packages);
+
+	return g_steal_pointer (&packages);
+}
+
 static gboolean
 gs_plugin_packagekit_add_updates (GsPlugin *plugin,
 				  GsAppList *list,
@@ -757,7 +817,6 @@ gs_plugin_packagekit_add_updates (GsPlugin *plugin,
 {
 	g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
 	g_autoptr(PkTask) task_updates = NULL;
-	g_autoptr(PkResults) results = NULL;
 	g_autoptr(GPtrArray) array = NULL;
 	g_autoptr(GsApp) first_app = NULL;
 	gboolean all_downloaded = TRUE;
@@ -768,17 +827,15 @@ gs_plugin_packagekit_add_updates (GsPlugin *plugin,
 	task_updates = gs_packagekit_task_new (plugin);
 	gs_packagekit_task_setup (GS_PACKAGEKIT_TASK (task_updates), GS_PLUGIN_ACTION_GET_UPDATES, gs_plugin_has_flags (plugin, GS_PLUGIN_FLAGS_INTERACTIVE));
 
-	results = pk_client_get_updates (PK_CLIENT (task_updates),
-					 pk_bitfield_value (PK_FILTER_ENUM_NONE),
-					 cancellable,
-					 gs_packagekit_helper_cb, helper,
-					 error);
-
-	if (!gs_plugin_packagekit_results_valid (results, error))
+	array = gs_plugin_packagekit_get_updates (GS_PLUGIN_PACKAGEKIT (plugin),
+						  PK_CLIENT (task_updates),
+						  helper,
+						  cancellable,
+						  error);
+	if (array == NULL)
 		return FALSE;
 
 	/* add results */
-	array = pk_results_get_package_array (results);
 	for (guint i = 0; i < array->len; i++) {
 		PkPackage *package = g_ptr_array_index (array, i);
 		g_autoptr(GsApp) app = NULL;
@@ -824,6 +881,34 @@ static void list_apps_cb (GObject      *source_object,
                           GAsyncResult *result,
                           gpointer      user_data);
 
+/* Answers a provides-files query from the file index, which is only possible
+ * if an installed package owns every one of @files and the index knows the
+ * newest version of each, as the query returns. Returns %FALSE if packagekitd
+ * has to be asked instead. */
+static gboolean
+gs_plugin_packagekit_list_apps_from_file_index (GsPluginPackagekit  *self,
+                                                const gchar * const *files,
+                                                GTask               *task)
+{
+	g_autoptr(PkResults) results = pk_results_new ();
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GError) local_error = NULL;
+
+	for (guint i = 0; files[i] != NULL; i++) {
+		g_autoptr(PkPackage) package = gs_packagekit_file_index_lookup_newest (self->file_index, files[i]);
+		if (package == NULL)
+			return FALSE;
+		pk_results_add_package (results, package);
+	}
+
+	if (!gs_plugin_packagekit_add_results (GS_PLUGIN (self), list, results, &local_error))
+		g_task_return_error (task, g_steal_pointer (&local_error));
+	else
+		g_task_return_pointer (task, g_steal_pointer (&list), g_object_unref);
+
+	return TRUE;
+}
+
 static void
 gs_plugin_packagekit_list_apps_async (GsPlugin              *plugin,
                                       GsAppQuery            *query,
@@ -844,6 +929,13 @@ gs_plugin_packagekit_list_apps_async (GsPlugin              *plugin,
 	g_task_set_source_tag (task, gs_plugin_packagekit_list_apps_async);
 	g_task_set_task_data (task, g_object_ref (helper), g_object_unref);
 
+	/* installed files can be looked up without a transaction */
+	if (gs_app_query_get_provides_files (query) != NULL &&
+	    gs_plugin_packagekit_list_apps_from_file_index (GS_PLUGIN_PACKAGEKIT (plugin),
+							    gs_app_query_get_provides_files (query),
+							    task))
+		return;
+
 	gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_WAITING);
 	gs_packagekit_helper_set_progress_app (helper, app_dl);
 
@@ -939,12 +1031,28 @@ gs_plugin_launch (GsPlugin *plugin,
 static void
 gs_plugin_packagekit_updates_changed_cb (PkControl *control, GsPlugin *plugin)
 {
+	GsPluginPackagekit *self = GS_PLUGIN_PACKAGEKIT (plugin);
+
+	if (self->details_cache != NULL)
+		gs_packagekit_details_cache_invalidate (self->details_cache);
+	if (self->updates_cache != NULL)
+		gs_packagekit_updates_cache_invalidate (self->updates_cache);
+	gs_packagekit_file_index_rebuild (self->file_index);
+
 	gs_plugin_updates_changed (plugin);
 }
 
 static void
 gs_plugin_packagekit_repo_list_changed_cb (PkControl *control, GsPlugin *plugin)
 {
+	GsPluginPackagekit *self = GS_PLUGIN_PACKAGEKIT (plugin);
+
+	if (self->details_cache != NULL)
+		gs_packagekit_details_cache_invalidate (self->details_cache);
+	if (self->updates_cache != NULL)
+		gs_packagekit_updates_cache_invalidate (self->updates_cache);
+	gs_packagekit_file_index_rebuild (self->file_index);
+
 	gs_plugin_reload (plugin);
 }
 
@@ -1032,14 +1140,16 @@ gs_plugin_packagekit_resolve_packages_with_filter_async (GsPluginPackagekit  *se
 
 	g_ptr_array_add (package_ids, NULL);
 
-	/* resolve them all at once */
-	pk_client_resolve_async (client_refine,
-				 filter,
-				 (gchar **) package_ids->pdata,
-				 cancellable,
-				 gs_packagekit_helper_cb, data_unowned->progress_data,
-				 resolve_packages_with_filter_cb,
-				 g_steal_pointer (&task));
+	/* resolve them all at once, along with those of other refines */
+	gs_packagekit_batcher_run_async (self->batcher,
+					 GS_PACKAGEKIT_BATCH_KIND_RESOLVE,
+					 filter,
+					 (const gchar * const *) package_ids->pdata,
+					 pk_client_get_interactive (client_refine),
+					 data_unowned->progress_data,
+					 cancellable,
+					 resolve_packages_with_filter_cb,
+					 g_steal_pointer (&task));
 }
 
 static void
@@ -1047,7 +1157,7 @@ resolve_packages_with_filter_cb (GObject      *source_object,
                                  GAsyncResult *result,
                                  gpointer      user_data)
 {
-	PkClient *client = PK_CLIENT (source_object);
+	GsPackagekitBatcher *batcher = GS_PACKAGEKIT_BATCHER (source_object);
 	g_autoptr(GTask) task = g_steal_pointer (&user_data);
 	GsPluginPackagekit *self = g_task_get_source_object (task);
 	GCancellable *cancellable = g_task_get_cancellable (task);
@@ -1057,7 +1167,7 @@ resolve_packages_with_filter_cb (GObject      *source_object,
 	g_autoptr(GPtrArray) packages = NULL;
 	g_autoptr(GError) local_error = NULL;
 
-	results = pk_client_generic_finish (client, result, &local_error);
+	results = gs_packagekit_batcher_run_finish (batcher, result, &local_error);
 
 	if (!gs_plugin_packagekit_results_valid (results, &local_error)) {
 		g_prefix_error (&local_error, "failed to resolve package_ids: ");
@@ -1121,25 +1231,6 @@ gs_plugin_packagekit_fixup_update_description (const gchar *text)
 	return g_strdup (text);
 }
 
-static gboolean
-gs_plugin_refine_app_needs_details (GsPluginRefineFlags  flags,
-                                    GsApp               *app)
-{
-	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE) > 0 &&
-	    gs_app_get_license (app) == NULL)
-		return TRUE;
-	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_URL) > 0 &&
-	    gs_app_get_url (app, AS_URL_KIND_HOMEPAGE) == NULL)
-		return TRUE;
-	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE) > 0 &&
-	    gs_app_get_size_installed (app, NULL) != GS_SIZE_TYPE_VALID)
-		return TRUE;
-	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE) > 0 &&
-	    gs_app_get_size_download (app, NULL) != GS_SIZE_TYPE_VALID)
-		return TRUE;
-	return FALSE;
-}
-
 static gboolean
 gs_plugin_refine_requires_version (GsApp *app, GsPluginRefineFlags flags)
 {
@@ -1150,16 +1241,6 @@ gs_plugin_refine_requires_version (GsApp *app, GsPluginRefineFlags flags)
 	return (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_VERSION) > 0;
 }
 
-static gboolean
-gs_plugin_refine_requires_update_details (GsApp *app, GsPluginRefineFlags flags)
-{
-	const gchar *tmp;
-	tmp = gs_app_get_update_details_markup (app);
-	if (tmp != NULL)
-		return FALSE;
-	return (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS) > 0;
-}
-
 static gboolean
 gs_plugin_refine_requires_origin (GsApp *app, GsPluginRefineFlags flags)
 {
@@ -1261,11 +1342,12 @@ typedef struct {
 	PkClient *client_refine;  /* (owned) */
 
 	/* Input data for operations. */
+	GsPluginRefineFlags flags;
 	GsAppList *full_list;  /* (nullable) (owned) */
 	GsAppList *resolve_list;  /* (nullable) (owned) */
+	GHashTable *unresolved_apps;  /* (owned) (not nullable) (element-type GsApp); being resolved, with no package ID yet */
 	GsApp *app_operating_system;  /* (nullable) (owned) */
-	GsAppList *update_details_list;  /* (nullable) (owned) */
-	GsAppList *details_list;  /* (nullable) (owned) */
+	gchar *updates_stamp;  /* (nullable) (owned) */
 } RefineData;
 
 static void
@@ -1279,9 +1361,9 @@ refine_data_free (RefineData *data)
 	g_clear_object (&data->client_refine);
 	g_clear_object (&data->full_list);
 	g_clear_object (&data->resolve_list);
+	g_clear_pointer (&data->unresolved_apps, g_hash_table_unref);
 	g_clear_object (&data->app_operating_system);
-	g_clear_object (&data->update_details_list);
-	g_clear_object (&data->details_list);
+	g_free (data->updates_stamp);
 
 	g_free (data);
 }
@@ -1377,6 +1459,130 @@ search_files_data_new_operation (GTask       *refine_task,
 	return g_steal_pointer (&data);
 }
 
+typedef struct {
+	GTask *refine_task;  /* (owned) (not nullable) */
+	GsAppList *list;  /* (owned) (not nullable) */
+	gboolean best_effort;  /* failures only skip @list rather than failing the refine */
+} AppListData;
+
+static void
+app_list_data_free (AppListData *data)
+{
+	g_clear_object (&data->list);
+	g_clear_object (&data->refine_task);
+	g_free (data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (AppListData, app_list_data_free)
+
+static AppListData *
+app_list_data_new_operation (GTask     *refine_task,
+                             GsAppList *list,
+                             gboolean   best_effort)
+{
+	g_autoptr(AppListData) data = g_new0 (AppListData, 1);
+	data->refine_task = refine_task_add_operation (refine_task);
+	data->list = g_object_ref (list);
+	data->best_effort = best_effort;
+
+	return g_steal_pointer (&data);
+}
+
+/* Sets the package of @app to the installed one owning @filename, if the
+ * file index knows it. */
+static gboolean
+gs_plugin_packagekit_refine_from_file_index (GsPluginPackagekit *self,
+                                             GsApp              *app,
+                                             const gchar        *filename)
+{
+	g_autoptr(PkPackage) package = gs_packagekit_file_index_lookup (self->file_index, filename);
+
+	if (package == NULL)
+		return FALSE;
+
+	gs_plugin_packagekit_set_metadata_from_package (GS_PLUGIN (self), app, package);
+	return TRUE;
+}
+
+/* Refines the apps in @list whose packages all have cached details, and
+ * returns a new list of the others. */
+static GsAppList *
+gs_plugin_packagekit_refine_details_from_cache (GsPluginPackagekit *self,
+                                                GsAppList          *list)
+{
+	g_autoptr(GsAppList) uncached_list = gs_app_list_new ();
+	g_autoptr(GsAppList) cached_list = gs_app_list_new ();
+	g_autoptr(GPtrArray) array = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GHashTable) details_collection = NULL;
+	g_autoptr(GHashTable) prepared_updates = NULL;
+
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		GPtrArray *source_ids = gs_app_get_source_ids (app);
+		guint n_cached = 0;
+
+		for (guint j = 0; j < source_ids->len; j++) {
+			PkDetails *details;
+
+			details = gs_packagekit_details_cache_lookup_details (self->details_cache,
+									      g_ptr_array_index (source_ids, j));
+			if (details == NULL)
+				break;
+			g_ptr_array_add (array, details);
+			n_cached++;
+		}
+
+		if (n_cached == source_ids->len)
+			gs_app_list_add (cached_list, app);
+		else
+			gs_app_list_add (uncached_list, app);
+	}
+
+	if (gs_app_list_length (cached_list) == 0)
+		return g_steal_pointer (&uncached_list);
+
+	details_collection = gs_plugin_packagekit_details_array_to_hash (array);
+
+	g_mutex_lock (&self->prepared_updates_mutex);
+	prepared_updates = g_hash_table_ref (self->prepared_updates);
+	g_mutex_unlock (&self->prepared_updates_mutex);
+
+	for (guint i = 0; i < gs_app_list_length (cached_list); i++) {
+		GsApp *app = gs_app_list_index (cached_list, i);
+		gs_plugin_packagekit_refine_details_app (GS_PLUGIN (self), details_collection, prepared_updates, app);
+	}
+
+	return g_steal_pointer (&uncached_list);
+}
+
+/* Sets the update details of the apps in @list which have them cached, and
+ * returns a new list of the others. */
+static GsAppList *
+gs_plugin_packagekit_refine_update_details_from_cache (GsPluginPackagekit *self,
+                                                       GsAppList          *list)
+{
+	g_autoptr(GsAppList) uncached_list = gs_app_list_new ();
+
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		g_autofree gchar *update_text = NULL;
+		g_autofree gchar *desc = NULL;
+
+		if (!gs_packagekit_details_cache_lookup_update_text (self->details_cache,
+								     gs_app_get_source_id_default (app),
+								     &update_text)) {
+			gs_app_list_add (uncached_list, app);
+			continue;
+		}
+
+		desc = gs_plugin_packagekit_fixup_update_description (update_text);
+		if (desc != NULL)
+			gs_app_set_update_details_markup (app, desc);
+	}
+
+	return g_steal_pointer (&uncached_list);
+}
+
 static void upgrade_system_cb (GObject      *source_object,
                                GAsyncResult *result,
                                gpointer      user_data);
@@ -1392,6 +1598,9 @@ static void get_update_detail_cb (GObject      *source_object,
 static void get_details_cb (GObject      *source_object,
                             GAsyncResult *result,
                             gpointer      user_data);
+static void updates_cache_lookup_cb (GObject      *source_object,
+                                     GAsyncResult *result,
+                                     gpointer      user_data);
 static void get_updates_cb (GObject      *source_object,
                             GAsyncResult *result,
                             gpointer      user_data);
@@ -1399,6 +1608,196 @@ static void refine_all_history_cb (GObject      *source_object,
                                    GAsyncResult *result,
                                    gpointer      user_data);
 
+/* Sets the update severity of the apps in @list from @packages, the
+ * results of a GetUpdates. */
+static void
+gs_plugin_packagekit_refine_update_severity (GsAppList *list,
+                                             GPtrArray *packages)
+{
+	g_autoptr(GHashTable) packages_by_id = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (guint i = 0; i < packages->len; i++) {
+		PkPackage *package = g_ptr_array_index (packages, i);
+		g_hash_table_insert (packages_by_id, (gpointer) pk_package_get_id (package), package);
+	}
+
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		PkPackage *pkg;
+		const gchar *package_id;
+		GsApp *app = gs_app_list_index (list, i);
+
+		if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD))
+			continue;
+		package_id = gs_app_get_source_id_default (app);
+		if (package_id == NULL)
+			continue;
+		pkg = g_hash_table_lookup (packages_by_id, package_id);
+		if (pkg == NULL)
+			continue;
+		#ifdef HAVE_PK_PACKAGE_GET_UPDATE_SEVERITY
+		switch (pk_package_get_update_severity (pkg)) {
+		case PK_INFO_ENUM_LOW:
+			gs_app_set_update_urgency (app, AS_URGENCY_KIND_LOW);
+			break;
+		case PK_INFO_ENUM_NORMAL:
+			gs_app_set_update_urgency (app, AS_URGENCY_KIND_MEDIUM);
+			break;
+		case PK_INFO_ENUM_IMPORTANT:
+			gs_app_set_update_urgency (app, AS_URGENCY_KIND_HIGH);
+			break;
+		case PK_INFO_ENUM_CRITICAL:
+			gs_app_set_update_urgency (app, AS_URGENCY_KIND_CRITICAL);
+			break;
+		default:
+			gs_app_set_update_urgency (app, AS_URGENCY_KIND_UNKNOWN);
+			break;
+		}
+		#else
+		switch (pk_package_get_info (pkg)) {
+		case PK_INFO_ENUM_AVAILABLE:
+		case PK_INFO_ENUM_NORMAL:
+		case PK_INFO_ENUM_LOW:
+		case PK_INFO_ENUM_ENHANCEMENT:
+			gs_app_set_update_urgency (app, AS_URGENCY_KIND_LOW);
+			break;
+		case PK_INFO_ENUM_BUGFIX:
+			gs_app_set_update_urgency (app, AS_URGENCY_KIND_MEDIUM);
+			break;
+		case PK_INFO_ENUM_SECURITY:
+			gs_app_set_update_urgency (app, AS_URGENCY_KIND_CRITICAL);
+			break;
+		case PK_INFO_ENUM_IMPORTANT:
+			gs_app_set_update_urgency (app, AS_URGENCY_KIND_HIGH);
+			break;
+		default:
+			gs_app_set_update_urgency (app, AS_URGENCY_KIND_UNKNOWN);
+			g_warning ("unhandled info state %s",
+				   pk_info_enum_to_string (pk_package_get_info (pkg)));
+			break;
+		}
+		#endif
+	}
+}
+
+/* Starts a GetUpdateDetail for the apps in @update_details_list which
+ * do not have their update details cached. If @best_effort is set, a
+ * failure only leaves those apps without update details. */
+static void
+refine_task_get_update_details (GTask     *refine_task,
+                                GsAppList *update_details_list,
+                                gboolean   best_effort)
+{
+	GsPluginPackagekit *self = GS_PLUGIN_PACKAGEKIT (g_task_get_source_object (refine_task));
+	RefineData *data = g_task_get_task_data (refine_task);
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GsPackagekitHelper) helper = NULL;
+	g_autofree const gchar **package_ids = NULL;
+
+	/* only ask PackageKit about packages not seen before */
+	if (self->details_cache != NULL)
+		list = gs_plugin_packagekit_refine_update_details_from_cache (self, update_details_list);
+	else
+		list = g_object_ref (update_details_list);
+	if (gs_app_list_length (list) == 0)
+		return;
+
+	package_ids = g_new0 (const gchar *, gs_app_list_length (list) + 1);
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		package_ids[i] = gs_app_get_source_id_default (app);
+		g_assert (package_ids[i] != NULL);  /* checked when update_details_list is built */
+	}
+
+	/* get any update details */
+	helper = gs_packagekit_helper_new (GS_PLUGIN (self));
+	gs_packagekit_batcher_run_async (self->batcher,
+					 GS_PACKAGEKIT_BATCH_KIND_GET_UPDATE_DETAIL,
+					 pk_bitfield_value (PK_FILTER_ENUM_NONE),
+					 package_ids,
+					 pk_client_get_interactive (data->client_refine),
+					 refine_task_add_progress_data (refine_task, helper),
+					 g_task_get_cancellable (refine_task),
+					 get_update_detail_cb,
+					 app_list_data_new_operation (refine_task, list, best_effort));
+}
+
+/* Starts a GetDetails for the apps in @details_list which do not have the
+ * details of all their packages cached. If @best_effort is set, a failure
+ * only leaves those apps without details. */
+static void
+refine_task_get_details (GTask     *refine_task,
+                         GsAppList *details_list,
+                         gboolean   best_effort)
+{
+	GsPluginPackagekit *self = GS_PLUGIN_PACKAGEKIT (g_task_get_source_object (refine_task));
+	RefineData *data = g_task_get_task_data (refine_task);
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GsPackagekitHelper) helper = NULL;
+	g_autoptr(GPtrArray) package_ids = NULL;
+
+	/* only ask PackageKit about packages not seen before */
+	if (self->details_cache != NULL)
+		list = gs_plugin_packagekit_refine_details_from_cache (self, details_list);
+	else
+		list = g_object_ref (details_list);
+
+	package_ids = app_list_get_package_ids (list, NULL, FALSE);
+	if (package_ids->len == 0)
+		return;
+
+	/* NULL-terminate the array */
+	g_ptr_array_add (package_ids, NULL);
+
+	/* get any details */
+	helper = gs_packagekit_helper_new (GS_PLUGIN (self));
+	gs_packagekit_batcher_run_async (self->batcher,
+					 GS_PACKAGEKIT_BATCH_KIND_GET_DETAILS,
+					 pk_bitfield_value (PK_FILTER_ENUM_NONE),
+					 (const gchar * const *) package_ids->pdata,
+					 pk_client_get_interactive (data->client_refine),
+					 refine_task_add_progress_data (refine_task, helper),
+					 g_task_get_cancellable (refine_task),
+					 get_details_cb,
+					 app_list_data_new_operation (refine_task, list, best_effort));
+}
+
+/* Apps which had no package ID before being resolved can only have their
+ * details and update details looked up once they do. Rather than leaving
+ * that to another refine, start those lookups for the apps in
+ * @data->unresolved_apps which have just been resolved, while other
+ * operations of the refine are still running. */
+static void
+refine_task_get_details_for_resolved (GTask *refine_task)
+{
+	RefineData *data = g_task_get_task_data (refine_task);
+	g_autoptr(GsAppList) update_details_list = gs_app_list_new ();
+	g_autoptr(GsAppList) details_list = gs_app_list_new ();
+
+	gs_plugin_packagekit_take_resolved_apps (data->unresolved_apps, data->flags,
+						 update_details_list, details_list);
+
+	if (gs_app_list_length (update_details_list) > 0)
+		refine_task_get_update_details (refine_task, update_details_list, TRUE);
+	if (gs_app_list_length (details_list) > 0)
+		refine_task_get_details (refine_task, details_list, TRUE);
+}
+
+/* Starts a GetUpdates to set the update severity of the apps. */
+static void
+refine_task_get_updates (GTask *refine_task)
+{
+	GsPlugin *plugin = GS_PLUGIN (g_task_get_source_object (refine_task));
+	RefineData *data = g_task_get_task_data (refine_task);
+	g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
+
+	pk_client_get_updates_async (data->client_refine,
+				     pk_bitfield_value (PK_FILTER_ENUM_NONE),
+				     g_task_get_cancellable (refine_task),
+				     gs_packagekit_helper_cb, refine_task_add_progress_data (refine_task, helper),
+				     get_updates_cb,
+				     refine_task_add_operation (refine_task));
+}
+
 static void
 gs_plugin_packagekit_refine_async (GsPlugin            *plugin,
                                    GsAppList           *list,
@@ -1421,7 +1820,9 @@ gs_plugin_packagekit_refine_async (GsPlugin            *plugin,
 	task = g_task_new (plugin, cancellable, callback, user_data);
 	g_task_set_source_tag (task, gs_plugin_packagekit_refine_async);
 	data_unowned = data = g_new0 (RefineData, 1);
+	data->flags = flags;
 	data->full_list = g_object_ref (list);
+	data->unresolved_apps = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
 	data->n_pending_operations = 1;  /* to prevent the task being completed before all operations have been started */
 	data->progress_datas = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	data->client_refine = pk_client_new ();
@@ -1460,6 +1861,8 @@ gs_plugin_packagekit_refine_async (GsPlugin            *plugin,
 		     gs_plugin_refine_requires_origin (app, flags) ||
 		     gs_plugin_refine_requires_version (app, flags))) {
 			gs_app_list_add (resolve_list, app);
+			if (gs_app_get_source_id_default (app) == NULL)
+				g_hash_table_add (data_unowned->unresolved_apps, g_object_ref (app));
 		}
 
 		if ((gs_app_get_state (app) == GS_APP_STATE_UPDATABLE ||
@@ -1590,17 +1993,21 @@ gs_plugin_packagekit_refine_async (GsPlugin            *plugin,
 				g_debug ("ignoring %s as does not exist", fn);
 				continue;
 			}
+			if (gs_plugin_packagekit_refine_from_file_index (self, app, fn))
+				continue;
 
 			helper = gs_packagekit_helper_new (plugin);
 			to_array[0] = fn;
 			gs_packagekit_helper_add_app (helper, app);
-			pk_client_search_files_async (data_unowned->client_refine,
-						      pk_bitfield_from_enums (PK_FILTER_ENUM_INSTALLED, -1),
-						      (gchar **) to_array,
-						      cancellable,
-						      gs_packagekit_helper_cb, refine_task_add_progress_data (task, helper),
-						      search_files_cb,
-						      search_files_data_new_operation (task, app, fn));
+			gs_packagekit_batcher_run_async (self->batcher,
+							 GS_PACKAGEKIT_BATCH_KIND_SEARCH_FILES,
+							 pk_bitfield_from_enums (PK_FILTER_ENUM_INSTALLED, -1),
+							 to_array,
+							 pk_client_get_interactive (data_unowned->client_refine),
+							 refine_task_add_progress_data (task, helper),
+							 cancellable,
+							 search_files_cb,
+							 search_files_data_new_operation (task, app, fn));
 		}
 	}
 
@@ -1612,87 +2019,42 @@ gs_plugin_packagekit_refine_async (GsPlugin            *plugin,
 		g_autoptr(GsPackagekitHelper) helper = NULL;
 
 		filename = gs_app_get_metadata_item (app, "repos::repo-filename");
+		if (gs_plugin_packagekit_refine_from_file_index (self, app, filename))
+			continue;
 
 		/* set the source package name for an installed .repo file */
 		helper = gs_packagekit_helper_new (plugin);
 		to_array[0] = filename;
 		gs_packagekit_helper_add_app (helper, app);
 
-		pk_client_search_files_async (data_unowned->client_refine,
-					      pk_bitfield_from_enums (PK_FILTER_ENUM_INSTALLED, -1),
-					      (gchar **) to_array,
-					      cancellable,
-					      gs_packagekit_helper_cb, refine_task_add_progress_data (task, helper),
-					      search_files_cb,
-					      search_files_data_new_operation (task, app, filename));
+		gs_packagekit_batcher_run_async (self->batcher,
+						 GS_PACKAGEKIT_BATCH_KIND_SEARCH_FILES,
+						 pk_bitfield_from_enums (PK_FILTER_ENUM_INSTALLED, -1),
+						 to_array,
+						 pk_client_get_interactive (data_unowned->client_refine),
+						 refine_task_add_progress_data (task, helper),
+						 cancellable,
+						 search_files_cb,
+						 search_files_data_new_operation (task, app, filename));
 	}
 
 	/* any update details missing? */
-	if (gs_app_list_length (update_details_list) > 0) {
-		GsApp *app;
-		g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
-		g_autofree const gchar **package_ids = NULL;
-
-		/* Expose the @update_details_list to the callback functions so
-		 * its apps can be updated. */
-		g_assert (data_unowned->update_details_list == NULL);
-		data_unowned->update_details_list = g_object_ref (update_details_list);
-
-		package_ids = g_new0 (const gchar *, gs_app_list_length (update_details_list) + 1);
-		for (guint i = 0; i < gs_app_list_length (update_details_list); i++) {
-			app = gs_app_list_index (update_details_list, i);
-			package_ids[i] = gs_app_get_source_id_default (app);
-			g_assert (package_ids[i] != NULL);  /* checked when update_details_list is built */
-		}
-
-		/* get any update details */
-		pk_client_get_update_detail_async (data_unowned->client_refine,
-						   (gchar **) package_ids,
-						   cancellable,
-						   gs_packagekit_helper_cb, refine_task_add_progress_data (task, helper),
-						   get_update_detail_cb,
-						   refine_task_add_operation (task));
-	}
+	if (gs_app_list_length (update_details_list) > 0)
+		refine_task_get_update_details (task, update_details_list, FALSE);
 
 	/* any package details missing? */
-	if (gs_app_list_length (details_list) > 0) {
-		g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
-		g_autoptr(GPtrArray) package_ids = NULL;
-
-		/* Expose the @details_list to the callback functions so
-		 * its apps can be updated. */
-		g_assert (data_unowned->details_list == NULL);
-		data_unowned->details_list = g_object_ref (details_list);
-
-		package_ids = app_list_get_package_ids (details_list, NULL, FALSE);
-
-		if (package_ids->len > 0) {
-			/* NULL-terminate the array */
-			g_ptr_array_add (package_ids, NULL);
-
-			/* get any details */
-			pk_client_get_details_async (data_unowned->client_refine,
-						     (gchar **) package_ids->pdata,
-						     cancellable,
-						     gs_packagekit_helper_cb, refine_task_add_progress_data (task, helper),
-						     get_details_cb,
-						     refine_task_add_operation (task));
-		}
-	}
+	if (gs_app_list_length (details_list) > 0)
+		refine_task_get_details (task, details_list, FALSE);
 
 	/* get the update severity */
 	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_SEVERITY) != 0) {
-		PkBitfield filter;
-		g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
-
-		/* get the list of updates */
-		filter = pk_bitfield_value (PK_FILTER_ENUM_NONE);
-		pk_client_get_updates_async (data_unowned->client_refine,
-					     filter,
-					     cancellable,
-					     gs_packagekit_helper_cb, refine_task_add_progress_data (task, helper),
-					     get_updates_cb,
-					     refine_task_add_operation (task));
+		if (self->updates_cache != NULL)
+			gs_packagekit_updates_cache_lookup_async (self->updates_cache,
+								  cancellable,
+								  updates_cache_lookup_cb,
+								  refine_task_add_operation (task));
+		else
+			refine_task_get_updates (task);
 	}
 
 	for (guint i = 0; i < gs_app_list_length (list); i++) {
@@ -1794,6 +2156,10 @@ resolve_all_packages_with_filter_cb (GObject      *source_object,
 		return;
 	}
 
+	/* don’t wait for the second attempt to look up the details of the
+	 * apps resolved by the first one */
+	refine_task_get_details_for_resolved (refine_task);
+
 	/* if any packages remaining in UNKNOWN state, try to resolve them again,
 	 * but this time without ARCH filter */
 	resolve2_list = gs_app_list_new ();
@@ -1832,6 +2198,8 @@ resolve_all_packages_with_filter_cb2 (GObject      *source_object,
 		return;
 	}
 
+	refine_task_get_details_for_resolved (refine_task);
+
 	refine_task_complete_operation (refine_task);
 }
 
@@ -1840,7 +2208,7 @@ search_files_cb (GObject      *source_object,
                  GAsyncResult *result,
                  gpointer      user_data)
 {
-	PkClient *client = PK_CLIENT (source_object);
+	GsPackagekitBatcher *batcher = GS_PACKAGEKIT_BATCHER (source_object);
 	g_autoptr(SearchFilesData) search_files_data = g_steal_pointer (&user_data);
 	GTask *refine_task = search_files_data->refine_task;
 	GsPluginPackagekit *self = GS_PLUGIN_PACKAGEKIT (g_task_get_source_object (refine_task));
@@ -1848,7 +2216,7 @@ search_files_cb (GObject      *source_object,
 	g_autoptr(GPtrArray) packages = NULL;
 	g_autoptr(GError) local_error = NULL;
 
-	results = pk_client_generic_finish (client, result, &local_error);
+	results = gs_packagekit_batcher_run_finish (batcher, result, &local_error);
 
 	if (!gs_plugin_packagekit_results_valid (results, &local_error)) {
 		g_prefix_error (&local_error, "failed to search file %s: ", search_files_data->filename);
@@ -1875,24 +2243,34 @@ get_update_detail_cb (GObject      *source_object,
                       GAsyncResult *result,
                       gpointer      user_data)
 {
-	PkClient *client = PK_CLIENT (source_object);
-	g_autoptr(GTask) refine_task = g_steal_pointer (&user_data);
-	RefineData *data = g_task_get_task_data (refine_task);
+	GsPackagekitBatcher *batcher = GS_PACKAGEKIT_BATCHER (source_object);
+	g_autoptr(AppListData) update_details_data = g_steal_pointer (&user_data);
+	GTask *refine_task = update_details_data->refine_task;
+	GsPluginPackagekit *self = GS_PLUGIN_PACKAGEKIT (g_task_get_source_object (refine_task));
+	GsAppList *update_details_list = update_details_data->list;
 	g_autoptr(PkResults) results = NULL;
 	g_autoptr(GPtrArray) array = NULL;
 	g_autoptr(GError) local_error = NULL;
 
-	results = pk_client_generic_finish (client, result, &local_error);
+	results = gs_packagekit_batcher_run_finish (batcher, result, &local_error);
 	if (!gs_plugin_packagekit_results_valid (results, &local_error)) {
 		g_prefix_error (&local_error, "failed to get update details: ");
+		if (update_details_data->best_effort &&
+		    !g_cancellable_is_cancelled (g_task_get_cancellable (refine_task))) {
+			g_debug ("%s", local_error->message);
+			refine_task_complete_operation (refine_task);
+			return;
+		}
 		refine_task_complete_operation_with_error (refine_task, g_steal_pointer (&local_error));
 		return;
 	}
 
 	/* set the update details for the update */
 	array = pk_results_get_update_detail_array (results);
-	for (guint j = 0; j < gs_app_list_length (data->update_details_list); j++) {
-		GsApp *app = gs_app_list_index (data->update_details_list, j);
+	if (self->details_cache != NULL)
+		gs_packagekit_details_cache_add_update_details (self->details_cache, array);
+	for (guint j = 0; j < gs_app_list_length (update_details_list); j++) {
+		GsApp *app = gs_app_list_index (update_details_list, j);
 		const gchar *package_id = gs_app_get_source_id_default (app);
 
 		for (guint i = 0; i < array->len; i++) {
@@ -1920,26 +2298,33 @@ get_details_cb (GObject      *source_object,
                 GAsyncResult *result,
                 gpointer      user_data)
 {
-	PkClient *client = PK_CLIENT (source_object);
-	g_autoptr(GTask) refine_task = g_steal_pointer (&user_data);
+	GsPackagekitBatcher *batcher = GS_PACKAGEKIT_BATCHER (source_object);
+	g_autoptr(AppListData) details_data = g_steal_pointer (&user_data);
+	GTask *refine_task = details_data->refine_task;
 	GsPluginPackagekit *self = GS_PLUGIN_PACKAGEKIT (g_task_get_source_object (refine_task));
-	RefineData *data = g_task_get_task_data (refine_task);
+	GsAppList *details_list = details_data->list;
 	g_autoptr(GPtrArray) array = NULL;
 	g_autoptr(PkResults) results = NULL;
 	g_autoptr(GHashTable) details_collection = NULL;
 	g_autoptr(GHashTable) prepared_updates = NULL;
 	g_autoptr(GError) local_error = NULL;
 
-	results = pk_client_generic_finish (client, result, &local_error);
+	results = gs_packagekit_batcher_run_finish (batcher, result, &local_error);
 
 	if (!gs_plugin_packagekit_results_valid (results, &local_error)) {
-		g_autoptr(GPtrArray) package_ids = app_list_get_package_ids (data->details_list, NULL, FALSE);
+		g_autoptr(GPtrArray) package_ids = app_list_get_package_ids (details_list, NULL, FALSE);
 		g_autofree gchar *package_ids_str = NULL;
 		/* NULL-terminate the array */
 		g_ptr_array_add (package_ids, NULL);
 		package_ids_str = g_strjoinv (",", (gchar **) package_ids->pdata);
 		g_prefix_error (&local_error, "failed to get details for %s: ",
 				package_ids_str);
+		if (details_data->best_effort &&
+		    !g_cancellable_is_cancelled (g_task_get_cancellable (refine_task))) {
+			g_debug ("%s", local_error->message);
+			refine_task_complete_operation (refine_task);
+			return;
+		}
 		refine_task_complete_operation_with_error (refine_task, g_steal_pointer (&local_error));
 		return;
 	}
@@ -1950,20 +2335,45 @@ get_details_cb (GObject      *source_object,
 	 * sometimes 200) */
 	array = pk_results_get_details_array (results);
 	details_collection = gs_plugin_packagekit_details_array_to_hash (array);
+	if (self->details_cache != NULL)
+		gs_packagekit_details_cache_add_details (self->details_cache, array);
 
 	/* set the update details for the update */
 	g_mutex_lock (&self->prepared_updates_mutex);
 	prepared_updates = g_hash_table_ref (self->prepared_updates);
 	g_mutex_unlock (&self->prepared_updates_mutex);
 
-	for (guint i = 0; i < gs_app_list_length (data->details_list); i++) {
-		GsApp *app = gs_app_list_index (data->details_list, i);
+	for (guint i = 0; i < gs_app_list_length (details_list); i++) {
+		GsApp *app = gs_app_list_index (details_list, i);
 		gs_plugin_packagekit_refine_details_app (GS_PLUGIN (self), details_collection, prepared_updates, app);
 	}
 
 	refine_task_complete_operation (refine_task);
 }
 
+static void
+updates_cache_lookup_cb (GObject      *source_object,
+                         GAsyncResult *result,
+                         gpointer      user_data)
+{
+	GsPackagekitUpdatesCache *updates_cache = GS_PACKAGEKIT_UPDATES_CACHE (source_object);
+	g_autoptr(GTask) refine_task = g_steal_pointer (&user_data);
+	RefineData *data = g_task_get_task_data (refine_task);
+	g_autoptr(GPtrArray) packages = NULL;
+
+	g_clear_pointer (&data->updates_stamp, g_free);
+	packages = gs_packagekit_updates_cache_lookup_finish (updates_cache, result,
+							      &data->updates_stamp);
+
+	/* get the list of updates, unless they are cached */
+	if (packages != NULL)
+		gs_plugin_packagekit_refine_update_severity (data->full_list, packages);
+	else
+		refine_task_get_updates (refine_task);
+
+	refine_task_complete_operation (refine_task);
+}
+
 static void
 get_updates_cb (GObject      *source_object,
                 GAsyncResult *result,
@@ -1971,8 +2381,9 @@ get_updates_cb (GObject      *source_object,
 {
 	PkClient *client = PK_CLIENT (source_object);
 	g_autoptr(GTask) refine_task = g_steal_pointer (&user_data);
+	GsPluginPackagekit *self = GS_PLUGIN_PACKAGEKIT (g_task_get_source_object (refine_task));
 	RefineData *data = g_task_get_task_data (refine_task);
-	g_autoptr(PkPackageSack) sack = NULL;
+	g_autoptr(GPtrArray) packages = NULL;
 	g_autoptr(PkResults) results = NULL;
 	g_autoptr(GError) local_error = NULL;
 
@@ -1985,63 +2396,10 @@ get_updates_cb (GObject      *source_object,
 	}
 
 	/* set the update severity for the app */
-	sack = pk_results_get_package_sack (results);
-	for (guint i = 0; i < gs_app_list_length (data->full_list); i++) {
-		g_autoptr(PkPackage) pkg = NULL;
-		const gchar *package_id;
-		GsApp *app = gs_app_list_index (data->full_list, i);
-
-		if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD))
-			continue;
-		package_id = gs_app_get_source_id_default (app);
-		if (package_id == NULL)
-			continue;
-		pkg = pk_package_sack_find_by_id (sack, package_id);
-		if (pkg == NULL)
-			continue;
-		#ifdef HAVE_PK_PACKAGE_GET_UPDATE_SEVERITY
-		switch (pk_package_get_update_severity (pkg)) {
-		case PK_INFO_ENUM_LOW:
-			gs_app_set_update_urgency (app, AS_URGENCY_KIND_LOW);
-			break;
-		case PK_INFO_ENUM_NORMAL:
-			gs_app_set_update_urgency (app, AS_URGENCY_KIND_MEDIUM);
-			break;
-		case PK_INFO_ENUM_IMPORTANT:
-			gs_app_set_update_urgency (app, AS_URGENCY_KIND_HIGH);
-			break;
-		case PK_INFO_ENUM_CRITICAL:
-			gs_app_set_update_urgency (app, AS_URGENCY_KIND_CRITICAL);
-			break;
-		default:
-			gs_app_set_update_urgency (app, AS_URGENCY_KIND_UNKNOWN);
-			break;
-		}
-		#else
-		switch (pk_package_get_info (pkg)) {
-		case PK_INFO_ENUM_AVAILABLE:
-		case PK_INFO_ENUM_NORMAL:
-		case PK_INFO_ENUM_LOW:
-		case PK_INFO_ENUM_ENHANCEMENT:
-			gs_app_set_update_urgency (app, AS_URGENCY_KIND_LOW);
-			break;
-		case PK_INFO_ENUM_BUGFIX:
-			gs_app_set_update_urgency (app, AS_URGENCY_KIND_MEDIUM);
-			break;
-		case PK_INFO_ENUM_SECURITY:
-			gs_app_set_update_urgency (app, AS_URGENCY_KIND_CRITICAL);
-			break;
-		case PK_INFO_ENUM_IMPORTANT:
-			gs_app_set_update_urgency (app, AS_URGENCY_KIND_HIGH);
-			break;
-		default:
-			gs_app_set_update_urgency (app, AS_URGENCY_KIND_UNKNOWN);
-			g_warning ("unhandled info state %s",
-				   pk_info_enum_to_string (pk_package_get_info (pkg)));
-			break;
-		}
-		#endif
-	}
+	packages = pk_results_get_package_array (results);
+	if (self->updates_cache != NULL)
+		gs_packagekit_updates_cache_set (self->updates_cache, data->updates_stamp, packages);
+	gs_plugin_packagekit_refine_update_severity (data->full_list, packages);
 
 	refine_task_complete_operation (refine_task);
 }
@@ -2132,6 +2490,26 @@ gs_plugin_packagekit_download (GsPlugin *plugin,
 			       GCancellable *cancellable,
 			       GError **error);
 
+static gboolean
+gs_plugin_packagekit_auto_prepare_update (GsPlugin      *plugin,
+                                          GCancellable  *cancellable,
+                                          GError       **error)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+
+	if (!gs_plugin_packagekit_add_updates (plugin, list, cancellable, error))
+		return FALSE;
+
+	if (gs_app_list_length (list) > 0 &&
+	    !gs_plugin_packagekit_download (plugin, list, cancellable, error))
+		return FALSE;
+
+	/* Ignore errors here */
+	gs_plugin_systemd_update_cache (GS_PLUGIN_PACKAGEKIT (plugin), NULL);
+
+	return TRUE;
+}
+
 static void
 gs_plugin_packagekit_auto_prepare_update_thread (GTask *task,
 						 gpointer source_object,
@@ -2139,27 +2517,22 @@ gs_plugin_packagekit_auto_prepare_update_thread (GTask *task,
 						 GCancellable *cancellable)
 {
 	GsPlugin *plugin = source_object;
-	g_autoptr(GsAppList) list = NULL;
+	gboolean ret;
 	g_autoptr(GError) local_error = NULL;
 
 	g_return_if_fail (GS_IS_PLUGIN_PACKAGEKIT (plugin));
 
-	list = gs_app_list_new ();
-	if (!gs_plugin_packagekit_add_updates (plugin, list, cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
+	/* this is not run by the plugin loader’s worker threads, which would
+	 * have set this already; the thread is shared with other tasks, so
+	 * the default priority new threads get is restored afterwards */
+	gs_ioprio_set (G_PRIORITY_LOW);
+	ret = gs_plugin_packagekit_auto_prepare_update (plugin, cancellable, &local_error);
+	gs_ioprio_set (G_PRIORITY_DEFAULT);
 
-	if (gs_app_list_length (list) > 0 &&
-	    !gs_plugin_packagekit_download (plugin, list, cancellable, &local_error)) {
+	if (!ret)
 		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
-
-	/* Ignore errors here */
-	gs_plugin_systemd_update_cache (GS_PLUGIN_PACKAGEKIT (source_object), NULL);
-
-	g_task_return_boolean (task, TRUE);
+	else
+		g_task_return_boolean (task, TRUE);
 }
 
 static void
@@ -2290,6 +2663,38 @@ gs_plugin_packagekit_setup_async (GsPlugin            *plugin,
 	task = g_task_new (plugin, cancellable, callback, user_data);
 	g_task_set_source_tag (task, gs_plugin_packagekit_setup_async);
 
+	/* package details are the same for every session */
+	if (self->details_cache == NULL) {
+		g_autoptr(GError) error_local = NULL;
+		g_autofree gchar *details_cache_fn = NULL;
+
+		details_cache_fn = gs_utils_get_cache_filename ("packagekit",
+								"details.ini",
+								GS_UTILS_CACHE_FLAG_WRITEABLE |
+								GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+								&error_local);
+		if (details_cache_fn == NULL)
+			g_debug ("not caching package details: %s", error_local->message);
+		else
+			self->details_cache = gs_packagekit_details_cache_new (details_cache_fn);
+	}
+
+	/* the update list is kept until the repositories or packages change */
+	if (self->updates_cache == NULL) {
+		g_autoptr(GError) error_local = NULL;
+		g_autofree gchar *updates_cache_fn = NULL;
+
+		updates_cache_fn = gs_utils_get_cache_filename ("packagekit",
+								"updates.ini",
+								GS_UTILS_CACHE_FLAG_WRITEABLE |
+								GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+								&error_local);
+		if (updates_cache_fn == NULL)
+			g_debug ("not caching updates: %s", error_local->message);
+		else
+			self->updates_cache = gs_packagekit_updates_cache_new (updates_cache_fn);
+	}
+
 	reload_proxy_settings_async (self, cancellable, setup_proxy_settings_cb, g_steal_pointer (&task));
 }
 
@@ -2359,10 +2764,15 @@ get_offline_update_permission_cb (GObject      *source_object,
 	}
 
 	/* get the list of currently downloaded packages */
-	if (!gs_plugin_systemd_update_cache (self, &local_error))
+	if (!gs_plugin_systemd_update_cache (self, &local_error)) {
 		g_task_return_error (task, g_steal_pointer (&local_error));
-	else
-		g_task_return_boolean (task, TRUE);
+		return;
+	}
+
+	/* map installed files to their packages in the background */
+	gs_packagekit_file_index_rebuild (self->file_index);
+
+	g_task_return_boolean (task, TRUE);
 }
 
 static gboolean
@@ -2387,6 +2797,7 @@ gs_plugin_packagekit_shutdown_async (GsPlugin            *plugin,
 
 	/* Cancel any ongoing proxy settings loading operation. */
 	g_cancellable_cancel (self->proxy_settings_cancellable);
+	gs_packagekit_file_index_cancel (self->file_index);
 
 	g_task_return_boolean (task, TRUE);
 }
@@ -3606,6 +4017,128 @@ gs_plugin_packagekit_disable_repository_finish (GsPlugin      *plugin,
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+/* Number of packages downloaded by each transaction when staging updates
+ * in the background; the download can be paused between two of them. */
+#define STAGED_DOWNLOAD_CHUNK_SIZE 20
+
+/* The package IDs already staged by earlier, interrupted, downloads are
+ * kept in a key file so they are not staged again. Package IDs include the
+ * version, so stale entries never match a newer update. */
+static gchar *
+gs_plugin_packagekit_get_staged_filename (void)
+{
+	g_autoptr(GError) error_local = NULL;
+	gchar *fn;
+
+	fn = gs_utils_get_cache_filename ("packagekit",
+					  "staged-updates.ini",
+					  GS_UTILS_CACHE_FLAG_WRITEABLE |
+					  GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+					  &error_local);
+	if (fn == NULL)
+		g_debug ("not checkpointing staged updates: %s", error_local->message);
+	return fn;
+}
+
+static void
+staged_download_cancelled_cb (GCancellable *cancellable,
+                              gpointer      user_data)
+{
+	g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+
+/* Downloads the packages in @package_ids a chunk at a time, skipping those
+ * already staged by an earlier call, and pausing while the download gate is
+ * closed. Returns %FALSE only if @cancellable was cancelled; if a chunk
+ * fails, the rest is left to the caller’s transaction for all the packages.
+ *
+ * Each chunk only downloads its own packages, so the prepared-update file
+ * lists just the last chunk until the caller’s transaction for all the
+ * packages, which finds the staged ones in the cache, rewrites it. The
+ * progress of @helper is split between the chunks, and what is left of it is
+ * set aside for that transaction. */
+static gboolean
+gs_plugin_packagekit_stage_downloads (GsPluginPackagekit  *self,
+                                      PkTask              *task,
+                                      GsPackagekitHelper  *helper,
+                                      gchar              **package_ids,
+                                      GCancellable        *cancellable,
+                                      GError             **error)
+{
+	g_autofree gchar *staged_fn = gs_plugin_packagekit_get_staged_filename ();
+	g_autoptr(GHashTable) staged_ids = gs_plugin_packagekit_load_staged_ids (staged_fn);
+	g_autoptr(GPtrArray) pending_ids = g_ptr_array_new ();
+	guint n_staged = 0;
+	guint n_total;
+	guint i = 0;
+
+	for (guint j = 0; package_ids[j] != NULL; j++) {
+		if (g_hash_table_contains (staged_ids, package_ids[j]))
+			n_staged++;
+		else
+			g_ptr_array_add (pending_ids, package_ids[j]);
+	}
+	n_total = n_staged + pending_ids->len;
+	g_debug ("staging %u updates, %u already staged",
+		 pending_ids->len, n_staged);
+
+	while (i < pending_ids->len) {
+		guint n_chunk = MIN (STAGED_DOWNLOAD_CHUNK_SIZE, pending_ids->len - i);
+		g_autofree gchar **chunk_ids = g_new0 (gchar *, n_chunk + 1);
+		g_autoptr(GCancellable) chunk_cancellable = g_cancellable_new ();
+		g_autoptr(PkResults) results = NULL;
+		g_autoptr(GError) error_local = NULL;
+		gulong handler_id = 0;
+
+		if (!gs_packagekit_download_gate_wait (self->download_gate, cancellable)) {
+			g_cancellable_set_error_if_cancelled (cancellable, error);
+			return FALSE;
+		}
+
+		for (guint j = 0; j < n_chunk; j++)
+			chunk_ids[j] = g_ptr_array_index (pending_ids, i + j);
+
+		if (cancellable != NULL)
+			handler_id = g_cancellable_connect (cancellable,
+							    G_CALLBACK (staged_download_cancelled_cb),
+							    chunk_cancellable, NULL);
+		gs_packagekit_helper_set_progress_range (helper,
+							 100 * (n_staged + i) / n_total,
+							 100 * (n_staged + i + n_chunk) / n_total);
+		gs_packagekit_download_gate_set_transfer (self->download_gate, chunk_cancellable);
+		results = pk_task_update_packages_sync (task,
+							chunk_ids,
+							chunk_cancellable,
+							gs_packagekit_helper_cb, helper,
+							&error_local);
+		gs_packagekit_download_gate_set_transfer (self->download_gate, NULL);
+		g_cancellable_disconnect (cancellable, handler_id);
+
+		if (g_cancellable_set_error_if_cancelled (cancellable, error))
+			return FALSE;
+
+		/* the gate closed; retry the chunk once it opens again */
+		if (g_cancellable_is_cancelled (chunk_cancellable))
+			continue;
+
+		if (!gs_plugin_packagekit_results_valid (results, &error_local)) {
+			g_debug ("failed to stage updates, downloading them together: %s",
+				 error_local->message);
+			break;
+		}
+
+		for (guint j = 0; j < n_chunk; j++)
+			g_hash_table_add (staged_ids, g_strdup (g_ptr_array_index (pending_ids, i + j)));
+		gs_plugin_packagekit_save_staged_ids (staged_fn, staged_ids);
+
+		i += n_chunk;
+	}
+
+	gs_packagekit_helper_set_progress_range (helper, 100 * (n_staged + i) / n_total, 100);
+
+	return TRUE;
+}
+
 static gboolean
 _download_only (GsPluginPackagekit  *self,
                 GsAppList           *list,
@@ -3617,9 +4150,9 @@ _download_only (GsPluginPackagekit  *self,
 	g_auto(GStrv) package_ids = NULL;
 	g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
 	g_autoptr(PkTask) task_refresh = NULL;
-	g_autoptr(PkPackageSack) sack = NULL;
+	g_autoptr(GPtrArray) packages = NULL;
 	g_autoptr(PkResults) results2 = NULL;
-	g_autoptr(PkResults) results = NULL;
+	g_autofree gchar *staged_fn = NULL;
 
 	/* get the list of packages to update */
 	gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_WAITING);
@@ -3631,30 +4164,47 @@ _download_only (GsPluginPackagekit  *self,
 	pk_task_set_only_download (task_refresh, TRUE);
 	gs_packagekit_task_setup (GS_PACKAGEKIT_TASK (task_refresh), GS_PLUGIN_ACTION_DOWNLOAD, gs_plugin_has_flags (plugin, GS_PLUGIN_FLAGS_INTERACTIVE));
 
-	results = pk_client_get_updates (PK_CLIENT (task_refresh),
-					 pk_bitfield_value (PK_FILTER_ENUM_NONE),
-					 cancellable,
-					 gs_packagekit_helper_cb, helper,
-					 error);
-
-	if (!gs_plugin_packagekit_results_valid (results, error)) {
+	packages = gs_plugin_packagekit_get_updates (self,
+						     PK_CLIENT (task_refresh),
+						     helper,
+						     cancellable,
+						     error);
+	if (packages == NULL)
 		return FALSE;
-	}
 
 	/* download all the packages */
-	sack = pk_results_get_package_sack (results);
-	if (pk_package_sack_get_size (sack) == 0)
+	if (packages->len == 0)
 		return TRUE;
-	package_ids = pk_package_sack_get_ids (sack);
+	package_ids = g_new0 (gchar *, packages->len + 1);
+	for (guint i = 0; i < packages->len; i++)
+		package_ids[i] = g_strdup (pk_package_get_id (g_ptr_array_index (packages, i)));
 	for (guint i = 0; i < gs_app_list_length (list); i++) {
 		GsApp *app = gs_app_list_index (list, i);
 		gs_packagekit_helper_add_app (helper, app);
 	}
 	gs_packagekit_helper_set_progress_list (helper, progress_list);
 
+	/* in the background, download a few packages at a time, so that the
+	 * download can pause and pick up where it was left */
+	if (!gs_plugin_has_flags (plugin, GS_PLUGIN_FLAGS_INTERACTIVE) &&
+	    !gs_plugin_packagekit_stage_downloads (self, task_refresh, helper, package_ids,
+						   cancellable, error)) {
+		gs_app_list_override_progress (progress_list, GS_APP_PROGRESS_UNKNOWN);
+		return FALSE;
+	}
+
+	/* wait again in case the gate closed after the last chunk */
+	if (!gs_plugin_has_flags (plugin, GS_PLUGIN_FLAGS_INTERACTIVE) &&
+	    !gs_packagekit_download_gate_wait (self->download_gate, cancellable)) {
+		gs_app_list_override_progress (progress_list, GS_APP_PROGRESS_UNKNOWN);
+		g_cancellable_set_error_if_cancelled (cancellable, error);
+		return FALSE;
+	}
+
 	/* never refresh the metadata here as this can surprise the frontend if
 	 * we end up downloading a different set of packages than what was
-	 * shown to the user */
+	 * shown to the user; this downloads anything not staged yet, and
+	 * records all the packages as the prepared update */
 	results2 = pk_task_update_packages_sync (task_refresh,
 						 package_ids,
 						 cancellable,
@@ -3668,6 +4218,12 @@ _download_only (GsPluginPackagekit  *self,
 	}
 	if (g_cancellable_set_error_if_cancelled (cancellable, error))
 		return FALSE;
+
+	/* nothing left to resume */
+	staged_fn = gs_plugin_packagekit_get_staged_filename ();
+	if (staged_fn != NULL)
+		g_unlink (staged_fn);
+
 	for (guint i = 0; i < gs_app_list_length (list); i++) {
 		GsApp *app = gs_app_list_index (list, i);
 		/* To indicate the app is already downloaded */
@@ -3693,6 +4249,11 @@ gs_plugin_packagekit_download (GsPlugin *plugin,
 		GsApp *app = gs_app_list_index (list, i);
 		GsAppList *related = gs_app_get_related (app);
 
+		/* only updates are downloaded ahead; an app which is not
+		 * installed yet is left for the install itself */
+		if (gs_app_get_state (app) == GS_APP_STATE_AVAILABLE)
+			continue;
+
 		/* add this app */
 		if (!gs_app_has_quirk (app, GS_APP_QUIRK_IS_PROXY)) {
 			if (gs_app_has_management_plugin (app, plugin))
@@ -3793,6 +4354,7 @@ refresh_metadata_cb (GObject      *source_object,
 	if (!gs_plugin_packagekit_results_valid (results, &local_error)) {
 		g_task_return_error (task, g_steal_pointer (&local_error));
 	} else {
+		gs_packagekit_file_index_rebuild (GS_PLUGIN_PACKAGEKIT (plugin)->file_index);
 		gs_plugin_updates_changed (plugin);
 		g_task_return_boolean (task, TRUE);
 	}
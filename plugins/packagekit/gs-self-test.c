@@ -8,10 +8,16 @@
 
 #include "config.h"
 
+#include <glib/gstdio.h>
+
 #include "gnome-software-private.h"
 
 #include "gs-markdown.h"
+#include "gs-packagekit-download-gate.h"
+#include "gs-packagekit-file-index.h"
+#include "gs-packagekit-updates-cache.h"
 #include "gs-test.h"
+#include "packagekit-common.h"
 
 static void
 gs_markdown_func (void)
@@ -193,6 +199,379 @@ gs_markdown_func (void)
 	g_free (text);
 }
 
+static void
+gs_packagekit_updates_cache_func (void)
+{
+	g_autoptr(GsPackagekitUpdatesCache) cache = NULL;
+	g_autoptr(GPtrArray) packages = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GPtrArray) cached = NULL;
+	g_autoptr(PkPackage) package = pk_package_new ();
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *metadata_dir = NULL;
+	g_autofree gchar *repodata_dir = NULL;
+	g_autofree gchar *repomd_fn = NULL;
+	g_autofree gchar *database_fn = NULL;
+	g_autofree gchar *missing_fn = NULL;
+	const gchar *metadata_dirs[2] = { NULL, NULL };
+	const gchar *database_files[3] = { NULL, NULL, NULL };
+	g_autofree gchar *stamp = NULL;
+	g_autofree gchar *stamp_old = NULL;
+	g_autoptr(GError) error = NULL;
+
+	g_assert_cmpint (g_mkdir_with_parents (g_get_user_cache_dir (), 0755), ==, 0);
+	fn = g_build_filename (g_get_user_cache_dir (), "updates.ini", NULL);
+	metadata_dir = g_build_filename (g_get_user_cache_dir (), "metadata", NULL);
+	repodata_dir = g_build_filename (metadata_dir, "fedora", "repodata", NULL);
+	repomd_fn = g_build_filename (repodata_dir, "repomd.xml", NULL);
+	database_fn = g_build_filename (g_get_user_cache_dir (), "rpmdb.sqlite", NULL);
+	missing_fn = g_build_filename (g_get_user_cache_dir (), "Packages", NULL);
+	metadata_dirs[0] = metadata_dir;
+	database_files[0] = missing_fn;
+	database_files[1] = database_fn;
+
+	/* disabled while there is no metadata or package database to cover */
+	cache = gs_packagekit_updates_cache_new_for_paths (fn, metadata_dirs, database_files);
+	cached = gs_packagekit_updates_cache_lookup (cache, &stamp);
+	g_assert_null (cached);
+	g_assert_null (stamp);
+	g_assert_cmpint (g_mkdir_with_parents (repodata_dir, 0755), ==, 0);
+	g_file_set_contents (repomd_fn, "<repomd/>", -1, &error);
+	g_assert_no_error (error);
+	cached = gs_packagekit_updates_cache_lookup (cache, &stamp);
+	g_assert_null (cached);
+	g_assert_null (stamp);
+	g_file_set_contents (database_fn, "rpmdb", -1, &error);
+	g_assert_no_error (error);
+
+	/* nothing cached yet */
+	cached = gs_packagekit_updates_cache_lookup (cache, &stamp);
+	g_assert_null (cached);
+	g_assert_nonnull (stamp);
+
+	pk_package_set_id (package, "chiron;1.1-1.fc24;x86_64;updates", &error);
+	g_assert_no_error (error);
+	pk_package_set_info (package, PK_INFO_ENUM_SECURITY);
+	pk_package_set_summary (package, "Single line synopsis");
+	g_ptr_array_add (packages, g_object_ref (package));
+	gs_packagekit_updates_cache_set (cache, stamp, packages);
+
+	/* handed out while nothing changed */
+	g_clear_pointer (&stamp, g_free);
+	cached = gs_packagekit_updates_cache_lookup (cache, &stamp);
+	g_assert_nonnull (cached);
+	g_assert_cmpuint (cached->len, ==, 1);
+	g_assert_cmpstr (pk_package_get_id (g_ptr_array_index (cached, 0)), ==, "chiron;1.1-1.fc24;x86_64;updates");
+	g_assert_cmpint (pk_package_get_info (g_ptr_array_index (cached, 0)), ==, PK_INFO_ENUM_SECURITY);
+	g_assert_cmpstr (pk_package_get_summary (g_ptr_array_index (cached, 0)), ==, "Single line synopsis");
+	g_clear_pointer (&cached, g_ptr_array_unref);
+
+	/* and by the next session */
+	g_clear_object (&cache);
+	cache = gs_packagekit_updates_cache_new_for_paths (fn, metadata_dirs, database_files);
+	g_clear_pointer (&stamp, g_free);
+	cached = gs_packagekit_updates_cache_lookup (cache, &stamp);
+	g_assert_nonnull (cached);
+	g_assert_cmpuint (cached->len, ==, 1);
+	g_clear_pointer (&cached, g_ptr_array_unref);
+
+	/* but not once the repository metadata changed */
+	g_file_set_contents (repomd_fn, "<repomd revision=\"2\"/>", -1, &error);
+	g_assert_no_error (error);
+	g_clear_pointer (&stamp, g_free);
+	cached = gs_packagekit_updates_cache_lookup (cache, &stamp);
+	g_assert_null (cached);
+	g_assert_nonnull (stamp);
+	gs_packagekit_updates_cache_set (cache, stamp, packages);
+	g_clear_pointer (&stamp, g_free);
+	cached = gs_packagekit_updates_cache_lookup (cache, &stamp);
+	g_assert_nonnull (cached);
+	g_clear_pointer (&cached, g_ptr_array_unref);
+
+	/* nor once the installed packages did */
+	g_file_set_contents (database_fn, "rpmdb with chiron", -1, &error);
+	g_assert_no_error (error);
+	g_clear_pointer (&stamp, g_free);
+	cached = gs_packagekit_updates_cache_lookup (cache, &stamp);
+	g_assert_null (cached);
+	g_assert_nonnull (stamp);
+
+	/* updates computed before an invalidation are not kept */
+	stamp_old = g_steal_pointer (&stamp);
+	gs_packagekit_updates_cache_invalidate (cache);
+	gs_packagekit_updates_cache_set (cache, stamp_old, packages);
+	cached = gs_packagekit_updates_cache_lookup (cache, &stamp);
+	g_assert_null (cached);
+}
+
+static PkPackage *
+file_index_package_new (const gchar *package_id)
+{
+	g_autoptr(PkPackage) package = pk_package_new ();
+	g_autoptr(GError) error = NULL;
+
+	pk_package_set_id (package, package_id, &error);
+	g_assert_no_error (error);
+	return g_steal_pointer (&package);
+}
+
+static void
+file_index_add_files (GPtrArray *files_array,
+		      const gchar *package_id,
+		      const gchar * const *files)
+{
+	PkFiles *item = pk_files_new ();
+
+	g_object_set (item,
+		      "package-id", package_id,
+		      "files", files,
+		      NULL);
+	g_ptr_array_add (files_array, item);
+}
+
+static void
+gs_packagekit_file_index_func (void)
+{
+	g_autoptr(GsPackagekitFileIndex) file_index = gs_packagekit_file_index_new ();
+	g_autoptr(GHashTable) wanted = g_hash_table_new (g_str_hash, g_str_equal);
+	g_autoptr(GHashTable) packages = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+	g_autoptr(GPtrArray) files_array = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GPtrArray) resolved = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GHashTable) owners = NULL;
+	g_autoptr(GHashTable) newest = NULL;
+	g_autoptr(GCancellable) cancellable1 = NULL;
+	g_autoptr(GCancellable) cancellable2 = NULL;
+	g_autoptr(PkPackage) package = NULL;
+	const gchar * const package_ids[] = {
+		"chiron;1.1-1.fc24;x86_64;installed",
+		"shared;1.0-1.fc24;x86_64;installed",
+		"shared;1.0-1.fc24;i686;installed",
+	};
+	const gchar * const chiron_files[] = {
+		"/usr/share/applications/chiron.desktop",
+		"/usr/share/metainfo/chiron.metainfo.xml",
+		"/usr/bin/chiron",
+		NULL
+	};
+	const gchar * const shared_files[] = {
+		"/usr/share/applications/shared.desktop",
+		NULL
+	};
+
+	g_hash_table_add (wanted, (gpointer) "/usr/share/applications/chiron.desktop");
+	g_hash_table_add (wanted, (gpointer) "/usr/share/metainfo/chiron.metainfo.xml");
+	g_hash_table_add (wanted, (gpointer) "/usr/share/applications/shared.desktop");
+	for (guint i = 0; i < G_N_ELEMENTS (package_ids); i++)
+		g_hash_table_insert (packages, (gpointer) package_ids[i], file_index_package_new (package_ids[i]));
+
+	/* what GetFiles returns for the packages found by SearchFiles; the
+	 * multilib variants of a package both own the same file */
+	file_index_add_files (files_array, package_ids[0], chiron_files);
+	file_index_add_files (files_array, package_ids[1], shared_files);
+	file_index_add_files (files_array, package_ids[2], shared_files);
+
+	/* only wanted files with a single owner are indexed */
+	owners = gs_packagekit_file_index_map_owners (wanted, packages, files_array);
+	g_assert_cmpuint (g_hash_table_size (owners), ==, 2);
+	g_assert_cmpstr (pk_package_get_id (g_hash_table_lookup (owners, "/usr/share/applications/chiron.desktop")),
+			 ==, package_ids[0]);
+	g_assert_cmpstr (pk_package_get_id (g_hash_table_lookup (owners, "/usr/share/metainfo/chiron.metainfo.xml")),
+			 ==, package_ids[0]);
+	g_assert_false (g_hash_table_contains (owners, "/usr/share/applications/shared.desktop"));
+	g_assert_false (g_hash_table_contains (owners, "/usr/bin/chiron"));
+
+	/* what Resolve returns for the owners' names: an update */
+	g_ptr_array_add (resolved, file_index_package_new ("chiron;1.2-1.fc24;x86_64;updates"));
+	newest = gs_packagekit_file_index_map_newest (owners, resolved);
+	g_assert_cmpuint (g_hash_table_size (newest), ==, 2);
+	g_assert_cmpstr (pk_package_get_id (g_hash_table_lookup (newest, "/usr/share/applications/chiron.desktop")),
+			 ==, "chiron;1.2-1.fc24;x86_64;updates");
+
+	/* nothing is known until a build finishes */
+	g_assert_null (gs_packagekit_file_index_lookup (file_index, "/usr/share/applications/chiron.desktop"));
+
+	/* a build superseded by another one is cancelled, and its results
+	 * are not used */
+	cancellable1 = gs_packagekit_file_index_begin_build (file_index);
+	cancellable2 = gs_packagekit_file_index_begin_build (file_index);
+	g_assert_true (g_cancellable_is_cancelled (cancellable1));
+	g_assert_false (g_cancellable_is_cancelled (cancellable2));
+	g_assert_false (gs_packagekit_file_index_finish_build (file_index, cancellable1, owners, newest));
+	g_assert_null (gs_packagekit_file_index_lookup (file_index, "/usr/share/applications/chiron.desktop"));
+
+	g_assert_true (gs_packagekit_file_index_finish_build (file_index, cancellable2, owners, newest));
+	package = gs_packagekit_file_index_lookup (file_index, "/usr/share/applications/chiron.desktop");
+	g_assert_nonnull (package);
+	g_assert_cmpstr (pk_package_get_id (package), ==, package_ids[0]);
+	g_clear_object (&package);
+	package = gs_packagekit_file_index_lookup_newest (file_index, "/usr/share/applications/chiron.desktop");
+	g_assert_nonnull (package);
+	g_assert_cmpstr (pk_package_get_id (package), ==, "chiron;1.2-1.fc24;x86_64;updates");
+	g_clear_object (&package);
+	g_assert_null (gs_packagekit_file_index_lookup (file_index, "/usr/share/applications/shared.desktop"));
+
+	/* and cancelling drops the index again */
+	gs_packagekit_file_index_cancel (file_index);
+	g_assert_null (gs_packagekit_file_index_lookup (file_index, "/usr/share/applications/chiron.desktop"));
+}
+
+typedef struct {
+	GsPackagekitDownloadGate *gate;
+	GCancellable *cancellable;
+} DownloadGateWaitData;
+
+static gpointer
+download_gate_wait_thread_cb (gpointer user_data)
+{
+	DownloadGateWaitData *data = user_data;
+
+	return GINT_TO_POINTER (gs_packagekit_download_gate_wait (data->gate, data->cancellable));
+}
+
+static gboolean
+download_gate_wait_in_thread (GsPackagekitDownloadGate *gate,
+			      GCancellable             *cancellable,
+			      gboolean                  open)
+{
+	DownloadGateWaitData data = { gate, cancellable };
+	GThread *thread = g_thread_new ("download-gate-wait", download_gate_wait_thread_cb, &data);
+
+	/* either unblocks the waiting thread, or stops it from blocking */
+	if (open)
+		gs_packagekit_download_gate_set_open (gate, TRUE);
+	else
+		g_cancellable_cancel (cancellable);
+
+	return GPOINTER_TO_INT (g_thread_join (thread));
+}
+
+static void
+gs_packagekit_download_gate_func (void)
+{
+	g_autoptr(GsPackagekitDownloadGate) gate = gs_packagekit_download_gate_new ();
+	g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+	g_autoptr(GCancellable) transfer_cancellable = g_cancellable_new ();
+
+	/* transfers go ahead while the gate is open */
+	gs_packagekit_download_gate_set_open (gate, TRUE);
+	g_assert_true (gs_packagekit_download_gate_wait (gate, NULL));
+	gs_packagekit_download_gate_set_transfer (gate, transfer_cancellable);
+	g_assert_false (g_cancellable_is_cancelled (transfer_cancellable));
+
+	/* and are cancelled as soon as it closes */
+	gs_packagekit_download_gate_set_open (gate, FALSE);
+	g_assert_true (g_cancellable_is_cancelled (transfer_cancellable));
+	gs_packagekit_download_gate_set_transfer (gate, NULL);
+
+	/* new ones are cancelled straight away while it is closed */
+	g_clear_object (&transfer_cancellable);
+	transfer_cancellable = g_cancellable_new ();
+	gs_packagekit_download_gate_set_transfer (gate, transfer_cancellable);
+	g_assert_true (g_cancellable_is_cancelled (transfer_cancellable));
+	gs_packagekit_download_gate_set_transfer (gate, NULL);
+
+	/* waiting stops when the download is cancelled, or once it opens */
+	g_assert_false (download_gate_wait_in_thread (gate, cancellable, FALSE));
+	g_clear_object (&cancellable);
+	cancellable = g_cancellable_new ();
+	g_assert_true (download_gate_wait_in_thread (gate, cancellable, TRUE));
+}
+
+static void
+gs_packagekit_staged_ids_func (void)
+{
+	g_autoptr(GHashTable) staged_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_autoptr(GHashTable) loaded = NULL;
+	g_autofree gchar *fn = NULL;
+
+	g_assert_cmpint (g_mkdir_with_parents (g_get_user_cache_dir (), 0755), ==, 0);
+	fn = g_build_filename (g_get_user_cache_dir (), "staged-updates.ini", NULL);
+
+	/* nothing staged without a checkpoint */
+	loaded = gs_plugin_packagekit_load_staged_ids (NULL);
+	g_assert_cmpuint (g_hash_table_size (loaded), ==, 0);
+	g_clear_pointer (&loaded, g_hash_table_unref);
+	loaded = gs_plugin_packagekit_load_staged_ids (fn);
+	g_assert_cmpuint (g_hash_table_size (loaded), ==, 0);
+	g_clear_pointer (&loaded, g_hash_table_unref);
+
+	/* the package IDs staged so far survive an interruption */
+	g_hash_table_add (staged_ids, g_strdup ("chiron;1.1-1.fc24;x86_64;updates"));
+	g_hash_table_add (staged_ids, g_strdup ("chiron-libs;1.1-1.fc24;x86_64;updates"));
+	gs_plugin_packagekit_save_staged_ids (fn, staged_ids);
+	loaded = gs_plugin_packagekit_load_staged_ids (fn);
+	g_assert_cmpuint (g_hash_table_size (loaded), ==, 2);
+	g_assert_true (g_hash_table_contains (loaded, "chiron;1.1-1.fc24;x86_64;updates"));
+	g_assert_true (g_hash_table_contains (loaded, "chiron-libs;1.1-1.fc24;x86_64;updates"));
+	g_clear_pointer (&loaded, g_hash_table_unref);
+
+	/* and each checkpoint replaces the previous one */
+	g_hash_table_add (staged_ids, g_strdup ("chiron-data;1.1-1.fc24;noarch;updates"));
+	gs_plugin_packagekit_save_staged_ids (fn, staged_ids);
+	loaded = gs_plugin_packagekit_load_staged_ids (fn);
+	g_assert_cmpuint (g_hash_table_size (loaded), ==, 3);
+	g_clear_pointer (&loaded, g_hash_table_unref);
+
+	g_assert_cmpint (g_unlink (fn), ==, 0);
+}
+
+static GsApp *
+resolved_app_new (GHashTable  *unresolved_apps,
+		  const gchar *id,
+		  const gchar *package_id,
+		  GsAppState   state)
+{
+	GsApp *app = gs_app_new (id);
+
+	if (package_id != NULL)
+		gs_app_add_source_id (app, package_id);
+	gs_app_set_state (app, state);
+	g_hash_table_add (unresolved_apps, app);
+	return app;
+}
+
+static void
+gs_packagekit_take_resolved_apps_func (void)
+{
+	g_autoptr(GHashTable) unresolved_apps = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+	g_autoptr(GsAppList) update_details_list = gs_app_list_new ();
+	g_autoptr(GsAppList) details_list = gs_app_list_new ();
+	GsApp *unresolved, *updatable, *complete;
+
+	unresolved = resolved_app_new (unresolved_apps, "chiron.desktop", NULL, GS_APP_STATE_UNKNOWN);
+	updatable = resolved_app_new (unresolved_apps, "chiron-updates.desktop", "chiron;1.1-1.fc24;x86_64;updates", GS_APP_STATE_UPDATABLE);
+	complete = resolved_app_new (unresolved_apps, "chiron-fedora.desktop", "chiron;1.1-1.fc24;x86_64;fedora", GS_APP_STATE_INSTALLED);
+	gs_app_set_license (complete, GS_APP_QUALITY_NORMAL, "GPL-2.0+");
+
+	/* only the apps with a package ID are published, and only to the
+	 * lookups they still need */
+	gs_plugin_packagekit_take_resolved_apps (unresolved_apps,
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE |
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS,
+						 update_details_list, details_list);
+	g_assert_cmpuint (g_hash_table_size (unresolved_apps), ==, 1);
+	g_assert_true (g_hash_table_contains (unresolved_apps, unresolved));
+	g_assert_cmpuint (gs_app_list_length (update_details_list), ==, 1);
+	g_assert_true (gs_app_list_index (update_details_list, 0) == updatable);
+	g_assert_cmpuint (gs_app_list_length (details_list), ==, 1);
+	g_assert_true (gs_app_list_index (details_list, 0) == updatable);
+
+	/* the rest once they are resolved too, and nothing twice */
+	gs_app_add_source_id (unresolved, "chiron;1.1-1.fc24;x86_64;updates-testing");
+	g_clear_object (&update_details_list);
+	g_clear_object (&details_list);
+	update_details_list = gs_app_list_new ();
+	details_list = gs_app_list_new ();
+	gs_plugin_packagekit_take_resolved_apps (unresolved_apps,
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE |
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS,
+						 update_details_list, details_list);
+	g_assert_cmpuint (g_hash_table_size (unresolved_apps), ==, 0);
+	g_assert_cmpuint (gs_app_list_length (update_details_list), ==, 1);
+	g_assert_true (gs_app_list_index (update_details_list, 0) == unresolved);
+	g_assert_cmpuint (gs_app_list_length (details_list), ==, 1);
+	g_assert_true (gs_app_list_index (details_list, 0) == unresolved);
+}
+
 static void
 gs_plugins_packagekit_local_func (GsPluginLoader *plugin_loader)
 {
@@ -252,6 +631,11 @@ main (int argc, char **argv)
 
 	/* generic tests go here */
 	g_test_add_func ("/gnome-software/markdown", gs_markdown_func);
+	g_test_add_func ("/gnome-software/packagekit/updates-cache", gs_packagekit_updates_cache_func);
+	g_test_add_func ("/gnome-software/packagekit/file-index", gs_packagekit_file_index_func);
+	g_test_add_func ("/gnome-software/packagekit/take-resolved-apps", gs_packagekit_take_resolved_apps_func);
+	g_test_add_func ("/gnome-software/packagekit/download-gate", gs_packagekit_download_gate_func);
+	g_test_add_func ("/gnome-software/packagekit/staged-ids", gs_packagekit_staged_ids_func);
 
 	/* we can only load this once per process */
 	plugin_loader = gs_plugin_loader_new (NULL, NULL);
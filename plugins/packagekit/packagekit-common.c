@@ -583,3 +583,101 @@ gs_plugin_packagekit_set_packaging_format (GsPlugin *plugin, GsApp *app)
 
 	gs_app_set_metadata (app, "GnomeSoftware::PackagingBaseCssColor", "error_color");
 }
+
+gboolean
+gs_plugin_refine_app_needs_details (GsPluginRefineFlags  flags,
+                                    GsApp               *app)
+{
+	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE) > 0 &&
+	    gs_app_get_license (app) == NULL)
+		return TRUE;
+	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_URL) > 0 &&
+	    gs_app_get_url (app, AS_URL_KIND_HOMEPAGE) == NULL)
+		return TRUE;
+	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE) > 0 &&
+	    gs_app_get_size_installed (app, NULL) != GS_SIZE_TYPE_VALID)
+		return TRUE;
+	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE) > 0 &&
+	    gs_app_get_size_download (app, NULL) != GS_SIZE_TYPE_VALID)
+		return TRUE;
+	return FALSE;
+}
+
+gboolean
+gs_plugin_refine_requires_update_details (GsApp *app, GsPluginRefineFlags flags)
+{
+	const gchar *tmp;
+	tmp = gs_app_get_update_details_markup (app);
+	if (tmp != NULL)
+		return FALSE;
+	return (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS) > 0;
+}
+
+/* Moves the apps of @unresolved_apps which have a package ID by now out of
+ * it, adding those which still need their update details to
+ * @update_details_list and those which still need their details to
+ * @details_list. Apps still without a package ID are left in place. */
+void
+gs_plugin_packagekit_take_resolved_apps (GHashTable          *unresolved_apps,
+                                         GsPluginRefineFlags  flags,
+                                         GsAppList           *update_details_list,
+                                         GsAppList           *details_list)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	g_hash_table_iter_init (&iter, unresolved_apps);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		GsApp *app = GS_APP (key);
+
+		if (gs_app_get_source_id_default (app) == NULL)
+			continue;
+
+		if ((gs_app_get_state (app) == GS_APP_STATE_UPDATABLE ||
+		     gs_app_get_state (app) == GS_APP_STATE_UNKNOWN) &&
+		    gs_plugin_refine_requires_update_details (app, flags))
+			gs_app_list_add (update_details_list, app);
+		if (gs_plugin_refine_app_needs_details (flags, app))
+			gs_app_list_add (details_list, app);
+
+		g_hash_table_iter_remove (&iter);
+	}
+}
+
+/* Returns the package IDs checkpointed in @filename as staged, if any. */
+GHashTable *
+gs_plugin_packagekit_load_staged_ids (const gchar *filename)
+{
+	g_autoptr(GKeyFile) kf = g_key_file_new ();
+	GHashTable *staged_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_auto(GStrv) package_ids = NULL;
+
+	if (filename == NULL ||
+	    !g_key_file_load_from_file (kf, filename, G_KEY_FILE_NONE, NULL))
+		return staged_ids;
+
+	package_ids = g_key_file_get_string_list (kf, "Staged", "PackageIds", NULL, NULL);
+	for (guint i = 0; package_ids != NULL && package_ids[i] != NULL; i++)
+		g_hash_table_add (staged_ids, g_steal_pointer (&package_ids[i]));
+
+	return staged_ids;
+}
+
+/* Checkpoints @staged_ids to @filename; does nothing if it is %NULL. */
+void
+gs_plugin_packagekit_save_staged_ids (const gchar *filename,
+                                      GHashTable  *staged_ids)
+{
+	g_autoptr(GKeyFile) kf = g_key_file_new ();
+	g_autofree const gchar **package_ids = NULL;
+	guint n_package_ids;
+	g_autoptr(GError) error_local = NULL;
+
+	if (filename == NULL)
+		return;
+
+	package_ids = (const gchar **) g_hash_table_get_keys_as_array (staged_ids, &n_package_ids);
+	g_key_file_set_string_list (kf, "Staged", "PackageIds", package_ids, n_package_ids);
+	if (!g_key_file_save_to_file (kf, filename, &error_local))
+		g_debug ("failed to save %s: %s", filename, error_local->message);
+}
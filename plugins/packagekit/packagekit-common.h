@@ -37,5 +37,16 @@ void		gs_plugin_packagekit_refine_details_app		(GsPlugin *plugin,
 								 GsApp *app);
 void		gs_plugin_packagekit_set_packaging_format	(GsPlugin *plugin,
 								 GsApp *app);
+gboolean	gs_plugin_refine_app_needs_details		(GsPluginRefineFlags flags,
+								 GsApp *app);
+gboolean	gs_plugin_refine_requires_update_details	(GsApp *app,
+								 GsPluginRefineFlags flags);
+void		gs_plugin_packagekit_take_resolved_apps		(GHashTable *unresolved_apps,
+								 GsPluginRefineFlags flags,
+								 GsAppList *update_details_list,
+								 GsAppList *details_list);
+GHashTable *	gs_plugin_packagekit_load_staged_ids		(const gchar *filename);
+void		gs_plugin_packagekit_save_staged_ids		(const gchar *filename,
+								 GHashTable *staged_ids);
 
 G_END_DECLS
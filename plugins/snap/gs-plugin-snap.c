@@ -15,6 +15,8 @@
 #include <gnome-software.h>
 
 #include "gs-plugin-snap.h"
+#include "gs-snap-icons.h"
+#include "gs-snap-store-cache.h"
 
 /*
  * SECTION:
@@ -34,32 +36,13 @@ struct _GsPluginSnap {
 	gchar			*store_hostname;
 	SnapdSystemConfinement	 system_confinement;
 
-	GMutex			 store_snaps_lock;
-	GHashTable		*store_snaps;
+	GsSnapStoreCache	*store_cache;  /* (owned) */
 };
 
 G_DEFINE_TYPE (GsPluginSnap, gs_plugin_snap, GS_TYPE_PLUGIN)
 
-typedef struct {
-	SnapdSnap *snap;
-	gboolean full_details;
-} CacheEntry;
-
-static CacheEntry *
-cache_entry_new (SnapdSnap *snap, gboolean full_details)
-{
-	CacheEntry *entry = g_slice_new (CacheEntry);
-	entry->snap = g_object_ref (snap);
-	entry->full_details = full_details;
-	return entry;
-}
-
-static void
-cache_entry_free (CacheEntry *entry)
-{
-	g_object_unref (entry->snap);
-	g_slice_free (CacheEntry, entry);
-}
+/* at most this many store snaps are remembered across sessions */
+#define STORE_CACHE_MAX_SNAPS 500
 
 static SnapdAuthData *
 get_auth_data (GsPluginSnap *self)
@@ -134,8 +117,7 @@ gs_plugin_snap_init (GsPluginSnap *self)
 {
 	g_autoptr(SnapdClient) client = NULL;
 	g_autoptr (GError) error = NULL;
-
-	g_mutex_init (&self->store_snaps_lock);
+	g_autofree gchar *store_cache_fn = NULL;
 
 	client = get_client (self, FALSE, &error);
 	if (client == NULL) {
@@ -143,8 +125,14 @@ gs_plugin_snap_init (GsPluginSnap *self)
 		return;
 	}
 
-	self->store_snaps = g_hash_table_new_full (g_str_hash, g_str_equal,
-						   g_free, (GDestroyNotify) cache_entry_free);
+	/* store snaps are kept across sessions, and refreshed once expired */
+	store_cache_fn = gs_utils_get_cache_filename ("snap", "store.json",
+						      GS_UTILS_CACHE_FLAG_WRITEABLE |
+						      GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+						      &error);
+	if (store_cache_fn == NULL)
+		g_debug ("not saving store snaps: %s", error->message);
+	self->store_cache = gs_snap_store_cache_new (store_cache_fn, STORE_CACHE_MAX_SNAPS);
 
 	gs_plugin_add_rule (GS_PLUGIN (self), GS_PLUGIN_RULE_BETTER_THAN, "packagekit");
 	gs_plugin_add_rule (GS_PLUGIN (self), GS_PLUGIN_RULE_RUN_BEFORE, "icons");
@@ -319,30 +307,11 @@ gs_plugin_snap_setup_finish (GsPlugin      *plugin,
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
-static SnapdSnap *
-store_snap_cache_lookup (GsPluginSnap *self,
-                         const gchar  *name,
-                         gboolean      need_details)
-{
-	CacheEntry *entry;
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->store_snaps_lock);
-
-	entry = g_hash_table_lookup (self->store_snaps, name);
-	if (entry == NULL)
-		return NULL;
-
-	if (need_details && !entry->full_details)
-		return NULL;
-
-	return g_object_ref (entry->snap);
-}
-
 static void
 store_snap_cache_update (GsPluginSnap *self,
                          GPtrArray    *snaps,
                          gboolean      full_details)
 {
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->store_snaps_lock);
 	guint i;
 
 	for (i = 0; i < snaps->len; i++) {
@@ -352,8 +321,121 @@ store_snap_cache_update (GsPluginSnap *self,
 			snapd_snap_get_publisher_display_name (snap),
 			snapd_snap_get_version (snap),
 			snapd_snap_get_revision (snap));
-		g_hash_table_insert (self->store_snaps, g_strdup (snapd_snap_get_name (snap)), cache_entry_new (snap, full_details));
 	}
+
+	gs_snap_store_cache_add_snaps (self->store_cache, snaps, full_details);
+}
+
+static void
+revalidate_store_snap_cb (GObject      *source_object,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+	SnapdClient *client = SNAPD_CLIENT (source_object);
+	g_autoptr(GsPluginSnap) self = GS_PLUGIN_SNAP (user_data);
+	g_autoptr(GPtrArray) snaps = NULL;
+	g_autoptr(GError) local_error = NULL;
+
+	snaps = snapd_client_find_section_finish (client, result, NULL, &local_error);
+	if (snaps == NULL) {
+		g_debug ("Failed to refresh cached snap: %s", local_error->message);
+		return;
+	}
+
+	store_snap_cache_update (self, snaps, TRUE);
+}
+
+/* Gets a store snap from the cache. If it has expired it is still returned,
+ * and fetched again in the background for next time. */
+static SnapdSnap *
+store_snap_cache_lookup (GsPluginSnap *self,
+                         SnapdClient  *client,
+                         const gchar  *name,
+                         gboolean      need_details)
+{
+	g_autoptr(SnapdSnap) snap = NULL;
+	gboolean revalidate = FALSE;
+
+	snap = gs_snap_store_cache_lookup_snap (self->store_cache, name, need_details, &revalidate);
+	if (revalidate) {
+		g_debug ("Refreshing expired cached snap '%s'", name);
+		snapd_client_find_section_async (client,
+						 SNAPD_FIND_FLAGS_SCOPE_WIDE | SNAPD_FIND_FLAGS_MATCH_NAME,
+						 NULL, name,
+						 NULL,
+						 revalidate_store_snap_cb, g_object_ref (self));
+	}
+
+	return g_steal_pointer (&snap);
+}
+
+typedef struct {
+	GsPluginSnap *self;  /* (owned) */
+	GTask *task;  /* (owned) (nullable); of the list_apps operation, if any */
+	gchar *section;  /* (owned) */
+} SectionData;
+
+static SectionData *
+section_data_new (GsPluginSnap *self,
+                  GTask        *task,
+                  const gchar  *section)
+{
+	SectionData *data = g_new0 (SectionData, 1);
+	data->self = g_object_ref (self);
+	data->task = (task != NULL) ? g_object_ref (task) : NULL;
+	data->section = g_strdup (section);
+	return data;
+}
+
+static void
+section_data_free (SectionData *data)
+{
+	g_free (data->section);
+	g_clear_object (&data->task);
+	g_object_unref (data->self);
+	g_free (data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SectionData, section_data_free)
+
+static void
+revalidate_section_cb (GObject      *source_object,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+	SnapdClient *client = SNAPD_CLIENT (source_object);
+	g_autoptr(SectionData) data = user_data;
+	g_autoptr(GPtrArray) snaps = NULL;
+	g_autoptr(GError) local_error = NULL;
+
+	snaps = snapd_client_find_section_finish (client, result, NULL, &local_error);
+	if (snaps == NULL) {
+		g_debug ("Failed to refresh cached section '%s': %s", data->section, local_error->message);
+		return;
+	}
+
+	gs_snap_store_cache_set_section (data->self->store_cache, data->section, snaps);
+}
+
+/* Gets the snaps listed in a store section from the cache. If the listing
+ * has expired it is still returned, and fetched again in the background. */
+static GPtrArray *
+store_section_cache_lookup (GsPluginSnap *self,
+                            SnapdClient  *client,
+                            const gchar  *section)
+{
+	g_autoptr(GPtrArray) snaps = NULL;
+	gboolean revalidate = FALSE;
+
+	snaps = gs_snap_store_cache_lookup_section (self->store_cache, section, &revalidate);
+	if (revalidate) {
+		g_debug ("Refreshing expired cached section '%s'", section);
+		snapd_client_find_section_async (client, SNAPD_FIND_FLAGS_SCOPE_WIDE, section, NULL,
+						 NULL,
+						 revalidate_section_cb, section_data_new (self, NULL, section));
+	}
+
+	return g_steal_pointer (&snaps);
 }
 
 static GPtrArray *
@@ -495,21 +577,11 @@ gs_plugin_snap_dispose (GObject *object)
 
 	g_clear_pointer (&self->store_name, g_free);
 	g_clear_pointer (&self->store_hostname, g_free);
-	g_clear_pointer (&self->store_snaps, g_hash_table_unref);
+	g_clear_object (&self->store_cache);
 
 	G_OBJECT_CLASS (gs_plugin_snap_parent_class)->dispose (object);
 }
 
-static void
-gs_plugin_snap_finalize (GObject *object)
-{
-	GsPluginSnap *self = GS_PLUGIN_SNAP (object);
-
-	g_mutex_clear (&self->store_snaps_lock);
-
-	G_OBJECT_CLASS (gs_plugin_snap_parent_class)->finalize (object);
-}
-
 static gboolean
 is_banner_image (const gchar *filename)
 {
@@ -549,6 +621,20 @@ category_build_full_path (GsCategory *category)
 	return g_string_free (g_steal_pointer (&id), FALSE);
 }
 
+static void
+add_snaps_to_list (GsPluginSnap *self,
+                   GPtrArray    *snaps,
+                   GsAppList    *list)
+{
+	for (guint i = 0; i < snaps->len; i++) {
+		SnapdSnap *snap = g_ptr_array_index (snaps, i);
+		g_autoptr(GsApp) app = NULL;
+
+		app = snap_to_app (self, snap, NULL);
+		gs_app_list_add (list, app);
+	}
+}
+
 typedef struct {
 	/* In-progress data. */
 	guint n_pending_ops;
@@ -584,6 +670,9 @@ static void list_alternative_apps_nonsnap_get_store_snap_cb (GObject      *sourc
 static void list_apps_cb (GObject      *source_object,
                           GAsyncResult *result,
                           gpointer      user_data);
+static void list_apps_section_cb (GObject      *source_object,
+                                  GAsyncResult *result,
+                                  gpointer      user_data);
 static void finish_list_apps_op (GTask  *task,
                                  GError *error);
 
@@ -732,15 +821,23 @@ gs_plugin_snap_list_apps_async (GsPlugin              *plugin,
 		}
 	}
 
-	/* Start a query for each of the sections we’re interested in, keeping a
-	 * counter of pending operations which is initialised to 1 until all
-	 * the operations are started. */
+	/* Start a query for each of the sections we’re interested in and not
+	 * cached, keeping a counter of pending operations which is initialised
+	 * to 1 until all the operations are started. */
 	data->n_pending_ops = 1;
 
 	for (gsize i = 0; sections != NULL && sections[i] != NULL; i++) {
+		g_autoptr(GPtrArray) snaps = store_section_cache_lookup (self, client, sections[i]);
+
+		if (snaps != NULL) {
+			add_snaps_to_list (self, snaps, data->results_list);
+			continue;
+		}
+
 		data->n_pending_ops++;
 		snapd_client_find_section_async (client, SNAPD_FIND_FLAGS_SCOPE_WIDE, sections[i], NULL,
-						 cancellable, list_apps_cb, g_object_ref (task));
+						 cancellable, list_apps_section_cb,
+						 section_data_new (self, task, sections[i]));
 	}
 
 	finish_list_apps_op (task, NULL);
@@ -863,14 +960,31 @@ list_apps_cb (GObject      *source_object,
 
 	if (snaps != NULL) {
 		store_snap_cache_update (self, snaps, FALSE);
+		add_snaps_to_list (self, snaps, data->results_list);
+	} else {
+		snapd_error_convert (&local_error);
+	}
 
-		for (guint i = 0; i < snaps->len; i++) {
-			SnapdSnap *snap = g_ptr_array_index (snaps, i);
-			g_autoptr(GsApp) app = NULL;
+	finish_list_apps_op (task, g_steal_pointer (&local_error));
+}
 
-			app = snap_to_app (self, snap, NULL);
-			gs_app_list_add (data->results_list, app);
-		}
+static void
+list_apps_section_cb (GObject      *source_object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+	SnapdClient *client = SNAPD_CLIENT (source_object);
+	g_autoptr(SectionData) section_data = user_data;
+	GTask *task = section_data->task;
+	ListAppsData *data = g_task_get_task_data (task);
+	g_autoptr(GPtrArray) snaps = NULL;
+	g_autoptr(GError) local_error = NULL;
+
+	snaps = snapd_client_find_section_finish (client, result, NULL, &local_error);
+
+	if (snaps != NULL) {
+		gs_snap_store_cache_set_section (section_data->self->store_cache, section_data->section, snaps);
+		add_snaps_to_list (section_data->self, snaps, data->results_list);
 	} else {
 		snapd_error_convert (&local_error);
 	}
@@ -927,9 +1041,9 @@ get_store_snap (GsPluginSnap  *self,
 	g_autoptr(GPtrArray) snaps = NULL;
 
 	/* use cached version if available */
-	snap = store_snap_cache_lookup (self, name, need_details);
+	snap = store_snap_cache_lookup (self, client, name, need_details);
 	if (snap != NULL)
-		return g_object_ref (snap);
+		return snap;
 
 	snaps = find_snaps (self, client,
 			    SNAPD_FIND_FLAGS_SCOPE_WIDE | SNAPD_FIND_FLAGS_MATCH_NAME,
@@ -960,9 +1074,9 @@ get_store_snap_async (GsPluginSnap        *self,
 	g_task_set_source_tag (task, get_store_snap_async);
 
 	/* use cached version if available */
-	snap = store_snap_cache_lookup (self, name, need_details);
+	snap = store_snap_cache_lookup (self, client, name, need_details);
 	if (snap != NULL) {
-		g_task_return_pointer (task, g_object_ref (snap), (GDestroyNotify) g_object_unref);
+		g_task_return_pointer (task, snap, (GDestroyNotify) g_object_unref);
 		return;
 	}
 
@@ -1134,28 +1248,6 @@ get_primary_app (SnapdSnap *snap)
 	return primary_app;
 }
 
-static void
-refine_icons (GsApp        *app,
-              SnapdSnap    *snap)
-{
-	GPtrArray *media;
-	guint i;
-
-	media = snapd_snap_get_media (snap);
-	for (i = 0; i < media->len; i++) {
-		SnapdMedia *m = media->pdata[i];
-		g_autoptr(GIcon) icon = NULL;
-
-		if (g_strcmp0 (snapd_media_get_media_type (m), "icon") != 0)
-			continue;
-
-		icon = gs_remote_icon_new (snapd_media_get_url (m));
-		gs_icon_set_width (icon, snapd_media_get_width (m));
-		gs_icon_set_height (icon, snapd_media_get_height (m));
-		gs_app_add_icon (app, icon);
-	}
-}
-
 static void serialize_node (SnapdMarkdownNode *node, GString *text, guint indentation);
 
 static gboolean
@@ -1335,6 +1427,9 @@ find_snap_in_array (GPtrArray   *snaps,
 static void get_snaps_cb (GObject      *object,
                           GAsyncResult *result,
                           gpointer      user_data);
+static void refine_local_icons_cb (GObject      *object,
+                                   GAsyncResult *result,
+                                   gpointer      user_data);
 
 static void
 gs_plugin_snap_refine_async (GsPlugin            *plugin,
@@ -1387,10 +1482,6 @@ gs_plugin_snap_refine_async (GsPlugin            *plugin,
 	snapd_client_get_snaps_async (client, SNAPD_GET_SNAPS_FLAGS_NONE, (gchar **) snap_names->pdata, cancellable, get_snaps_cb, g_steal_pointer (&task));
 }
 
-static void get_icon_cb (GObject      *object,
-                         GAsyncResult *result,
-                         gpointer      user_data);
-
 static void
 get_snaps_cb (GObject      *object,
               GAsyncResult *result,
@@ -1404,6 +1495,8 @@ get_snaps_cb (GObject      *object,
 	GsAppList *list = data->list;
 	GsPluginRefineFlags flags = data->flags;
 	g_autoptr(GPtrArray) local_snaps = NULL;
+	g_autoptr(GHashTable) remote_icons = NULL;
+	g_autoptr(GHashTable) local_icon_apps = NULL;
 	g_autoptr(GError) local_error = NULL;
 
 	local_snaps = snapd_client_get_snaps_finish (client, result, &local_error);
@@ -1412,6 +1505,9 @@ get_snaps_cb (GObject      *object,
 		return;
 	}
 
+	remote_icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+	local_icon_apps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
+
 	for (guint i = 0; i < gs_app_list_length (list); i++) {
 		GsApp *app = gs_app_list_index (list, i);
 		const gchar *snap_name, *name, *website, *contact, *version;
@@ -1431,7 +1527,7 @@ get_snaps_cb (GObject      *object,
 
 		/* get information from locally installed snaps and information we already have */
 		local_snap = find_snap_in_array (local_snaps, snap_name);
-		store_snap = store_snap_cache_lookup (self, snap_name, FALSE);
+		store_snap = store_snap_cache_lookup (self, client, snap_name, FALSE);
 		if (store_snap != NULL)
 			store_channel = expand_channel_name (snapd_snap_get_channel (store_snap));
 
@@ -1573,9 +1669,21 @@ get_snaps_cb (GObject      *object,
 				refine_screenshots (app, store_snap);
 		}
 
-		/* load icon if requested */
-		if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON)
-			refine_icons (app, snap);
+		/* load icon if requested; snapd only serves those of installed
+		 * snaps, which are fetched below */
+		if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON) {
+			gs_snap_icons_refine_remote (app, snap, remote_icons);
+
+			if (local_snap != NULL) {
+				GPtrArray *apps = g_hash_table_lookup (local_icon_apps, snap_name);
+
+				if (apps == NULL) {
+					apps = g_ptr_array_new_with_free_func (g_object_unref);
+					g_hash_table_insert (local_icon_apps, g_strdup (snap_name), apps);
+				}
+				g_ptr_array_add (apps, g_object_ref (app));
+			}
+		}
 
 		if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE_DATA) != 0 &&
 		    gs_app_is_installed (app) &&
@@ -1592,43 +1700,27 @@ get_snaps_cb (GObject      *object,
 		}
 	}
 
-	/* Icons require async calls to get */
-	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON && gs_app_list_length (list) > 0) {
-		GsApp *app = gs_app_list_index (list, 0);
-		snapd_client_get_icon_async (client, gs_app_get_metadata_item (app, "snap::name"), cancellable, get_icon_cb, g_steal_pointer (&task));
-	} else {
+	/* Icons of installed snaps require async calls to get */
+	if (g_hash_table_size (local_icon_apps) > 0)
+		gs_snap_icons_refine_local_async (client, g_steal_pointer (&local_icon_apps),
+						  cancellable, refine_local_icons_cb,
+						  g_steal_pointer (&task));
+	else
 		g_task_return_boolean (task, TRUE);
-	}
 }
 
 static void
-get_icon_cb (GObject      *object,
-             GAsyncResult *result,
-             gpointer      user_data)
+refine_local_icons_cb (GObject      *object,
+                       GAsyncResult *result,
+                       gpointer      user_data)
 {
-	SnapdClient *client = SNAPD_CLIENT (object);
 	g_autoptr(GTask) task = g_steal_pointer (&user_data);
-	GCancellable *cancellable = g_task_get_cancellable (task);
-	GsPluginRefineData *data = g_task_get_task_data (task);
-	GsApp *app;
-	g_autoptr(SnapdIcon) snap_icon = NULL;
 	g_autoptr(GError) local_error = NULL;
 
-	app = gs_app_list_index (data->list, 0);
-	snap_icon = snapd_client_get_icon_finish (client, result, &local_error);
-	if (snap_icon != NULL) {
-		g_autoptr(GIcon) icon = g_bytes_icon_new (snapd_icon_get_data (snap_icon));
-		gs_app_add_icon (app, icon);
-	}
-
-	/* Get next icon in the list or done */
-	gs_app_list_remove (data->list, app);
-	if (gs_app_list_length (data->list) > 0) {
-		app = gs_app_list_index (data->list, 0);
-		snapd_client_get_icon_async (client, gs_app_get_metadata_item (app, "snap::name"), cancellable, get_icon_cb, g_steal_pointer (&task));
-	} else {
+	if (gs_snap_icons_refine_local_finish (result, &local_error))
 		g_task_return_boolean (task, TRUE);
-	}
+	else
+		g_task_return_error (task, g_steal_pointer (&local_error));
 }
 
 static gboolean
@@ -1907,7 +1999,6 @@ gs_plugin_snap_class_init (GsPluginSnapClass *klass)
 	GsPluginClass *plugin_class = GS_PLUGIN_CLASS (klass);
 
 	object_class->dispose = gs_plugin_snap_dispose;
-	object_class->finalize = gs_plugin_snap_finalize;
 
 	plugin_class->setup_async = gs_plugin_snap_setup_async;
 	plugin_class->setup_finish = gs_plugin_snap_setup_finish;
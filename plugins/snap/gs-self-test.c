@@ -12,10 +12,18 @@
 
 #include "gnome-software-private.h"
 
+#include "gs-snap-icons.h"
+#include "gs-snap-store-cache.h"
 #include "gs-test.h"
 
 static gboolean snap_installed = FALSE;
 
+/* icon requests which have not completed yet, and how many were in flight
+ * at most; @icon_requests counts the requests for each snap name */
+static GQueue icon_fetches = G_QUEUE_INIT;
+static guint icon_fetches_peak = 0;
+static GHashTable *icon_requests = NULL;
+
 SnapdAuthData *
 snapd_login_sync (const gchar *username, const gchar *password, const gchar *otp,
 		  GCancellable *cancellable, GError **error)
@@ -167,6 +175,42 @@ snapd_client_get_icon_sync (SnapdClient *client,
 			     NULL);
 }
 
+static gboolean
+complete_icon_fetch_cb (gpointer user_data)
+{
+	g_autoptr(GTask) task = g_queue_pop_head (&icon_fetches);
+	SnapdClient *client = g_task_get_source_object (task);
+	const gchar *name = g_task_get_task_data (task);
+
+	g_task_return_pointer (task, snapd_client_get_icon_sync (client, name, NULL, NULL), g_object_unref);
+	return G_SOURCE_REMOVE;
+}
+
+void
+snapd_client_get_icon_async (SnapdClient *client,
+			     const gchar *name,
+			     GCancellable *cancellable,
+			     GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task = g_task_new (client, cancellable, callback, user_data);
+
+	g_task_set_task_data (task, g_strdup (name), g_free);
+	g_queue_push_tail (&icon_fetches, task);
+	icon_fetches_peak = MAX (icon_fetches_peak, g_queue_get_length (&icon_fetches));
+	if (icon_requests != NULL)
+		g_hash_table_insert (icon_requests, g_strdup (name),
+				     GUINT_TO_POINTER (GPOINTER_TO_UINT (g_hash_table_lookup (icon_requests, name)) + 1));
+
+	/* complete the requests one at a time */
+	g_idle_add (complete_icon_fetch_cb, NULL);
+}
+
+SnapdIcon *
+snapd_client_get_icon_finish (SnapdClient *client, GAsyncResult *result, GError **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 gboolean
 snapd_client_get_connections_sync (SnapdClient *client,
 				   GPtrArray **established, GPtrArray **undesired,
@@ -251,6 +295,176 @@ snapd_client_remove_sync (SnapdClient *client,
 	return TRUE;
 }
 
+static void
+gs_plugins_snap_store_cache_func (void)
+{
+	g_autoptr(GsSnapStoreCache) cache = NULL;
+	g_autoptr(GPtrArray) snaps = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GPtrArray) cached = NULL;
+	g_autoptr(SnapdSnap) snap = NULL;
+	g_autofree gchar *fn = NULL;
+	gboolean revalidate = TRUE;
+	GPtrArray *media;
+
+	g_assert_cmpint (g_mkdir_with_parents (g_get_user_cache_dir (), 0755), ==, 0);
+	fn = g_build_filename (g_get_user_cache_dir (), "store.json", NULL);
+	cache = gs_snap_store_cache_new (fn, 2);
+
+	/* nothing cached yet */
+	cached = gs_snap_store_cache_lookup_section (cache, "featured", &revalidate);
+	g_assert_null (cached);
+	g_assert_false (revalidate);
+
+	g_ptr_array_add (snaps, make_snap ("snap", SNAPD_SNAP_STATUS_AVAILABLE));
+	gs_snap_store_cache_set_section (cache, "featured", snaps);
+
+	/* fresh listings need no revalidation, but lack the full details */
+	cached = gs_snap_store_cache_lookup_section (cache, "featured", &revalidate);
+	g_assert_nonnull (cached);
+	g_assert_cmpuint (cached->len, ==, 1);
+	g_assert_false (revalidate);
+	g_clear_pointer (&cached, g_ptr_array_unref);
+	snap = gs_snap_store_cache_lookup_snap (cache, "snap", TRUE, NULL);
+	g_assert_null (snap);
+	g_assert_cmpuint (gs_snap_store_cache_get_hits (cache), ==, 1);
+	g_assert_cmpuint (gs_snap_store_cache_get_misses (cache), ==, 2);
+
+	/* kept for the next session */
+	g_clear_object (&cache);
+	cache = gs_snap_store_cache_new (fn, 2);
+	snap = gs_snap_store_cache_lookup_snap (cache, "snap", FALSE, &revalidate);
+	g_assert_nonnull (snap);
+	g_assert_false (revalidate);
+	g_assert_cmpstr (snapd_snap_get_summary (snap), ==, "SUMMARY");
+	g_assert_cmpint (snapd_snap_get_status (snap), ==, SNAPD_SNAP_STATUS_AVAILABLE);
+	g_assert_cmpint (snapd_snap_get_download_size (snap), ==, 500);
+	media = snapd_snap_get_media (snap);
+	g_assert_cmpuint (media->len, ==, 2);
+	g_assert_cmpstr (snapd_media_get_url (g_ptr_array_index (media, 1)), ==, "http://example.com/screenshot2.jpg");
+	g_assert_cmpuint (snapd_media_get_width (g_ptr_array_index (media, 1)), ==, 1024);
+	g_clear_object (&snap);
+
+	/* the least recently used snaps are evicted, along with the listings
+	 * they were in */
+	g_ptr_array_set_size (snaps, 0);
+	g_ptr_array_add (snaps, make_snap ("snap2", SNAPD_SNAP_STATUS_AVAILABLE));
+	g_ptr_array_add (snaps, make_snap ("snap3", SNAPD_SNAP_STATUS_AVAILABLE));
+	gs_snap_store_cache_add_snaps (cache, snaps, TRUE);
+	snap = gs_snap_store_cache_lookup_snap (cache, "snap", FALSE, NULL);
+	g_assert_null (snap);
+	snap = gs_snap_store_cache_lookup_snap (cache, "snap3", TRUE, NULL);
+	g_assert_nonnull (snap);
+	cached = gs_snap_store_cache_lookup_section (cache, "featured", NULL);
+	g_assert_null (cached);
+}
+
+static SnapdSnap *
+make_snap_with_icon (const gchar *name, const gchar *icon_url)
+{
+	g_autoptr(GPtrArray) media = g_ptr_array_new_with_free_func (g_object_unref);
+
+	g_ptr_array_add (media, g_object_new (SNAPD_TYPE_MEDIA,
+					      "type", "icon",
+					      "url", icon_url,
+					      "width", 64,
+					      "height", 64,
+					      NULL));
+	return g_object_new (SNAPD_TYPE_SNAP,
+			     "name", name,
+			     "media", media,
+			     NULL);
+}
+
+static void
+refine_local_icons_cb (GObject *object, GAsyncResult *result, gpointer user_data)
+{
+	gboolean *done = user_data;
+	g_autoptr(GError) error = NULL;
+
+	g_assert_true (gs_snap_icons_refine_local_finish (result, &error));
+	g_assert_no_error (error);
+	*done = TRUE;
+}
+
+static void
+gs_plugins_snap_icons_func (void)
+{
+	g_autoptr(GHashTable) remote_icons = NULL;
+	g_autoptr(GHashTable) local_icon_apps = NULL;
+	g_autoptr(GPtrArray) apps = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(SnapdClient) client = NULL;
+	g_autoptr(GsApp) app1 = gs_app_new ("one");
+	g_autoptr(GsApp) app2 = gs_app_new ("two");
+	g_autoptr(GsApp) app3 = gs_app_new ("three");
+	g_autoptr(SnapdSnap) snap1 = make_snap_with_icon ("one", "http://example.com/icon.png");
+	g_autoptr(SnapdSnap) snap2 = make_snap_with_icon ("two", "http://example.com/icon.png");
+	g_autoptr(SnapdSnap) snap3 = make_snap_with_icon ("three", "http://example.com/other.png");
+	GHashTableIter iter;
+	gpointer value;
+	GIcon *icon;
+	gboolean done = FALSE;
+
+	/* snaps sharing an icon URL share the remote icon */
+	remote_icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+	gs_snap_icons_refine_remote (app1, snap1, remote_icons);
+	gs_snap_icons_refine_remote (app2, snap2, remote_icons);
+	gs_snap_icons_refine_remote (app3, snap3, remote_icons);
+	g_assert_cmpuint (g_hash_table_size (remote_icons), ==, 2);
+	g_assert_nonnull (gs_app_get_icons (app1));
+	g_assert_true (g_ptr_array_index (gs_app_get_icons (app1), 0) ==
+		       g_ptr_array_index (gs_app_get_icons (app2), 0));
+	g_assert_false (g_ptr_array_index (gs_app_get_icons (app1), 0) ==
+			g_ptr_array_index (gs_app_get_icons (app3), 0));
+
+	/* many more installed snaps than requests allowed at once, one of
+	 * them with two apps */
+	local_icon_apps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
+	for (guint i = 0; i < 3 * GS_SNAP_ICONS_MAX_FETCHES; i++) {
+		g_autofree gchar *snap_name = g_strdup_printf ("snap%u", i);
+		GPtrArray *snap_apps = g_ptr_array_new_with_free_func (g_object_unref);
+		GsApp *app = gs_app_new (snap_name);
+
+		g_ptr_array_add (snap_apps, g_object_ref (app));
+		g_ptr_array_add (apps, app);
+		if (i == 0) {
+			app = gs_app_new ("snap0-other");
+			g_ptr_array_add (snap_apps, g_object_ref (app));
+			g_ptr_array_add (apps, app);
+		}
+		g_hash_table_insert (local_icon_apps, g_steal_pointer (&snap_name), snap_apps);
+	}
+
+	icon_requests = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	icon_fetches_peak = 0;
+	client = g_object_new (SNAPD_TYPE_CLIENT, NULL);
+	gs_snap_icons_refine_local_async (client, g_steal_pointer (&local_icon_apps), NULL,
+					  refine_local_icons_cb, &done);
+	while (!done)
+		g_main_context_iteration (NULL, TRUE);
+
+	/* the requests were limited, and made once per snap */
+	g_assert_cmpuint (icon_fetches_peak, ==, GS_SNAP_ICONS_MAX_FETCHES);
+	g_assert_true (g_queue_is_empty (&icon_fetches));
+	g_assert_cmpuint (g_hash_table_size (icon_requests), ==, 3 * GS_SNAP_ICONS_MAX_FETCHES);
+	g_hash_table_iter_init (&iter, icon_requests);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		g_assert_cmpuint (GPOINTER_TO_UINT (value), ==, 1);
+	g_clear_pointer (&icon_requests, g_hash_table_unref);
+
+	/* every app got the icon saved in the cache, and both apps of the
+	 * same snap share it */
+	for (guint i = 0; i < apps->len; i++) {
+		GPtrArray *icons = gs_app_get_icons (g_ptr_array_index (apps, i));
+
+		g_assert_nonnull (icons);
+		g_assert_cmpuint (icons->len, ==, 1);
+		g_assert_true (G_IS_FILE_ICON (g_ptr_array_index (icons, 0)));
+		g_assert_cmpuint (gs_icon_get_width (g_ptr_array_index (icons, 0)), ==, 1);
+	}
+	icon = g_ptr_array_index (gs_app_get_icons (g_ptr_array_index (apps, 0)), 0);
+	g_assert_true (icon == g_ptr_array_index (gs_app_get_icons (g_ptr_array_index (apps, 1)), 0));
+}
+
 static void
 gs_plugins_snap_test_func (GsPluginLoader *plugin_loader)
 {
@@ -388,6 +602,8 @@ main (int argc, char **argv)
 	g_assert (ret);
 
 	/* plugin tests go here */
+	g_test_add_func ("/gnome-software/plugins/snap/store-cache", gs_plugins_snap_store_cache_func);
+	g_test_add_func ("/gnome-software/plugins/snap/icons", gs_plugins_snap_icons_func);
 	g_test_add_data_func ("/gnome-software/plugins/snap/test",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_snap_test_func);
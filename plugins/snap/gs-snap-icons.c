@@ -0,0 +1,266 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/* Notes:
+ *
+ * Snaps in the store only have icon URLs, which become #GsRemoteIcons; snaps
+ * sharing a URL share the icon. Installed snaps have their icon served by
+ * snapd, one request per snap, so those requests are made several at once,
+ * but never more than %GS_SNAP_ICONS_MAX_FETCHES, and only once per snap
+ * however many apps it has.
+ *
+ * Icons from snapd are saved in the icon cache, named after their contents
+ * so that identical icons are only stored once, and handed out as
+ * #GFileIcons. Saving them, and reading their size back, happens in a thread
+ * so the main context is never blocked on the disk.
+ */
+
+#include "config.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "gs-snap-icons.h"
+
+/* @remote_icons maps URLs to the icons already created for them, so that
+ * snaps sharing an icon share the #GsRemoteIcon too. */
+void
+gs_snap_icons_refine_remote (GsApp      *app,
+			     SnapdSnap  *snap,
+			     GHashTable *remote_icons)
+{
+	GPtrArray *media;
+	guint i;
+
+	media = snapd_snap_get_media (snap);
+	for (i = 0; media != NULL && i < media->len; i++) {
+		SnapdMedia *m = media->pdata[i];
+		GIcon *icon;
+
+		if (g_strcmp0 (snapd_media_get_media_type (m), "icon") != 0)
+			continue;
+
+		icon = g_hash_table_lookup (remote_icons, snapd_media_get_url (m));
+		if (icon == NULL) {
+			icon = gs_remote_icon_new (snapd_media_get_url (m));
+			gs_icon_set_width (icon, snapd_media_get_width (m));
+			gs_icon_set_height (icon, snapd_media_get_height (m));
+			g_hash_table_insert (remote_icons, g_strdup (snapd_media_get_url (m)), icon);
+		}
+		gs_app_add_icon (app, icon);
+	}
+}
+
+/* Saves the icon of an installed snap in the icon cache and returns a
+ * #GFileIcon for it. Falls back to an in-memory icon if that fails.
+ *
+ * Run in a worker thread. */
+static GIcon *
+snap_icon_to_icon (SnapdIcon *snap_icon)
+{
+	GBytes *data = snapd_icon_get_data (snap_icon);
+	const gchar *mime_type = snapd_icon_get_mime_type (snap_icon);
+	const gchar *extension = "png";
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *basename = NULL;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(GFile) file = NULL;
+	GIcon *icon;
+	gint width = 0, height = 0;
+	g_autoptr(GError) local_error = NULL;
+
+	if (g_strcmp0 (mime_type, "image/svg+xml") == 0)
+		extension = "svg";
+	else if (g_strcmp0 (mime_type, "image/jpeg") == 0)
+		extension = "jpg";
+
+	checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, data);
+	basename = g_strdup_printf ("snap-%s.%s", checksum, extension);
+	filename = gs_utils_get_cache_filename ("icons", basename,
+						GS_UTILS_CACHE_FLAG_WRITEABLE |
+						GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+						&local_error);
+	if (filename != NULL &&
+	    !g_file_test (filename, G_FILE_TEST_EXISTS) &&
+	    !g_file_set_contents (filename, g_bytes_get_data (data, NULL), g_bytes_get_size (data), &local_error))
+		g_clear_pointer (&filename, g_free);
+	if (filename == NULL) {
+		g_debug ("Failed to cache snap icon: %s", local_error->message);
+		return g_bytes_icon_new (data);
+	}
+
+	file = g_file_new_for_path (filename);
+	icon = g_file_icon_new (file);
+
+	/* only reads the header */
+	if (gdk_pixbuf_get_file_info (filename, &width, &height) != NULL) {
+		gs_icon_set_width (icon, width);
+		gs_icon_set_height (icon, height);
+	}
+
+	return icon;
+}
+
+typedef struct {
+	SnapdClient *client;  /* (owned) */
+	GHashTable *apps;  /* (owned) (element-type utf8 GPtrArray<GsApp>); by snap name */
+	const gchar **snap_names;  /* (owned) (array length=n_snap_names); keys of @apps */
+	guint n_snap_names;
+	guint next;
+	guint n_fetching;
+} RefineIconsData;
+
+typedef struct {
+	GTask *task;  /* (owned); of the whole refine */
+	const gchar *snap_name;  /* (unowned); owned by the #RefineIconsData */
+} IconFetchData;
+
+static void
+refine_icons_data_free (RefineIconsData *data)
+{
+	g_free (data->snap_names);
+	g_hash_table_unref (data->apps);
+	g_object_unref (data->client);
+	g_free (data);
+}
+
+static void
+icon_fetch_data_free (IconFetchData *fetch)
+{
+	g_object_unref (fetch->task);
+	g_free (fetch);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IconFetchData, icon_fetch_data_free)
+
+static void get_icon_cb (GObject      *object,
+                         GAsyncResult *result,
+                         gpointer      user_data);
+static void save_icon_cb (GObject      *object,
+                          GAsyncResult *result,
+                          gpointer      user_data);
+
+/* Keeps up to %GS_SNAP_ICONS_MAX_FETCHES requests going, and completes
+ * @task once they are all done. */
+static void
+refine_icons_fetch_next (GTask *task)
+{
+	RefineIconsData *data = g_task_get_task_data (task);
+	GCancellable *cancellable = g_task_get_cancellable (task);
+
+	while (data->n_fetching < GS_SNAP_ICONS_MAX_FETCHES && data->next < data->n_snap_names) {
+		IconFetchData *fetch = g_new0 (IconFetchData, 1);
+
+		fetch->task = g_object_ref (task);
+		fetch->snap_name = data->snap_names[data->next++];
+		data->n_fetching++;
+		snapd_client_get_icon_async (data->client, fetch->snap_name, cancellable, get_icon_cb, fetch);
+	}
+
+	if (data->n_fetching == 0)
+		g_task_return_boolean (task, TRUE);
+}
+
+/* The request for @fetch is over, successful or not; start the next one. */
+static void
+refine_icons_fetch_done (IconFetchData *fetch)
+{
+	RefineIconsData *data = g_task_get_task_data (fetch->task);
+
+	data->n_fetching--;
+	refine_icons_fetch_next (fetch->task);
+}
+
+/* Run in a worker thread. */
+static void
+save_icon_thread_cb (GTask        *task,
+		     gpointer      source_object,
+		     gpointer      task_data,
+		     GCancellable *cancellable)
+{
+	g_task_return_pointer (task, snap_icon_to_icon (SNAPD_ICON (task_data)), g_object_unref);
+}
+
+static void
+get_icon_cb (GObject      *object,
+             GAsyncResult *result,
+             gpointer      user_data)
+{
+	SnapdClient *client = SNAPD_CLIENT (object);
+	g_autoptr(IconFetchData) fetch = user_data;
+	g_autoptr(SnapdIcon) snap_icon = NULL;
+	g_autoptr(GTask) task = NULL;
+	GCancellable *cancellable;
+	g_autoptr(GError) local_error = NULL;
+
+	snap_icon = snapd_client_get_icon_finish (client, result, &local_error);
+	if (snap_icon == NULL) {
+		g_debug ("Failed to get icon of snap %s: %s", fetch->snap_name, local_error->message);
+		refine_icons_fetch_done (fetch);
+		return;
+	}
+
+	/* the fetch keeps its slot until the icon is saved */
+	cancellable = g_task_get_cancellable (fetch->task);
+	task = g_task_new (NULL, cancellable, save_icon_cb, g_steal_pointer (&fetch));
+	g_task_set_source_tag (task, get_icon_cb);
+	g_task_set_task_data (task, g_steal_pointer (&snap_icon), g_object_unref);
+	g_task_run_in_thread (task, save_icon_thread_cb);
+}
+
+static void
+save_icon_cb (GObject      *object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+	g_autoptr(IconFetchData) fetch = user_data;
+	RefineIconsData *data = g_task_get_task_data (fetch->task);
+	g_autoptr(GIcon) icon = NULL;
+
+	icon = g_task_propagate_pointer (G_TASK (result), NULL);
+	if (icon != NULL) {
+		GPtrArray *apps = g_hash_table_lookup (data->apps, fetch->snap_name);
+
+		for (guint i = 0; i < apps->len; i++)
+			gs_app_add_icon (g_ptr_array_index (apps, i), icon);
+	}
+
+	refine_icons_fetch_done (fetch);
+}
+
+/* Fetches the icons of the installed snaps in @apps, which maps snap names
+ * to the apps needing their icon, several at once. Takes ownership of
+ * @apps. */
+void
+gs_snap_icons_refine_local_async (SnapdClient         *client,
+				  GHashTable          *apps,
+				  GCancellable        *cancellable,
+				  GAsyncReadyCallback  callback,
+				  gpointer             user_data)
+{
+	g_autoptr(GTask) task = NULL;
+	RefineIconsData *data = g_new0 (RefineIconsData, 1);
+
+	data->client = g_object_ref (client);
+	data->apps = apps;
+	data->snap_names = (const gchar **) g_hash_table_get_keys_as_array (apps, &data->n_snap_names);
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, gs_snap_icons_refine_local_async);
+	g_task_set_task_data (task, data, (GDestroyNotify) refine_icons_data_free);
+
+	refine_icons_fetch_next (task);
+}
+
+gboolean
+gs_snap_icons_refine_local_finish (GAsyncResult  *result,
+				   GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
@@ -0,0 +1,31 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <snapd-glib/snapd-glib.h>
+#include <gnome-software.h>
+
+G_BEGIN_DECLS
+
+/* at most this many icons are requested from snapd at once */
+#define GS_SNAP_ICONS_MAX_FETCHES	8
+
+void		 gs_snap_icons_refine_remote		(GsApp			*app,
+							 SnapdSnap		*snap,
+							 GHashTable		*remote_icons);
+void		 gs_snap_icons_refine_local_async	(SnapdClient		*client,
+							 GHashTable		*apps,
+							 GCancellable		*cancellable,
+							 GAsyncReadyCallback	 callback,
+							 gpointer		 user_data);
+gboolean	 gs_snap_icons_refine_local_finish	(GAsyncResult		*result,
+							 GError			**error);
+
+G_END_DECLS
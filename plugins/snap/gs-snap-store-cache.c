@@ -0,0 +1,842 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/* Notes:
+ *
+ * Every category page and the featured snaps used to be a round trip to the
+ * Snap Store through snapd, in each session. #GsSnapStoreCache remembers the
+ * snaps snapd returned, and which snaps each store section listed, and keeps
+ * them on disk between sessions.
+ *
+ * Each snap and each section listing has its own expiry time. Until then it
+ * is used as is; after that it is still used, but the caller is told to fetch
+ * it again in the background (stale-while-revalidate), so pages show up
+ * immediately and are up to date the next time. Entries too long past their
+ * expiry are dropped, and only the most recently used snaps are kept.
+ *
+ * SnapdSnap has no serialisation of its own, so snaps are saved as a JSON
+ * object of their properties; those snapd-glib adds later are saved too, and
+ * those it drops are skipped when loading.
+ *
+ * Saving happens in a background thread, and several changes in a row are
+ * written out together.
+ */
+
+#include "config.h"
+
+#include <json-glib/json-glib.h>
+
+#include "gs-snap-store-cache.h"
+
+/* bumped whenever the file format changes */
+#define CACHE_VERSION		1
+
+/* how long snaps and section listings are used without asking snapd */
+#define SNAP_TTL		(6 * G_TIME_SPAN_HOUR)
+#define SECTION_TTL		(G_TIME_SPAN_DAY)
+
+/* how long after expiring entries are still used while being fetched
+ * again; older entries are dropped */
+#define MAX_STALENESS		(7 * G_TIME_SPAN_DAY)
+
+/* how long before asking again for an entry to be fetched, in case the
+ * last attempt failed */
+#define REVALIDATE_RETRY	(5 * G_TIME_SPAN_MINUTE)
+
+typedef struct {
+	gchar		*name;  /* (owned) */
+	SnapdSnap	*snap;  /* (owned) */
+	gboolean	 full_details;
+	gint64		 expires;  /* real time, in µs */
+	gint64		 revalidated;  /* real time of the last revalidation, or 0 */
+	GList		 link;  /* in GsSnapStoreCache.lru, with the entry as data */
+} SnapEntry;
+
+typedef struct {
+	GStrv		 names;  /* (owned); of the snaps listed */
+	gint64		 expires;
+	gint64		 revalidated;
+} SectionEntry;
+
+struct _GsSnapStoreCache {
+	GObject			 parent_instance;
+
+	gchar			*filename;  /* (owned) (nullable); not saved if %NULL */
+	guint			 max_snaps;
+	GMutex			 mutex;
+	GHashTable		*snaps;  /* (owned) (element-type utf8 SnapEntry) */
+	GHashTable		*sections;  /* (owned) (element-type utf8 SectionEntry) */
+	GQueue			 lru;  /* (element-type SnapEntry); most recently used first */
+	guint			 hits;
+	guint			 misses;
+	GThreadPool		*pool;  /* (owned) (nullable) */
+	gboolean		 dirty;
+	gboolean		 save_queued;
+};
+
+G_DEFINE_TYPE (GsSnapStoreCache, gs_snap_store_cache, G_TYPE_OBJECT)
+
+static SnapEntry *
+snap_entry_new (SnapdSnap *snap,
+		gboolean full_details,
+		gint64 expires)
+{
+	SnapEntry *entry = g_new0 (SnapEntry, 1);
+	entry->name = g_strdup (snapd_snap_get_name (snap));
+	entry->snap = g_object_ref (snap);
+	entry->full_details = full_details;
+	entry->expires = expires;
+	entry->link.data = entry;
+	return entry;
+}
+
+static void
+snap_entry_free (SnapEntry *entry)
+{
+	g_object_unref (entry->snap);
+	g_free (entry->name);
+	g_free (entry);
+}
+
+static SectionEntry *
+section_entry_new (GStrv names,
+		   gint64 expires)
+{
+	SectionEntry *entry = g_new0 (SectionEntry, 1);
+	entry->names = names;
+	entry->expires = expires;
+	return entry;
+}
+
+static void
+section_entry_free (SectionEntry *entry)
+{
+	g_strfreev (entry->names);
+	g_free (entry);
+}
+
+/* #SnapdSnap and the objects it holds only have construct-only properties.
+ * Arrays of objects can only be saved if their element type is known. */
+static const struct {
+	const gchar *property;
+	GType (*get_type) (void);
+} object_arrays[] = {
+	{ "apps", snapd_app_get_type },
+	{ "channels", snapd_channel_get_type },
+	{ "media", snapd_media_get_type },
+	{ "prices", snapd_price_get_type },
+};
+
+static GType
+object_array_get_element_type (const gchar *property)
+{
+	for (gsize i = 0; i < G_N_ELEMENTS (object_arrays); i++) {
+		if (g_str_equal (object_arrays[i].property, property))
+			return object_arrays[i].get_type ();
+	}
+	return G_TYPE_INVALID;
+}
+
+static void
+serialize_object (JsonBuilder *builder,
+		  GObject *object)
+{
+	g_autofree GParamSpec **pspecs = NULL;
+	guint n_pspecs = 0;
+
+	pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (object), &n_pspecs);
+
+	json_builder_begin_object (builder);
+	for (guint i = 0; i < n_pspecs; i++) {
+		GParamSpec *pspec = pspecs[i];
+		GType type = G_PARAM_SPEC_VALUE_TYPE (pspec);
+		g_auto(GValue) value = G_VALUE_INIT;
+
+		if ((pspec->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE ||
+		    (pspec->flags & G_PARAM_DEPRECATED) != 0)
+			continue;
+
+		g_value_init (&value, type);
+		g_object_get_property (object, pspec->name, &value);
+
+		if (type == G_TYPE_STRV) {
+			const gchar * const *strv = g_value_get_boxed (&value);
+
+			if (strv == NULL)
+				continue;
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_begin_array (builder);
+			for (guint j = 0; strv[j] != NULL; j++)
+				json_builder_add_string_value (builder, strv[j]);
+			json_builder_end_array (builder);
+		} else if (type == G_TYPE_DATE_TIME) {
+			GDateTime *date_time = g_value_get_boxed (&value);
+			g_autofree gchar *str = NULL;
+
+			if (date_time == NULL)
+				continue;
+			str = g_date_time_format_iso8601 (date_time);
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_add_string_value (builder, str);
+		} else if (type == G_TYPE_PTR_ARRAY) {
+			GPtrArray *array = g_value_get_boxed (&value);
+
+			if (array == NULL || object_array_get_element_type (pspec->name) == G_TYPE_INVALID)
+				continue;
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_begin_array (builder);
+			for (guint j = 0; j < array->len; j++)
+				serialize_object (builder, g_ptr_array_index (array, j));
+			json_builder_end_array (builder);
+		} else if (G_TYPE_IS_ENUM (type)) {
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_add_int_value (builder, g_value_get_enum (&value));
+		} else if (G_TYPE_IS_FLAGS (type)) {
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_add_int_value (builder, g_value_get_flags (&value));
+		} else if (type == G_TYPE_STRING) {
+			if (g_value_get_string (&value) == NULL)
+				continue;
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_add_string_value (builder, g_value_get_string (&value));
+		} else if (type == G_TYPE_BOOLEAN) {
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_add_boolean_value (builder, g_value_get_boolean (&value));
+		} else if (type == G_TYPE_INT) {
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_add_int_value (builder, g_value_get_int (&value));
+		} else if (type == G_TYPE_UINT) {
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_add_int_value (builder, g_value_get_uint (&value));
+		} else if (type == G_TYPE_INT64) {
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_add_int_value (builder, g_value_get_int64 (&value));
+		} else if (type == G_TYPE_UINT64) {
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_add_int_value (builder, (gint64) g_value_get_uint64 (&value));
+		} else if (type == G_TYPE_DOUBLE) {
+			json_builder_set_member_name (builder, pspec->name);
+			json_builder_add_double_value (builder, g_value_get_double (&value));
+		}
+	}
+	json_builder_end_object (builder);
+}
+
+static GObject *deserialize_object (GType type, JsonNode *node);
+
+static gboolean
+deserialize_value (GParamSpec *pspec,
+		   JsonNode *node,
+		   GValue *value)
+{
+	GType type = G_PARAM_SPEC_VALUE_TYPE (pspec);
+
+	if (type == G_TYPE_STRV) {
+		JsonArray *array;
+		gchar **strv;
+		guint n = 0;
+
+		if (!JSON_NODE_HOLDS_ARRAY (node))
+			return FALSE;
+		array = json_node_get_array (node);
+		strv = g_new0 (gchar *, json_array_get_length (array) + 1);
+		for (guint i = 0; i < json_array_get_length (array); i++) {
+			const gchar *str = json_array_get_string_element (array, i);
+			if (str != NULL)
+				strv[n++] = g_strdup (str);
+		}
+		g_value_init (value, G_TYPE_STRV);
+		g_value_take_boxed (value, strv);
+	} else if (type == G_TYPE_DATE_TIME) {
+		GDateTime *date_time;
+
+		if (json_node_get_value_type (node) != G_TYPE_STRING)
+			return FALSE;
+		date_time = g_date_time_new_from_iso8601 (json_node_get_string (node), NULL);
+		if (date_time == NULL)
+			return FALSE;
+		g_value_init (value, G_TYPE_DATE_TIME);
+		g_value_take_boxed (value, date_time);
+	} else if (type == G_TYPE_PTR_ARRAY) {
+		GType element_type = object_array_get_element_type (pspec->name);
+		JsonArray *array;
+		GPtrArray *objects;
+
+		if (element_type == G_TYPE_INVALID || !JSON_NODE_HOLDS_ARRAY (node))
+			return FALSE;
+		array = json_node_get_array (node);
+		objects = g_ptr_array_new_with_free_func (g_object_unref);
+		for (guint i = 0; i < json_array_get_length (array); i++) {
+			GObject *object = deserialize_object (element_type, json_array_get_element (array, i));
+			if (object != NULL)
+				g_ptr_array_add (objects, object);
+		}
+		g_value_init (value, G_TYPE_PTR_ARRAY);
+		g_value_take_boxed (value, objects);
+	} else if (!JSON_NODE_HOLDS_VALUE (node)) {
+		return FALSE;
+	} else if (G_TYPE_IS_ENUM (type)) {
+		g_value_init (value, type);
+		g_value_set_enum (value, json_node_get_int (node));
+	} else if (G_TYPE_IS_FLAGS (type)) {
+		g_value_init (value, type);
+		g_value_set_flags (value, json_node_get_int (node));
+	} else if (type == G_TYPE_STRING) {
+		g_value_init (value, type);
+		g_value_set_string (value, json_node_get_string (node));
+	} else if (type == G_TYPE_BOOLEAN) {
+		g_value_init (value, type);
+		g_value_set_boolean (value, json_node_get_boolean (node));
+	} else if (type == G_TYPE_INT) {
+		g_value_init (value, type);
+		g_value_set_int (value, json_node_get_int (node));
+	} else if (type == G_TYPE_UINT) {
+		g_value_init (value, type);
+		g_value_set_uint (value, json_node_get_int (node));
+	} else if (type == G_TYPE_INT64) {
+		g_value_init (value, type);
+		g_value_set_int64 (value, json_node_get_int (node));
+	} else if (type == G_TYPE_UINT64) {
+		g_value_init (value, type);
+		g_value_set_uint64 (value, json_node_get_int (node));
+	} else if (type == G_TYPE_DOUBLE) {
+		g_value_init (value, type);
+		g_value_set_double (value, json_node_get_double (node));
+	} else {
+		return FALSE;
+	}
+
+	/* e.g. an enum value this version of snapd-glib does not know */
+	if (g_param_value_validate (pspec, value)) {
+		g_value_unset (value);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static GObject *
+deserialize_object (GType type,
+		    JsonNode *node)
+{
+	g_autoptr(GTypeClass) klass = NULL;
+	g_autoptr(GList) members = NULL;
+	g_autoptr(GPtrArray) names = NULL;
+	g_autoptr(GArray) values = NULL;
+	JsonObject *object;
+
+	if (!JSON_NODE_HOLDS_OBJECT (node))
+		return NULL;
+
+	klass = g_type_class_ref (type);
+	names = g_ptr_array_new ();
+	values = g_array_new (FALSE, TRUE, sizeof (GValue));
+	g_array_set_clear_func (values, (GDestroyNotify) g_value_unset);
+
+	object = json_node_get_object (node);
+	members = json_object_get_members (object);
+	for (GList *l = members; l != NULL; l = l->next) {
+		GParamSpec *pspec = g_object_class_find_property (G_OBJECT_CLASS (klass), l->data);
+		GValue value = G_VALUE_INIT;
+
+		/* saved with a different version of snapd-glib */
+		if (pspec == NULL || (pspec->flags & G_PARAM_WRITABLE) == 0)
+			continue;
+		if (!deserialize_value (pspec, json_object_get_member (object, l->data), &value))
+			continue;
+
+		g_ptr_array_add (names, (gpointer) pspec->name);
+		g_array_append_val (values, value);
+	}
+
+	return g_object_new_with_properties (type, names->len,
+					     (const gchar **) names->pdata,
+					     (const GValue *) values->data);
+}
+
+/* must be called with @self->mutex held */
+static void
+snap_entry_remove_locked (GsSnapStoreCache *self,
+			  SnapEntry *entry)
+{
+	g_queue_unlink (&self->lru, &entry->link);
+	g_hash_table_remove (self->snaps, entry->name);
+}
+
+/* Adds @snap as the most recently used snap, evicting the least recently used
+ * ones if there are too many. Must be called with @self->mutex held. */
+static void
+add_snap_locked (GsSnapStoreCache *self,
+		 SnapdSnap *snap,
+		 gboolean full_details,
+		 gint64 expires)
+{
+	SnapEntry *entry;
+
+	if (snapd_snap_get_name (snap) == NULL)
+		return;
+
+	entry = g_hash_table_lookup (self->snaps, snapd_snap_get_name (snap));
+	if (entry != NULL)
+		snap_entry_remove_locked (self, entry);
+
+	entry = snap_entry_new (snap, full_details, expires);
+	g_hash_table_insert (self->snaps, entry->name, entry);
+	g_queue_push_head_link (&self->lru, &entry->link);
+
+	while (self->lru.length > self->max_snaps) {
+		SnapEntry *last = g_queue_peek_tail (&self->lru);
+		g_debug ("evicting '%s' from the store cache", last->name);
+		snap_entry_remove_locked (self, last);
+	}
+}
+
+/* Gets the snap called @name, dropping it if it is too old to be used. Must
+ * be called with @self->mutex held. */
+static SnapEntry *
+lookup_snap_locked (GsSnapStoreCache *self,
+		    const gchar *name,
+		    gint64 now)
+{
+	SnapEntry *entry = g_hash_table_lookup (self->snaps, name);
+
+	if (entry != NULL && now >= entry->expires + MAX_STALENESS) {
+		snap_entry_remove_locked (self, entry);
+		return NULL;
+	}
+
+	return entry;
+}
+
+/* Whether an entry has expired and should be fetched again; the caller is
+ * expected to do so, so it is not asked again for a while. */
+static gboolean
+needs_revalidate (gint64 expires,
+		  gint64 *revalidated,
+		  gint64 now)
+{
+	if (now < expires || now < *revalidated + REVALIDATE_RETRY)
+		return FALSE;
+	*revalidated = now;
+	return TRUE;
+}
+
+static gchar *
+gs_snap_store_cache_to_data_locked (GsSnapStoreCache *self,
+				    gsize *length)
+{
+	g_autoptr(JsonBuilder) builder = json_builder_new ();
+	g_autoptr(JsonGenerator) generator = NULL;
+	g_autoptr(JsonNode) root = NULL;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "version");
+	json_builder_add_int_value (builder, CACHE_VERSION);
+
+	json_builder_set_member_name (builder, "snaps");
+	json_builder_begin_array (builder);
+	for (GList *l = self->lru.head; l != NULL; l = l->next) {
+		SnapEntry *entry = l->data;
+
+		json_builder_begin_object (builder);
+		json_builder_set_member_name (builder, "expires");
+		json_builder_add_int_value (builder, entry->expires);
+		json_builder_set_member_name (builder, "full-details");
+		json_builder_add_boolean_value (builder, entry->full_details);
+		json_builder_set_member_name (builder, "snap");
+		serialize_object (builder, G_OBJECT (entry->snap));
+		json_builder_end_object (builder);
+	}
+	json_builder_end_array (builder);
+
+	json_builder_set_member_name (builder, "sections");
+	json_builder_begin_object (builder);
+	g_hash_table_iter_init (&iter, self->sections);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		SectionEntry *entry = value;
+
+		json_builder_set_member_name (builder, key);
+		json_builder_begin_object (builder);
+		json_builder_set_member_name (builder, "expires");
+		json_builder_add_int_value (builder, entry->expires);
+		json_builder_set_member_name (builder, "names");
+		json_builder_begin_array (builder);
+		for (guint i = 0; entry->names[i] != NULL; i++)
+			json_builder_add_string_value (builder, entry->names[i]);
+		json_builder_end_array (builder);
+		json_builder_end_object (builder);
+	}
+	json_builder_end_object (builder);
+	json_builder_end_object (builder);
+
+	root = json_builder_get_root (builder);
+	generator = json_generator_new ();
+	json_generator_set_root (generator, root);
+	return json_generator_to_data (generator, length);
+}
+
+static void
+gs_snap_store_cache_save (GsSnapStoreCache *self)
+{
+	g_autofree gchar *data = NULL;
+	gsize length = 0;
+	g_autoptr(GError) error_local = NULL;
+
+	{
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->mutex);
+		self->save_queued = FALSE;
+		if (!self->dirty)
+			return;
+		self->dirty = FALSE;
+		data = gs_snap_store_cache_to_data_locked (self, &length);
+	}
+
+	if (!g_file_set_contents (self->filename, data, length, &error_local))
+		g_debug ("failed to save %s: %s", self->filename, error_local->message);
+}
+
+/* Run in @self->pool. */
+static void
+gs_snap_store_cache_save_cb (gpointer data,
+			     gpointer user_data)
+{
+	gs_snap_store_cache_save (GS_SNAP_STORE_CACHE (user_data));
+}
+
+/* must be called with @self->mutex held */
+static void
+gs_snap_store_cache_queue_save_locked (GsSnapStoreCache *self)
+{
+	if (self->pool == NULL)
+		return;
+	self->dirty = TRUE;
+	if (self->save_queued)
+		return;
+	self->save_queued = TRUE;
+	g_thread_pool_push (self->pool, self, NULL);
+}
+
+static void
+gs_snap_store_cache_load (GsSnapStoreCache *self)
+{
+	g_autoptr(JsonParser) parser = json_parser_new ();
+	g_autoptr(GError) error_local = NULL;
+	JsonNode *root;
+	JsonObject *object;
+	gint64 now = g_get_real_time ();
+
+	if (!json_parser_load_from_file (parser, self->filename, &error_local)) {
+		if (!g_error_matches (error_local, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_debug ("failed to load %s: %s", self->filename, error_local->message);
+		return;
+	}
+
+	root = json_parser_get_root (parser);
+	if (root == NULL || !JSON_NODE_HOLDS_OBJECT (root))
+		return;
+	object = json_node_get_object (root);
+	if (json_object_get_int_member_with_default (object, "version", 0) != CACHE_VERSION) {
+		g_debug ("ignoring %s, saved in a different format", self->filename);
+		return;
+	}
+
+	if (json_object_has_member (object, "snaps") &&
+	    JSON_NODE_HOLDS_ARRAY (json_object_get_member (object, "snaps"))) {
+		JsonArray *snaps = json_object_get_array_member (object, "snaps");
+
+		/* saved most recently used first */
+		for (guint i = json_array_get_length (snaps); i > 0; i--) {
+			JsonNode *node = json_array_get_element (snaps, i - 1);
+			JsonObject *snap_object;
+			g_autoptr(GObject) snap = NULL;
+			gint64 expires;
+
+			if (!JSON_NODE_HOLDS_OBJECT (node))
+				continue;
+			snap_object = json_node_get_object (node);
+			expires = json_object_get_int_member_with_default (snap_object, "expires", 0);
+			if (now >= expires + MAX_STALENESS || !json_object_has_member (snap_object, "snap"))
+				continue;
+			snap = deserialize_object (SNAPD_TYPE_SNAP, json_object_get_member (snap_object, "snap"));
+			if (snap == NULL)
+				continue;
+			add_snap_locked (self, SNAPD_SNAP (snap),
+					 json_object_get_boolean_member_with_default (snap_object, "full-details", FALSE),
+					 expires);
+		}
+	}
+
+	if (json_object_has_member (object, "sections") &&
+	    JSON_NODE_HOLDS_OBJECT (json_object_get_member (object, "sections"))) {
+		JsonObject *sections = json_object_get_object_member (object, "sections");
+		g_autoptr(GList) members = json_object_get_members (sections);
+
+		for (GList *l = members; l != NULL; l = l->next) {
+			JsonNode *node = json_object_get_member (sections, l->data);
+			JsonObject *section_object;
+			JsonArray *names;
+			gchar **strv;
+			guint n = 0;
+			gint64 expires;
+
+			if (!JSON_NODE_HOLDS_OBJECT (node))
+				continue;
+			section_object = json_node_get_object (node);
+			expires = json_object_get_int_member_with_default (section_object, "expires", 0);
+			if (now >= expires + MAX_STALENESS ||
+			    !json_object_has_member (section_object, "names") ||
+			    !JSON_NODE_HOLDS_ARRAY (json_object_get_member (section_object, "names")))
+				continue;
+
+			names = json_object_get_array_member (section_object, "names");
+			strv = g_new0 (gchar *, json_array_get_length (names) + 1);
+			for (guint i = 0; i < json_array_get_length (names); i++) {
+				const gchar *name = json_array_get_string_element (names, i);
+				if (name != NULL)
+					strv[n++] = g_strdup (name);
+			}
+			g_hash_table_insert (self->sections, g_strdup (l->data),
+					     section_entry_new (strv, expires));
+		}
+	}
+
+	g_debug ("loaded %u snaps and %u sections from %s",
+		 g_hash_table_size (self->snaps),
+		 g_hash_table_size (self->sections),
+		 self->filename);
+}
+
+/* Gets the cached snap called @name, or %NULL if it is not cached or, when
+ * @need_details is set, only partially. @out_revalidate is set if the snap
+ * has expired and should be fetched again. */
+SnapdSnap *
+gs_snap_store_cache_lookup_snap (GsSnapStoreCache *self,
+				 const gchar *name,
+				 gboolean need_details,
+				 gboolean *out_revalidate)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	SnapEntry *entry;
+	gint64 now = g_get_real_time ();
+
+	g_return_val_if_fail (GS_IS_SNAP_STORE_CACHE (self), NULL);
+	g_return_val_if_fail (name != NULL, NULL);
+
+	if (out_revalidate != NULL)
+		*out_revalidate = FALSE;
+
+	locker = g_mutex_locker_new (&self->mutex);
+	entry = lookup_snap_locked (self, name, now);
+	if (entry == NULL || (need_details && !entry->full_details)) {
+		self->misses++;
+		return NULL;
+	}
+
+	self->hits++;
+	g_queue_unlink (&self->lru, &entry->link);
+	g_queue_push_head_link (&self->lru, &entry->link);
+	if (out_revalidate != NULL)
+		*out_revalidate = needs_revalidate (entry->expires, &entry->revalidated, now);
+
+	return g_object_ref (entry->snap);
+}
+
+/* Gets the snaps last listed in @section, or %NULL if the listing is not
+ * cached, or some of its snaps no longer are. @out_revalidate is set if the
+ * listing has expired and should be fetched again. */
+GPtrArray *
+gs_snap_store_cache_lookup_section (GsSnapStoreCache *self,
+				    const gchar *section,
+				    gboolean *out_revalidate)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GPtrArray) snaps = NULL;
+	SectionEntry *entry;
+	gint64 now = g_get_real_time ();
+
+	g_return_val_if_fail (GS_IS_SNAP_STORE_CACHE (self), NULL);
+	g_return_val_if_fail (section != NULL, NULL);
+
+	if (out_revalidate != NULL)
+		*out_revalidate = FALSE;
+
+	locker = g_mutex_locker_new (&self->mutex);
+	entry = g_hash_table_lookup (self->sections, section);
+	if (entry != NULL && now >= entry->expires + MAX_STALENESS) {
+		g_hash_table_remove (self->sections, section);
+		entry = NULL;
+	}
+	if (entry == NULL) {
+		self->misses++;
+		return NULL;
+	}
+
+	snaps = g_ptr_array_new_with_free_func (g_object_unref);
+	for (guint i = 0; entry->names[i] != NULL; i++) {
+		SnapEntry *snap_entry = lookup_snap_locked (self, entry->names[i], now);
+
+		if (snap_entry == NULL) {
+			self->misses++;
+			return NULL;
+		}
+		g_queue_unlink (&self->lru, &snap_entry->link);
+		g_queue_push_head_link (&self->lru, &snap_entry->link);
+		g_ptr_array_add (snaps, g_object_ref (snap_entry->snap));
+	}
+
+	self->hits++;
+	if (out_revalidate != NULL &&
+	    needs_revalidate (entry->expires, &entry->revalidated, now)) {
+		/* fetching the listing again fetches its snaps too */
+		for (guint i = 0; entry->names[i] != NULL; i++) {
+			SnapEntry *snap_entry = g_hash_table_lookup (self->snaps, entry->names[i]);
+			snap_entry->revalidated = now;
+		}
+		*out_revalidate = TRUE;
+	}
+
+	return g_steal_pointer (&snaps);
+}
+
+/* Remembers @snaps as returned by snapd; @full_details is set if they were
+ * looked up by name, which returns more details than listings do. */
+void
+gs_snap_store_cache_add_snaps (GsSnapStoreCache *self,
+			       GPtrArray *snaps,
+			       gboolean full_details)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	gint64 now = g_get_real_time ();
+
+	g_return_if_fail (GS_IS_SNAP_STORE_CACHE (self));
+	g_return_if_fail (snaps != NULL);
+
+	if (snaps->len == 0)
+		return;
+
+	locker = g_mutex_locker_new (&self->mutex);
+	for (guint i = 0; i < snaps->len; i++)
+		add_snap_locked (self, g_ptr_array_index (snaps, i), full_details, now + SNAP_TTL);
+	gs_snap_store_cache_queue_save_locked (self);
+}
+
+/* Remembers @snaps as the listing of @section. */
+void
+gs_snap_store_cache_set_section (GsSnapStoreCache *self,
+				 const gchar *section,
+				 GPtrArray *snaps)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	gint64 now = g_get_real_time ();
+	gchar **names;
+	guint n = 0;
+
+	g_return_if_fail (GS_IS_SNAP_STORE_CACHE (self));
+	g_return_if_fail (section != NULL);
+	g_return_if_fail (snaps != NULL);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	names = g_new0 (gchar *, snaps->len + 1);
+	for (guint i = 0; i < snaps->len; i++) {
+		SnapdSnap *snap = g_ptr_array_index (snaps, i);
+
+		if (snapd_snap_get_name (snap) == NULL)
+			continue;
+		add_snap_locked (self, snap, FALSE, now + SNAP_TTL);
+		names[n++] = g_strdup (snapd_snap_get_name (snap));
+	}
+	g_hash_table_replace (self->sections, g_strdup (section),
+			      section_entry_new (names, now + SECTION_TTL));
+	gs_snap_store_cache_queue_save_locked (self);
+}
+
+/* Gets how many lookups found what they were after, stale or not. */
+guint
+gs_snap_store_cache_get_hits (GsSnapStoreCache *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_SNAP_STORE_CACHE (self), 0);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	return self->hits;
+}
+
+/* Gets how many lookups had to be answered by snapd. */
+guint
+gs_snap_store_cache_get_misses (GsSnapStoreCache *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_SNAP_STORE_CACHE (self), 0);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	return self->misses;
+}
+
+static void
+gs_snap_store_cache_finalize (GObject *object)
+{
+	GsSnapStoreCache *self = GS_SNAP_STORE_CACHE (object);
+
+	g_debug ("store cache: %u hits, %u misses", self->hits, self->misses);
+
+	/* a queued save may have been dropped, so save again */
+	if (self->pool != NULL) {
+		g_thread_pool_free (self->pool, TRUE, TRUE);
+		gs_snap_store_cache_save (self);
+	}
+
+	g_hash_table_unref (self->sections);
+	g_hash_table_unref (self->snaps);
+	g_mutex_clear (&self->mutex);
+	g_free (self->filename);
+
+	G_OBJECT_CLASS (gs_snap_store_cache_parent_class)->finalize (object);
+}
+
+static void
+gs_snap_store_cache_class_init (GsSnapStoreCacheClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_snap_store_cache_finalize;
+}
+
+static void
+gs_snap_store_cache_init (GsSnapStoreCache *self)
+{
+	g_mutex_init (&self->mutex);
+	self->snaps = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     NULL, (GDestroyNotify) snap_entry_free);
+	self->sections = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, (GDestroyNotify) section_entry_free);
+	g_queue_init (&self->lru);
+}
+
+/* Creates a cache of at most @max_snaps snaps, persisted to @filename and
+ * loading what was saved there, or only kept in memory if it is %NULL. */
+GsSnapStoreCache *
+gs_snap_store_cache_new (const gchar *filename,
+			 guint max_snaps)
+{
+	GsSnapStoreCache *self;
+
+	g_return_val_if_fail (max_snaps > 0, NULL);
+
+	self = g_object_new (GS_TYPE_SNAP_STORE_CACHE, NULL);
+	self->max_snaps = max_snaps;
+	if (filename != NULL) {
+		self->filename = g_strdup (filename);
+		self->pool = g_thread_pool_new (gs_snap_store_cache_save_cb, self,
+						1, TRUE, NULL);
+		gs_snap_store_cache_load (self);
+	}
+	return self;
+}
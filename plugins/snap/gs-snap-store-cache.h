@@ -0,0 +1,38 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 The GNOME Software Authors
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <snapd-glib/snapd-glib.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_SNAP_STORE_CACHE (gs_snap_store_cache_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsSnapStoreCache, gs_snap_store_cache, GS, SNAP_STORE_CACHE, GObject)
+
+GsSnapStoreCache *gs_snap_store_cache_new		(const gchar		*filename,
+							 guint			 max_snaps);
+SnapdSnap	*gs_snap_store_cache_lookup_snap	(GsSnapStoreCache	*self,
+							 const gchar		*name,
+							 gboolean		 need_details,
+							 gboolean		*out_revalidate);
+GPtrArray	*gs_snap_store_cache_lookup_section	(GsSnapStoreCache	*self,
+							 const gchar		*section,
+							 gboolean		*out_revalidate);
+void		 gs_snap_store_cache_add_snaps		(GsSnapStoreCache	*self,
+							 GPtrArray		*snaps,
+							 gboolean		 full_details);
+void		 gs_snap_store_cache_set_section	(GsSnapStoreCache	*self,
+							 const gchar		*section,
+							 GPtrArray		*snaps);
+guint		 gs_snap_store_cache_get_hits		(GsSnapStoreCache	*self);
+guint		 gs_snap_store_cache_get_misses		(GsSnapStoreCache	*self);
+
+G_END_DECLS
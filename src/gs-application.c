@@ -27,6 +27,7 @@
 #include "gs-shell.h"
 #include "gs-update-monitor.h"
 #include "gs-shell-search-provider.h"
+#include "gs-performance-generated.h"
 
 #define ENABLE_REPOS_DIALOG_CONF_KEY "enable-repos-dialog"
 
@@ -42,6 +43,7 @@ struct _GsApplication {
 	GsDbusHelper	*dbus_helper;
 #endif
 	GsShellSearchProvider *search_provider;  /* (nullable) (owned) */
+	GsSoftwarePerformance *performance_skeleton;  /* (nullable) (owned) */
 	GSettings       *settings;
 	GSimpleActionGroup	*action_map;
 	guint		 shell_loaded_handler_id;
@@ -149,6 +151,8 @@ gs_application_init (GsApplication *application)
 		  _("Quit the running instance"), NULL },
 		{ "prefer-local", '\0', 0, G_OPTION_ARG_NONE, NULL,
 		  _("Prefer local file sources to AppStream"), NULL },
+		{ "dump-perf", '\0', 0, G_OPTION_ARG_NONE, NULL,
+		  _("Print the performance trace of the running instance as JSON"), NULL },
 		{ "version", 0, 0, G_OPTION_ARG_NONE, NULL,
 		  _("Show version number"), NULL },
 		{ NULL }
@@ -157,6 +161,27 @@ gs_application_init (GsApplication *application)
 	g_application_add_main_option_entries (G_APPLICATION (application), options);
 }
 
+static gchar *
+gs_application_dump_perf (GsApplication *app)
+{
+	/* the plugin loader is only created on startup */
+	if (app->plugin_loader == NULL)
+		return g_strdup ("{}");
+	return gs_plugin_loader_dump_perf (app->plugin_loader);
+}
+
+static gboolean
+handle_get_trace_cb (GsSoftwarePerformance *skeleton,
+		     GDBusMethodInvocation *invocation,
+		     gpointer               user_data)
+{
+	GsApplication *app = GS_APPLICATION (user_data);
+	g_autofree gchar *trace = gs_application_dump_perf (app);
+
+	gs_software_performance_complete_get_trace (skeleton, invocation, trace);
+	return TRUE;
+}
+
 static gboolean
 gs_application_dbus_register (GApplication    *application,
                               GDBusConnection *connection,
@@ -164,6 +189,16 @@ gs_application_dbus_register (GApplication    *application,
                               GError         **error)
 {
 	GsApplication *app = GS_APPLICATION (application);
+
+	app->performance_skeleton = gs_software_performance_skeleton_new ();
+	g_signal_connect (app->performance_skeleton, "handle-get-trace",
+			  G_CALLBACK (handle_get_trace_cb), app);
+	if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (app->performance_skeleton),
+					       connection,
+					       "/org/gnome/Software/Performance",
+					       error))
+		return FALSE;
+
 	app->search_provider = gs_shell_search_provider_new ();
 	return gs_shell_search_provider_register (app->search_provider, connection, error);
 }
@@ -177,6 +212,8 @@ gs_application_dbus_unregister (GApplication    *application,
 
 	if (app->search_provider != NULL)
 		gs_shell_search_provider_unregister (app->search_provider);
+	if (app->performance_skeleton != NULL)
+		g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (app->performance_skeleton));
 }
 
 static void
@@ -1191,6 +1228,7 @@ gs_application_dispose (GObject *object)
 	GsApplication *app = GS_APPLICATION (object);
 
 	g_clear_object (&app->search_provider);
+	g_clear_object (&app->performance_skeleton);
 	g_clear_object (&app->plugin_loader);
 	g_clear_object (&app->update_monitor);
 #ifdef HAVE_PACKAGEKIT
@@ -1242,6 +1280,31 @@ gs_application_handle_local_options (GApplication *app, GVariantDict *options)
 		return 1;
 	}
 
+	if (g_variant_dict_contains (options, "dump-perf")) {
+		g_autofree gchar *trace = NULL;
+
+		if (g_application_get_is_remote (app)) {
+			g_autoptr(GsSoftwarePerformance) proxy = NULL;
+
+			proxy = gs_software_performance_proxy_new_sync (g_application_get_dbus_connection (app),
+									G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+									G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+									g_application_get_application_id (app),
+									"/org/gnome/Software/Performance",
+									NULL, &error);
+			if (proxy == NULL ||
+			    !gs_software_performance_call_get_trace_sync (proxy, &trace, NULL, &error)) {
+				g_printerr ("%s\n", error->message);
+				return 1;
+			}
+		} else {
+			trace = gs_application_dump_perf (self);
+		}
+
+		g_print ("%s\n", trace);
+		return 0;
+	}
+
 	if (g_variant_dict_contains (options, "autoupdate")) {
 		g_action_group_activate_action (G_ACTION_GROUP (app),
 						"autoupdate",
@@ -49,7 +49,6 @@
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_CONTENT_RATING | \
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_DESCRIPTION | \
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_DEVELOPER_NAME | \
-					GS_PLUGIN_REFINE_FLAGS_REQUIRE_HISTORY | \
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON | \
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_KUDOS | \
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE | \
@@ -61,11 +60,19 @@
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_RUNTIME | \
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_SCREENSHOTS | \
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_SETUP_ACTION | \
-					GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE | \
-					GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE_DATA | \
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_URL | \
 					GS_PLUGIN_REFINE_FLAGS_REQUIRE_VERSION
 
+/* Refined after the page is shown, as the plugins can take a while to get
+ * these and the page does not need them to be usable. Whichever stage a
+ * plugin runs for them publishes its results to the app as it completes. */
+#define GS_DETAILS_PAGE_DEFERRED_REFINE_FLAGS	GS_PLUGIN_REFINE_FLAGS_REQUIRE_HISTORY | \
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING | \
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEW_RATINGS | \
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS | \
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE | \
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE_DATA
+
 static void gs_details_page_refresh_addons (GsDetailsPage *self);
 static void gs_details_page_refresh_all (GsDetailsPage *self);
 static void gs_details_page_app_refine_cb (GObject *source, GAsyncResult *res, gpointer user_data);
@@ -824,10 +831,7 @@ gs_details_page_get_alternates_cb (GObject *source_object,
 
 		/* Make sure the changed instance contains the reviews and such */
 		plugin_job = gs_plugin_job_refine_new_for_app (self->app,
-							       GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING |
-							       GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEW_RATINGS |
-							       GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS |
-							       GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE);
+							       GS_DETAILS_PAGE_DEFERRED_REFINE_FLAGS);
 		gs_plugin_loader_job_process_async (self->plugin_loader, plugin_job,
 						    self->cancellable,
 						    gs_details_page_app_refine_cb,
@@ -1652,8 +1656,8 @@ gs_details_page_app_refine_cb (GObject *source,
 		}
 		return;
 	}
+	gs_details_page_refresh_all (self);
 	gs_details_page_refresh_reviews (self);
-	gs_details_page_refresh_addons (self);
 }
 
 static void
@@ -1746,10 +1750,7 @@ gs_details_page_load_stage2 (GsDetailsPage *self,
 	/* if these tasks fail (e.g. because we have no networking) then it's
 	 * of no huge importance if we don't get the required data */
 	plugin_job1 = gs_plugin_job_refine_new_for_app (self->app,
-							GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING |
-							GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEW_RATINGS |
-							GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS |
-							GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE);
+							GS_DETAILS_PAGE_DEFERRED_REFINE_FLAGS);
 
 	query = gs_app_query_new ("alternate-of", self->app,
 				  "refine-flags", GS_DETAILS_PAGE_REFINE_FLAGS,